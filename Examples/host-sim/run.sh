@@ -0,0 +1,17 @@
+#!/bin/sh
+# Build and run the host simulations, see README.md. Usage: ./run.sh [sim_<name>.cpp ...]
+cd "$(dirname "$0")" || exit 1
+CXX=${CXX:-g++}
+mkdir -p build
+failed=0
+for sim in ${@:-sim_*.cpp}; do
+    bin=build/$(basename "$sim" .cpp)
+    echo "== $sim"
+    if ! $CXX -std=c++11 -O2 -Wall -Wno-unused-variable -Istubs -I../.. -include Arduino.h \
+        "$sim" stubs/hardware.cpp -o "$bin"; then
+        failed=1
+        continue
+    fi
+    "$bin" || failed=1
+done
+exit $failed
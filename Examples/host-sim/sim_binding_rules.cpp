@@ -0,0 +1,52 @@
+// sim_binding_rules.cpp - Binding rule checks and dispatch
+//
+// The scheduler stand-in delivers messages synchronously, so a rule cycle that is not rejected
+// would recurse until the stack overflows. Checks the cycle rejection of begin() for direct,
+// indirect and wildcard cycles, that the remaining rules still forward, and that `scale` output
+// stays within the dispatch buffer.
+
+#include "binding.h"
+
+static bool rejected(ustd::Binding &binding, unsigned index) {
+    return binding.rules[index]->rejected;
+}
+
+int main() {
+    ustd::Scheduler sched;
+    ustd::Binding binding("bind");
+    binding.addRule("a -> b");
+    binding.addRule("b -> a");          // 1: closes a -> b -> a
+    binding.addRule("p -> q");
+    binding.addRule("q -> r");
+    binding.addRule("r -> p");          // 4: closes p -> q -> r -> p
+    binding.addRule("x/# -> x/y");      // 5: wildcard source matches its own target
+    binding.addRule("s/+/v -> t/1/v");
+    binding.addRule("t/+/v -> s/1/v");  // 7: closes through wildcards
+    binding.addRule("c -> d scale 0,1,-1e14,1e14");
+    simCheck(!binding.addRule("e -> f scale 0,1,0,1e20"), "scale output beyond 1e15 rejected");
+    binding.begin(&sched);
+
+    const unsigned expected[] = {1, 4, 5, 7};
+    unsigned n = 0;
+    for (unsigned i = 0; i < binding.rules.length(); i++) {
+        bool want = n < 4 && expected[n] == i;
+        if (want)
+            ++n;
+        simCheck(rejected(binding, i) == want, "rule %u '%s': %s", i,
+                 binding.rules[i]->text.c_str(), rejected(binding, i) ? "rejected" : "accepted");
+    }
+
+    sched.publish("a", "1");
+    simCheck(sched.last("b") == "1" && binding.rules[0]->hits == 1, "a -> b forwards once");
+    sched.publish("p", "2");
+    simCheck(sched.last("r") == "2", "p -> q -> r forwards");
+    sched.publish("s/2/v", "3");
+    simCheck(sched.last("t/1/v") == "3", "s/+/v -> t/1/v forwards");
+    sched.publish("c", "1e300");
+    simCheck(sched.last("d") == "100000000000000.000", "scale clamps to out1: %s",
+             sched.last("d").c_str());
+    sched.publish("bind/binding/rules/get");
+    simCheck(sched.last("bind/binding/rules").indexOf("\"rejected\":true") > 0,
+             "rejected rules listed");
+    return simExit();
+}
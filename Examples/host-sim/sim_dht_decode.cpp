@@ -0,0 +1,93 @@
+// sim_dht_decode.cpp - interrupt decoder of Dht on DHT22 and DHT11 edge traces
+//
+// Runs the Dht mupplet in interrupt mode: loop() sends the start signal and attaches the ISR, the
+// simulation then fires the ISR at the falling edges of a frame and checks the published values.
+// The edge traces are built from the bus timing of the DHT11 and AM2302 (DHT22) datasheets, at
+// typical timing and at the corners of the timing tolerance (fast and slow sensor oscillator).
+// Frames with a bad checksum or a missing edge must be counted and not published.
+
+#include "temp_hum_dht.h"
+
+typedef struct {
+    const char *name;
+    uint8_t type;
+    uint8_t data[4];         // humidity (2), temperature (2), checksum is appended
+    unsigned long startUs;   // micros() at release of the data line
+    uint16_t ackUs;          // sensor pulls low after release
+    uint16_t responseUs;     // response low and high phase, each
+    uint16_t lowUs;          // low phase of each bit
+    uint16_t zeroUs;         // high phase of a 0
+    uint16_t oneUs;          // high phase of a 1
+    const char *temperature;  // expected messages, "" if nothing is published
+    const char *humidity;
+    bool corrupt;  // flip one checksum bit
+    bool dropEdge;
+} T_TRACE;
+
+static const T_TRACE traces[] = {
+    {"DHT22 typical", DHT22, {0x02, 0x8c, 0x01, 0x5f}, 100000, 30, 80, 50, 26, 70, " 35.1", " 65.2",
+     false, false},
+    {"DHT22 fast, below zero", DHT22, {0x01, 0x90, 0x80, 0x65}, 100000, 20, 75, 48, 22, 68, "-10.1",
+     " 40.0", false, false},
+    {"DHT22 slow, micros() wraps", DHT22, {0x03, 0xe7, 0x02, 0x0d}, 65536UL * 7 - 2500, 40, 85, 55,
+     30, 75, " 52.5", " 99.9", false, false},
+    {"DHT11 typical", DHT11, {45, 0, 23, 1}, 100000, 30, 80, 50, 26, 70, " 23.1", " 45.0", false,
+     false},
+    {"DHT11 slow, below zero", DHT11, {80, 0, 2, 0x83}, 100000, 40, 88, 56, 30, 77, " -2.3",
+     " 80.0", false, false},
+    {"DHT22 bad checksum", DHT22, {0x02, 0x8c, 0x01, 0x5f}, 100000, 30, 80, 50, 26, 70, "", "",
+     true, false},
+    {"DHT11 missing edge", DHT11, {45, 0, 23, 1}, 100000, 30, 80, 50, 26, 70, "", "", false, true},
+};
+
+static void replay(const T_TRACE &tr) {
+    // falling edges: sensor acknowledge, then the start of each of the 40 bits and the end low
+    uint8_t frame[5];
+    memcpy(frame, tr.data, 4);
+    frame[4] = frame[0] + frame[1] + frame[2] + frame[3];
+    if (tr.corrupt)
+        frame[4] ^= 0x01;
+    unsigned long t = tr.startUs + tr.ackUs;
+    unsigned long edges[42];
+    uint8_t n = 0;
+    edges[n++] = t;
+    t += 2 * tr.responseUs;
+    edges[n++] = t;
+    for (uint8_t i = 0; i < 40; i++) {
+        bool one = frame[i / 8] >> (7 - i % 8) & 1;
+        t += tr.lowUs + (one ? tr.oneUs : tr.zeroUs);
+        edges[n++] = t;
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        if (tr.dropEdge && i == 20)
+            continue;
+        simMicros = edges[i];
+        if (simIsr)
+            simIsr();
+    }
+}
+
+int main() {
+    for (const T_TRACE &tr : traces) {
+        ustd::Scheduler sched;
+        ustd::Dht dht("dht", 5, tr.type, 0);
+        dht.begin(&sched);
+        simMicros = tr.startUs - 25000;
+        dht.loop();  // start signal
+        simMicros = tr.startUs;
+        dht.loop();  // release, ISR attached
+        bool attached = simIsr != nullptr;
+        replay(tr);
+        simMicros += 11000;  // frame complete or capture timeout
+        dht.loop();
+        String t = sched.last("dht/sensor/temperature");
+        String h = sched.last("dht/sensor/humidity");
+        bool expected = *tr.temperature;
+        simCheck(attached && t == tr.temperature && h == tr.humidity,
+                 "%s: temperature '%s' humidity '%s'", tr.name, t.c_str(), h.c_str());
+        simCheck(expected ? dht.frames == 1 : dht.checksumErrors + dht.timeouts == 1,
+                 "%s: frames %lu, checksum errors %lu, timeouts %lu", tr.name, dht.frames,
+                 dht.checksumErrors, dht.timeouts);
+    }
+    return simExit();
+}
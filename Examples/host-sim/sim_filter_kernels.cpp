@@ -0,0 +1,137 @@
+// sim_filter_kernels.cpp - exactness, accuracy and cost of the filter kernels
+//
+// MedianFilter and HampelFilter are compared sample by sample with a straightforward reference
+// (sort the window) for odd and even windows, including the warm-up while the window fills.
+// Accuracy and time per sample are measured on two traces with the disturbances of the sensors
+// that use the kernels:
+// * LDR: slow daylight change, ADC noise and 2% single-sample spikes to 0 or full scale.
+// * BL0937 power: pulse frequency of a 60W load at 2s intervals (counting quantization), load
+//   steps and 1% spikes from relay and motor switching transients.
+// The traces are generated with a fixed seed, so the results are reproducible.
+
+#include "filter_kernels.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace ustd;
+
+static double refMedian(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+static double refHampel(const std::vector<double> &win, double x, double k) {
+    if (win.size() < 3)
+        return x;
+    double med = refMedian(win);
+    std::vector<double> dev;
+    for (double v : win)
+        dev.push_back(fabs(v - med));
+    double sigma = 1.4826 * refMedian(dev);
+    return fabs(x - med) > k * sigma ? med : x;
+}
+
+static int mismatches(const std::vector<double> &raw, uint8_t window, bool hampel) {
+    MedianFilter median(window);
+    HampelFilter hampelFilter(window, 3.0);
+    std::vector<double> win;
+    int bad = 0;
+    for (double x : raw) {
+        win.push_back(x);
+        if (win.size() > window)
+            win.erase(win.begin());
+        double y = hampel ? hampelFilter.update(x) : median.update(x);
+        double ref = hampel ? refHampel(win, x, 3.0) : refMedian(win);
+        if (fabs(y - ref) > 1e-9)
+            ++bad;
+    }
+    return bad;
+}
+
+typedef struct {
+    const char *name;
+    std::vector<double> truth;
+    std::vector<double> raw;
+} T_TRACE;
+
+static T_TRACE ldrTrace(int n) {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    T_TRACE t = {"ldr", {}, {}};
+    for (int i = 0; i < n; i++) {
+        double v = 0.5 + 0.3 * sin(i / 2000.0);
+        double x = v + noise(rng);
+        if (u(rng) < 0.02)
+            x = u(rng) < 0.5 ? 0.0 : 1.0;
+        t.truth.push_back(v);
+        t.raw.push_back(x);
+    }
+    return t;
+}
+
+static T_TRACE powerTrace(int n) {
+    // BL0937 CF: ~1.2 pulses per W and s (datasheet application values), counted over 2s
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    T_TRACE t = {"bl0937 power", {}, {}};
+    double watts = 60.0;
+    for (int i = 0; i < n; i++) {
+        if (i % 3000 == 1500)
+            watts = watts == 60.0 ? 1500.0 : 60.0;  // load steps
+        double pulses = floor(watts * 1.2 * 2.0 + u(rng));  // counting quantization
+        double x = pulses / 2.4;
+        if (u(rng) < 0.01)
+            x *= 1.0 + 4.0 * u(rng);  // switching transient
+        t.truth.push_back(watts);
+        t.raw.push_back(x);
+    }
+    return t;
+}
+
+int main() {
+    const int N = 20000;
+    T_TRACE traces[] = {ldrTrace(N), powerTrace(N)};
+
+    for (uint8_t window : {4, 5, 6, 7, 15}) {
+        int bad = mismatches(traces[0].raw, window, false);
+        simCheck(bad == 0, "median:%u equals reference median: %d mismatches", window, bad);
+        bad = mismatches(traces[0].raw, window, true);
+        simCheck(bad == 0, "hampel:%u,3 equals reference (median, MAD): %d mismatches", window,
+                 bad);
+    }
+
+    const char *specs[] = {"none", "ewma:0.2", "median:7", "hampel:7,3", "hampel:5,3",
+                           "kalman:0.0001,0.01"};
+    for (T_TRACE &tr : traces) {
+        double rmseRaw = 0.0;
+        for (const char *spec : specs) {
+            FilterKernel *k = createFilterKernel(spec);
+            std::vector<double> out(N);
+            auto t0 = std::chrono::steady_clock::now();
+            for (int rep = 0; rep < 20; rep++) {
+                if (k)
+                    k->reset();
+                for (int i = 0; i < N; i++)
+                    out[i] = k ? k->update(tr.raw[i]) : tr.raw[i];
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            double se = 0.0;
+            for (int i = 100; i < N; i++)
+                se += (out[i] - tr.truth[i]) * (out[i] - tr.truth[i]);
+            double rmse = sqrt(se / (N - 100));
+            if (!k)
+                rmseRaw = rmse;
+            double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / (20.0 * N);
+            printf("     %-12s %-20s rmse %9.4f  %6.1f ns/sample (host)\n", tr.name, spec, rmse, ns);
+            if (!strncmp(spec, "hampel", 6))
+                simCheck(rmse < rmseRaw / 2.0, "%s %s: rmse %.4f below half of raw %.4f",
+                         tr.name, spec, rmse, rmseRaw);
+            delete k;
+        }
+    }
+    return simExit();
+}
@@ -0,0 +1,78 @@
+// sim_history_steps.cpp - large steps in the raw and aggregate history of SensorHistory
+//
+// At scale 100, a raw entry holds a step below 327.67. Illuminance jumps from 20 to 1500 lux and
+// back: the published raw history must contain exactly the measured values, at their times, and
+// no intermediate ones. A step that doesn't fit into the raw buffer restarts the raw history. The
+// minute aggregate of a minute with 20 and 1500 lux must report both extremes.
+
+#include "sensor_history.h"
+
+#include <string>
+
+static const char *topic = "tsl/sensor/illuminance";
+
+static void second(ustd::SensorHistory &history, int n = 1) {
+    for (int i = 0; i < n; i++) {
+        simMicros += 1000000;
+        history.loop();
+    }
+}
+
+int main() {
+    ustd::Scheduler sched;
+    ustd::SensorHistory history(topic, 100.0, 16, 60, 48);
+    history.begin(&sched);
+
+    sched.publish(topic, "20");
+    second(history, 10);
+    sched.publish(topic, "1500");  // +1480: 4 continued entries and the last one
+    second(history, 10);
+    sched.publish(topic, "327.67");  // -1172.33
+    second(history, 10);
+    sched.publish(topic, "20.5");
+    second(history);
+    simCheck(history.rawCount == 1 + 5 + 4 + 1, "raw entries for the steps: %u", history.rawCount);
+    sched.publish("tsl/sensor/illuminance/history/get", "raw");
+    std::string raw = sched.last("tsl/sensor/illuminance/history/raw").c_str();
+    simCheck(raw == "{\"chunk\":0,\"last\":true,\"data\":[[31,20],[21,1500],[11,327.7],[1,20.5]]}",
+             "only measured values published: %s", raw.c_str());
+    simCheck(history.rawLastValue == 2050, "reconstructed last value: %ld",
+             (long)history.rawLastValue);
+
+    // the oldest value dropped in the middle of a continued step
+    ustd::SensorHistory small("small/sensor/illuminance", 100.0, 6, 60, 48);
+    small.begin(&sched);
+    sched.publish("small/sensor/illuminance", "0");
+    second(small);
+    sched.publish("small/sensor/illuminance", "1000");  // 4 entries
+    second(small);
+    sched.publish("small/sensor/illuminance", "1001");
+    second(small);
+    sched.publish("small/sensor/illuminance", "1002");
+    second(small);
+    small.publish(ustd::SensorHistory::RAW);
+    raw = sched.last("small/sensor/illuminance/history/raw").c_str();
+    simCheck(raw == "{\"chunk\":0,\"last\":true,\"data\":[[3,1000],[2,1001],[1,1002]]}",
+             "oldest entries dropped inside a step: %s", raw.c_str());
+
+    // larger than the raw buffer
+    sched.publish("small/sensor/illuminance", "5000");
+    second(small);
+    small.publish(ustd::SensorHistory::RAW);
+    raw = sched.last("small/sensor/illuminance/history/raw").c_str();
+    simCheck(small.rawRestarts == 1 && raw == "{\"chunk\":0,\"last\":true,\"data\":[[1,5000]]}",
+             "step larger than the buffer restarts the raw history: %s", raw.c_str());
+
+    // aggregates beyond 655.35 (16 bit at scale 100)
+    while (history.clock.sec != history.minuteStart)
+        second(history);  // start of a minute
+    sched.publish(topic, "20");
+    second(history, 30);
+    sched.publish(topic, "1500");
+    second(history, 40);
+    history.publish(ustd::SensorHistory::MINUTE, 90);
+    std::string minute = sched.last("tsl/sensor/illuminance/history/minute").c_str();
+    simCheck(minute.find(",20,") != std::string::npos && minute.find(",1500]") != std::string::npos,
+             "minute with 20 and 1500 lux: %s", minute.c_str());
+    return simExit();
+}
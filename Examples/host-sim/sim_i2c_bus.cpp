@@ -0,0 +1,173 @@
+// sim_i2c_bus.cpp - error handling and time budget of I2CBus on the I2CPortStandIn
+//
+// The bus runs on the software port with register devices. A device that NACKs is backed off for
+// 100, 200 and 400ms, transfers queued meanwhile fail with BACKOFF without touching the bus. A
+// stuck device times out, after recoverAfterErrors timeouts the bus is recovered; a transfer that
+// completes but takes longer than the device timeout fails as well. A full queue rejects transfers
+// with QUEUE_FULL, and a tick executes only as many slow transfers as fit into sliceUs.
+
+#include "i2c_bus.h"
+
+#include <string>
+#include <vector>
+
+typedef struct {
+    unsigned long ms;
+    uint8_t status;
+    uint8_t len;
+} T_RESULT;
+
+static std::vector<T_RESULT> results;
+
+static void record(uint8_t status, const uint8_t *data, uint8_t len) {
+    results.push_back({millis(), status, len});
+}
+
+static std::string trace(uint8_t status) {
+    std::string s;
+    for (const T_RESULT &r : results) {
+        if (r.status == status)
+            s += std::to_string(r.ms) + " ";
+    }
+    return s;
+}
+
+static unsigned count(uint8_t status) {
+    unsigned n = 0;
+    for (const T_RESULT &r : results)
+        n += r.status == status;
+    return n;
+}
+
+// poll the device like a mupplet every 10ms, the bus task runs every 5ms
+static void poll(ustd::I2CBus &bus, int device, unsigned long durationMs) {
+    for (unsigned long t = 0; t < durationMs; t += 5) {
+        if (t % 10 == 0 && !bus.isPending(device))
+            bus.readRegisters(device, 0x00, 2, record);
+        bus.loop();
+        simMicros += 5000;
+    }
+}
+
+static void backoff() {
+    ustd::Scheduler sched;
+    ustd::I2CPortStandIn port;
+    port.addDevice(0x40)->nacks = 3;
+    ustd::I2CBus bus("i2c", &port);
+    bus.begin(&sched);
+    int dev = bus.addDevice("nacking", 0x40);
+    std::string backoffs;
+    results.clear();
+    simMicros = 0;
+    for (unsigned long t = 0; t < 1000; t += 5) {
+        if (t % 10 == 0 && !bus.isPending(dev))
+            bus.readRegisters(dev, 0x00, 2,
+                              [&](uint8_t status, const uint8_t *data, uint8_t len) {
+                                  record(status, data, len);
+                                  if (status == ustd::I2CPort::NACK_ADDR)
+                                      backoffs += std::to_string(bus.devices[dev].backoffMs) + " ";
+                              });
+        bus.loop();
+        simMicros += 5000;
+    }
+    simCheck(trace(ustd::I2CPort::NACK_ADDR) == "0 100 300 ", "NACKs at 0, 100, 300ms: %s",
+             trace(ustd::I2CPort::NACK_ADDR).c_str());
+    simCheck(backoffs == "100 200 400 ", "backoff 100, 200, 400ms: %s", backoffs.c_str());
+    unsigned long firstOk = 0;
+    for (const T_RESULT &r : results) {
+        if (r.status == ustd::I2CPort::OK) {
+            firstOk = r.ms;
+            break;
+        }
+    }
+    simCheck(firstOk == 700, "first OK after the last backoff: %lu ms", firstOk);
+    // polls every 10ms within the 100, 200 and 400ms backoff periods
+    simCheck(count(ustd::I2CBus::BACKOFF) == 9 + 19 + 39, "%u transfers answered with BACKOFF",
+             count(ustd::I2CBus::BACKOFF));
+    // a NACKed address ends the transfer after the write, OK reads are write + read
+    simCheck(port.transactions == 3 + (1000 - 700) / 10 * 2,
+             "no bus access during backoff: %lu port transactions", port.transactions);
+}
+
+static void stuck() {
+    ustd::Scheduler sched;
+    ustd::I2CPortStandIn port;
+    port.addDevice(0x41)->stuck = true;
+    ustd::I2CBus bus("i2c", &port);
+    bus.begin(&sched);
+    int dev = bus.addDevice("stuck", 0x41);
+    results.clear();
+    simMicros = 0;
+    poll(bus, dev, 1000);
+    simCheck(trace(ustd::I2CPort::TIMEOUT) == "0 100 300 ", "timeouts at 0, 100, 300ms: %s",
+             trace(ustd::I2CPort::TIMEOUT).c_str());
+    simCheck(port.recoveries == 1 && bus.recoveries == 1,
+             "bus recovered once after %u timeouts: port %lu, bus %lu", bus.recoverAfterErrors,
+             port.recoveries, bus.recoveries);
+    simCheck(count(ustd::I2CPort::OK) > 0 && results.back().status == ustd::I2CPort::OK,
+             "device answers after the recovery and its backoff");
+
+    // completes, but too late
+    port.getDevice(0x41)->delayUs = 30000;
+    results.clear();
+    bus.readRegisters(dev, 0x00, 2, record);
+    bus.loop();
+    simCheck(results.size() == 1 && results[0].status == ustd::I2CPort::TIMEOUT &&
+                 results[0].len == 0,
+             "30ms transfer with 25ms device timeout fails, data discarded");
+    simCheck(bus.devices[dev].timeouts == 4, "timeouts counted: %lu", bus.devices[dev].timeouts);
+}
+
+static void queueFull() {
+    ustd::Scheduler sched;
+    ustd::I2CPortStandIn port;
+    port.addDevice(0x40);
+    ustd::I2CBus bus("i2c", &port, 4);
+    bus.begin(&sched);
+    int dev = bus.addDevice("dev", 0x40);
+    results.clear();
+    bool queued[5];
+    for (int i = 0; i < 5; i++)
+        queued[i] = bus.writeRegister(dev, 0x01, i, record);
+    simCheck(queued[3] && !queued[4], "fifth transfer on a queue of 4 rejected");
+    simCheck(results.size() == 1 && results[0].status == ustd::I2CBus::QUEUE_FULL &&
+                 bus.overflows == 1,
+             "QUEUE_FULL reported to the caller and counted");
+    bus.loop();
+    simCheck(count(ustd::I2CPort::OK) == 4, "queued transfers executed: %u",
+             count(ustd::I2CPort::OK));
+}
+
+static void timeSlice() {
+    ustd::Scheduler sched;
+    ustd::I2CPortStandIn port;
+    port.addDevice(0x40)->delayUs = 600;
+    ustd::I2CBus bus("i2c", &port, 16);
+    bus.begin(&sched, 5000, 2000);
+    int dev = bus.addDevice("slow", 0x40);
+    results.clear();
+    for (int i = 0; i < 10; i++)
+        bus.writeRegister(dev, 0x01, i, record);
+    std::string perTick;
+    unsigned long maxTickUs = 0;
+    while (bus.transactions.length()) {
+        size_t before = results.size();
+        unsigned long start = micros();
+        bus.loop();
+        if (micros() - start > maxTickUs)
+            maxTickUs = micros() - start;
+        perTick += std::to_string(results.size() - before) + " ";
+        simMicros += 5000;
+    }
+    simCheck(perTick == "4 4 2 ", "600us transfers per 2000us tick: %s", perTick.c_str());
+    simCheck(maxTickUs <= bus.sliceUs + 600, "longest tick %lu us <= slice + one transfer",
+             maxTickUs);
+}
+
+int main() {
+    backoff();
+    stuck();
+    queueFull();
+    timeSlice();
+    return simExit();
+}
@@ -0,0 +1,35 @@
+// sim_i2cpwm_batch.cpp - I2C transactions of batched I2CPWM channel writes
+//
+// Counts the Wire transactions of a flush() with a 128 byte transmit buffer (ESP8266, ESP32),
+// compared to one transaction per channel without batching.
+
+#define USTD_I2CPWM_MAX_BURST (128)
+#include "i2c_pwm.h"
+
+int main() {
+    ustd::Scheduler sched;
+    ustd::I2CPWM pwm("pwm", ustd::I2CPWM::Mode::PWM, 0x40, 4);
+    pwm.begin(&sched);
+
+    unsigned long tx = Wire.transactions, bytes = Wire.bytesWritten;
+    for (uint16_t ch = 0; ch < 64; ch++)
+        pwm.setUnitLevel(ch, (ch + 1) / 65.0);  // all channels change
+    pwm.flush();
+    tx = Wire.transactions - tx;
+    bytes = Wire.bytesWritten - bytes;
+    simCheck(tx == 4, "64 channels on 4 boards: %lu transactions (unbatched: 64)", tx);
+    simCheck(bytes == 4 * (1 + 16 * 4), "64 channels on 4 boards: %lu bytes", bytes);
+
+    tx = Wire.transactions;
+    pwm.setUnitLevel(17, 0.5);
+    pwm.setUnitLevel(20, 0.5);
+    pwm.flush();
+    tx = Wire.transactions - tx;
+    simCheck(tx == 1, "channels 17 and 20: %lu transaction", tx);
+
+    tx = Wire.transactions;
+    pwm.flush();
+    simCheck(Wire.transactions == tx, "flush without changes: %lu transactions",
+             Wire.transactions - tx);
+    return simExit();
+}
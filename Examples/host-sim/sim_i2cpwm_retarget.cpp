@@ -0,0 +1,50 @@
+// sim_i2cpwm_retarget.cpp - servo speed when a move is retargeted halfway
+//
+// Runs the I2CPWM motion loop at 50Hz, starts a move of channel 0 and retargets it back while the
+// servo is at speed. The largest speed change between two ticks must stay within what the
+// acceleration limit allows, for both profiles and for a target ahead and behind.
+
+#include "i2c_pwm.h"
+
+static double retarget(ustd::I2CPWM::Profile profile, double target2, double *pFinal) {
+    ustd::Scheduler sched;
+    ustd::I2CPWM pwm("servo", ustd::I2CPWM::Mode::SERVO);
+    pwm.begin(&sched);
+    pwm.setMotionLimits(0, 1.0, 4.0);
+    pwm.setProfile(profile);
+    pwm.setUnitLevel(0, 0.0);  // position unknown: jumps
+    pwm.setUnitLevel(0, 1.0);
+    double last = pwm.motion[0].pos, lastV = 0.0, maxDv = 0.0;
+    for (int tick = 1; tick < 200; tick++) {
+        simMicros += 20000;
+        if (tick == 15)
+            pwm.setUnitLevel(0, target2);
+        pwm.loop();
+        double v = (pwm.motion[0].pos - last) / 0.02;
+        double dv = v > lastV ? v - lastV : lastV - v;
+        if (dv > maxDv)
+            maxDv = dv;
+        last = pwm.motion[0].pos;
+        lastV = v;
+    }
+    *pFinal = last;
+    return maxDv;
+}
+
+int main() {
+    const char *names[] = {"trapezoid", "scurve"};
+    const double targets[] = {0.2, 0.9};
+    // acceleration limit 4/s^2 allows 0.08/s per 20ms tick; a restart from zero speed jumps by
+    // the full speed of the move at that time (>0.4/s)
+    for (int p = 0; p < 2; p++) {
+        for (int i = 0; i < 2; i++) {
+            double final;
+            double maxDv = retarget((ustd::I2CPWM::Profile)p, targets[i], &final);
+            simCheck(maxDv < 0.085, "%s, retarget to %.1f: max speed step %.3f/s per tick",
+                     names[p], targets[i], maxDv);
+            simCheck(final > targets[i] - 1e-4 && final < targets[i] + 1e-4,
+                     "%s, retarget to %.1f: arrives at %.4f", names[p], targets[i], final);
+        }
+    }
+    return simExit();
+}
@@ -0,0 +1,85 @@
+// sim_keypad_ghost.cpp - Keypad on a 4x4 matrix without diodes
+//
+// The matrix model connects a driven row to a column through every pressed key, so three keys in
+// the corners of a rectangle also pull the fourth corner low (ghost key). Keys outside the rows
+// and columns of the ambiguity must still be debounced and reported while it lasts, ambiguous keys
+// keep their state and the ghost key is never reported.
+
+#include "keypad.h"
+
+static const uint8_t rowPins[4] = {10, 11, 12, 13};
+static const uint8_t colPins[4] = {20, 21, 22, 23};
+static int driven = -1;
+static bool down[4][4];
+
+static void matrixPinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= 10 && pin < 14) {
+        if (mode == OUTPUT)
+            driven = pin - 10;
+        else if (driven == pin - 10)
+            driven = -1;
+    }
+}
+
+static bool connected(int row, int col, uint8_t visited) {
+    // column col is low if a path of pressed keys leads from it to the driven row
+    for (int r = 0; r < 4; r++) {
+        if (!down[r][col] || visited >> r & 1)
+            continue;
+        if (r == driven)
+            return true;
+        for (int c = 0; c < 4; c++) {
+            if (c != col && down[r][c] && connected(r, c, visited | 1 << r))
+                return true;
+        }
+    }
+    return false;
+}
+
+static int matrixDigitalRead(uint8_t pin) {
+    if (pin >= 20 && pin < 24 && driven >= 0 && connected(driven, pin - 20, 0))
+        return LOW;
+    return HIGH;
+}
+
+int main() {
+    simMicros = 1000000;
+    simPinMode = matrixPinMode;
+    simDigitalRead = matrixDigitalRead;
+    ustd::Scheduler sched;
+    ustd::Keypad keypad("kp", rowPins, 4, colPins, 4);
+    keypad.addKey(0, 0, "k00");
+    keypad.addKey(3, 3, "k33");
+    keypad.begin(&sched);
+    auto step = [&](int ms) {
+        for (int i = 0; i < ms; i++) {
+            simMicros += 1000;
+            keypad.loop();
+        }
+    };
+
+    step(50);
+    down[2][2] = down[2][3] = true;
+    step(40);
+    simCheck(sched.last("kp/keypad/key") == "2,3 on", "two keys in a row: reported");
+    down[3][2] = true;  // 3,3 becomes a ghost
+    step(40);
+    simCheck(sched.last("kp/keypad/ghosting") == "on", "ghosting detected");
+    simCheck(sched.last("k33/switch/state") != "on", "ghost key 3,3 not reported");
+    simCheck(sched.last("kp/keypad/key") == "2,3 on", "ambiguous key 3,2 not reported");
+    down[0][0] = true;
+    step(40);
+    simCheck(sched.last("k00/switch/state") == "on", "key 0,0 outside the ambiguity: pressed");
+    down[0][0] = false;
+    step(40);
+    simCheck(sched.last("k00/switch/state") == "off", "key 0,0 outside the ambiguity: released");
+    simCheck(keypad.debounced == ((uint64_t)0x0c << 16), "keys 2,2 and 2,3 keep their state: %llx",
+             (unsigned long long)keypad.debounced);
+    down[2][3] = false;  // ambiguity resolved: 2,2 and 3,2 pressed
+    step(40);
+    simCheck(sched.last("kp/keypad/ghosting") == "off", "ghosting resolved");
+    simCheck(keypad.debounced == ((uint64_t)0x04 << 16 | (uint64_t)0x04 << 24),
+             "keys 2,2 and 3,2 after the ambiguity: %llx", (unsigned long long)keypad.debounced);
+    simCheck(sched.last("k33/switch/state") != "on", "ghost key 3,3 never reported");
+    return simExit();
+}
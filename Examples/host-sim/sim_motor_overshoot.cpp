@@ -0,0 +1,77 @@
+// sim_motor_overshoot.cpp - stop position of MotorInterval, sensor edge polled or from interrupt
+//
+// A motor turns at 30 rpm, the interval sensor has 12 notches (30 degrees per interval, low in
+// the second half). Each run starts at a random position before a sensor edge and with a random
+// phase of the 50ms sensor task, advances 3 intervals and measures how far the motor turns past
+// the target edge before it is switched off. The simulation steps in 10us.
+
+#include "motor_interval.h"
+
+#include <random>
+
+static double pos = 0.0;  // degrees
+static bool motorOn = false;
+static const double degPerUs = 180.0 / 1e6;  // 30 rpm
+
+static int sensorLevel() {
+    return fmod(pos, 30.0) >= 15.0 ? LOW : HIGH;
+}
+
+static void motorWrite(uint8_t pin, uint8_t val) {
+    if (pin == 4)
+        motorOn = val == LOW;  // motorActiveLogic false: on at LOW
+}
+
+static int sensorRead(uint8_t pin) {
+    return sensorLevel();
+}
+
+static void overshoot(bool irq, int runs, double *pMean, double *pMax) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> startPos(0.0, 15.0);
+    std::uniform_int_distribution<int> taskPhase(0, 4999);
+    double sum = 0.0, max = 0.0;
+    for (int run = 0; run < runs; run++) {
+        pos = startPos(rng);  // before begin(): the sensor switch reads its initial level
+        ustd::Scheduler sched;
+        ustd::MotorInterval motor("motor", 4, 5, 2000, false, true, irq ? 0 : -1);
+        motor.begin(&sched);
+        unsigned long phase = taskPhase(rng) * 10;
+        double target = floor((pos - 15.0) / 30.0) * 30.0 + 15.0 + 3 * 30.0;
+        motor.start(3);
+        int last = sensorLevel();
+        for (unsigned long us = 0; us < 3000000 && motorOn; us += 10) {
+            simMicros += 10;
+            pos += degPerUs * 10;
+            int level = sensorLevel();
+            if (irq && last == HIGH && level == LOW && simIsr)
+                simIsr();
+            last = level;
+            if ((us + phase) % 50000 == 0) {
+                motor.intervalSensor.loop();
+                motor.loop();
+            }
+        }
+        double over = pos - target;
+        sum += over;
+        if (over > max)
+            max = over;
+    }
+    *pMean = sum / runs;
+    *pMax = max;
+}
+
+int main() {
+    simMicros = 1000000;
+    simDigitalRead = sensorRead;
+    simDigitalWrite = motorWrite;
+    double mean, max;
+    // 50ms poll: the motor turns up to 9 degrees until the edge is seen
+    overshoot(false, 200, &mean, &max);
+    simCheck(max < 9.01, "edge hook from 50ms poll: mean overshoot %.2f deg, max %.2f deg", mean,
+             max);
+    overshoot(true, 200, &mean, &max);
+    simCheck(max < 0.002, "edge hook from interrupt: mean overshoot %.4f deg, max %.4f deg", mean,
+             max);
+    return simExit();
+}
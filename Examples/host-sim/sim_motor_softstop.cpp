@@ -0,0 +1,84 @@
+// sim_motor_softstop.cpp - interval timing, drag detection and soft stop of MotorInterval
+//
+// A motor turns at 30 rpm at full duty cycle, the interval sensor has 12 notches (30 degrees per
+// interval, 166.7ms) and is read by interrupt. The mupplet runs 4-interval moves with a soft stop
+// to 30% duty; from run 5 on, the load slows the motor down by 30%. The learned interval duration,
+// the drag report, the lowest duty cycle of the ramp and the stop position are checked.
+
+#include "motor_interval.h"
+
+static double pos = 0.0;  // degrees
+static double duty = 0.0;
+static double load = 1.0;  // speed factor of the mechanical load
+
+static int sensorLevel() {
+    return fmod(pos, 30.0) >= 15.0 ? LOW : HIGH;
+}
+
+static void motorWrite(uint8_t pin, uint8_t val) {
+    if (pin == 4)
+        duty = val == LOW ? 1.0 : 0.0;  // motorActiveLogic false: on at LOW
+}
+
+static void motorAnalogWrite(uint8_t pin, int val) {
+    if (pin == 4)
+        duty = 1.0 - val / 255.0;
+}
+
+static int sensorRead(uint8_t pin) {
+    return sensorLevel();
+}
+
+int main() {
+    simMicros = 1000000;
+    simDigitalRead = sensorRead;
+    simDigitalWrite = motorWrite;
+    simAnalogWrite = motorAnalogWrite;
+    ustd::Scheduler sched;
+    ustd::MotorInterval motor("motor", 4, 5, 5000, false, true, 0);
+    motor.setSoftStop(30);
+    motor.begin(&sched);
+
+    for (int run = 0; run < 8; run++) {
+        if (run == 5)
+            load = 0.7;
+        double minDuty = 1.0, stopPos = -1.0;
+        double target = floor((pos + 15.0) / 30.0) * 30.0 + 15.0 + 3 * 30.0;  // 4th falling edge
+        motor.start(4);
+        int last = sensorLevel();
+        for (unsigned long us = 0; us < 20000000; us += 10) {
+            simMicros += 10;
+            pos += 0.0018 * duty * load;  // 180 deg/s at full duty
+            int level = sensorLevel();
+            if (last == HIGH && level == LOW && simIsr)
+                simIsr();
+            last = level;
+            if (motor.state && duty < minDuty)
+                minDuty = duty;
+            if (!motor.state && stopPos < 0.0)
+                stopPos = pos;
+            if (us % 10000 == 0) {
+                motor.intervalSensor.loop();
+                motor.loop();
+                if (!motor.state)
+                    break;
+            }
+        }
+        bool drag = sched.last("motor/switch/drag") != "";
+        printf("     run %d: periodMs %.1f, nominalMs %.1f, jitterMs %.1f, lowest duty %.2f\n", run,
+               motor.periodMs, motor.nominalMs, motor.jitterMs, minDuty);
+        simCheck(stopPos >= target && stopPos < target + 0.01,
+                 "run %d: stops at %.3f deg, target edge %.1f deg", run, stopPos, target);
+        if (run == 4) {
+            simCheck(fabs(motor.periodMs - 166.7) < 2.0, "interval duration learned: %.1fms",
+                     motor.periodMs);
+            simCheck(!drag, "no drag at nominal load");
+            simCheck(minDuty > 0.29 && minDuty < 0.31, "soft stop ramps down to %.2f duty", minDuty);
+            simCheck(motor.watchdogTimeout() < 1000, "watchdog from learned timing: %lums",
+                     motor.watchdogTimeout());
+        }
+    }
+    simCheck(sched.last("motor/switch/drag") != "", "drag reported after 30%% slowdown: %s",
+             sched.last("motor/switch/drag").c_str());
+    return simExit();
+}
@@ -0,0 +1,69 @@
+// sim_mupplet_stats.cpp - stats requests and durations of mupplet_stats.h
+//
+// A SensorHistory has a multi-level mupplet name (`<value-topic>/history`), its statistics must be
+// available on `<value-topic>/history/stats/get`, also when it is started after muppletStatsBegin().
+// Each request is answered once and the replies are not delivered to the stats handler. Durations
+// are reported with two decimals and counted in 1/16us buckets.
+
+#define USTD_MUPPLET_STATS
+#include "sensor_history.h"
+
+#include <string>
+
+static unsigned replies(ustd::Scheduler &sched, const char *topic) {
+    unsigned n = 0;
+    for (auto &m : sched.published)
+        n += m.topic == topic;
+    return n;
+}
+
+int main() {
+    ustd::Scheduler sched;
+    ustd::SensorHistory history("ldr/sensor/illuminance");
+    history.begin(&sched);
+    ustd::muppletStatsBegin(&sched);
+    ustd::SensorHistory late("bme/sensor/temperature");
+    late.begin(&sched);
+
+    unsigned subs = sched.subs.size();
+    sched.publish("ldr/sensor/illuminance/history/stats/get");
+    simCheck(replies(sched, "ldr/sensor/illuminance/history/stats") == 1,
+             "multi-level name answered once");
+    sched.publish("bme/sensor/temperature/history/stats/get");
+    simCheck(replies(sched, "bme/sensor/temperature/history/stats") == 1,
+             "mupplet started after muppletStatsBegin() answered");
+    sched.publish("stats/get");
+    simCheck(replies(sched, "ldr/sensor/illuminance/history/stats") == 2 &&
+                 replies(sched, "bme/sensor/temperature/history/stats") == 2,
+             "stats/get answered for all mupplets");
+    simCheck(sched.subs.size() == subs, "no subscriptions added by requests");
+    std::string selfDelivered;
+    for (auto &s : sched.subs) {
+        if (ustd::Scheduler::mqttmatch("ldr/sensor/illuminance/history/stats", s.first) ||
+            ustd::Scheduler::mqttmatch("stats/memory", s.first))
+            selfDelivered += std::string(s.first.c_str()) + " ";
+    }
+    simCheck(selfDelivered.empty(), "replies not delivered to a subscription: %s",
+             selfDelivered.c_str());
+
+    // a 3us handler and an immediate one
+    auto slow = ustd::muppletStatsTask("slow", 0, []() { delayMicroseconds(3); });
+    auto fast = ustd::muppletStatsTask("fast", 0, []() {});
+    slow();
+    fast();
+    sched.publish("slow/stats/get");
+    std::string json = sched.last("slow/stats").c_str();
+    simCheck(json.find("\"minUs\":3.00,\"avgUs\":3.00,\"maxUs\":3.00,"
+                       "\"hist\":[0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0]") != std::string::npos,
+             "3us in bucket 6 (32/16 to 64/16us): %s", json.c_str());
+    sched.publish("fast/stats/get");
+    json = sched.last("fast/stats").c_str();
+    simCheck(json.find("\"minUs\":0.00,\"avgUs\":0.00,\"maxUs\":0.00,\"hist\":[1,") !=
+                 std::string::npos,
+             "below 1/16us in bucket 0: %s", json.c_str());
+    sched.publish("stats/reset");
+    sched.publish("slow/stats/get");
+    json = sched.last("slow/stats").c_str();
+    simCheck(json.find("\"loop\":{\"count\":0,") != std::string::npos, "reset: %s", json.c_str());
+    return simExit();
+}
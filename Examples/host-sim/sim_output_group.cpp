@@ -0,0 +1,54 @@
+// sim_output_group.cpp - switching order and message checks of DigitalOutGroup
+//
+// On the host, the group writes one digitalWrite() per line in the order of the register writes
+// on the targets. Reverses a pair of interlocked outputs (one active high, one active low) and
+// checks that the output switched off is written before the output switched on. Messages with an
+// unknown output, a missing or an invalid value must not switch anything.
+
+#include "digital_out_group.h"
+
+#include <string>
+
+static std::string writes;
+
+static void recordWrite(uint8_t pin, uint8_t val) {
+    writes += std::to_string(pin) + (val == HIGH ? "H " : "L ");
+}
+
+int main() {
+    simDigitalWrite = recordWrite;
+    ustd::Scheduler sched;
+    ustd::DigitalOut up("up", 4, true);        // on: high
+    ustd::DigitalOut down("down", 40, false);  // on: low, second GPIO word
+    ustd::DigitalOut lamp("lamp", 5, true);
+    ustd::DigitalOutGroup group("motor");
+    group.add(&up);
+    group.add(&down);
+    group.add(&lamp);
+    group.begin(&sched);
+
+    group.set("up=on");
+    writes = "";
+    group.set("up=off,down=on");
+    simCheck(writes == "4L 40L ", "up off before down on: %s", writes.c_str());
+    writes = "";
+    group.set("down=0,up=1");
+    simCheck(writes == "40H 4H ", "down off before up on: %s", writes.c_str());
+    writes = "";
+    group.set("up=off,lamp=on,down=on");
+    simCheck(writes == "4L 5H 40L ", "both words, off step first: %s", writes.c_str());
+
+    const char *invalid[] = {"lamp", "lamp=bogus", "lamp=", "lamp=off,heater=on", "lamp=On"};
+    for (const char *states : invalid) {
+        writes = "";
+        bool accepted = group.set(states);
+        simCheck(!accepted && writes == "" && lamp.state, "'%s' rejected, nothing switched",
+                 states);
+    }
+    simCheck(!group.addScene("bad", "lamp"), "scene with a name without value rejected");
+    sched.publish("motor/outputgroup/set", "lamp=bogus");
+    simCheck(lamp.state, "invalid outputgroup/set message ignored");
+    sched.publish("motor/outputgroup/set", "lamp=off");
+    simCheck(!lamp.state, "outputgroup/set lamp=off switches");
+    return simExit();
+}
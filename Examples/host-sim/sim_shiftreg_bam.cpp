@@ -0,0 +1,77 @@
+// sim_shiftreg_bam.cpp - duty cycle of the ShiftRegRefresh bit-angle modulation
+//
+// Runs the refresh engine with simulated time: each refreshStep() latches a pattern that is shown
+// for the returned duration. The on-time of every output over whole frames is compared with the
+// requested level, for every level of 8 bit and 6 bit configurations.
+
+#include "shift_reg_74595.h"
+
+void checkDuty(uint8_t pwmBits, unsigned int frameHz, uint8_t chips) {
+    ustd::ShiftRegRefresh engine(1, 2, 3, chips, frameHz, pwmBits, 1000);
+    uint16_t outputs = chips * 8;
+    uint8_t *levels = new uint8_t[outputs];
+    for (uint16_t i = 0; i < outputs; i++)
+        levels[i] = i % (engine.maxLevel + 1);  // every level at least once
+    engine.setLevels(levels);
+
+    double *onUs = new double[outputs]();
+    double totalUs = 0;
+    simMicros = 0;
+    engine.refreshStep(simMicros);  // first frame start swaps in the levels
+    while (engine.curPlane || engine.curSlice)
+        simMicros += engine.refreshStep(simMicros);
+    unsigned long startFrames = engine.frames;
+    unsigned long isrCount = 0;
+    while (engine.frames < startFrames + 20) {
+        unsigned long us = engine.refreshStep(simMicros);
+        ++isrCount;
+        if (engine.frames == startFrames + 20)
+            break;  // first slice of the next frame
+        for (uint16_t i = 0; i < outputs; i++) {
+            if (engine.shown[i / 8] & (1 << (i % 8)))
+                onUs[i] += us;
+        }
+        totalUs += us;
+        simMicros += us;
+    }
+
+    double maxErr = 0;
+    for (uint16_t i = 0; i < outputs; i++) {
+        double err = fabs(onUs[i] / totalUs - (double)levels[i] / engine.maxLevel);
+        if (err > maxErr)
+            maxErr = err;
+    }
+    double lsb = 1.0 / engine.maxLevel;
+    simCheck(maxErr < lsb / 2,
+             "%u bit, %u chips: max duty error %.5f (1 LSB %.5f) over %u levels, %u Hz", pwmBits,
+             chips, maxErr, lsb, engine.maxLevel + 1, engine.frameHz);
+    simCheck(engine.planeUs[0] >= engine.minPlaneUs(),
+             "%u bit, %u chips: shortest plane %lu us >= %lu us, %lu interrupts per frame",
+             pwmBits, chips, engine.planeUs[0], engine.minPlaneUs(), isrCount / 20);
+    delete[] levels;
+    delete[] onUs;
+}
+
+void checkPulse() {
+    ustd::ShiftRegRefresh engine(1, 2, 3, 1, 200, 6, 1000);
+    simMicros = 0;
+    engine.pulse(0, 3);
+    unsigned long onUs = 0;
+    for (int i = 0; i < 200; i++) {
+        unsigned long us = engine.refreshStep(simMicros);
+        if (engine.shown[0] & 1)
+            onUs += us;
+        simMicros += us;
+    }
+    simCheck(onUs >= 3000 && onUs <= 3000 + engine.maxSliceUs,
+             "3 ms pulse on a level 0 output: on for %lu us (resolution %lu us)", onUs,
+             engine.maxSliceUs);
+}
+
+int main() {
+    checkDuty(8, 200, 32);  // 256 outputs: every 8 bit level, frame rate reduced
+    checkDuty(8, 60, 1);
+    checkDuty(6, 200, 8);
+    checkPulse();
+    return simExit();
+}
@@ -0,0 +1,116 @@
+// sim_switch_bank.cpp - SwitchBank and Keypad with switch variants
+//
+// A SwitchBankT<SwitchOnly<Switch::Flipflop>> toggles its switches on debounced presses, a
+// KeypadT<SwitchOnly<Switch::Timer>> switches its keys on when pressed and off after the timer
+// duration, without the code of the other switch modes. Only switches with a timer or gesture in
+// progress are ticked: the bank's `ticking` mask is set while a timer runs, also one started by a
+// `switch/set` `pulse` message, and cleared when it expires.
+
+#include "switch_bank.h"
+#include "keypad.h"
+
+static bool level[64];  // GPIO levels, true: HIGH
+static int driven = -1;
+static bool keyDown = false;  // key 1,1 of the keypad
+
+static int gpioRead(uint8_t pin) {
+    if (pin == 21)  // column 1 of the keypad: low if row 1 is driven and key 1,1 is down
+        return (driven == 11 && keyDown) ? LOW : HIGH;
+    return level[pin] ? HIGH : LOW;
+}
+
+static void gpioMode(uint8_t pin, uint8_t mode) {
+    if (mode == OUTPUT)
+        driven = pin;
+    else if (driven == pin)
+        driven = -1;
+}
+
+int main() {
+    simMicros = 1000000;
+    simDigitalRead = gpioRead;
+    simPinMode = gpioMode;
+    ustd::Scheduler sched;
+    for (int i = 0; i < 64; i++)
+        level[i] = true;
+
+    typedef ustd::SwitchOnly<ustd::Switch::Flipflop> Toggle;
+    ustd::SwitchBankT<Toggle> bank("bank");
+    Toggle s4("s4", 4, Toggle::Flipflop);
+    Toggle s40("s40", 40, Toggle::Flipflop);
+    bool added = bank.add(&s4) && bank.add(&s40);
+    bank.begin(&sched);
+    auto bankTicks = [&](int n) {
+        for (int i = 0; i < n; i++) {
+            simMicros += 5000;
+            bank.loop();
+        }
+    };
+    bankTicks(10);
+    for (int press = 0; press < 2; press++) {
+        level[40] = false;
+        bankTicks(10);
+        level[40] = true;
+        bankTicks(10);
+    }
+    simCheck(added && sched.last("s40/switch/state") == "off" && bank.changes == 4,
+             "Flipflop variant in a bank: two presses toggle on and off, %lu changes",
+             bank.changes);
+    simCheck(sched.last("s4/switch/state") != "on", "idle switch not toggled");
+
+    static const uint8_t rowPins[2] = {10, 11};
+    static const uint8_t colPins[2] = {20, 21};
+    typedef ustd::SwitchOnly<ustd::Switch::Timer> TimerSwitch;
+    ustd::KeypadT<TimerSwitch> keypad("kp", rowPins, 2, colPins, 2);
+    TimerSwitch *key = keypad.addKey(1, 1, "k11");
+    key->setTimerDuration(200);
+    keypad.begin(&sched);
+    auto rowTicks = [&](int ms) {
+        for (int i = 0; i < ms; i++) {
+            simMicros += 1000;
+            keypad.loop();
+        }
+    };
+    rowTicks(20);
+    keyDown = true;
+    rowTicks(20);
+    keyDown = false;
+    rowTicks(20);
+    simCheck(key->isMode(ustd::Switch::Timer) && sched.last("k11/switch/state") == "on",
+             "Timer variant key on after the press");
+    rowTicks(200);
+    simCheck(sched.last("k11/switch/state") == "off", "Timer variant key off after 200ms");
+    simCheck(keypad.ticking == 0, "no key ticked after the timer");
+
+    ustd::SwitchBank mixed("mixed");
+    ustd::Switch plain("plain", 6);
+    ustd::Switch timer("timer", 7, ustd::Switch::Timer);
+    timer.setTimerDuration(100);
+    mixed.add(&plain);
+    mixed.add(&timer);
+    mixed.begin(&sched);
+    auto mixedTicks = [&](int n) {
+        for (int i = 0; i < n; i++) {
+            simMicros += 5000;
+            mixed.loop();
+        }
+    };
+    mixedTicks(30);  // the initial released level runs the timer once
+    simCheck(mixed.ticking == 0, "idle bank: no switch ticked");
+    level[6] = false;
+    level[7] = false;
+    mixedTicks(10);
+    level[7] = true;
+    mixedTicks(10);
+    simCheck(mixed.ticking == 2, "running timer ticked, pressed plain switch not: %llx",
+             (unsigned long long)mixed.ticking);
+    mixedTicks(30);
+    simCheck(mixed.ticking == 0 && sched.last("timer/switch/state") == "off",
+             "timer expired: no switch ticked");
+    sched.publish("timer/switch/set", "pulse");
+    simCheck(mixed.ticking == 2, "timer started by a pulse message ticked");
+    mixedTicks(30);
+    simCheck(mixed.ticking == 0 && sched.last("timer/switch/state") == "off",
+             "pulse timer expired");
+    return simExit();
+}
@@ -0,0 +1,18 @@
+// Adafruit_PWMServoDriver.h - host stand-in, see ../README.md
+#pragma once
+
+#include "Wire.h"
+
+class Adafruit_PWMServoDriver {
+  public:
+    Adafruit_PWMServoDriver(uint8_t addr, TwoWire &i2c) {
+    }
+    bool begin(uint8_t prescale = 0) {
+        return true;
+    }
+    void setPWMFreq(float freq) {
+    }
+    uint8_t setPWM(uint8_t num, uint16_t on, uint16_t off) {
+        return 0;
+    }
+};
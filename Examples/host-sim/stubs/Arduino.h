@@ -0,0 +1,178 @@
+// Arduino.h - host stand-in for the Arduino core, see ../README.md
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+
+using std::isinf;  // global in the Arduino core (math.h)
+using std::isnan;
+
+class String : public std::string {
+  public:
+    String() {
+    }
+    String(const char *s) : std::string(s ? s : "") {
+    }
+    String(const std::string &s) : std::string(s) {
+    }
+    String(char c) : std::string(1, c) {
+    }
+    String(int v) : std::string(std::to_string(v)) {
+    }
+    String(unsigned int v) : std::string(std::to_string(v)) {
+    }
+    String(long v) : std::string(std::to_string(v)) {
+    }
+    String(unsigned long v) : std::string(std::to_string(v)) {
+    }
+    String(double v, int decimals = 2) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        assign(buf);
+    }
+    unsigned int length() const {
+        return (unsigned int)size();
+    }
+    long toInt() const {
+        return atol(c_str());
+    }
+    float toFloat() const {
+        return atof(c_str());
+    }
+    void toLowerCase() {
+        for (auto &c : *this)
+            c = tolower(c);
+    }
+    void toUpperCase() {
+        for (auto &c : *this)
+            c = toupper(c);
+    }
+    String substring(unsigned int from) const {
+        return from < size() ? String(substr(from)) : String();
+    }
+    String substring(unsigned int from, unsigned int to) const {
+        return from < size() ? String(substr(from, to - from)) : String();
+    }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t p = find(c, from);
+        return p == npos ? -1 : (int)p;
+    }
+    int indexOf(const String &s, unsigned int from = 0) const {
+        size_t p = find(s, from);
+        return p == npos ? -1 : (int)p;
+    }
+    bool startsWith(const String &s) const {
+        return compare(0, s.size(), s) == 0;
+    }
+    bool endsWith(const String &s) const {
+        return size() >= s.size() && compare(size() - s.size(), s.size(), s) == 0;
+    }
+    void replace(const String &from, const String &to) {
+        for (size_t p = 0; (p = find(from, p)) != npos; p += to.size())
+            std::string::replace(p, from.size(), to);
+    }
+    void trim() {
+        erase(0, find_first_not_of(" \t\r\n"));
+        erase(find_last_not_of(" \t\r\n") + 1);
+    }
+    bool reserve(unsigned int n) {
+        std::string::reserve(n);
+        return true;
+    }
+    char charAt(unsigned int i) const {
+        return (*this)[i];
+    }
+};
+
+inline String operator+(const String &a, const String &b) {
+    return String(static_cast<const std::string &>(a) + static_cast<const std::string &>(b));
+}
+inline String operator+(const String &a, const char *b) {
+    return String(static_cast<const std::string &>(a) + b);
+}
+inline String operator+(const char *a, const String &b) {
+    return String(a + static_cast<const std::string &>(b));
+}
+inline String operator+(const String &a, char b) {
+    return String(static_cast<const std::string &>(a) + b);
+}
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define OUTPUT_OPEN_DRAIN 3
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define MSBFIRST 1
+#define LSBFIRST 0
+#define A0 17
+#define SDA 4
+#define SCL 5
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void noInterrupts();
+void interrupts();
+uint8_t digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t irq, void (*fn)(), int mode);
+void detachInterrupt(uint8_t irq);
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val);
+long random(long max);
+
+struct SerialC {
+    void begin(long) {
+    }
+    template <class T> void print(T) {
+    }
+    template <class T> void println(T) {
+    }
+    void println() {
+    }
+    int available() {
+        return 0;
+    }
+    int read() {
+        return -1;
+    }
+    size_t write(uint8_t) {
+        return 1;
+    }
+    size_t write(const uint8_t *, size_t n) {
+        return n;
+    }
+    void flush() {
+    }
+};
+extern SerialC Serial;
+
+struct EspC {
+    uint32_t getFreeHeap();
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz();
+};
+extern EspC ESP;
+
+#include "sim.h"
@@ -0,0 +1,15 @@
+// SPI.h - host stand-in, see ../README.md
+#pragma once
+
+#include "Arduino.h"
+
+struct SPIClass {
+    void begin() {
+    }
+    void end() {
+    }
+    uint8_t transfer(uint8_t data) {
+        return data;
+    }
+};
+extern SPIClass SPI;
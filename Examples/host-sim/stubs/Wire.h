@@ -0,0 +1,39 @@
+// Wire.h - host stand-in counting I2C transactions, see ../README.md
+#pragma once
+
+#include "Arduino.h"
+
+struct TwoWire {
+    unsigned long transactions = 0;  // endTransmission() calls
+    unsigned long bytesWritten = 0;
+    void begin() {
+    }
+    void begin(int sda, int scl) {
+    }
+    void setClock(uint32_t) {
+    }
+    void beginTransmission(uint8_t address) {
+    }
+    size_t write(uint8_t) {
+        ++bytesWritten;
+        return 1;
+    }
+    size_t write(const uint8_t *, size_t n) {
+        bytesWritten += n;
+        return n;
+    }
+    uint8_t endTransmission(bool sendStop = true) {
+        ++transactions;
+        return 0;
+    }
+    uint8_t requestFrom(uint8_t address, uint8_t n, bool sendStop = true) {
+        return n;
+    }
+    int available() {
+        return 0;
+    }
+    int read() {
+        return 0;
+    }
+};
+extern TwoWire Wire;
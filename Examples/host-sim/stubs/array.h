@@ -0,0 +1,34 @@
+// array.h - host stand-in for ustd array.h, see ../README.md
+#pragma once
+
+#include <vector>
+
+namespace ustd {
+
+template <class T> class array {
+    std::vector<T> v;
+
+  public:
+    array(unsigned startSize = 16, unsigned maxSize = 256, unsigned incSize = 16,
+          bool shrink = true) {
+    }
+    int add(T e) {
+        v.push_back(e);
+        return (int)v.size() - 1;
+    }
+    T &operator[](unsigned i) {
+        return v[i];
+    }
+    unsigned length() {
+        return (unsigned)v.size();
+    }
+    bool erase(unsigned i) {
+        v.erase(v.begin() + i);
+        return true;
+    }
+    bool isEmpty() {
+        return v.empty();
+    }
+};
+
+}  // namespace ustd
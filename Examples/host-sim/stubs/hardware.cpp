@@ -0,0 +1,94 @@
+// hardware.cpp - simulated hardware of the host stand-ins, see ../README.md
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+
+unsigned long simMicros = 0;
+void (*simPinMode)(uint8_t, uint8_t) = nullptr;
+void (*simDigitalWrite)(uint8_t, uint8_t) = nullptr;
+int (*simDigitalRead)(uint8_t) = nullptr;
+void (*simAnalogWrite)(uint8_t, int) = nullptr;
+int simPinState = LOW;
+void (*simIsr)() = nullptr;
+static int simFailures = 0;
+
+// 32 bit like the targets: millis() wraps after 49.7 days, micros() after 71.6 minutes
+unsigned long millis() {
+    return (uint32_t)(simMicros / 1000);
+}
+unsigned long micros() {
+    return (uint32_t)simMicros;
+}
+void delay(unsigned long ms) {
+    simMicros += ms * 1000;
+}
+void delayMicroseconds(unsigned int us) {
+    simMicros += us;
+}
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (simPinMode)
+        simPinMode(pin, mode);
+}
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (simDigitalWrite)
+        simDigitalWrite(pin, val);
+}
+int digitalRead(uint8_t pin) {
+    return simDigitalRead ? simDigitalRead(pin) : simPinState;
+}
+int analogRead(uint8_t pin) {
+    return 0;
+}
+void analogWrite(uint8_t pin, int val) {
+    if (simAnalogWrite)
+        simAnalogWrite(pin, val);
+}
+void noInterrupts() {
+}
+void interrupts() {
+}
+uint8_t digitalPinToInterrupt(uint8_t pin) {
+    return pin;
+}
+void attachInterrupt(uint8_t irq, void (*fn)(), int mode) {
+    simIsr = fn;
+}
+void detachInterrupt(uint8_t irq) {
+    simIsr = nullptr;
+}
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val) {
+}
+long random(long max) {
+    return rand() % max;
+}
+
+uint32_t EspC::getFreeHeap() {
+    return 0;
+}
+uint32_t EspC::getCycleCount() {
+    return simMicros * 80;
+}
+uint32_t EspC::getCpuFreqMHz() {
+    return 80;
+}
+
+SerialC Serial;
+EspC ESP;
+SPIClass SPI;
+TwoWire Wire;
+
+bool simCheck(bool ok, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    printf("%s ", ok ? "ok  " : "FAIL");
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+    if (!ok)
+        ++simFailures;
+    return ok;
+}
+
+int simExit() {
+    return simFailures ? 1 : 0;
+}
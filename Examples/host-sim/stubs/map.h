@@ -0,0 +1,2 @@
+// map.h - host stand-in for ustd map.h, see ../README.md
+#pragma once
@@ -0,0 +1,4 @@
+// platform.h - host stand-in for ustd platform.h, see ../README.md
+#pragma once
+
+#define DBG(x)
@@ -0,0 +1,34 @@
+// queue.h - host stand-in for ustd queue.h, see ../README.md
+#pragma once
+
+#include <deque>
+
+namespace ustd {
+
+template <class T> class queue {
+    std::deque<T> d;
+    unsigned maxSize;
+
+  public:
+    queue(unsigned maxSize = 16) : maxSize(maxSize) {
+    }
+    bool push(T e) {
+        if (d.size() >= maxSize)
+            return false;
+        d.push_back(e);
+        return true;
+    }
+    T pop() {
+        T e = d.front();
+        d.pop_front();
+        return e;
+    }
+    unsigned length() {
+        return (unsigned)d.size();
+    }
+    bool isEmpty() {
+        return d.empty();
+    }
+};
+
+}  // namespace ustd
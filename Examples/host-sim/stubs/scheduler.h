@@ -0,0 +1,88 @@
+// scheduler.h - host stand-in for the muwerk scheduler, see ../README.md
+#pragma once
+
+#include "Arduino.h"
+#include "platform.h"
+#include "array.h"
+#include "queue.h"
+#include "map.h"
+
+#include <vector>
+
+namespace ustd {
+
+typedef std::function<void()> T_LOOPCALLBACK;
+typedef std::function<void(String, String, String)> T_SUBS;
+
+inline unsigned long timeDiff(unsigned long first, unsigned long second) {
+    return (uint32_t)(second - first);  // millis() and micros() are 32 bit on the targets
+}
+
+class Scheduler {
+    /*! Tasks are not run (the simulation calls the loops of the mupplets), publish() delivers
+     * synchronously to matching subscriptions and records the messages */
+  public:
+    typedef struct {
+        String topic;
+        String msg;
+    } T_MSG;
+    std::vector<std::pair<String, T_SUBS>> subs;
+    std::vector<T_MSG> published;
+    bool verbose = false;
+
+    Scheduler(int nTaskListSize = 2, int nSubscriptionListSize = 2, int nQueueSize = 2) {
+    }
+    int add(T_LOOPCALLBACK task, String name, unsigned long minMicroSecs = 0) {
+        return 0;
+    }
+    int subscribe(int taskID, String topic, T_SUBS subs) {
+        this->subs.push_back({topic, subs});
+        return (int)this->subs.size();
+    }
+    bool unsubscribe(int subscriptionHandle) {
+        return true;
+    }
+    bool reschedule(int taskID, unsigned long minMicroSecs) {
+        return true;
+    }
+    static bool mqttmatch(const String &pubTopic, const String &subTopic) {
+        size_t p = 0, s = 0;
+        while (s < subTopic.size()) {
+            if (subTopic[s] == '#')
+                return true;
+            if (subTopic[s] == '+') {
+                while (p < pubTopic.size() && pubTopic[p] != '/')
+                    ++p;
+                ++s;
+                continue;
+            }
+            if (p >= pubTopic.size() || pubTopic[p] != subTopic[s])
+                return false;
+            ++p;
+            ++s;
+        }
+        return p == pubTopic.size();
+    }
+    bool publish(String topic, String msg = "", String originator = "") {
+        if (verbose)
+            printf("  %s %s\n", topic.c_str(), msg.c_str());
+        published.push_back({topic, msg});
+        for (size_t i = 0; i < subs.size(); i++) {
+            if (mqttmatch(topic, subs[i].first))
+                subs[i].second(topic, msg, originator);
+        }
+        return true;
+    }
+    String last(String topic) {
+        /*! Last message published on topic, "" if none */
+        for (size_t i = published.size(); i > 0; i--) {
+            if (published[i - 1].topic == topic)
+                return published[i - 1].msg;
+        }
+        return "";
+    }
+    void loop() {
+    }
+};
+
+}  // namespace ustd
@@ -0,0 +1,32 @@
+// sensors.h - host stand-in for ustd sensorprocessor: every value passes, see ../README.md
+#pragma once
+
+#include "Arduino.h"
+
+namespace ustd {
+
+class sensorprocessor {
+  public:
+    unsigned int smoothInterval;
+    unsigned int pollTimeSec;
+    double eps;
+    double lastVal = 0.0;  // last value that passed
+
+    sensorprocessor(unsigned int smoothInterval = 5, unsigned int pollTimeSec = 60,
+                    double eps = 0.1)
+        : smoothInterval(smoothInterval), pollTimeSec(pollTimeSec), eps(eps) {
+    }
+    bool filter(double *pvalue) {
+        lastVal = *pvalue;
+        return true;
+    }
+    bool filter(long *pvalue) {
+        lastVal = *pvalue;
+        return true;
+    }
+    void reset() {
+        lastVal = 0.0;
+    }
+};
+
+}  // namespace ustd
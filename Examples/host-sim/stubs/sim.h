@@ -0,0 +1,21 @@
+// sim.h - simulated hardware of the host stand-ins, see ../README.md
+#pragma once
+
+#include <cstdint>
+
+// Simulated time, advanced by the simulation
+extern unsigned long simMicros;
+
+// Optional hooks of the simulation, nullptr: ignored (digitalRead(): simPinState)
+extern void (*simPinMode)(uint8_t pin, uint8_t mode);
+extern void (*simDigitalWrite)(uint8_t pin, uint8_t val);
+extern int (*simDigitalRead)(uint8_t pin);
+extern void (*simAnalogWrite)(uint8_t pin, int val);
+extern int simPinState;
+
+// ISR of the last attachInterrupt(), nullptr after detachInterrupt(): the simulation calls it
+extern void (*simIsr)();
+
+// Result of a check: prints and counts failures, simExit() returns the exit code
+bool simCheck(bool ok, const char *fmt, ...);
+int simExit();
@@ -0,0 +1,95 @@
+// memory_report.cpp - instance size and heap of a node with 15 mupplets, host build
+//
+// Replaces the global operator new/delete to count the heap in use. Prints the heap allocated by
+// the constructors of the global instances, then per mupplet its size and the heap allocated by
+// its begin(), and the totals. See README.md.
+
+#include "platform.h"
+#include "scheduler.h"
+
+#include "switch.h"
+#include "led.h"
+#include "digital_out.h"
+#include "frequency_counter.h"
+#include "i2c_pwm.h"
+#include "illuminance_ldr.h"
+#include "temp_hum_dht.h"
+#include "store_forward.h"
+#include "airq_bme280.h"
+#include "illuminance_tsl2561.h"
+#include "sensor_history.h"
+#include "binding.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static size_t heapInUse = 0;  // bytes requested by new and not yet deleted
+
+void *operator new(size_t n) {
+    // the requested size is kept in front of the block, aligned like malloc()
+    std::max_align_t *p = (std::max_align_t *)malloc(sizeof(std::max_align_t) + n);
+    if (!p)
+        throw std::bad_alloc();
+    *(size_t *)p = n;
+    heapInUse += n;
+    return p + 1;
+}
+
+void operator delete(void *ptr) noexcept {
+    if (!ptr)
+        return;
+    std::max_align_t *p = (std::max_align_t *)ptr - 1;
+    heapInUse -= *(size_t *)p;
+    free(p);
+}
+
+ustd::Scheduler sched;
+ustd::Switch button1("button1", 4);
+ustd::Switch button2("button2", 5);
+ustd::Led led1("led1", 12);
+ustd::Led led2("led2", 13);
+ustd::DigitalOut relay1("relay1", 14);
+ustd::DigitalOut relay2("relay2", 15);
+ustd::FrequencyCounter counter("counter", 16, 0);
+ustd::I2CPWM pwm("pwm");
+ustd::Ldr ldr("ldr", 0);
+ustd::Dht dht("dht", 2);
+ustd::StoreForward store("store");
+ustd::AirQualityBme280 bme("bme280");
+ustd::IlluminanceTsl2561 tsl("tsl2561", 0x39);
+ustd::SensorHistory history("ldr/sensor/unitilluminance");
+ustd::Binding binding("binding");
+
+template <typename M> static size_t begin(const char *name, M &mupplet) {
+    size_t before = heapInUse;
+    mupplet.begin(&sched);
+    size_t heap = heapInUse - before;
+    printf("%-10s sizeof %5zu  heap in begin() %6zu\n", name, sizeof(mupplet), heap);
+    return sizeof(mupplet);
+}
+
+int main() {
+    size_t constructorHeap = heapInUse;
+    size_t start = heapInUse;
+    size_t instances = 0;
+    instances += begin("button1", button1);
+    instances += begin("button2", button2);
+    instances += begin("led1", led1);
+    instances += begin("led2", led2);
+    instances += begin("relay1", relay1);
+    instances += begin("relay2", relay2);
+    instances += begin("counter", counter);
+    instances += begin("pwm", pwm);
+    instances += begin("ldr", ldr);
+    instances += begin("dht", dht);
+    instances += begin("store", store);
+    instances += begin("bme280", bme);
+    instances += begin("tsl2561", tsl);
+    instances += begin("history", history);
+    instances += begin("binding", binding);
+    printf("15 mupplets: instances %zu, heap of constructors %zu, heap of begin() %zu, total %zu\n",
+           instances, constructorHeap, heapInUse - start, instances + heapInUse);
+    return 0;
+}
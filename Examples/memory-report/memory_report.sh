@@ -0,0 +1,18 @@
+#!/bin/sh
+# Instance size and heap of a node with 15 mupplets on the host, see README.md.
+# Usage: ./memory_report.sh [git-revision]  (default: the working tree)
+cd "$(dirname "$0")" || exit 1
+root=$(cd ../.. && pwd)
+CXX=${CXX:-g++}
+mkdir -p build
+src=$root
+if [ -n "$1" ]; then
+    # mupplet headers of the revision, stand-ins and report program of the working tree
+    src=build/tree-$1
+    rm -rf "$src"
+    mkdir -p "$src"
+    git -C "$root" archive "$1" -- '*.h' | tar -x -C "$src" || exit 1
+fi
+$CXX -std=c++11 -O2 -I../host-sim/stubs -I"$src" -include Arduino.h \
+    memory_report.cpp ../host-sim/stubs/hardware.cpp -o build/memory_report || exit 1
+build/memory_report
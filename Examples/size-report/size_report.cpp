@@ -0,0 +1,59 @@
+// size_report.cpp - one mupplet instance, for the flash size of the compile-time mode variants
+//
+// SIZE_VARIANT selects the instance (see size_report.sh, which builds all of them):
+//   0 Switch            1 SwitchOnly<Switch::Flipflop>
+//   2 Led               3 LedOnly<Led::Blink>
+//   4 FrequencyCounter  5 FrequencyCounterOnly<FrequencyCounter::LOWFREQUENCY_MEDIUM>
+//   6 I2CPWM            7 I2CPWMOnly<I2CPWM::PWM>
+
+#include "platform.h"
+#include "scheduler.h"
+
+#if SIZE_VARIANT == 0 || SIZE_VARIANT == 1
+#include "switch.h"
+#elif SIZE_VARIANT == 2 || SIZE_VARIANT == 3
+#include "led.h"
+#elif SIZE_VARIANT == 4 || SIZE_VARIANT == 5
+#include "frequency_counter.h"
+#elif SIZE_VARIANT == 6 || SIZE_VARIANT == 7
+#include "i2c_pwm.h"
+#else
+#error "SIZE_VARIANT must be 0..7"
+#endif
+
+ustd::Scheduler sched;
+
+#if SIZE_VARIANT == 0
+ustd::Switch mupplet("mupplet", 4);
+#elif SIZE_VARIANT == 1
+ustd::SwitchOnly<ustd::Switch::Flipflop> mupplet("mupplet", 4);
+#elif SIZE_VARIANT == 2
+ustd::Led mupplet("mupplet", 4);
+#elif SIZE_VARIANT == 3
+ustd::LedOnly<ustd::Led::Blink> mupplet("mupplet", 4);
+#elif SIZE_VARIANT == 4
+ustd::FrequencyCounter mupplet("mupplet", 4, 0);
+#elif SIZE_VARIANT == 5
+ustd::FrequencyCounterOnly<ustd::FrequencyCounter::LOWFREQUENCY_MEDIUM> mupplet("mupplet", 4, 0);
+#elif SIZE_VARIANT == 6
+ustd::I2CPWM mupplet("mupplet");
+#elif SIZE_VARIANT == 7
+ustd::I2CPWMOnly<ustd::I2CPWM::PWM> mupplet("mupplet");
+#endif
+
+void setup() {
+    mupplet.begin(&sched);
+}
+
+void loop() {
+    sched.loop();
+}
+
+#ifndef ARDUINO
+int main() {
+    // host build with the stand-ins of ../host-sim
+    setup();
+    loop();
+    return 0;
+}
+#endif
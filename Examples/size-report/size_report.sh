@@ -0,0 +1,48 @@
+#!/bin/sh
+# Flash size of the compile-time mode variants, see README.md.
+# Usage: ./size_report.sh [esp8266|esp32|host]  (default esp8266)
+cd "$(dirname "$0")" || exit 1
+target=${1:-esp8266}
+root=$(cd ../.. && pwd)
+mkdir -p build
+names="Switch SwitchOnly<Switch::Flipflop> Led LedOnly<Led::Blink> FrequencyCounter
+FrequencyCounterOnly<FrequencyCounter::LOWFREQUENCY_MEDIUM> I2CPWM I2CPWMOnly<I2CPWM::PWM>"
+
+case $target in
+esp8266) board=d1_mini ;;
+esp32) board=esp32dev ;;
+host) ;;
+*)
+    echo "unknown target $target" >&2
+    exit 1
+    ;;
+esac
+
+pwmlib="adafruit/Adafruit PWM Servo Driver Library"
+variant=0
+for name in $names; do
+    dir=build/$target-$variant
+    if [ "$target" = host ]; then
+        CXX=${CXX:-g++}
+        mkdir -p "$dir"
+        $CXX -std=c++11 -Os -ffunction-sections -fdata-sections -Wl,--gc-sections \
+            -I../host-sim/stubs -I"$root" -include Arduino.h -DSIZE_VARIANT=$variant \
+            size_report.cpp ../host-sim/stubs/hardware.cpp -o "$dir/firmware.elf" || exit 1
+        elf=$dir/firmware.elf
+        sizetool=${SIZE:-size}
+    else
+        # PlatformIO with the libraries of the muwerk Examples projects
+        pio ci size_report.cpp --board "$board" --keep-build-dir --build-dir "$dir" \
+            -O "lib_deps=muwerk/ustd, muwerk/muwerk, arduino-libraries/Arduino_JSON, $pwmlib" \
+            -O "build_flags=-DSIZE_VARIANT=$variant -I$root" >"$dir.log" 2>&1 || {
+            echo "$name: build failed, see $dir.log" >&2
+            exit 1
+        }
+        elf=$(find "$dir/.pio/build" -name firmware.elf | head -n 1)
+        sizetool=${SIZE:-$(find "$HOME/.platformio/packages" -name 'xtensa-*-elf-size' |
+            grep -m 1 "$([ "$target" = esp32 ] && echo esp32 || echo lx106)")}
+    fi
+    # Berkeley format: text data bss dec hex filename
+    $sizetool "$elf" | awk -v name="$name" 'NR == 2 { printf "%-62s text %7d  data %6d  bss %6d\n", name, $1, $2, $3 }'
+    variant=$((variant + 1))
+done
@@ -0,0 +1,123 @@
+// adaptive_poll.h
+#pragma once
+
+#include "scheduler.h"
+
+namespace ustd {
+
+#define USTD_MAX_ADAPTIVE_CHANNELS (4)
+
+class AdaptivePoll {
+    /*! Adapt the sample interval of a sensor to the variability of its values
+     *
+     * For each value (channel), mean and variance are tracked with exponential weighting. If a
+     * new value deviates from the mean by more than eps, or the standard deviation exceeds eps,
+     * the interval is reduced to a quarter. If the deviation stays below eps/2 and the standard
+     * deviation below eps, the interval grows by growFactor. The interval is kept within
+     * [minIntervalMs, maxIntervalMs]; with several channels, the most active channel determines
+     * it.
+     *
+     * eps is usually the eps of the sensorprocessor of the value, i.e. the change that would be
+     * published.
+     */
+  public:
+    typedef struct {
+        double eps;
+        double mean;
+        double var;
+        bool first;
+        unsigned long intervalMs;
+    } T_CHANNEL;
+
+    unsigned long minIntervalMs;
+    unsigned long maxIntervalMs;
+    unsigned long intervalMs;
+    double alpha = 0.3;
+    double growFactor = 1.5;
+    uint8_t channels;
+    T_CHANNEL channel[USTD_MAX_ADAPTIVE_CHANNELS];
+
+    AdaptivePoll(unsigned long minIntervalMs, unsigned long maxIntervalMs, uint8_t channels = 1)
+        : minIntervalMs(minIntervalMs), maxIntervalMs(maxIntervalMs), channels(channels) {
+        /*! Instantiate an adaptive interval
+         *
+         * @param minIntervalMs Shortest interval, used while values change
+         * @param maxIntervalMs Longest interval, reached while values are stable
+         * @param channels Number of values (1..USTD_MAX_ADAPTIVE_CHANNELS)
+         */
+        if (this->channels < 1)
+            this->channels = 1;
+        if (this->channels > USTD_MAX_ADAPTIVE_CHANNELS)
+            this->channels = USTD_MAX_ADAPTIVE_CHANNELS;
+        if (this->maxIntervalMs < this->minIntervalMs)
+            this->maxIntervalMs = this->minIntervalMs;
+        intervalMs = this->minIntervalMs;
+        for (uint8_t i = 0; i < USTD_MAX_ADAPTIVE_CHANNELS; i++) {
+            channel[i].eps = 0.1;
+            channel[i].intervalMs = this->minIntervalMs;
+        }
+        reset();
+    }
+
+    void setEps(uint8_t ch, double eps) {
+        /*! Set the significant change of a channel */
+        if (ch < channels)
+            channel[ch].eps = eps;
+    }
+
+    void reset() {
+        for (uint8_t i = 0; i < channels; i++) {
+            channel[i].first = true;
+            channel[i].var = 0.0;
+            channel[i].intervalMs = minIntervalMs;
+        }
+        intervalMs = minIntervalMs;
+    }
+
+    unsigned long update(uint8_t ch, double value) {
+        /*! Add a value of a channel
+         *
+         * @return New sample interval in ms
+         */
+        if (ch >= channels || isnan(value))
+            return intervalMs;
+        T_CHANNEL &c = channel[ch];
+        if (c.first) {
+            c.mean = value;
+            c.first = false;
+            return intervalMs;
+        }
+        double d = value - c.mean;
+        c.mean += alpha * d;
+        c.var = (1.0 - alpha) * (c.var + alpha * d * d);
+        double sd = sqrt(c.var);
+        if (fabs(d) > c.eps || sd > c.eps) {
+            c.intervalMs /= 4;
+            if (c.intervalMs < minIntervalMs)
+                c.intervalMs = minIntervalMs;
+        } else if (fabs(d) < c.eps / 2.0 && sd < c.eps) {
+            c.intervalMs = (unsigned long)(c.intervalMs * growFactor);
+            if (c.intervalMs > maxIntervalMs)
+                c.intervalMs = maxIntervalMs;
+        }
+        intervalMs = maxIntervalMs;
+        for (uint8_t i = 0; i < channels; i++) {
+            if (channel[i].intervalMs < intervalMs)
+                intervalMs = channel[i].intervalMs;
+        }
+        return intervalMs;
+    }
+
+    void reschedule(Scheduler *pSched, int tID) {
+        /*! Apply the current interval to a scheduler task, if it changed */
+        if (intervalMs != scheduledMs) {
+            scheduledMs = intervalMs;
+            pSched->reschedule(tID, intervalMs * 1000);
+        }
+    }
+
+  private:
+    unsigned long scheduledMs = 0;
+};  // AdaptivePoll
+
+}  // namespace ustd
@@ -1,23 +1,39 @@
 // airq_bme280.h
-// adapted from:
-// https://github.com/adafruit/Adafruit_BME280_Library/blob/master/examples/bme280_unified/bme280_unified.ino
+// Forced mode driver, compensation formulas from the Bosch BME280 datasheet (BST-BME280-DS002)
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 
 #include "sensors.h"
+#include "i2c_bus.h"
+#include "adaptive_poll.h"
 
 #include <Wire.h>
-#include <Adafruit_Sensor.h>
-#include <Adafruit_BME280.h>
 
 #include "home_assistant.h"
 
+#ifndef BME280_ADDRESS
+#define BME280_ADDRESS (0x77)
+#endif
+
 namespace ustd {
 class AirQualityBme280 {
   public:
     enum FilterMode { FAST, MEDIUM, LONGTERM };
-    String AIRQUALITY_VERSION = "0.1.1";
+    enum MeasureState { IDLE, TRIGGERING, CONVERTING, READING };
+    enum BmeRegister {
+        REG_CALIB_00 = 0x88,
+        REG_CHIPID = 0xD0,
+        REG_RESET = 0xE0,
+        REG_CALIB_26 = 0xE1,
+        REG_CTRL_HUM = 0xF2,
+        REG_STATUS = 0xF3,
+        REG_CTRL_MEAS = 0xF4,
+        REG_CONFIG = 0xF5,
+        REG_PRESS_MSB = 0xF7
+    };
+    static constexpr const char *AIRQUALITY_VERSION = "0.2.0";
     Scheduler *pSched;
     int tID;
     String name;
@@ -32,10 +48,32 @@ class AirQualityBme280 {
     ustd::sensorprocessor temperature = ustd::sensorprocessor(4, 30, 0.1);
     ustd::sensorprocessor humidity = ustd::sensorprocessor(4, 30, 0.1);
     ustd::sensorprocessor pressure = ustd::sensorprocessor(4, 30, 0.01);
-    Adafruit_BME280 *pAirQuality;
-    Adafruit_Sensor *bme_temp;
-    Adafruit_Sensor *bme_pressure;
-    Adafruit_Sensor *bme_humidity;
+    unsigned long sampleIntervalMs = 2000;  // time between start of two measurements
+    AdaptivePoll *pAdaptive = nullptr;  // adapts sampleIntervalMs if set
+    I2CBus *pBus = nullptr;
+    int busDevice = -1;
+    I2CPort *pPort = nullptr;  // used without bus and for initialization
+    bool ownPort = false;
+
+    // measurement cycle
+    MeasureState state = MeasureState::IDLE;
+    unsigned long cycleStart = 0;
+    unsigned long convStart = 0;
+    unsigned long convMs = 0;
+    bool configPending = true;
+    uint8_t osrsT = 1, osrsP = 1, osrsH = 1, iirFilter = 0;  // register codes
+    unsigned long samples = 0;
+    unsigned long errors = 0;
+
+    // calibration data
+    uint16_t dig_T1;
+    int16_t dig_T2, dig_T3;
+    uint16_t dig_P1;
+    int16_t dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7, dig_P8, dig_P9;
+    uint8_t dig_H1, dig_H3;
+    int16_t dig_H2, dig_H4, dig_H5;
+    int8_t dig_H6;
+    int32_t t_fine;
 
 #ifdef __ESP__
     HomeAssistant *pHA;
@@ -43,18 +81,22 @@ class AirQualityBme280 {
 
     AirQualityBme280(String name, uint8_t i2c_addr = BME280_ADDRESS,
                      uint8_t filterMode = LONGTERM)  // i2c_addr: usually 0x77 or 0x76
-        : name(name), i2c_addr(i2c_addr), filterMode(filterMode) {
-        pAirQuality = new Adafruit_BME280();  // seems to be on i2c port 0x77 always
-        setFilterMode(filterMode, true);
+        : name(name), i2c_addr(i2c_addr), filterMode((FilterMode)filterMode) {
+        setFilterMode(this->filterMode, true);
     }
 
     ~AirQualityBme280() {
+        if (ownPort)
+            delete pPort;
+        if (pAdaptive)
+            delete pAdaptive;
     }
 
     void setFilterMode(FilterMode mode, bool silent = false) {
         switch (mode) {
         case FAST:
             filterMode = FAST;
+            setOversampling(1, 1, 1, 0);  // x1, x1, x1, IIR off
             temperature.smoothInterval = 1;
             temperature.pollTimeSec = 15;
             temperature.eps = 0.1;
@@ -70,6 +112,7 @@ class AirQualityBme280 {
             break;
         case MEDIUM:
             filterMode = MEDIUM;
+            setOversampling(2, 3, 2, 2);  // x2, x4, x2, IIR 4
             temperature.smoothInterval = 4;
             temperature.pollTimeSec = 180;
             temperature.eps = 0.2;
@@ -86,6 +129,7 @@ class AirQualityBme280 {
         case LONGTERM:
         default:
             filterMode = LONGTERM;
+            setOversampling(2, 5, 1, 4);  // x2, x16, x1, IIR 16
             temperature.smoothInterval = 16;
             temperature.pollTimeSec = 600;
             temperature.eps = 0.5;
@@ -100,10 +144,27 @@ class AirQualityBme280 {
             pressure.reset();
             break;
         }
+        setAdaptiveEps();
         if (!silent)
             publishFilterMode();
     }
 
+    void setAdaptivePolling(unsigned long minIntervalMs = 2000,
+                            unsigned long maxIntervalMs = 60000) {
+        /*! Measure fast while one of the values changes and slow down while they are stable
+         *
+         * The significant change of each value is the eps of the current filter mode.
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs, 3);
+        setAdaptiveEps();
+        sampleIntervalMs = pAdaptive->intervalMs;
+    }
+
     double getTemperature() {
         return temperatureVal;
     }
@@ -116,39 +177,71 @@ class AirQualityBme280 {
         return pressureVal;
     }
 
-    void begin(Scheduler *_pSched) {
+    void setOversampling(uint8_t t, uint8_t p, uint8_t h, uint8_t iir) {
+        /*! Set oversampling and IIR filter register codes
+         *
+         * Codes as in the datasheet: oversampling 0: skipped, 1: x1, 2: x2,
+         * 3: x4, 4: x8, 5: x16; IIR filter 0: off, 1: 2, 2: 4, 3: 8, 4: 16.
+         * The new settings are written before the next measurement.
+         */
+        osrsT = t;
+        osrsP = p;
+        osrsH = h;
+        iirFilter = iir;
+        configPending = true;
+        // t_meas [ms] = 1.25 + 2.3*T + (2.3*P + 0.575) + (2.3*H + 0.575)
+        unsigned long us = 1250 + 2300 * osrsFactor(osrsT);
+        if (osrsP)
+            us += 2300 * osrsFactor(osrsP) + 575;
+        if (osrsH)
+            us += 2300 * osrsFactor(osrsH) + 575;
+        convMs = (us + 999) / 1000 + 1;
+    }
+
+    void begin(Scheduler *_pSched, I2CBus *_pBus = nullptr) {
+        /*! Initialize sensor and start measurements
+         *
+         * @param _pSched Scheduler
+         * @param _pBus Optional shared I2C bus manager, measurements are then
+         * queued on the bus instead of accessing the sensor from the loop.
+         */
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
+        pBus = _pBus;
+        if (pBus) {
+            busDevice = pBus->addDevice(name, i2c_addr);
+            pPort = pBus->pPort;
+        } else {
+            pPort = new I2CWirePort();
+            ownPort = true;
+            pPort->begin();
+        }
 
-        if (!pAirQuality->begin(i2c_addr)) {
+        if (!initSensor()) {
             errmsg = "Could not find a valid BME280 sensor, check wiring!";
 #ifdef USE_SERIAL_DBG
             Serial.println(errmsg);
 #endif
         } else {
-
-            bme_temp = pAirQuality->getTemperatureSensor();
-            bme_pressure = pAirQuality->getPressureSensor();
-            bme_humidity = pAirQuality->getHumiditySensor();
-
             bActive = true;
             pSched->publish(name + "/sensor/result", "OK");
-            configureSensor();
         }
 
-        auto ft = [=]() { this->loop(); };
-        tID = pSched->add(ft, name, 2000000);  // every 2sec
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, 10000);  // state machine, measurement every sampleIntervalMs
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/#", fnall);
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                AIRQUALITY_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, AIRQUALITY_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Temperature", "\\u00B0C", "temperature", "mdi:thermometer");
         pHA->addSensor("humidity", "Humidity", "%", "humidity", "mdi:water-percent");
         pHA->addSensor("pressure", "Pressure", "hPa", "pressure", "mdi:altimeter");
@@ -156,15 +249,6 @@ class AirQualityBme280 {
     }
 #endif
 
-    void configureSensor() {
-        pAirQuality->setSampling(Adafruit_BME280::MODE_FORCED,
-                                 Adafruit_BME280::SAMPLING_X1,      // temperature
-                                 Adafruit_BME280::SAMPLING_X1,      // pressure
-                                 Adafruit_BME280::SAMPLING_X1,      // humidity
-                                 Adafruit_BME280::FILTER_OFF,       // no exponential sample filter
-                                 Adafruit_BME280::STANDBY_MS_0_5);  // minimal standby
-    }
-
     void publishTemperature() {
         if (bActive && !bStartup) {
             char buf[32];
@@ -210,57 +294,38 @@ class AirQualityBme280 {
     }
 
     void loop() {
-#ifdef USE_SERIAL_DBG
-        Serial.println("BME280 enter loop");
-#endif
+        /*! Forced mode measurement cycle
+         *
+         * IDLE: write config (if changed) and trigger a forced measurement
+         * CONVERTING: wait for the conversion time of the current oversampling
+         * READING: one burst read of all data registers, compensate and publish
+         *
+         * Each tick does at most one step, so the loop never waits for the sensor.
+         */
         if (startTime < 100000)
             startTime = time(NULL);  // NTP data available.
-        if (bActive) {
-            double t, h, p;
-            sensors_event_t temp_event, pressure_event, humidity_event;
-            bme_temp->getEvent(&temp_event);
-            bme_pressure->getEvent(&pressure_event);
-            bme_humidity->getEvent(&humidity_event);
-
-            Serial.print(temp_event.temperature);
-            Serial.print(humidity_event.relative_humidity);
-            Serial.print(pressure_event.pressure);
-
-            t = temp_event.temperature;
-            h = humidity_event.relative_humidity;
-            p = pressure_event.pressure;
-
-            configureSensor();  // reload parameters after each measurement
-
-            if (temperature.filter(&t)) {
-                temperatureVal = t;
-                publishTemperature();
-            }
-            if (humidity.filter(&h)) {
-                humidityVal = h;
-                publishHumidity();
-            }
-            if (pressure.filter(&p)) {
-                pressureVal = p;
-                publishPressure();
-            }
-#ifdef USE_SERIAL_DBG
-            Serial.println(t);
-            Serial.println(h);
-            Serial.println(p);
-#endif
-        } else {
-#ifdef USE_SERIAL_DBG
-            Serial.println("AirQualityBme280 sensor not active.");
-#endif
+        if (!bActive) {
             if (errmsg != "") {
                 pSched->publish(name + "/sensor/result", errmsg);
                 errmsg = "";
             }
+            return;
+        }
+        switch (state) {
+        case MeasureState::IDLE:
+            if (samples + errors == 0 || timeDiff(cycleStart, millis()) >= sampleIntervalMs) {
+                cycleStart = millis();
+                trigger();
+            }
+            break;
+        case MeasureState::CONVERTING:
+            if (timeDiff(convStart, millis()) >= convMs) {
+                readData();
+            }
+            break;
+        default:  // waiting for bus
+            break;
         }
-#ifdef USE_SERIAL_DBG
-        Serial.println("BME280 exit loop.");
-#endif
     }
 
     void subsMsg(String topic, String msg, String originator) {
@@ -288,6 +353,220 @@ class AirQualityBme280 {
             }
         }
     };
+
+  private:
+    void setAdaptiveEps() {
+        if (!pAdaptive)
+            return;
+        pAdaptive->setEps(0, temperature.eps);
+        pAdaptive->setEps(1, humidity.eps);
+        pAdaptive->setEps(2, pressure.eps);
+    }
+
+    static unsigned int osrsFactor(uint8_t code) {
+        return code ? 1 << (code - 1) : 0;
+    }
+
+    uint8_t readRegs(uint8_t reg, uint8_t *buf, uint8_t len) {
+        uint8_t st = pPort->write(i2c_addr, &reg, 1, false);
+        if (st != I2CPort::OK)
+            return st;
+        return pPort->read(i2c_addr, buf, len);
+    }
+
+    uint8_t writeReg(uint8_t reg, uint8_t value) {
+        uint8_t buf[2] = {reg, value};
+        return pPort->write(i2c_addr, buf, 2);
+    }
+
+    bool initSensor() {
+        uint8_t id = 0;
+        if (readRegs(REG_CHIPID, &id, 1) != I2CPort::OK || id != 0x60)
+            return false;
+        writeReg(REG_RESET, 0xB6);
+        delay(3);  // startup time 2ms, only at begin()
+        uint8_t status = 0x01;
+        for (uint8_t i = 0; i < 10 && (status & 0x01); i++) {  // wait for NVM copy
+            if (readRegs(REG_STATUS, &status, 1) != I2CPort::OK)
+                return false;
+            delay(1);
+        }
+        uint8_t c[26];
+        if (readRegs(REG_CALIB_00, c, 26) != I2CPort::OK)
+            return false;
+        dig_T1 = (uint16_t)(c[1] << 8 | c[0]);
+        dig_T2 = (int16_t)(c[3] << 8 | c[2]);
+        dig_T3 = (int16_t)(c[5] << 8 | c[4]);
+        dig_P1 = (uint16_t)(c[7] << 8 | c[6]);
+        dig_P2 = (int16_t)(c[9] << 8 | c[8]);
+        dig_P3 = (int16_t)(c[11] << 8 | c[10]);
+        dig_P4 = (int16_t)(c[13] << 8 | c[12]);
+        dig_P5 = (int16_t)(c[15] << 8 | c[14]);
+        dig_P6 = (int16_t)(c[17] << 8 | c[16]);
+        dig_P7 = (int16_t)(c[19] << 8 | c[18]);
+        dig_P8 = (int16_t)(c[21] << 8 | c[20]);
+        dig_P9 = (int16_t)(c[23] << 8 | c[22]);
+        dig_H1 = c[25];
+        if (readRegs(REG_CALIB_26, c, 7) != I2CPort::OK)
+            return false;
+        dig_H2 = (int16_t)(c[1] << 8 | c[0]);
+        dig_H3 = c[2];
+        dig_H4 = (int16_t)((int8_t)c[3] * 16 | (c[4] & 0x0F));
+        dig_H5 = (int16_t)((int8_t)c[5] * 16 | (c[4] >> 4));
+        dig_H6 = (int8_t)c[6];
+        configPending = true;
+        return true;
+    }
+
+    void trigger() {
+        // sensor is in sleep mode between forced measurements, config can be written
+        uint8_t ctrlMeas = (uint8_t)(osrsT << 5 | osrsP << 2 | 0x01);  // forced mode
+        if (pBus) {
+            state = MeasureState::TRIGGERING;
+            if (configPending) {
+                pBus->writeRegister(busDevice, REG_CONFIG, (uint8_t)(iirFilter << 2));
+                pBus->writeRegister(busDevice, REG_CTRL_HUM, osrsH);  // active after ctrl_meas
+                configPending = false;
+            }
+            pBus->writeRegister(busDevice, REG_CTRL_MEAS, ctrlMeas,
+                                [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                                    this->onTriggered(st);
+                                });
+        } else {
+            uint8_t st = I2CPort::OK;
+            if (configPending) {
+                st = writeReg(REG_CONFIG, (uint8_t)(iirFilter << 2));
+                if (st == I2CPort::OK)
+                    st = writeReg(REG_CTRL_HUM, osrsH);
+                if (st == I2CPort::OK)
+                    configPending = false;
+            }
+            if (st == I2CPort::OK)
+                st = writeReg(REG_CTRL_MEAS, ctrlMeas);
+            onTriggered(st);
+        }
+    }
+
+    void onTriggered(uint8_t st) {
+        if (st != I2CPort::OK) {
+            ++errors;
+            configPending = true;
+            state = MeasureState::IDLE;
+            return;
+        }
+        convStart = millis();
+        state = MeasureState::CONVERTING;
+    }
+
+    void readData() {
+        if (pBus) {
+            state = MeasureState::READING;
+            pBus->readRegisters(busDevice, REG_PRESS_MSB, 8,
+                                [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                                    this->onData(st, data);
+                                });
+        } else {
+            uint8_t data[8];
+            uint8_t st = readRegs(REG_PRESS_MSB, data, 8);
+            onData(st, data);
+        }
+    }
+
+    void onData(uint8_t st, const uint8_t *d) {
+        state = MeasureState::IDLE;
+        if (st != I2CPort::OK) {
+            ++errors;
+            configPending = true;
+            return;
+        }
+        int32_t adcP = (int32_t)d[0] << 12 | (int32_t)d[1] << 4 | d[2] >> 4;
+        int32_t adcT = (int32_t)d[3] << 12 | (int32_t)d[4] << 4 | d[5] >> 4;
+        int32_t adcH = (int32_t)d[6] << 8 | d[7];
+        if (adcT == 0x80000) {  // measurement skipped or invalid
+            ++errors;
+            return;
+        }
+        ++samples;
+        double t = compensateTemperature(adcT) / 100.0;
+        if (pAdaptive)
+            sampleIntervalMs = pAdaptive->update(0, t);
+        if (temperature.filter(&t)) {
+            temperatureVal = t;
+            publishTemperature();
+        }
+        if (adcH != 0x8000) {
+            double h = compensateHumidity(adcH) / 1024.0;
+            if (pAdaptive)
+                sampleIntervalMs = pAdaptive->update(1, h);
+            if (humidity.filter(&h)) {
+                humidityVal = h;
+                publishHumidity();
+            }
+        }
+        if (adcP != 0x80000) {
+            double p = compensatePressure(adcP) / 25600.0;  // Pa * 256 -> hPa
+            if (pAdaptive)
+                sampleIntervalMs = pAdaptive->update(2, p);
+            if (pressure.filter(&p)) {
+                pressureVal = p;
+                publishPressure();
+            }
+        }
+#ifdef USE_SERIAL_DBG
+        Serial.println(temperatureVal);
+        Serial.println(humidityVal);
+        Serial.println(pressureVal);
+#endif
+    }
+
+    int32_t compensateTemperature(int32_t adcT) {
+        // returns 0.01 DegC, sets t_fine
+        int32_t var1, var2;
+        var1 = ((((adcT >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
+        var2 = (((((adcT >> 4) - ((int32_t)dig_T1)) * ((adcT >> 4) - ((int32_t)dig_T1))) >> 12) *
+                ((int32_t)dig_T3)) >>
+               14;
+        t_fine = var1 + var2;
+        return (t_fine * 5 + 128) >> 8;
+    }
+
+    uint32_t compensatePressure(int32_t adcP) {
+        // returns Pa as Q24.8
+        int64_t var1, var2, p;
+        var1 = ((int64_t)t_fine) - 128000;
+        var2 = var1 * var1 * (int64_t)dig_P6;
+        var2 = var2 + ((var1 * (int64_t)dig_P5) << 17);
+        var2 = var2 + (((int64_t)dig_P4) << 35);
+        var1 = ((var1 * var1 * (int64_t)dig_P3) >> 8) + ((var1 * (int64_t)dig_P2) << 12);
+        var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)dig_P1) >> 33;
+        if (var1 == 0)
+            return 0;  // avoid division by zero
+        p = 1048576 - adcP;
+        p = (((p << 31) - var2) * 3125) / var1;
+        var1 = (((int64_t)dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+        var2 = (((int64_t)dig_P8) * p) >> 19;
+        p = ((p + var1 + var2) >> 8) + (((int64_t)dig_P7) << 4);
+        return (uint32_t)p;
+    }
+
+    uint32_t compensateHumidity(int32_t adcH) {
+        // returns %RH as Q22.10
+        int32_t v = t_fine - ((int32_t)76800);
+        v = (((((adcH << 14) - (((int32_t)dig_H4) << 20) - (((int32_t)dig_H5) * v)) +
+               ((int32_t)16384)) >>
+              15) *
+             (((((((v * ((int32_t)dig_H6)) >> 10) *
+                  (((v * ((int32_t)dig_H3)) >> 11) + ((int32_t)32768))) >>
+                 10) +
+                ((int32_t)2097152)) *
+                   ((int32_t)dig_H2) +
+               8192) >>
+              14));
+        v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)dig_H1)) >> 4));
+        v = (v < 0 ? 0 : v);
+        v = (v > 419430400 ? 419430400 : v);
+        return (uint32_t)(v >> 12);
+    }
 };  // AirQuality
 
 }  // namespace ustd
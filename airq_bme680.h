@@ -4,8 +4,10 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 
 #include "sensors.h"
+#include "adaptive_poll.h"
 
 #include <Wire.h>
 #include <Adafruit_Sensor.h>
@@ -16,7 +18,7 @@
 namespace ustd {
 class AirQualityBme680 {
   public:
-    String AIRQUALITY_VERSION = "0.1.0";
+    static constexpr const char *AIRQUALITY_VERSION = "0.1.0";
     Scheduler *pSched;
     int tID;
     String name;
@@ -31,6 +33,7 @@ class AirQualityBme680 {
     ustd::sensorprocessor humidity = ustd::sensorprocessor(4, 30, 0.1);
     ustd::sensorprocessor pressure = ustd::sensorprocessor(4, 30, 0.01);
     Adafruit_BME680 *pAirQuality;
+    AdaptivePoll *pAdaptive = nullptr;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
@@ -58,7 +61,24 @@ class AirQualityBme680 {
         return kOhmsVal;
     }
 
+    void setAdaptivePolling(unsigned long minIntervalMs = 2000,
+                            unsigned long maxIntervalMs = 60000) {
+        /*! Sample fast while one of the values changes and slow down while it is stable
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs, 4);
+        pAdaptive->setEps(0, temperature.eps);
+        pAdaptive->setEps(1, humidity.eps);
+        pAdaptive->setEps(2, pressure.eps);
+        pAdaptive->setEps(3, kOhmsGas.eps);
+    }
+
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
         if (!pAirQuality->begin()) {
@@ -77,20 +97,21 @@ class AirQualityBme680 {
             bActive = true;
         }
 
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 2000000);  // every 2sec
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/#", fnall);
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                AIRQUALITY_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, AIRQUALITY_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Temperature", "\\u00B0C", "temperature", "mdi:thermometer");
         pHA->addSensor("humidity", "Humidity", "%", "humidity", "mdi:water-percent");
         pHA->addSensor("pressure", "Pressure", "hPa", "pressure", "mdi:altimeter");
@@ -157,6 +178,13 @@ class AirQualityBme680 {
                 h = pAirQuality->humidity;
                 p = pAirQuality->pressure / 100.0;
                 k = pAirQuality->gas_resistance / 1000.0;
+                if (pAdaptive) {
+                    pAdaptive->update(0, t);
+                    pAdaptive->update(1, h);
+                    pAdaptive->update(2, p);
+                    pAdaptive->update(3, k);
+                    pAdaptive->reschedule(pSched, tID);
+                }
                 if (temperature.filter(&t)) {
                     temperatureVal = t;
                     publishTemperature();
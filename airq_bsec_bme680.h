@@ -11,6 +11,7 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 
 #include "sensors.h"
 
@@ -18,6 +19,7 @@
 #include "bsec.h"  // taints license!
 
 #include "home_assistant.h"
+#include "sensor_snapshot.h"
 
 namespace ustd {
 
@@ -28,7 +30,7 @@ class AirQualityBsecBme680 {
      * The Mupplet publishes temperature, humidity, pressure, co2(-equivalent), voc(-equivalent)
      * and an air-quality index iaq (0[good]..500[bad])
      */
-    String AIRQUALITY_VERSION = "0.1.0";
+    static constexpr const char *AIRQUALITY_VERSION = "0.2.0";
     Scheduler *pSched;
     int tID;
     String name;
@@ -53,6 +55,8 @@ class AirQualityBsecBme680 {
     ustd::sensorprocessor vocSensor = ustd::sensorprocessor(4, 30, 0.01);
 
     Bsec *pAirQuality;
+    SensorSnapshot *pSnapshot = nullptr;
+    bool bStateRestored = false;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
@@ -68,6 +72,8 @@ class AirQualityBsecBme680 {
     }
 
     ~AirQualityBsecBme680() {
+        if (pSnapshot)
+            delete pSnapshot;
     }
 
     double getTemperature() {
@@ -160,6 +166,7 @@ class AirQualityBsecBme680 {
     };
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
         // wire = _wire;
 
@@ -176,6 +183,7 @@ class AirQualityBsecBme680 {
 #ifdef USE_SERIAL_DBG
             Serial.println("Found BME680");
 #endif
+            restoreState();
             pAirQuality->updateSubscription(sensorList, 10, BSEC_SAMPLE_RATE_LP);
             if (!checkIaqSensorStatus()) {
                 bActive = false;
@@ -190,20 +198,21 @@ class AirQualityBsecBme680 {
             bActive = false;
         }
 
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 3000000);  // 3 seconds timing required.
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/#", fnall);
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                AIRQUALITY_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, AIRQUALITY_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Temperature", "\\u00B0C", "temperature", "mdi:thermometer");
         pHA->addSensor("humidity", "Humidity", "%", "humidity", "mdi:water-percent");
         pHA->addSensor("pressure", "Pressure", "hPa", "pressure", "mdi:altimeter");
@@ -214,6 +223,34 @@ class AirQualityBsecBme680 {
     }
 #endif
 
+    void restoreState() {
+        /*! Restore the BSEC state saved by saveState(), the IAQ calibration continues
+         * instead of starting with accuracy 0 */
+        pSnapshot = new SensorSnapshot("/" + name + "_bsec.json", 3600, 86400);
+        uint8_t state[BSEC_MAX_STATE_BLOB_SIZE];
+        if (pSnapshot->restore(state, BSEC_MAX_STATE_BLOB_SIZE)) {
+            pAirQuality->setState(state);
+            bStateRestored = checkIaqSensorStatus();
+        }
+    }
+
+    void saveState(bool force = false) {
+        /*! Persist the BSEC state
+         *
+         * Called by loop() once the IAQ accuracy reached 3 (calibrated), with increasing
+         * intervals (1h .. 24h).
+         */
+        uint8_t state[BSEC_MAX_STATE_BLOB_SIZE];
+        pAirQuality->getState(state);
+        if (checkIaqSensorStatus())
+            pSnapshot->save(state, BSEC_MAX_STATE_BLOB_SIZE, force);
+    }
+
+    void publishSnapshot() {
+        if (pSnapshot)
+            pSched->publish(name + "/sensor/snapshot", pSnapshot->toJson());
+    }
+
     void publishRawTemperature() {
         if (bActive && !bStartup) {
             char buf[32];
@@ -372,6 +409,8 @@ class AirQualityBsecBme680 {
                     co2 = c;
                     publishCO2();
                 }
+                if (pAirQuality->iaqAccuracy >= 3 && pSnapshot->due())
+                    saveState();
 #ifdef USE_SERIAL_DBG
                 Serial.println(t);
                 Serial.println(h);
@@ -433,6 +472,13 @@ class AirQualityBsecBme680 {
         if (topic == name + "/sensor/co2/get") {
             publishCO2();
         }
+        if (topic == name + "/sensor/snapshot/get") {
+            publishSnapshot();
+        }
+        if (topic == name + "/sensor/snapshot/save") {
+            if (bActive && pSnapshot)
+                saveState(true);
+        }
     };
 };  // AirQuality
 
@@ -1,23 +1,55 @@
 // airq_ccs811.h
-// adapted from:
-// https://github.com/sparkfun/SparkFun_CCS811_Arduino_Library/blob/master/examples/BasicReadings/BasicReadings.ino
+// CCS811 CO2 and VOC sensor, register access as in the ams CCS811 datasheet
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "sensors.h"
 #include "home_assistant.h"
-
-#include "SparkFunCCS811.h"
+#include "i2c_bus.h"
+#include "sensor_snapshot.h"
 
 // Default I2C Address for
 // https://learn.sparkfun.com/tutorials/ccs811-air-quality-breakout-hookup-guide
 #define SPARKFUN_CCS811_ADDR 0x5B
 
 namespace ustd {
+
+#ifdef __ESP32__
+#define G_INT_ATTR IRAM_ATTR
+#else
+#ifdef __ESP__
+#define G_INT_ATTR ICACHE_RAM_ATTR
+#else
+#define G_INT_ATTR
+#endif
+#endif
+
+#define USTD_MAX_CCS811_IRQS (2)
+
+// set by falling edge of nINT (data ready), cleared when results are read
+volatile bool ustd_ccs811_data_ready[USTD_MAX_CCS811_IRQS] = {false, false};
+
+void G_INT_ATTR ustd_ccs811_irq0() {
+    ustd_ccs811_data_ready[0] = true;
+}
+void G_INT_ATTR ustd_ccs811_irq1() {
+    ustd_ccs811_data_ready[1] = true;
+}
+
+void (*ustd_ccs811_irq_table[USTD_MAX_CCS811_IRQS])() = {ustd_ccs811_irq0, ustd_ccs811_irq1};
+
 class AirQualityCCS811 {
+    /*! CO2 and VOC of a CCS811
+     *
+     * The sensor measures on its own (drive mode 2: every 10s). Results are read with short
+     * register transfers when the status register (polling) or nINT (interrupt) signals data
+     * ready, baseline and environment data are single register transfers as well.
+     */
   public:
-    String AIRQUALITY_VERSION = "0.1.0";
-    Scheduler *pSched;
+    static constexpr const char *AIRQUALITY_VERSION = "0.3.0";
+    enum MeasureState { IDLE, READING_STATUS, READING_RESULT };
+    Scheduler *pSched = nullptr;
     int tID;
     String name;
     uint8_t i2caddr;
@@ -33,18 +65,57 @@ class AirQualityCCS811 {
     ustd::sensorprocessor voc = ustd::sensorprocessor(4, 600, 0.4);
     float relHumid = -1.0;
     float temper = -99.0;
-    CCS811 *pAirQuality;
+    int8_t interruptIndex;
+    uint8_t interruptPort;
+    unsigned long measureIntervalMs = 10000;  // drive mode 2
+    unsigned long lastRead = 0;
+    // environmental compensation
+    unsigned long envIntervalMs = 60000;
+    float envTempEps = 0.5;
+    float envHumidEps = 2.0;
+    float envTemper = -99.0;  // values last written to the sensor
+    float envRelHumid = -1.0;
+    unsigned long lastEnvUpdate = 0;
+    bool envPending = false;
+    int envSubs[2] = {-1, -1};  // subscriptions of temperature and humidity
+    unsigned long reads = 0;
+    unsigned long missedInterrupts = 0;
+    unsigned long envUpdates = 0;
+    // baseline persistence
+    SensorSnapshot *pSnapshot = nullptr;
+    uint16_t restoredBaseline = 0;
+    bool bBaselineRestored = false;
+    bool baselineSavePending = false;  // save read queued, due() stays true until it ran
+    I2CClient i2c;
+    MeasureState state = MeasureState::IDLE;
+    unsigned long errors = 0;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
 
     AirQualityCCS811(String name, uint8_t i2caddr = SPARKFUN_CCS811_ADDR,
-                     String calibrationTopic = "")
-        : name(name), i2caddr(i2caddr), calibrationTopic(calibrationTopic) {
-        pAirQuality = new CCS811(i2caddr);
+                     String calibrationTopic = "", int8_t interruptIndex = -1,
+                     uint8_t interruptPort = 0)
+        : name(name), i2caddr(i2caddr), calibrationTopic(calibrationTopic),
+          interruptIndex(interruptIndex), interruptPort(interruptPort) {
+        /*! Instantiate a CCS811 CO2 and VOC sensor
+         *
+         * @param name Name of the mupplet, used for topics
+         * @param i2caddr I2C address of the sensor
+         * @param calibrationTopic Optional topic prefix, `<calibrationTopic>/temperature`
+         * and `<calibrationTopic>/humidity` are used for environmental compensation
+         * @param interruptIndex 0..USTD_MAX_CCS811_IRQS-1: read results when the
+         * sensor signals data ready on nINT, each sensor needs a different index.
+         * -1 (default): poll the sensor.
+         * @param interruptPort GPIO connected to nINT
+         */
+        if (interruptIndex >= USTD_MAX_CCS811_IRQS)
+            this->interruptIndex = -1;
     }
 
     ~AirQualityCCS811() {
+        if (pSnapshot)
+            delete pSnapshot;
     }
 
     double getCo2() {
@@ -55,71 +126,78 @@ class AirQualityCCS811 {
         return vocVal;
     }
 
-    void printDriverError(CCS811Core::CCS811_Status_e errorCode) {
-#ifdef USE_SERIAL_DBG
-        switch (errorCode) {
-        case CCS811Core::CCS811_Status_e::CCS811_Stat_SUCCESS:
-            Serial.print("SUCCESS");
-            break;
-        case CCS811Core::CCS811_Status_e::CCS811_Stat_ID_ERROR:
-            errmsg = "ID_ERROR";
-            Serial.print(errmsg);
-            break;
-        case CCS811Core::CCS811_Status_e::CCS811_Stat_I2C_ERROR:
-            errmsg = "I2C_ERROR (did you put WAK low? Required!) See code for more.";
-            Serial.println(errmsg);
-            Serial.println("You need a patch: "
-                           "https://github.com/sparkfun/"
-                           "SparkFun_CCS811_Arduino_Library/issues/6");
-            break;
-        case CCS811Core::CCS811_Status_e::CCS811_Stat_INTERNAL_ERROR:
-            errmsg = "INTERNAL_ERROR";
-            Serial.print(errmsg);
-            break;
-        case CCS811Core::CCS811_Status_e::CCS811_Stat_GENERIC_ERROR:
-            errmsg = "GENERIC_ERROR";
-            Serial.print(errmsg);
-            break;
-        default:
-            errmsg = "Unspecified error.";
-            Serial.print(errmsg);
-        }
-#endif
-    }
-
-    void begin(Scheduler *_pSched) {
+    void begin(Scheduler *_pSched, I2CBus *_pBus = nullptr) {
+        /*! Initialize sensor and start measurements
+         *
+         * @param _pSched Scheduler
+         * @param _pBus Optional shared I2C bus manager, measurements are then
+         * queued on the bus instead of accessing the sensor from the loop.
+         */
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
+        i2c.begin(name, i2caddr, _pBus);
 
-        CCS811Core::CCS811_Status_e returnCode = pAirQuality->beginWithStatus();
-        if (returnCode == CCS811Core::CCS811_Status_e::CCS811_Stat_SUCCESS) {
+        if (initSensor()) {
             bActive = true;
-            // Mode 0 = Idle
-            // Mode 1 = read every 1s
-            // Mode 2 = every 10s
-            // Mode 3 = every 60s
-            // Mode 4 = RAW mode
             startTime = time(NULL);
-            pAirQuality->setDriveMode(2);  // measure every 10 secs.
+            if (interruptIndex >= 0) {
+                ustd_ccs811_data_ready[interruptIndex] = false;
+                pinMode(interruptPort, INPUT_PULLUP);
+                attachInterrupt(digitalPinToInterrupt(interruptPort),
+                                ustd_ccs811_irq_table[interruptIndex], FALLING);
+            }
         } else {
-            printDriverError(returnCode);
+#ifdef USE_SERIAL_DBG
+            Serial.println(errmsg);
+#endif
         }
 
-        auto ft = [=]() { this->loop(); };
-        tID = pSched->add(ft, name, 12000000);  // every 12sec
+        // the saved baseline is written to the sensor with the first valid measurement
+        pSnapshot = new SensorSnapshot("/" + name + "_baseline.json", 3600, 86400);
+        uint8_t data[2];
+        if (pSnapshot->restore(data, 2)) {
+            restoredBaseline = (uint16_t)(data[0] << 8 | data[1]);
+            bBaselineRestored = true;
+        }
+
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        if (interruptIndex >= 0)
+            tID = pSched->add(ft, name, 100000);  // check data ready every 100ms
+        else
+            tID = pSched->add(ft, name, 12000000);  // every 12sec
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/#", fnall);
-        if (calibrationTopic != "")
-            pSched->subscribe(tID, calibrationTopic + "/#", fnall);
+        subscribeEnvironment();
+    }
+
+    void attachEnvironmentSource(String sourceName, unsigned long minIntervalMs = 60000) {
+        /*! Use temperature and humidity of another mupplet for environmental compensation
+         *
+         * Subscribes to `<sourceName>/sensor/temperature` and `<sourceName>/sensor/humidity`,
+         * e.g. of an AirQualityBme280 or Dht mupplet. New values are written to the sensor at
+         * most every minIntervalMs, and only if they changed by more than envTempEps (°C)
+         * or envHumidEps (%).
+         *
+         * Can be called before or after begin(), a new source replaces the previous one.
+         *
+         * @param sourceName Name of the mupplet that publishes temperature and humidity
+         * @param minIntervalMs Minimum time between two updates of the sensor
+         */
+        calibrationTopic = sourceName + "/sensor";
+        envIntervalMs = minIntervalMs;
+        if (pSched)
+            subscribeEnvironment();  // otherwise done by begin()
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                AIRQUALITY_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, AIRQUALITY_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("co2", "CO2", "ppm", "None", "mdi:air-filter");
         pHA->addSensor("voc", "VOC", "ppb", "None", "mdi:air-filter");
         pHA->begin(pSched);
@@ -147,7 +225,7 @@ class AirQualityCCS811 {
     void publishBaseline() {
         char buf[32];
         if (bActive && !bStartup) {
-            sprintf(buf, "%5d", pAirQuality->getBaseline());
+            sprintf(buf, "%5d", baseline);
         } else {
             if (!bStartup)
                 sprintf(buf, errmsg.c_str());
@@ -159,9 +237,14 @@ class AirQualityCCS811 {
 
     void storeBaseline(uint16_t newBase) {
         if (bActive) {
-            pAirQuality->setBaseline(newBase);
-            publishBaseline();
-            publishCalibration();
+            uint8_t buf[3] = {regBaseline, (uint8_t)(newBase >> 8), (uint8_t)(newBase & 0xff)};
+            i2c.transfer(buf, 3, 0, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                if (st != I2CPort::OK)
+                    return;
+                baseline = newBase;
+                this->publishBaseline();
+                this->publishCalibration();
+            });
         }
     }
 
@@ -169,37 +252,28 @@ class AirQualityCCS811 {
         if (startTime < 100000)
             startTime = time(NULL);  // NTP data available.
         if (bActive) {
-            if (pAirQuality->dataAvailable()) {
-                double c, v;
-#ifdef USE_SERIAL_DBG
-                Serial.println("AirQuality sensor data available");
-#endif
-                pAirQuality->readAlgorithmResults();
-                c = pAirQuality->getCO2();
-                v = pAirQuality->getTVOC();
-                if (bStartup) {
-                    if (c < 350.0)
-                        return;  // invalid.
-                    bStartup = false;
-                }
-#ifdef USE_SERIAL_DBG
-                Serial.print("AirQuality sensor data available, co2: ");
-                Serial.print(c);
-                Serial.print(" voc: ");
-                Serial.println(v);
-#endif
-                if (co2.filter(&c)) {
-                    co2Val = c;
-                    publishCO2();
-                }
-                if (voc.filter(&v)) {
-                    vocVal = v;
-                    publishVOC();
-                }
-            } else {
-#ifdef USE_SERIAL_DBG
-                Serial.println("AirQuality sensor no data available");
-#endif
+            if (state != MeasureState::IDLE) {
+                // waiting for bus
+            } else if (interruptIndex < 0) {
+                readStatus();
+            } else if (ustd_ccs811_data_ready[interruptIndex]) {
+                // nINT is released by reading the results, the flag is set again on failure
+                ustd_ccs811_data_ready[interruptIndex] = false;
+                readResult();
+            } else if (timeDiff(lastRead, millis()) > 3 * measureIntervalMs) {
+                // nINT stays low until the results are read, a missed edge would stop all
+                // further interrupts.
+                ++missedInterrupts;
+                lastRead = millis();
+                readStatus();
+            }
+            if (!bStartup && !baselineSavePending && pSnapshot->due())
+                saveBaseline();
+            if (envPending && (lastEnvUpdate == 0 ||
+                               timeDiff(lastEnvUpdate, millis()) >= envIntervalMs)) {
+                envPending = false;
+                lastEnvUpdate = millis();
+                applyEnvironment();
             }
         } else {
 #ifdef USE_SERIAL_DBG
@@ -211,9 +285,52 @@ class AirQualityCCS811 {
         }
     }
 
+    void saveBaseline(bool force = false) {
+        /*! Persist the current baseline of the sensor
+         *
+         * Called periodically by loop() with increasing intervals (1h .. 24h), so that
+         * the baseline survives a restart and the sensor doesn't have to recalibrate.
+         */
+        baselineSavePending = true;
+        bool queued = i2c.readRegisters(regBaseline, 2, [=](uint8_t st, const uint8_t *data,
+                                                             uint8_t len) {
+            baselineSavePending = false;
+            if (st != I2CPort::OK)
+                return;
+            baseline = (uint16_t)(data[0] << 8 | data[1]);
+            uint8_t snap[2] = {data[0], data[1]};
+            pSnapshot->save(snap, 2, force);
+        });
+        if (!queued)
+            baselineSavePending = false;
+    }
+
+    void publishSnapshot() {
+        pSched->publish(name + "/sensor/snapshot", pSnapshot->toJson());
+    }
+
+    void readBaseline(bool calibration) {
+        /*! Read the baseline from the sensor, then publish it or the calibration */
+        if (!bActive || bStartup) {
+            if (calibration)
+                publishCalibration();
+            else
+                publishBaseline();
+            return;
+        }
+        i2c.readRegisters(regBaseline, 2, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK)
+                return;
+            baseline = (uint16_t)(data[0] << 8 | data[1]);
+            if (calibration)
+                this->publishCalibration();
+            else
+                this->publishBaseline();
+        });
+    }
+
     void publishCalibration() {
         if (bActive && !bStartup) {
-            baseline = pAirQuality->getBaseline();
             char msg[192];
             if (startTime < 100000)
                 startTime = time(NULL);  // NTP is now available.
@@ -227,14 +344,53 @@ class AirQualityCCS811 {
     }
 
     void calibrate() {
+        /*! Schedule environmental compensation with the current temperature and humidity
+         *
+         * The sensor is only updated if the values changed significantly, and at most
+         * every envIntervalMs, the update is done by loop().
+         */
         if (relHumid != -1.0 && temper != -99.0 && bActive && !bStartup) {
-            pAirQuality->setEnvironmentalData(relHumid, temper);
-            publishCalibration();
-            publishCO2();
-            publishVOC();
+            if (fabs(temper - envTemper) >= envTempEps ||
+                fabs(relHumid - envRelHumid) >= envHumidEps)
+                envPending = true;
         }
     }
 
+    void applyEnvironment() {
+        float h = relHumid;
+        float t = temper;
+        // humidity in %, temperature + 25 in °C, both with 9 fractional bits, big endian
+        float hc = h < 0.0 ? 0.0 : (h > 100.0 ? 100.0 : h);
+        float tc = t < -25.0 ? 0.0 : (t > 75.0 ? 100.0 : t + 25.0);
+        uint16_t hr = (uint16_t)(hc * 512.0 + 0.5);
+        uint16_t tr = (uint16_t)(tc * 512.0 + 0.5);
+        uint8_t buf[5] = {regEnvData, (uint8_t)(hr >> 8), (uint8_t)(hr & 0xff),
+                          (uint8_t)(tr >> 8), (uint8_t)(tr & 0xff)};
+        i2c.transfer(buf, 5, 0, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK)
+                return;
+            envRelHumid = h;
+            envTemper = t;
+            ++envUpdates;
+            this->readBaseline(true);
+        });
+    }
+
+    void subscribeEnvironment() {
+        for (uint8_t i = 0; i < 2; i++) {
+            if (envSubs[i] != -1)
+                pSched->unsubscribe(envSubs[i]);
+            envSubs[i] = -1;
+        }
+        if (calibrationTopic == "")
+            return;
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+            this->subsMsg(topic, msg, originator);
+        });
+        envSubs[0] = pSched->subscribe(tID, calibrationTopic + "/temperature", fnall);
+        envSubs[1] = pSched->subscribe(tID, calibrationTopic + "/humidity", fnall);
+    }
+
     void subsMsg(String topic, String msg, String originator) {
         if (topic == name + "/sensor/co2/get") {
             publishCO2();
@@ -243,14 +399,21 @@ class AirQualityCCS811 {
             publishVOC();
         }
         if (topic == name + "/sensor/calibration/get") {
-            publishCalibration();
+            readBaseline(true);
         }
         if (topic == name + "/sensor/baseline/get") {
-            publishBaseline();
+            readBaseline(false);
         }
         if (topic == name + "/sensor/baseline/set") {
             storeBaseline(atoi(msg.c_str()));
         }
+        if (topic == name + "/sensor/snapshot/get") {
+            publishSnapshot();
+        }
+        if (topic == name + "/sensor/snapshot/save") {
+            if (bActive && !bStartup)
+                saveBaseline(true);
+        }
         if (topic == calibrationTopic + "/temperature") {
             temper = atof(msg.c_str());
             calibrate();
@@ -260,6 +423,116 @@ class AirQualityCCS811 {
             calibrate();
         }
     };
+
+  private:
+    static const uint8_t regStatus = 0x00;
+    static const uint8_t regMeasMode = 0x01;
+    static const uint8_t regAlgResult = 0x02;
+    static const uint8_t regEnvData = 0x05;
+    static const uint8_t regBaseline = 0x11;
+    static const uint8_t regHwId = 0x20;
+    static const uint8_t regAppStart = 0xF4;
+    static const uint8_t regSwReset = 0xFF;
+    static const uint8_t statusError = 0x01;
+    static const uint8_t statusDataReady = 0x08;
+    static const uint8_t statusAppValid = 0x10;
+    static const uint8_t statusFwMode = 0x80;
+
+    bool initSensor() {
+        // reset, check id, start the application firmware and set drive mode 2 (every 10s)
+        const uint8_t reset[5] = {regSwReset, 0x11, 0xE5, 0x72, 0x8A};
+        uint8_t b = 0;
+        i2c.writeNow(reset, 5);
+        delay(20);
+        if (i2c.readNow(regHwId, &b, 1) != I2CPort::OK || b != 0x81) {
+            errmsg = "ID_ERROR";
+            return false;
+        }
+        if (i2c.readNow(regStatus, &b, 1) != I2CPort::OK || !(b & statusAppValid)) {
+            errmsg = "No valid application firmware";
+            return false;
+        }
+        const uint8_t appStart[1] = {regAppStart};
+        i2c.writeNow(appStart, 1);
+        delay(1);
+        if (i2c.readNow(regStatus, &b, 1) != I2CPort::OK || !(b & statusFwMode) ||
+            (b & statusError)) {
+            errmsg = "Application start failed (did you put WAK low? Required!)";
+            return false;
+        }
+        const uint8_t mode[2] = {regMeasMode,
+                                 (uint8_t)(2 << 4 | (interruptIndex >= 0 ? 0x08 : 0))};
+        if (i2c.writeNow(mode, 2) != I2CPort::OK) {
+            errmsg = "I2C_ERROR";
+            return false;
+        }
+        return true;
+    }
+
+    void readStatus() {
+        state = MeasureState::READING_STATUS;
+        i2c.readRegisters(regStatus, 1, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK || (data[0] & statusError)) {
+                this->onError();
+                return;
+            }
+            if (data[0] & statusDataReady) {
+                this->readResult();
+            } else {
+                state = MeasureState::IDLE;
+#ifdef USE_SERIAL_DBG
+                Serial.println("AirQuality sensor no data available");
+#endif
+            }
+        });
+    }
+
+    void readResult() {
+        state = MeasureState::READING_RESULT;
+        i2c.readRegisters(regAlgResult, 4, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK) {
+                if (interruptIndex >= 0)
+                    ustd_ccs811_data_ready[interruptIndex] = true;  // retry
+                this->onError();
+                return;
+            }
+            state = MeasureState::IDLE;
+            this->onResult((uint16_t)(data[0] << 8 | data[1]), (uint16_t)(data[2] << 8 | data[3]));
+        });
+    }
+
+    void onError() {
+        ++errors;
+        state = MeasureState::IDLE;
+    }
+
+    void onResult(double c, double v) {
+        lastRead = millis();
+        ++reads;
+        if (bStartup) {
+            if (c < 350.0)
+                return;  // invalid.
+            bStartup = false;
+            if (bBaselineRestored) {
+                bBaselineRestored = false;
+                storeBaseline(restoredBaseline);
+            }
+        }
+#ifdef USE_SERIAL_DBG
+        Serial.print("AirQuality sensor data available, co2: ");
+        Serial.print(c);
+        Serial.print(" voc: ");
+        Serial.println(v);
+#endif
+        if (co2.filter(&c)) {
+            co2Val = c;
+            publishCO2();
+        }
+        if (voc.filter(&v)) {
+            vocVal = v;
+            publishVOC();
+        }
+    }
 };  // AirQualityCCS811
 
 }  // namespace ustd
@@ -0,0 +1,349 @@
+// binding.h
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_stats.h"
+#include "mup_util.h"
+
+namespace ustd {
+
+#define USTD_MAX_BINDING_MAP (4)
+
+class Binding {
+    /*! Local rules that connect mupplets without MQTT broker
+     *
+     * A rule maps messages of a source topic to a target topic (or a C++ action), optionally
+     * through a transform:
+     *
+     *     <source> -> <target> [<transform> <args>]
+     *
+     * | transform | args | output
+     * | --------- | ---- | ------
+     * | (none) | | message unchanged
+     * | `scale` | `<in0>,<in1>,<out0>,<out1>` | value mapped linearly, clamped to [out0, out1]
+     * | `threshold` | `<t>[ <below>,<above>]` | `on` if value >= t, else `off`, only on change
+     * | `hysteresis` | `<low>,<high>[ <below>,<above>]` | `on` above high, `off` below low, only
+     * on change
+     * | `map` | `<in>=<out>[,<in>=<out>...]` | message replaced, other messages ignored
+     *
+     * Values are parsed with atof(), `on` and `true` are 1, `off` and `false` are 0. Rules are
+     * compiled by addRule() into a table; begin() subscribes each distinct source topic once
+     * and chains all rules of that source, so a message is dispatched without topic compare
+     * or string reformatting (except the number output of `scale`).
+     *
+     * A rule whose target reaches its own source again (directly, through a wildcard source or
+     * through other rules) would loop forever. begin() checks the rules in the order they were
+     * added with mqttmatch() and rejects each rule that would close such a cycle; rejected rules
+     * are not subscribed and are reported as `"rejected":true` in `<name>/binding/rules`.
+     */
+  public:
+    static constexpr const char *BINDING_VERSION = "0.1.0";
+    enum Transform { PASS, SCALE, THRESHOLD, HYSTERESIS, MAP };
+    typedef std::function<void(const char *msg)> T_ACTION;
+    typedef struct {
+        String text;   // rule as given
+        char *tokens;  // tokenized copy of text, the pointers below point into it
+        const char *source;
+        const char *target;
+        T_ACTION action;
+        Transform transform;
+        double param[4];
+        const char *out[2];  // below, above
+        const char *mapIn[USTD_MAX_BINDING_MAP];
+        const char *mapOut[USTD_MAX_BINDING_MAP];
+        uint8_t mapCount;
+        int8_t lastOut;  // index into out, -1: none yet
+        int16_t next;    // next rule with same source, -1: last
+        bool rejected;   // closes a cycle
+        bool visited;    // cycle check
+        unsigned long hits;
+    } T_RULE;
+
+    Scheduler *pSched;
+    int tID;
+    String name;
+    ustd::array<T_RULE *> rules;
+
+    Binding(String name) : name(name) {
+        /*! Instantiate a rule set
+         *
+         * @param name Name, used for topics `<name>/binding/...`
+         */
+    }
+
+    ~Binding() {
+        for (unsigned i = 0; i < rules.length(); i++) {
+            free(rules[i]->tokens);
+            delete rules[i];
+        }
+    }
+
+    bool addRule(const char *rule) {
+        /*! Compile `<source> -> <target> [<transform> <args>]`, before begin()
+         *
+         * @return false if the rule is invalid
+         */
+        return compile(rule, nullptr);
+    }
+
+    bool addRule(const char *rule, T_ACTION action) {
+        /*! Compile `<source> [<transform> <args>]` with a C++ action as target, before begin()
+         *
+         * The action is called with the transformed message from the scheduler's message
+         * dispatch.
+         *
+         * @return false if the rule is invalid
+         */
+        return compile(rule, action);
+    }
+
+#ifdef __ESP__
+    int loadRules(String filename) {
+        /*! Compile the rules of a json file `{"rules":["<rule>",...]}`
+         *
+         * @return Number of valid rules
+         */
+        String content;
+        if (!readJson(filename, content))
+            return 0;
+        JSONVar obj = JSON.parse(content);
+        if (JSON.typeof(obj) == "undefined" || !obj.hasOwnProperty("rules"))
+            return 0;
+        int count = 0;
+        for (int i = 0; i < obj["rules"].length(); i++) {
+            if (addRule((const char *)obj["rules"][i]))
+                ++count;
+        }
+        return count;
+    }
+#endif
+
+    void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+        tID = pSched->add([]() {}, name, 0xffffffff);  // message dispatch only
+
+        for (unsigned i = 0; i < rules.length(); i++) {
+            rules[i]->rejected = closesCycle(i);
+            if (rules[i]->rejected)
+                continue;
+            unsigned first = i;
+            for (unsigned j = 0; j < i; j++) {
+                if (!rules[j]->rejected && !strcmp(rules[j]->source, rules[i]->source)) {
+                    first = j;
+                    break;
+                }
+            }
+            if (first == i) {
+                auto fnsrc = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+                    this->dispatch(i, msg);
+                });
+                pSched->subscribe(tID, rules[i]->source, fnsrc);
+            } else {
+                unsigned last = first;
+                while (rules[last]->next != -1)
+                    last = rules[last]->next;
+                rules[last]->next = i;
+            }
+        }
+
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+            this->subsMsg(topic, msg, originator);
+        });
+        pSched->subscribe(tID, name + "/binding/#", fnall);
+    }
+
+    void publishRules() {
+        String json = "[";
+        for (unsigned i = 0; i < rules.length(); i++) {
+            json += (i ? ",{\"rule\":\"" : "{\"rule\":\"") + rules[i]->text + "\",\"hits\":" +
+                    String(rules[i]->hits) + (rules[i]->rejected ? ",\"rejected\":true}" : "}");
+        }
+        pSched->publish(name + "/binding/rules", json + "]");
+    }
+
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == name + "/binding/rules/get") {
+            publishRules();
+        }
+    }
+
+  private:
+    static double parseValue(const char *msg) {
+        if (!strcmp(msg, "on") || !strcmp(msg, "true"))
+            return 1.0;
+        if (!strcmp(msg, "off") || !strcmp(msg, "false"))
+            return 0.0;
+        return atof(msg);
+    }
+
+    static uint8_t parseNumbers(char *args, double *values, uint8_t maxValues) {
+        uint8_t n = 0;
+        for (char *p = strtok(args, ","); p && n < maxValues; p = strtok(nullptr, ","))
+            values[n++] = atof(p);
+        return n;
+    }
+
+    static bool parseOutputs(char *args, T_RULE *pRule) {
+        if (!args)
+            return true;
+        char *comma = strchr(args, ',');
+        if (!comma)
+            return false;
+        *comma = 0;
+        pRule->out[0] = args;
+        pRule->out[1] = comma + 1;
+        return true;
+    }
+
+    bool compile(const char *rule, T_ACTION action) {
+        T_RULE *pRule = new T_RULE();
+        pRule->text = rule;
+        pRule->tokens = strdup(rule);
+        pRule->action = action;
+        pRule->transform = PASS;
+        pRule->out[0] = "off";
+        pRule->out[1] = "on";
+        pRule->mapCount = 0;
+        pRule->lastOut = -1;
+        pRule->next = -1;
+        pRule->rejected = false;
+        pRule->hits = 0;
+
+        char *tok[6] = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+        uint8_t n = 0;
+        for (char *p = strtok(pRule->tokens, " "); p && n < 6; p = strtok(nullptr, " "))
+            tok[n++] = p;
+        uint8_t t = 1;  // first transform token
+        pRule->source = tok[0];
+        pRule->target = nullptr;
+        if (!action) {
+            if (n < 3 || strcmp(tok[1], "->") || !strcmp(tok[0], tok[2])) {
+                free(pRule->tokens);
+                delete pRule;
+                return false;  // no target, or a loop
+            }
+            pRule->target = tok[2];
+            t = 3;
+        }
+        bool valid = (n >= 1);
+        if (valid && t < n) {
+            char *args = tok[t + 1];
+            if (!strcmp(tok[t], "scale")) {
+                pRule->transform = SCALE;
+                // |out| < 1e15: the formatted output fits the dispatch buffer
+                valid = args && parseNumbers(args, pRule->param, 4) == 4 &&
+                        pRule->param[0] != pRule->param[1] && fabs(pRule->param[2]) < 1e15 &&
+                        fabs(pRule->param[3]) < 1e15;
+            } else if (!strcmp(tok[t], "threshold")) {
+                pRule->transform = THRESHOLD;
+                valid = args && parseNumbers(args, pRule->param, 1) == 1 &&
+                        parseOutputs(tok[t + 2], pRule);
+            } else if (!strcmp(tok[t], "hysteresis")) {
+                pRule->transform = HYSTERESIS;
+                valid = args && parseNumbers(args, pRule->param, 2) == 2 &&
+                        pRule->param[0] <= pRule->param[1] && parseOutputs(tok[t + 2], pRule);
+            } else if (!strcmp(tok[t], "map")) {
+                pRule->transform = MAP;
+                char *p = args ? strtok(args, ",") : nullptr;
+                for (; p && pRule->mapCount < USTD_MAX_BINDING_MAP; p = strtok(nullptr, ",")) {
+                    char *eq = strchr(p, '=');
+                    if (!eq)
+                        continue;
+                    *eq = 0;
+                    pRule->mapIn[pRule->mapCount] = p;
+                    pRule->mapOut[pRule->mapCount++] = eq + 1;
+                }
+                valid = pRule->mapCount > 0;
+            } else {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            free(pRule->tokens);
+            delete pRule;
+            return false;
+        }
+        rules.add(pRule);
+        return true;
+    }
+
+    bool reaches(unsigned from, unsigned to, unsigned limit) {
+        /*! True if messages of rule from arrive at rule to, through rules [0, limit] not rejected */
+        if (!rules[from]->target || rules[from]->visited)
+            return false;
+        rules[from]->visited = true;
+        for (unsigned j = 0; j <= limit; j++) {
+            if (rules[j]->rejected || !pSched->mqttmatch(rules[from]->target, rules[j]->source))
+                continue;
+            if (j == to || reaches(j, to, limit))
+                return true;
+        }
+        return false;
+    }
+
+    bool closesCycle(unsigned index) {
+        /*! True if rule index, added to the accepted rules before it, forms a cycle */
+        for (unsigned j = 0; j <= index; j++)
+            rules[j]->visited = false;
+        return reaches(index, index, index);
+    }
+
+    void emit(T_RULE *pRule, const char *msg) {
+        if (pRule->action)
+            pRule->action(msg);
+        else
+            pSched->publish(pRule->target, msg);
+    }
+
+    void emitOutput(T_RULE *pRule, int8_t out) {
+        if (out != pRule->lastOut) {
+            pRule->lastOut = out;
+            emit(pRule, pRule->out[out]);
+        }
+    }
+
+    void dispatch(int16_t index, String &msg) {
+        const char *m = msg.c_str();
+        for (int16_t i = index; i != -1; i = rules[i]->next) {
+            T_RULE *pRule = rules[i];
+            ++pRule->hits;
+            switch (pRule->transform) {
+            case PASS:
+                emit(pRule, m);
+                break;
+            case SCALE: {
+                const double *p = pRule->param;
+                double v = p[2] + (parseValue(m) - p[0]) * (p[3] - p[2]) / (p[1] - p[0]);
+                double lo = p[2] < p[3] ? p[2] : p[3];
+                double hi = p[2] < p[3] ? p[3] : p[2];
+                char buf[24];
+                snprintf(buf, sizeof(buf), "%.3f", v < lo ? lo : (v > hi ? hi : v));
+                emit(pRule, buf);
+                break;
+            }
+            case THRESHOLD:
+                emitOutput(pRule, parseValue(m) >= pRule->param[0] ? 1 : 0);
+                break;
+            case HYSTERESIS: {
+                double v = parseValue(m);
+                if (v > pRule->param[1])
+                    emitOutput(pRule, 1);
+                else if (v < pRule->param[0])
+                    emitOutput(pRule, 0);
+                break;
+            }
+            case MAP:
+                for (uint8_t j = 0; j < pRule->mapCount; j++) {
+                    if (!strcmp(m, pRule->mapIn[j])) {
+                        emit(pRule, pRule->mapOut[j]);
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+};  // Binding
+
+}  // namespace ustd
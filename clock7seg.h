@@ -11,12 +11,20 @@
 #include <Adafruit_LEDBackpack.h>
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "i2c_bus.h"
 
 // Seven segment display default i2c address:
 #define DISPLAY_ADDRESS 0x70
 
 namespace ustd {
 class Clock7Seg {
+    /*! HT16K33 seven segment clock
+     *
+     * Adafruit_7segment is only used to format the display buffer. Changes of the display
+     * and brightness are marked dirty and sent by the task as short register writes (display
+     * RAM in chunks), a failed write is repeated with the next tick.
+     */
   public:
     Scheduler *pSched;
     int tID;
@@ -25,6 +33,10 @@ class Clock7Seg {
     uint8_t buzzerPin;
     bool bStarted = false;
     Adafruit_7segment *pClockDisplay;
+    I2CClient i2c;
+    bool displayDirty = false;
+    bool brightnessDirty = false;
+    uint8_t brightness = 15;
     unsigned long timerCounter = 0;
     int maxAlarmDuration = 60;
     time_t timerStart = 0;
@@ -61,7 +73,17 @@ class Clock7Seg {
         pClockDisplay->writeDigitNum(3, d2);
         pClockDisplay->writeDigitNum(4, d3);
         pClockDisplay->drawColon(dots & 0x1);
-        pClockDisplay->writeDisplay();
+        displayDirty = true;  // sent by flush()
+    }
+
+    void flush() {
+        /*! Send changed display buffer and brightness, unless a previous update is still queued */
+        if (i2c.isPending())
+            return;
+        if (displayDirty)
+            sendDisplay();
+        if (brightnessDirty)
+            sendBrightness();
     }
 
     time_t old_now = -1;
@@ -120,7 +142,10 @@ class Clock7Seg {
         if (brL > 1.0)
             brL = 1.0;
         int iBr = (int)(brL * 15.0);
-        pClockDisplay->setBrightness(iBr);  // Brightness [0..15]
+        if (iBr != brightness) {
+            brightness = iBr;
+            brightnessDirty = true;  // sent by flush()
+        }
         if (oldIBr != iBr) {
             oldIBr = iBr;
             String sbr = String(iBr);
@@ -128,8 +153,16 @@ class Clock7Seg {
         }
     }
 
-    void begin(Scheduler *_pSched) {
+    void begin(Scheduler *_pSched, I2CBus *_pBus = nullptr) {
+        /*! Initialize display and start clock
+         *
+         * @param _pSched Scheduler
+         * @param _pBus Optional shared I2C bus manager, display updates are then
+         * queued on the bus.
+         */
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
+        i2c.begin(name, i2cAddress, _pBus);
 
         pClockDisplay = new Adafruit_7segment();
 
@@ -141,13 +174,13 @@ class Clock7Seg {
         }
         alarmStart = 0;
         /* std::function<void()> */
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 50000);
 
         /* std::function<void(String, String, String)> */
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/#", fnall);
         if (bAutobrightness) {
             if (brightnessTopic != "")
@@ -159,6 +192,7 @@ class Clock7Seg {
     void loop() {
         if (bStarted) {
             displayTime();
+            flush();
         }
     }
 
@@ -207,5 +241,36 @@ class Clock7Seg {
             }
         }
     }
+
+  private:
+    void sendDisplay() {
+        // display RAM 0..15 (low and high byte of the 8 rows), in chunks of the bus write size
+        uint8_t ram[16];
+        for (uint8_t i = 0; i < 8; i++) {
+            ram[2 * i] = (uint8_t)(pClockDisplay->displaybuffer[i] & 0xff);
+            ram[2 * i + 1] = (uint8_t)(pClockDisplay->displaybuffer[i] >> 8);
+        }
+        displayDirty = false;
+        const uint8_t chunk = I2CBus::maxWrite - 1;
+        for (uint8_t addr = 0; addr < 16; addr += chunk) {
+            uint8_t n = 16 - addr < chunk ? 16 - addr : chunk;
+            uint8_t buf[I2CBus::maxWrite];
+            buf[0] = addr;  // display RAM address
+            memcpy(buf + 1, ram + addr, n);
+            i2c.transfer(buf, n + 1, 0, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                if (st != I2CPort::OK)
+                    displayDirty = true;
+            });
+        }
+    }
+
+    void sendBrightness() {  // Brightness [0..15]
+        uint8_t cmd[1] = {(uint8_t)(HT16K33_CMD_BRIGHTNESS | brightness)};
+        brightnessDirty = false;
+        i2c.transfer(cmd, 1, 0, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK)
+                brightnessDirty = true;
+        });
+    }
 };
 };  // namespace ustd
@@ -11,6 +11,7 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 //#include "home_assistant.h"
 
 namespace ustd {
@@ -124,7 +125,7 @@ void (*ustd_dcc_timer_irq_table[USTD_MAX_DCC_TIMERS])() = {
 class Dcc {
   public:
     enum Mode { DCC, HBRIDGE, DC };
-    String DCC_VERSION = "0.1.0";
+    static constexpr const char *DCC_VERSION = "0.1.0";
     Scheduler *pSched;
     int tID;
     int pwmrange;
@@ -159,6 +160,7 @@ class Dcc {
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
         digitalWrite(pin_pwm, false);
@@ -205,12 +207,12 @@ class Dcc {
             break;
         }
 
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 1000000);
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/dcc/#", fnall);
     }
 
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "mup_util.h"
 #include "home_assistant.h"
 
@@ -9,7 +10,7 @@ namespace ustd {
 
 class DigitalOut {
   public:
-    String DIGITALOUT_VERSION = "0.1.0";
+    static constexpr const char *DIGITALOUT_VERSION = "0.1.0";
     Scheduler *pSched;
     int tID;
     String name;
@@ -29,23 +30,25 @@ class DigitalOut {
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
         pinMode(port, OUTPUT);
 
         setOff();
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 50000);
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/switch/#", fnall);
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                DIGITALOUT_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, DIGITALOUT_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSwitch();
         pHA->begin(pSched);
     }
@@ -0,0 +1,272 @@
+// digital_out_group.h
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_stats.h"
+#include "digital_out.h"
+
+namespace ustd {
+
+#define USTD_MAX_GROUP_OUTPUTS (32)
+#define USTD_MAX_GROUP_SCENES (8)
+#define USTD_GROUP_WORDS (2)  // 32 bit output words, GPIO 0..63
+
+class DigitalOutGroup {
+    /*! Switch several DigitalOut at once
+     *
+     * A change of the group is compiled into the GPIO levels it sets: for each 32 bit output
+     * word, a mask of lines to set high and a mask of lines to set low, separately for the
+     * outputs switched off and the outputs switched on. These are written with the set and clear
+     * registers of the GPIO port (ESP32, ESP8266 GPIO 0..15) without read-modify-write, so the
+     * time does not depend on the number of outputs. Scenes are compiled by addScene(),
+     * switching a scene writes the precomputed masks.
+     *
+     * The outputs don't switch at the same instant. The guarantee is:
+     * - Break before make: all outputs switched off change before any output switched on.
+     * - Within each of these two steps, the lines of one 32 bit word that go to the same level
+     *   change with one register write, clear (low) before set (high).
+     * - A change that touches both levels in both words takes up to 8 consecutive register
+     *   writes on ESP32 (GPIO 0..31 and 32..39) and 4 on ESP8266. Masks without lines are
+     *   skipped.
+     * - ESP8266 GPIO16 and other platforms use one digitalWrite() per line, in the same order.
+     *
+     * After a change, one combined message `<group-name>/outputgroup/state` is published instead
+     * of a `<name>/switch/state` per output. The state of the DigitalOut is updated, they can
+     * still be started with their own begin() to be switched individually, too.
+     */
+  public:
+    static constexpr const char *DIGITALOUT_GROUP_VERSION = "0.1.0";
+    typedef struct {
+        uint32_t high[2][USTD_GROUP_WORDS];  // lines set to high level, [0]: off, [1]: on
+        uint32_t low[2][USTD_GROUP_WORDS];   // lines set to low level, [0]: off, [1]: on
+        uint32_t mask;                       // bit n: output n is switched
+        uint32_t on;                         // bit n: output n is switched on
+    } T_CHANGE;
+    typedef struct {
+        String name;
+        T_CHANGE change;
+    } T_SCENE;
+
+    Scheduler *pSched;
+    int tID;
+    String name;
+    DigitalOut *outputs[USTD_MAX_GROUP_OUTPUTS];
+    uint8_t outputCount = 0;
+    T_SCENE scenes[USTD_MAX_GROUP_SCENES];
+    uint8_t sceneCount = 0;
+    uint32_t state = 0;  // bit n: output n is on
+    int8_t scene = -1;   // last scene, -1: none or changed since
+
+    DigitalOutGroup(String name) : name(name) {
+        /*! Instantiate an output group
+         *
+         * @param name Name of the group, used for topics `<name>/outputgroup/...`
+         */
+    }
+
+    ~DigitalOutGroup() {
+    }
+
+    bool add(DigitalOut *pOut) {
+        /*! Add an output, before begin()
+         *
+         * @param pOut DigitalOut, its port must be < 64
+         * @return false if the group is full or the port is not usable
+         */
+        if (outputCount == USTD_MAX_GROUP_OUTPUTS || pOut->port >= USTD_GROUP_WORDS * 32)
+            return false;
+        outputs[outputCount++] = pOut;
+        return true;
+    }
+
+    bool addScene(String sceneName, const char *states) {
+        /*! Define a scene, after all outputs are added
+         *
+         * @param sceneName Name of the scene
+         * @param states Outputs of the scene `<output-name>=on|off[,...]` (also `1|0`), outputs not
+         * listed keep their state
+         * @return false if the scene table is full or states contains an unknown output or value
+         */
+        if (sceneCount == USTD_MAX_GROUP_SCENES)
+            return false;
+        T_SCENE &s = scenes[sceneCount];
+        if (!compile(states, &s.change))
+            return false;
+        s.name = sceneName;
+        ++sceneCount;
+        return true;
+    }
+
+    void begin(Scheduler *_pSched) {
+        /*! Set all outputs off and start the group */
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+        for (uint8_t i = 0; i < outputCount; i++) {
+            pinMode(outputs[i]->port, OUTPUT);
+        }
+        T_CHANGE allOff;
+        changeMask((1ULL << outputCount) - 1, 0, &allOff);
+        write(allOff);
+        for (uint8_t i = 0; i < outputCount; i++) {
+            outputs[i]->state = false;
+        }
+
+        tID = pSched->add([]() {}, name, 0xffffffff);  // message dispatch only
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+            this->subsMsg(topic, msg, originator);
+        });
+        pSched->subscribe(tID, name + "/outputgroup/#", fnall);
+    }
+
+    bool setScene(String sceneName) {
+        /*! Switch to a scene
+         *
+         * @return false if the scene is not defined
+         */
+        for (uint8_t i = 0; i < sceneCount; i++) {
+            if (scenes[i].name == sceneName) {
+                apply(scenes[i].change, i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool set(const char *states) {
+        /*! Switch outputs `<output-name>=on|off[,...]` (also `1|0`) at once
+         *
+         * @return false if states contains an unknown output or value, nothing is switched then
+         */
+        T_CHANGE change;
+        if (!compile(states, &change))
+            return false;
+        apply(change, -1);
+        return true;
+    }
+
+    void setOutputs(uint32_t mask, uint32_t on) {
+        /*! Switch outputs by index at once
+         *
+         * @param mask Bit n: output n (order of add()) is switched
+         * @param on Bit n: output n is switched on
+         */
+        T_CHANGE change;
+        changeMask(mask, on, &change);
+        apply(change, -1);
+    }
+
+    void publishState() {
+        String json = "{\"scene\":\"";
+        if (scene != -1)
+            json += scenes[scene].name;
+        json += "\",\"outputs\":{";
+        for (uint8_t i = 0; i < outputCount; i++) {
+            json += (i ? ",\"" : "\"") + outputs[i]->name +
+                    (state >> i & 1 ? "\":\"on\"" : "\":\"off\"");
+        }
+        pSched->publish(name + "/outputgroup/state", json + "}}");
+    }
+
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == name + "/outputgroup/scene/set") {
+            setScene(msg);
+        } else if (topic == name + "/outputgroup/set") {
+            set(msg.c_str());
+        } else if (topic == name + "/outputgroup/state/get") {
+            publishState();
+        }
+    }
+
+  private:
+    void changeMask(uint32_t mask, uint32_t on, T_CHANGE *pChange) {
+        /*! Compute the GPIO levels of switching the outputs in mask */
+        memset(pChange, 0, sizeof(T_CHANGE));
+        pChange->mask = mask;
+        pChange->on = on & mask;
+        while (mask) {
+            uint8_t i = __builtin_ctz(mask);
+            mask &= mask - 1;
+            uint8_t port = outputs[i]->port;
+            uint32_t bit = (uint32_t)1 << (port % 32);
+            uint8_t step = on >> i & 1;  // off first, then on
+            // DigitalOut: activeLogic true is high when on
+            if (step == outputs[i]->activeLogic)
+                pChange->high[step][port / 32] |= bit;
+            else
+                pChange->low[step][port / 32] |= bit;
+        }
+    }
+
+    bool compile(const char *states, T_CHANGE *pChange) {
+        uint32_t mask = 0, on = 0;
+        char *tokens = strdup(states);
+        bool valid = true;
+        for (char *p = strtok(tokens, ", "); p && valid; p = strtok(nullptr, ", ")) {
+            char *eq = strchr(p, '=');
+            valid = false;
+            if (!eq)
+                break;
+            *eq = 0;
+            const char *value = eq + 1;
+            bool isOn = !strcmp(value, "on") || !strcmp(value, "1");
+            if (!isOn && strcmp(value, "off") && strcmp(value, "0"))
+                break;
+            for (uint8_t i = 0; i < outputCount; i++) {
+                if (outputs[i]->name == p) {
+                    mask |= (uint32_t)1 << i;
+                    if (isOn)
+                        on |= (uint32_t)1 << i;
+                    valid = true;
+                    break;
+                }
+            }
+        }
+        free(tokens);
+        if (valid)
+            changeMask(mask, on, pChange);
+        return valid;
+    }
+
+    void write(const T_CHANGE &change) {
+        for (uint8_t step = 0; step < 2; step++) {
+            const uint32_t *high = change.high[step];
+            const uint32_t *low = change.low[step];
+#if defined(__ESP32__)
+            if (low[0])
+                GPIO.out_w1tc = low[0];
+            if (high[0])
+                GPIO.out_w1ts = high[0];
+            if (low[1])
+                GPIO.out1_w1tc.val = low[1];
+            if (high[1])
+                GPIO.out1_w1ts.val = high[1];
+#elif defined(__ESP__)
+            if (low[0] & 0xffff)
+                GPOC = low[0] & 0xffff;
+            if (high[0] & 0xffff)
+                GPOS = high[0] & 0xffff;
+            if ((high[0] | low[0]) & 0x10000)
+                digitalWrite(16, high[0] & 0x10000 ? HIGH : LOW);
+#else
+            for (uint8_t w = 0; w < USTD_GROUP_WORDS; w++) {
+                for (uint32_t lines = low[w]; lines; lines &= lines - 1)
+                    digitalWrite(w * 32 + __builtin_ctz(lines), LOW);
+                for (uint32_t lines = high[w]; lines; lines &= lines - 1)
+                    digitalWrite(w * 32 + __builtin_ctz(lines), HIGH);
+            }
+#endif
+        }
+    }
+
+    void apply(const T_CHANGE &change, int8_t sceneIndex) {
+        write(change);
+        state = (state & ~change.mask) | change.on;
+        for (uint8_t i = 0; i < outputCount; i++) {
+            outputs[i]->state = state >> i & 1;
+        }
+        scene = sceneIndex;
+        publishState();
+    }
+};  // DigitalOutGroup
+
+}  // namespace ustd
@@ -0,0 +1,241 @@
+// filter_kernels.h
+#pragma once
+
+#include "scheduler.h"
+
+namespace ustd {
+
+#define USTD_MAX_FILTER_WINDOW (15)
+
+class FilterKernel {
+    /*! Interface for filters that preprocess raw sensor values
+     *
+     * All kernels use fixed memory and constant time per sample. A kernel is applied to
+     * each raw value before the value is handed to the mupplet's sensorprocessor, which
+     * still does the change detection and publishing schedule.
+     */
+  public:
+    virtual ~FilterKernel(){};
+    virtual double update(double x) = 0;  // returns filtered value
+    virtual void reset() = 0;
+    virtual String spec() = 0;  // parameters in the format of createFilterKernel()
+};
+
+class EwmaFilter : public FilterKernel {
+    /*! Exponentially weighted moving average, y = y + alpha * (x - y) */
+  public:
+    double alpha;
+    double y = 0.0;
+    bool first = true;
+
+    EwmaFilter(double alpha = 0.2) : alpha(alpha) {
+    }
+
+    virtual double update(double x) override {
+        if (first) {
+            y = x;
+            first = false;
+        } else {
+            y += alpha * (x - y);
+        }
+        return y;
+    }
+
+    virtual void reset() override {
+        first = true;
+    }
+
+    virtual String spec() override {
+        return "ewma:" + String(alpha, 3);
+    }
+};
+
+class MedianFilter : public FilterKernel {
+    /*! Running median over the last window samples
+     *
+     * The window is kept as ring buffer and as sorted array, each sample costs one
+     * removal and one insertion into the sorted array (window <= USTD_MAX_FILTER_WINDOW).
+     */
+  public:
+    uint8_t window;
+    uint8_t count = 0;
+    uint8_t next = 0;
+    double ring[USTD_MAX_FILTER_WINDOW];
+    double sorted[USTD_MAX_FILTER_WINDOW];
+
+    MedianFilter(uint8_t window = 5) : window(window) {
+        if (this->window < 1)
+            this->window = 1;
+        if (this->window > USTD_MAX_FILTER_WINDOW)
+            this->window = USTD_MAX_FILTER_WINDOW;
+    }
+
+    virtual double update(double x) override {
+        push(x);
+        return median();
+    }
+
+    virtual void reset() override {
+        count = 0;
+        next = 0;
+    }
+
+    virtual String spec() override {
+        return "median:" + String(window);
+    }
+
+    double median() {
+        if (!count)
+            return 0.0;
+        if (count & 1)
+            return sorted[count / 2];
+        return (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0;
+    }
+
+  protected:
+    void push(double x) {
+        uint8_t n = count;
+        if (count == window) {
+            // remove oldest value from sorted array
+            double old = ring[next];
+            uint8_t i = 0;
+            while (i < n - 1 && sorted[i] != old)
+                ++i;
+            for (; i < n - 1; i++)
+                sorted[i] = sorted[i + 1];
+            --n;
+        } else {
+            ++count;
+        }
+        ring[next] = x;
+        next = (next + 1) % window;
+        int8_t i = n - 1;
+        while (i >= 0 && sorted[i] > x) {
+            sorted[i + 1] = sorted[i];
+            --i;
+        }
+        sorted[i + 1] = x;
+    }
+};
+
+class HampelFilter : public MedianFilter {
+    /*! Outlier rejection: values that deviate from the window median by more than k
+     * scaled median absolute deviations (MAD) are replaced by the median, all other
+     * values pass unchanged.
+     *
+     * The window keeps the raw values, so a persistent step is accepted after
+     * (window+1)/2 samples.
+     */
+  public:
+    double k;
+    unsigned long outliers = 0;
+
+    HampelFilter(uint8_t window = 7, double k = 3.0) : MedianFilter(window), k(k) {
+    }
+
+    virtual double update(double x) override {
+        push(x);
+        if (count < 3)
+            return x;
+        double med = median();
+        double sigma = 1.4826 * mad(med);
+        if (fabs(x - med) > k * sigma) {
+            ++outliers;
+            return med;
+        }
+        return x;
+    }
+
+    virtual String spec() override {
+        return "hampel:" + String(window) + "," + String(k, 2);
+    }
+
+  private:
+    double mad(double med) {
+        // deviations left and right of the median are each sorted, merge up to the middle; for an
+        // even count, the two middle deviations are averaged like the two middle values
+        int8_t l = (count - 1) / 2;
+        uint8_t r = l + 1;
+        double d = 0.0, prev = 0.0;
+        for (uint8_t i = 0; i <= count / 2; i++) {
+            prev = d;
+            if (l >= 0 && (r >= count || med - sorted[l] <= sorted[r] - med)) {
+                d = med - sorted[l];
+                --l;
+            } else {
+                d = sorted[r] - med;
+                ++r;
+            }
+        }
+        return count & 1 ? d : (prev + d) / 2.0;
+    }
+};
+
+class KalmanFilter : public FilterKernel {
+    /*! One-dimensional Kalman filter for a constant value with process noise q and
+     * measurement noise r (both variances) */
+  public:
+    double q;
+    double r;
+    double x = 0.0;
+    double p = 1.0;
+    bool first = true;
+
+    KalmanFilter(double q = 0.01, double r = 1.0) : q(q), r(r) {
+    }
+
+    virtual double update(double z) override {
+        if (first) {
+            x = z;
+            p = r;
+            first = false;
+            return x;
+        }
+        p += q;
+        double gain = p / (p + r);
+        x += gain * (z - x);
+        p *= (1.0 - gain);
+        return x;
+    }
+
+    virtual void reset() override {
+        first = true;
+    }
+
+    virtual String spec() override {
+        return "kalman:" + String(q, 4) + "," + String(r, 4);
+    }
+};
+
+FilterKernel *createFilterKernel(String spec) {
+    /*! Create a filter kernel from a specification string
+     *
+     * @param spec `ewma:<alpha>`, `median:<window>`, `hampel:<window>[,<k>]` or
+     * `kalman:<q>[,<r>]`, parameters are optional.
+     * @return New kernel, nullptr for `none` or an invalid specification.
+     */
+    String type = spec;
+    double p1 = -1.0, p2 = -1.0;
+    int ind = spec.indexOf(':');
+    if (ind != -1) {
+        type = spec.substring(0, ind);
+        String par = spec.substring(ind + 1);
+        int ind2 = par.indexOf(',');
+        if (ind2 != -1) {
+            p2 = atof(par.substring(ind2 + 1).c_str());
+            par = par.substring(0, ind2);
+        }
+        p1 = atof(par.c_str());
+    }
+    if (type == "ewma")
+        return new EwmaFilter(p1 > 0.0 && p1 <= 1.0 ? p1 : 0.2);
+    if (type == "median")
+        return new MedianFilter(p1 >= 1.0 ? (uint8_t)p1 : 5);
+    if (type == "hampel")
+        return new HampelFilter(p1 >= 3.0 ? (uint8_t)p1 : 7, p2 > 0.0 ? p2 : 3.0);
+    if (type == "kalman")
+        return new KalmanFilter(p1 > 0.0 ? p1 : 0.01, p2 > 0.0 ? p2 : 1.0);
+    return nullptr;
+}
+
+}  // namespace ustd
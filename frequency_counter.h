@@ -2,6 +2,8 @@
 #pragma once
 
 #include "scheduler.h"
+#include "sensors.h"
+#include "mupplet_stats.h"
 #include "home_assistant.h"
 
 namespace ustd {
@@ -96,7 +98,31 @@ double getResetpIrqFrequency(uint8_t irqno, unsigned long minDtUs = 50) {
     return frequency;
 }
 
-class FrequencyCounter {
+class FrequencyCounterModes {
+  public:
+    enum InterruptMode : uint8_t { IM_RISING, IM_FALLING, IM_CHANGE };
+    enum MeasureMode : uint8_t {
+        LOWFREQUENCY_FAST,
+        LOWFREQUENCY_MEDIUM,
+        LOWFREQUENCY_LONGTERM,
+        HIGHFREQUENCY_FAST,
+        HIGHFREQUENCY_MEDIUM,
+        HIGHFREQUENCY_LONGTERM
+    };
+    static const uint8_t allModes = 0x3f;
+};
+
+constexpr uint8_t frequencyModeMask() {
+    return 0;
+}
+template <typename... T>
+constexpr uint8_t frequencyModeMask(FrequencyCounterModes::MeasureMode mode, T... more) {
+    /*! Bit mask of measure modes, template argument of FrequencyCounterT */
+    return (uint8_t)((1 << mode) | frequencyModeMask(more...));
+}
+
+template <uint8_t MODES = FrequencyCounterModes::allModes>
+class FrequencyCounterT : public FrequencyCounterModes {
     /*! Interrupt driven frequency counter.
 
     On an ESP32, measurement of frequencies at a GPIO are possible in ranges of 0-250kHz.
@@ -114,19 +140,14 @@ class FrequencyCounter {
 
     Precision <80kHz is better than 0.0005%. Interrupt load > 80kHz impacts the
     performance of the ESP32 severely and error goes up to 2-5%.
+
+    Measure modes that are not in MODES are not compiled in and are ignored by
+    setMeasureMode(). `FrequencyCounter` supports all modes, `FrequencyCounterOnly<...>` only the
+    given ones, e.g. `FrequencyCounterOnly<FrequencyCounter::LOWFREQUENCY_MEDIUM>`.
     */
 
   public:
-    enum InterruptMode { IM_RISING, IM_FALLING, IM_CHANGE };
-    enum MeasureMode {
-        LOWFREQUENCY_FAST,
-        LOWFREQUENCY_MEDIUM,
-        LOWFREQUENCY_LONGTERM,
-        HIGHFREQUENCY_FAST,
-        HIGHFREQUENCY_MEDIUM,
-        HIGHFREQUENCY_LONGTERM
-    };
-    String FREQUENCY_COUNTER_VERSION = "0.1.0";
+    static constexpr const char *FREQUENCY_COUNTER_VERSION = "0.2.0";
     Scheduler *pSched;
     int tID;
 
@@ -149,21 +170,34 @@ class FrequencyCounter {
     HomeAssistant *pHA;
 #endif
 
-    FrequencyCounter(String name, uint8_t pin_input, int8_t interruptIndex_input,
-                     MeasureMode measureMode = HIGHFREQUENCY_MEDIUM,
-                     InterruptMode irqMode = InterruptMode::IM_FALLING)
+    FrequencyCounterT(String name, uint8_t pin_input, int8_t interruptIndex_input,
+                      MeasureMode measureMode = defaultMode(),
+                      InterruptMode irqMode = InterruptMode::IM_FALLING)
         : name(name), pin_input(pin_input), interruptIndex_input(interruptIndex_input),
           measureMode(measureMode), irqMode(irqMode) {
-        setMeasureMode(measureMode, true);
+        setMeasureMode(hasMode(measureMode) ? measureMode : defaultMode(), true);
     }
 
-    ~FrequencyCounter() {
+    ~FrequencyCounterT() {
         if (irqsAttached) {
             detachInterrupt(irqno_input);
         }
     }
 
+    static constexpr bool hasMode(MeasureMode m) {
+        /*! True if measure mode m is compiled in */
+        return MODES & (1 << m);
+    }
+
+    static constexpr MeasureMode defaultMode() {
+        /*! HIGHFREQUENCY_MEDIUM, if compiled in, else the first compiled in mode */
+        return hasMode(HIGHFREQUENCY_MEDIUM) ? HIGHFREQUENCY_MEDIUM
+                                             : (MeasureMode)__builtin_ctz(MODES);
+    }
+
     void setMeasureMode(MeasureMode mode, bool silent = false) {
+        if (!hasMode(mode))
+            return;
         switch (mode) {
         case LOWFREQUENCY_FAST:
             detectZeroChange = false;
@@ -220,6 +254,7 @@ class FrequencyCounter {
     }
 
     bool begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
         pinMode(pin_input, INPUT_PULLUP);
@@ -245,12 +280,12 @@ class FrequencyCounter {
             return false;
         }
 
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 2000000);  // uS schedule
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/frequency/#", fnall);
         return true;
     }
@@ -259,8 +294,9 @@ class FrequencyCounter {
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String icon = "mdi:gauge",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                FREQUENCY_COUNTER_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
+                          FREQUENCY_COUNTER_VERSION, homeAssistantDiscoveryPrefix);
         pHA->addSensor("frequency", "Frequency", "Hz", "None", icon);
         pHA->begin(pSched);
         publish();
@@ -270,22 +306,28 @@ class FrequencyCounter {
     void publishMeasureMode() {
         switch (measureMode) {
         case LOWFREQUENCY_FAST:
-            pSched->publish(name + "/sensor/mode", "LOWFREQUENCY_FAST");
+            if (hasMode(LOWFREQUENCY_FAST))
+                pSched->publish(name + "/sensor/mode", "LOWFREQUENCY_FAST");
             break;
         case LOWFREQUENCY_MEDIUM:
-            pSched->publish(name + "/sensor/mode", "LOWFREQUENCY_MEDIUM");
+            if (hasMode(LOWFREQUENCY_MEDIUM))
+                pSched->publish(name + "/sensor/mode", "LOWFREQUENCY_MEDIUM");
             break;
         case LOWFREQUENCY_LONGTERM:
-            pSched->publish(name + "/sensor/mode", "LOWFREQUENCY_LONGTERM");
+            if (hasMode(LOWFREQUENCY_LONGTERM))
+                pSched->publish(name + "/sensor/mode", "LOWFREQUENCY_LONGTERM");
             break;
         case HIGHFREQUENCY_FAST:
-            pSched->publish(name + "/sensor/mode", "HIGHFREQUENCY_FAST");
+            if (hasMode(HIGHFREQUENCY_FAST))
+                pSched->publish(name + "/sensor/mode", "HIGHFREQUENCY_FAST");
             break;
         case HIGHFREQUENCY_MEDIUM:
-            pSched->publish(name + "/sensor/mode", "HIGHFREQUENCY_MEDIUM");
+            if (hasMode(HIGHFREQUENCY_MEDIUM))
+                pSched->publish(name + "/sensor/mode", "HIGHFREQUENCY_MEDIUM");
             break;
         case HIGHFREQUENCY_LONGTERM:
-            pSched->publish(name + "/sensor/mode", "HIGHFREQUENCY_LONGTERM");
+            if (hasMode(HIGHFREQUENCY_LONGTERM))
+                pSched->publish(name + "/sensor/mode", "HIGHFREQUENCY_LONGTERM");
             break;
         }
     }
@@ -326,22 +368,23 @@ class FrequencyCounter {
             publish_frequency();
         }
         if (topic == name + "/sensor/mode/set") {
-            if (msg == "LOWFREQUENCY_FAST" || msg == "0") {
+            if (hasMode(LOWFREQUENCY_FAST) && (msg == "LOWFREQUENCY_FAST" || msg == "0")) {
                 setMeasureMode(MeasureMode::LOWFREQUENCY_FAST);
             }
-            if (msg == "LOWFREQUENCY_MEDIUM" || msg == "1") {
+            if (hasMode(LOWFREQUENCY_MEDIUM) && (msg == "LOWFREQUENCY_MEDIUM" || msg == "1")) {
                 setMeasureMode(MeasureMode::LOWFREQUENCY_MEDIUM);
             }
-            if (msg == "LOWFREQUENCY_LONGTERM" || msg == "2") {
+            if (hasMode(LOWFREQUENCY_LONGTERM) && (msg == "LOWFREQUENCY_LONGTERM" || msg == "2")) {
                 setMeasureMode(MeasureMode::LOWFREQUENCY_LONGTERM);
             }
-            if (msg == "HIGHFREQUENCY_FAST" || msg == "3") {
+            if (hasMode(HIGHFREQUENCY_FAST) && (msg == "HIGHFREQUENCY_FAST" || msg == "3")) {
                 setMeasureMode(MeasureMode::HIGHFREQUENCY_FAST);
             }
-            if (msg == "HIGHFREQUENCY_MEDIUM" || msg == "4") {
+            if (hasMode(HIGHFREQUENCY_MEDIUM) && (msg == "HIGHFREQUENCY_MEDIUM" || msg == "4")) {
                 setMeasureMode(MeasureMode::HIGHFREQUENCY_MEDIUM);
             }
-            if (msg == "HIGHFREQUENCY_LONGTERM" || msg == "5") {
+            if (hasMode(HIGHFREQUENCY_LONGTERM) &&
+                (msg == "HIGHFREQUENCY_LONGTERM" || msg == "5")) {
                 setMeasureMode(MeasureMode::HIGHFREQUENCY_LONGTERM);
             }
         }
@@ -349,6 +392,10 @@ class FrequencyCounter {
             publishMeasureMode();
         }
     };
-};  // FrequencyCounter
+};  // FrequencyCounterT
+
+typedef FrequencyCounterT<FrequencyCounterModes::allModes> FrequencyCounter;
+template <FrequencyCounterModes::MeasureMode... M>
+using FrequencyCounterOnly = FrequencyCounterT<frequencyModeMask(M...)>;
 
 }  // namespace ustd
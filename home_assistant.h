@@ -6,6 +6,8 @@
 
 #ifdef __ESP__
 #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "mupplet_arena.h"
 
 namespace ustd {
 
@@ -14,50 +16,62 @@ namespace ustd {
 
 class HomeAssistant {
   public:
+    enum EntityKind { SENSOR, LIGHT, SWITCH };
+    typedef struct {
+        uint8_t kind;     // EntityKind
+        uint16_t offset;  // first string of the entity in pool
+    } T_ENTITY;
+    typedef struct {
+        String macAddress;
+        String ipAddress;
+        String hostName;
+        String capHostName;
+        String HAmuPrefix;
+        String HAcmd;
+        String willTopic;
+        String willMessage;
+        long rssiVal = -99;
+    } T_NODE;
+
     Scheduler *pSched;
     bool useHA = false;
+    bool discovered = false;  // discovery sent, attributes can be published
     String devName;
     int tID;
     String HAname = "";
     String HAprefix = "";
-    String macAddress = "";
-    String ipAddress = "";
-    String hostName = "";
-    String capHostName;
     String swVersion;
     String muProject;
-    long rssiVal = -99;
-    String HAmuPrefix = "";
-    String HAcmd = "";
-    String willTopic = "";
-    String willMessage = "";
-
-    ustd::array<String> sensor_topic_sub_names;
-    ustd::array<String> sensor_friendlyNames;
-    ustd::array<String> sensor_unitDescs;
-    ustd::array<String> sensor_classNames;
-    ustd::array<String> sensor_iconNames;
-
-    ustd::array<String> switch_iconNames;
-    ustd::array<String> light_iconNames;
 
-    //    ustd::array<String> sensor_devNames;
-    //    ustd::array<String> sensor_HAnames;
-    ustd::array<String> sensorsAttribs;
+    // Network and mqtt settings are the same for all entities of the node, all instances share
+    // them
+    String &macAddress;
+    String &ipAddress;
+    String &hostName;
+    String &capHostName;
+    String &HAmuPrefix;
+    String &HAcmd;
+    String &willTopic;
+    String &willMessage;
+    long &rssiVal;
 
-    int nrLights = 0;
-    //    ustd::array<String> light_devNames;
-    //    ustd::array<String> light_HAnames;
-    ustd::array<String> lightsAttribs;
-
-    int nrSwitches = 0;
-    //    ustd::array<String> switch_devNames;
-    //    ustd::array<String> switch_HAnames;
-    ustd::array<String> switchesAttribs;
+    // Entity strings are kept in one pool block per instance, '\0' separated:
+    // sensors: topic_sub_name, friendlyName, unitDesc, className, iconName, lights and switches:
+    // iconName
+    T_ENTITY *entities = nullptr;
+    uint8_t entityCount = 0;
+    char *pool = nullptr;
+    uint16_t poolSize = 0;
+    uint8_t nrSensors = 0;
+    uint8_t nrLights = 0;
+    uint8_t nrSwitches = 0;
 
     HomeAssistant(String _devName, int _tID, String homeAssistantFriendlyName, String project = "",
                   String version = __HA_VERSION__,
-                  String homeAssistantDiscoveryPrefix = "homeassistant") {
+                  String homeAssistantDiscoveryPrefix = "homeassistant")
+        : macAddress(node().macAddress), ipAddress(node().ipAddress), hostName(node().hostName),
+          capHostName(node().capHostName), HAmuPrefix(node().HAmuPrefix), HAcmd(node().HAcmd),
+          willTopic(node().willTopic), willMessage(node().willMessage), rssiVal(node().rssiVal) {
         if (homeAssistantFriendlyName == "")
             HAname = _devName;
         else
@@ -71,14 +85,23 @@ class HomeAssistant {
     }
 
     ~HomeAssistant() {
+        free(entities);
+        free(pool);
+    }
+
+    static T_NODE &node() {
+        static T_NODE nodeInfo;
+        return nodeInfo;
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(devName + "_ha");
         pSched = _pSched;
         useHA = true;
-        auto fnmq = [=](String topic, String msg, String originator) {
-            this->mqMsg(topic, msg, originator);
-        };
+        auto fnmq = MUP_STATS_SUBS(devName + "_ha",
+                                   [=](String topic, String msg, String originator) {
+                                       this->mqMsg(topic, msg, originator);
+                                   });
         if (macAddress == "")
             macAddress = WiFi.macAddress();
         pSched->subscribe(tID, "mqtt/state", fnmq);
@@ -88,35 +111,54 @@ class HomeAssistant {
         pSched->publish("mqtt/state/get");
     }
 
-    void addSensor(/*String devName, String HAname, */ String topic_sub_name, String friendlyName,
-                   String unitDesc, String className, String iconName) {
-        // sensor_devNames.add(devName);
-        // sensor_HAnames.add(HAname);
+    bool addEntity(EntityKind kind, const String *fields, uint8_t count) {
+        /*! Append an entity and its strings to the pool */
+        uint16_t len = 0;
+        for (uint8_t i = 0; i < count; i++)
+            len += fields[i].length() + 1;
+        char *newPool = (char *)realloc(pool, poolSize + len);
+        if (!newPool)
+            return false;
+        pool = newPool;
+        T_ENTITY *newEntities =
+            (T_ENTITY *)realloc(entities, (entityCount + 1) * sizeof(T_ENTITY));
+        if (!newEntities)
+            return false;
+        entities = newEntities;
+        entities[entityCount].kind = kind;
+        entities[entityCount].offset = poolSize;
+        ++entityCount;
+        for (uint8_t i = 0; i < count; i++) {
+            memcpy(pool + poolSize, fields[i].c_str(), fields[i].length() + 1);
+            poolSize += fields[i].length() + 1;
+        }
         if (macAddress == "")
             macAddress = WiFi.macAddress();
-        sensor_topic_sub_names.add(topic_sub_name);
-        sensor_friendlyNames.add(friendlyName);
-        sensor_unitDescs.add(unitDesc);
-        sensor_classNames.add(className);
-        sensor_iconNames.add(iconName);
+        return true;
+    }
+
+    const char *entityString(uint8_t entity, uint8_t field) {
+        const char *p = pool + entities[entity].offset;
+        for (uint8_t i = 0; i < field; i++)
+            p += strlen(p) + 1;
+        return p;
+    }
+
+    void addSensor(/*String devName, String HAname, */ String topic_sub_name, String friendlyName,
+                   String unitDesc, String className, String iconName) {
+        const String fields[] = {topic_sub_name, friendlyName, unitDesc, className, iconName};
+        if (addEntity(SENSOR, fields, 5))
+            ++nrSensors;
     }
 
     void addLight(String iconName = "mdi:lightbulb") {
-        // light_devNames.add(devName);
-        // light_HAnames.add(HAname);
-        light_iconNames.add(iconName);
-        if (macAddress == "")
-            macAddress = WiFi.macAddress();
-        ++nrLights;
+        if (addEntity(LIGHT, &iconName, 1))
+            ++nrLights;
     }
 
     void addSwitch(String iconName = "mdi:light-switch") {
-        // switch_devNames.add(devName);
-        // switch_HAnames.add(HAname);
-        switch_iconNames.add(iconName);
-        if (macAddress == "")
-            macAddress = WiFi.macAddress();
-        ++nrSwitches;
+        if (addEntity(SWITCH, &iconName, 1))
+            ++nrSwitches;
     }
 
     void publishAttrib(String attrTopic) {
@@ -133,14 +175,20 @@ class HomeAssistant {
     }
 
     void publishAttribs() {
-        for (unsigned int i = 0; i < sensorsAttribs.length(); i++) {
-            publishAttrib(sensorsAttribs[i]);
-        }
-        for (unsigned int i = 0; i < lightsAttribs.length(); i++) {
-            publishAttrib(lightsAttribs[i]);
-        }
-        for (unsigned int i = 0; i < switchesAttribs.length(); i++) {
-            publishAttrib(switchesAttribs[i]);
+        if (!discovered)
+            return;
+        for (uint8_t i = 0; i < entityCount; i++) {
+            switch (entities[i].kind) {
+            case SENSOR:
+                publishAttrib(devName + "/sensor/" + entityString(i, 0) + "/attribs");
+                break;
+            case LIGHT:
+                publishAttrib(devName + "/light/attribs");
+                break;
+            case SWITCH:
+                publishAttrib(devName + "/switch/attribs");
+                break;
+            }
         }
     }
 
@@ -216,30 +264,33 @@ class HomeAssistant {
                     HAnameNS.replace(" ", "_");
                     if (macAddress == "")
                         macAddress = WiFi.macAddress();
-                    for (unsigned int i = 0; i < sensor_topic_sub_names.length(); i++) {
-                        String subDevNo = String(i + 1);
+                    uint8_t sensorNo = 0, lightNo = 0, switchNo = 0;
+                    for (uint8_t e = 0; e < entityCount; e++) {
+                        if (entities[e].kind != SENSOR)
+                            continue;
+                        String subDevNo = String(++sensorNo);
+                        String topicSubName = entityString(e, 0);
                         String HAstateTopic =
-                            HAmuPrefix + "/" + devName + "/sensor/" + sensor_topic_sub_names[i];
-                        String HAattrTopic =
-                            devName + "/sensor/" + sensor_topic_sub_names[i] + "/attribs";
+                            HAmuPrefix + "/" + devName + "/sensor/" + topicSubName;
+                        String HAattrTopic = devName + "/sensor/" + topicSubName + "/attribs";
                         String HAdiscoTopic = "!!" + HAprefix + "/sensor/" + subDevNo + "-" +
                                               HAnameNS + "/" + devName + "/config";
                         String HAdiscoEntityDef =
                             "{\"stat_t\":\"" + HAstateTopic + "\"," + "\"json_attr_t\":\"" +
                             HAmuPrefix + "/" + HAattrTopic + "\"," + "\"name\":\"" + HAname + " " +
-                            sensor_friendlyNames[i] + "\"," + "\"uniq_id\":\"" + macAddress + "-" +
+                            entityString(e, 1) + "\"," + "\"uniq_id\":\"" + macAddress + "-" +
                             devName + "-S" + subDevNo + "\"," +
                             "\"val_tpl\":\"{{ value | float }}\"," + "\"unit_of_meas\":\"" +
-                            sensor_unitDescs[i] + "\"," + "\"expire_after\": 1800," +
-                            "\"icon\":\"" + sensor_iconNames[i] + "\"";
+                            entityString(e, 2) + "\"," + "\"expire_after\": 1800," +
+                            "\"icon\":\"" + entityString(e, 4) + "\"";
                         if (willTopic != "") {
                             HAdiscoEntityDef += ",\"avty_t\":\"" + willTopic + "\"";
                             HAdiscoEntityDef += ",\"pl_avail\":\"connected\"";
                             HAdiscoEntityDef += ",\"pl_not_avail\":\"" + willMessage + "\"";
                         }
-                        if (sensor_classNames[i] != "None") {
+                        if (strcmp(entityString(e, 3), "None")) {
                             HAdiscoEntityDef +=
-                                ",\"device_class\":\"" + sensor_classNames[i] + "\"";
+                                ",\"device_class\":\"" + String(entityString(e, 3)) + "\"";
                         }
                         HAdiscoEntityDef =
                             HAdiscoEntityDef + ",\"device\":{" + "\"identifiers\":[\"" +
@@ -249,14 +300,14 @@ class HomeAssistant {
                             "\"connections\":[[\"IP\",\"" + ipAddress + "\"]," + "[\"Host\",\"" +
                             hostName + "\"]]}";
                         HAdiscoEntityDef += "}";
-                        sensorsAttribs.add(HAattrTopic);
                         pSched->publish(HAdiscoTopic, HAdiscoEntityDef);
                     }
 
                     // lights
-                    for (int i = 0; i < nrLights; i++) {
-                        int id = i + 1;
-                        String subDevNo = String(id);
+                    for (uint8_t e = 0; e < entityCount; e++) {
+                        if (entities[e].kind != LIGHT)
+                            continue;
+                        String subDevNo = String(++lightNo);
                         String HAcommandTopic = HAcmd + "/" + devName + "/light/set";
                         String HAstateTopic = HAmuPrefix + "/" + devName + "/light/state";
                         String HAattrTopic = devName + "/light/attribs";
@@ -276,7 +327,7 @@ class HomeAssistant {
                             "\"bri_cmd_t\":\"" + HAcommandBrTopic + "\"," +
                             "\"on_cmd_type\":\"brightness\"," + "\"pl_on\":\"on\"," +
                             "\"pl_off\":\"off\"";
-                        //"\"icon\":\""+light_iconNames[i]+"\"";
+                        //"\"icon\":\""+entityString(e, 0)+"\"";
                         if (willTopic != "") {
                             HAdiscoEntityDef += ",\"avty_t\":\"" + willTopic + "\"";
                             HAdiscoEntityDef += ",\"pl_avail\":\"connected\"";
@@ -290,14 +341,14 @@ class HomeAssistant {
                             "\"connections\":[[\"IP\",\"" + ipAddress + "\"]," + "[\"Host\",\"" +
                             hostName + "\"]]}";
                         HAdiscoEntityDef += "}";
-                        lightsAttribs.add(HAattrTopic);
                         pSched->publish(HAdiscoTopic, HAdiscoEntityDef);
                     }
 
                     // switches
-                    for (int i = 0; i < nrSwitches; i++) {
-                        int id = i + 1;
-                        String subDevNo = String(id);
+                    for (uint8_t e = 0; e < entityCount; e++) {
+                        if (entities[e].kind != SWITCH)
+                            continue;
+                        String subDevNo = String(++switchNo);
                         String HAcommandTopic = HAcmd + "/" + devName + "/switch/set";
                         String HAstateTopic = HAmuPrefix + "/" + devName + "/switch/state";
                         String HAattrTopic = devName + "/switch/attribs";
@@ -310,7 +361,7 @@ class HomeAssistant {
                             "\"json_attr_t\":\"" + HAmuPrefix + "/" + HAattrTopic + "\"," +
                             "\"state_on\":\"on\"," + "\"state_off\":\"off\"," +
                             "\"pl_on\":\"on\"," + "\"pl_off\":\"off\"," + "\"icon\":\"" +
-                            switch_iconNames[i] + "\"";
+                            entityString(e, 0) + "\"";
                         if (willTopic != "") {
                             HAdiscoEntityDef += ",\"avty_t\":\"" + willTopic + "\"";
                             HAdiscoEntityDef += ",\"pl_avail\":\"connected\"";
@@ -324,9 +375,9 @@ class HomeAssistant {
                             "\"connections\":[[\"IP\",\"" + ipAddress + "\"]," + "[\"Host\",\"" +
                             hostName + "\"]]}";
                         HAdiscoEntityDef += "}";
-                        switchesAttribs.add(HAattrTopic);
                         pSched->publish(HAdiscoTopic, HAdiscoEntityDef);
                     }
+                    discovered = true;
                 }
             }
         }
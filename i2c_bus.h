@@ -0,0 +1,675 @@
+// i2c_bus.h
+// Shared I2C bus manager: transaction queue, per-device timeouts, error backoff,
+// bus recovery and statistics for I2C mupplets.
+#pragma once
+
+#include <functional>
+
+#include "scheduler.h"
+#include "mupplet_stats.h"
+#include "Wire.h"
+
+namespace ustd {
+
+class I2CPort {
+    /*! Hardware abstraction of an I2C master port
+     *
+     * Status codes are those of TwoWire::endTransmission(). Derive from this
+     * class to run the I2CBus on something other than TwoWire, e.g. the
+     * I2CPortStandIn.
+     */
+  public:
+    enum Status { OK = 0, TOO_LONG = 1, NACK_ADDR = 2, NACK_DATA = 3, BUS_ERROR = 4, TIMEOUT = 5 };
+
+    virtual ~I2CPort(){};  // Otherwise destructor of derived classes
+                           // is never called!
+    virtual bool begin() {
+        return false;
+    }
+    virtual void setTimeout(unsigned long timeoutUs) {
+    }
+    virtual uint8_t write(uint8_t address, const uint8_t *data, uint8_t len,
+                          bool sendStop = true) {
+        return BUS_ERROR;
+    }
+    virtual uint8_t read(uint8_t address, uint8_t *data, uint8_t len) {
+        return BUS_ERROR;
+    }
+    virtual bool recover() {
+        return false;
+    }
+};
+
+class I2CWirePort : public I2CPort {
+    /*! I2CPort using Arduino's TwoWire */
+  public:
+    TwoWire *pWire;
+    int sda;
+    int scl;
+    uint32_t clock;
+
+    I2CWirePort(TwoWire *pWire = &Wire, int sda = -1, int scl = -1, uint32_t clock = 100000)
+        : pWire(pWire), sda(sda), scl(scl), clock(clock) {
+        /*! Instantiate a TwoWire based I2C port
+         *
+         * @param pWire TwoWire instance, default is Wire
+         * @param sda SDA pin, -1 for platform default
+         * @param scl SCL pin, -1 for platform default
+         * @param clock I2C clock frequency in Hz
+         */
+    }
+
+    virtual bool begin() override {
+#if defined(__ESP__)
+        if (sda >= 0 && scl >= 0) {
+            pWire->begin(sda, scl);
+        } else {
+            pWire->begin();
+        }
+#else
+        pWire->begin();
+#endif
+        pWire->setClock(clock);
+        return true;
+    }
+
+    virtual void setTimeout(unsigned long timeoutUs) override {
+#if defined(__ESP32__)
+        uint16_t ms = (uint16_t)((timeoutUs + 999) / 1000);
+        pWire->setTimeOut(ms ? ms : 1);
+#elif defined(__ESP__)
+        pWire->setClockStretchLimit(timeoutUs);
+#endif
+    }
+
+    virtual uint8_t write(uint8_t address, const uint8_t *data, uint8_t len,
+                          bool sendStop = true) override {
+        pWire->beginTransmission(address);
+        for (uint8_t i = 0; i < len; i++) {
+            pWire->write(data[i]);
+        }
+        return pWire->endTransmission(sendStop);
+    }
+
+    virtual uint8_t read(uint8_t address, uint8_t *data, uint8_t len) override {
+        uint8_t n = pWire->requestFrom(address, len);
+        for (uint8_t i = 0; i < n && i < len; i++) {
+            data[i] = pWire->read();
+        }
+        return n == len ? OK : NACK_ADDR;
+    }
+
+    virtual bool recover() override {
+        /*! Release a bus blocked by a slave that holds SDA low
+         *
+         * Clocks SCL up to 9 times until SDA is released, generates a STOP
+         * condition and re-initializes the port.
+         */
+#if defined(__ESP__)
+        int pinSda = sda >= 0 ? sda : SDA;
+        int pinScl = scl >= 0 ? scl : SCL;
+#else
+        int pinSda = sda;
+        int pinScl = scl;
+        if (pinSda < 0 || pinScl < 0)
+            return false;
+#endif
+        pinMode(pinSda, INPUT_PULLUP);
+        pinMode(pinScl, OUTPUT);
+        digitalWrite(pinScl, HIGH);
+        for (uint8_t i = 0; i < 9 && digitalRead(pinSda) == LOW; i++) {
+            digitalWrite(pinScl, LOW);
+            delayMicroseconds(5);
+            digitalWrite(pinScl, HIGH);
+            delayMicroseconds(5);
+        }
+        // STOP: SDA low->high while SCL is high
+        pinMode(pinSda, OUTPUT);
+        digitalWrite(pinSda, LOW);
+        delayMicroseconds(5);
+        digitalWrite(pinScl, HIGH);
+        delayMicroseconds(5);
+        digitalWrite(pinSda, HIGH);
+        delayMicroseconds(5);
+        pinMode(pinSda, INPUT_PULLUP);
+        bool released = digitalRead(pinSda) == HIGH;
+        begin();
+        return released;
+    }
+};
+
+class I2CPortStandIn : public I2CPort {
+    /*! Software stand-in for an I2C port with register based devices
+     *
+     * Each simulated device has 256 byte registers with auto-increment,
+     * the first written byte sets the register pointer. Delays and NACKs
+     * can be injected per device to exercise timeouts, backoff and recovery
+     * of the I2CBus without hardware.
+     */
+  public:
+    typedef struct {
+        uint8_t address;
+        uint8_t regs[256];
+        uint8_t pointer;
+        unsigned long delayUs;  // added to each transaction
+        uint16_t nacks;         // number of following transactions to NACK
+        bool stuck;             // device holds the bus: transactions time out
+    } T_STANDIN_DEVICE;
+
+    uint8_t maxDevices;
+    uint8_t deviceCount = 0;
+    T_STANDIN_DEVICE *devices;
+    unsigned long transactions = 0;
+    unsigned long recoveries = 0;
+
+    I2CPortStandIn(uint8_t maxDevices = 4) : maxDevices(maxDevices) {
+        devices = new T_STANDIN_DEVICE[maxDevices];
+    }
+
+    I2CPortStandIn(const I2CPortStandIn &) = delete;  // owns the device array
+    I2CPortStandIn &operator=(const I2CPortStandIn &) = delete;
+
+    virtual ~I2CPortStandIn() override {
+        delete[] devices;
+    }
+
+    T_STANDIN_DEVICE *addDevice(uint8_t address) {
+        if (deviceCount >= maxDevices)
+            return nullptr;
+        T_STANDIN_DEVICE *pDev = &devices[deviceCount++];
+        pDev->address = address;
+        memset(pDev->regs, 0, sizeof(pDev->regs));
+        pDev->pointer = 0;
+        pDev->delayUs = 0;
+        pDev->nacks = 0;
+        pDev->stuck = false;
+        return pDev;
+    }
+
+    T_STANDIN_DEVICE *getDevice(uint8_t address) {
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            if (devices[i].address == address)
+                return &devices[i];
+        }
+        return nullptr;
+    }
+
+    virtual bool begin() override {
+        return true;
+    }
+
+    virtual uint8_t write(uint8_t address, const uint8_t *data, uint8_t len,
+                          bool sendStop = true) override {
+        uint8_t status;
+        T_STANDIN_DEVICE *pDev = access(address, &status);
+        if (!pDev)
+            return status;
+        for (uint8_t i = 0; i < len; i++) {
+            if (i == 0)
+                pDev->pointer = data[0];
+            else
+                pDev->regs[pDev->pointer++] = data[i];
+        }
+        return OK;
+    }
+
+    virtual uint8_t read(uint8_t address, uint8_t *data, uint8_t len) override {
+        uint8_t status;
+        T_STANDIN_DEVICE *pDev = access(address, &status);
+        if (!pDev)
+            return status;
+        for (uint8_t i = 0; i < len; i++) {
+            data[i] = pDev->regs[pDev->pointer++];
+        }
+        return OK;
+    }
+
+    virtual bool recover() override {
+        ++recoveries;
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            devices[i].stuck = false;
+        }
+        return true;
+    }
+
+  private:
+    T_STANDIN_DEVICE *access(uint8_t address, uint8_t *pStatus) {
+        ++transactions;
+        T_STANDIN_DEVICE *pDev = getDevice(address);
+        if (!pDev) {
+            *pStatus = NACK_ADDR;
+            return nullptr;
+        }
+        if (pDev->delayUs)
+            delayMicroseconds(pDev->delayUs);
+        if (pDev->stuck) {
+            *pStatus = TIMEOUT;
+            return nullptr;
+        }
+        if (pDev->nacks) {
+            --pDev->nacks;
+            *pStatus = NACK_ADDR;
+            return nullptr;
+        }
+        return pDev;
+    }
+};
+
+typedef std::function<void(uint8_t status, const uint8_t *data, uint8_t len)> T_I2C_DONE;
+
+class I2CBus {
+    /*! Shared I2C bus manager
+     *
+     * I2C mupplets register their devices with addDevice() (usually through
+     * an I2CClient) and queue register transfers instead of accessing Wire
+     * directly. The bus task executes queued transfers within a time budget
+     * per scheduler tick, measures latency, applies per-device timeouts and
+     * backs off from failing devices so that a missing or stuck sensor
+     * cannot stall other tasks. After repeated bus errors the bus is
+     * recovered by clocking out a blocked slave.
+     *
+     * A transfer is a single transaction (write, optionally followed by a
+     * read with repeated start) of at most maxWrite and maxRead bytes, it
+     * never waits for a sensor: mupplets run their measurements as state
+     * machines (trigger, wait in their own task, read), see AirQualityBme280.
+     * The port aborts a transaction that exceeds the device timeout (clock
+     * stretch limit or Wire timeout). A transfer that took longer than the
+     * device timeout anyway is failed with I2CPort::TIMEOUT, its data are
+     * discarded and the device backs off. The time budget is checked after
+     * each transfer, so a tick takes at most sliceUs plus one transfer.
+     */
+  public:
+    enum Status { BACKOFF = 0x10, INVALID_DATA = 0x11, QUEUE_FULL = 0x12, NO_DEVICE = 0x13 };
+    static const uint8_t maxWrite = 8;
+    static const uint8_t maxRead = 32;
+
+    typedef struct {
+        String name;
+        uint8_t address;
+        unsigned long timeoutUs;
+        unsigned long transactions;
+        unsigned long errors;
+        unsigned long timeouts;
+        unsigned long totalUs;
+        unsigned long maxUs;
+        unsigned long backoffStart;
+        unsigned long backoffMs;
+        uint8_t consecutiveErrors;
+        uint8_t pending;
+        uint8_t lastStatus;
+    } T_I2C_DEVICE;
+
+    typedef struct {
+        int device;
+        uint8_t wlen;
+        uint8_t rlen;
+        uint8_t wbuf[maxWrite];
+        T_I2C_DONE done;
+    } T_I2C_TRANSACTION;
+
+    static constexpr const char *I2CBUS_VERSION = "0.1.0";
+    Scheduler *pSched;
+    int tID;
+    String name;
+    I2CPort *pPort;
+    bool ownPort = false;
+    uint8_t maxDevices;
+    uint8_t deviceCount = 0;
+    T_I2C_DEVICE *devices;
+    ustd::queue<T_I2C_TRANSACTION> transactions;
+    unsigned long sliceUs = 2000;  // max time spent per tick, at least one transaction is done
+    unsigned long maxBackoffMs = 30000;
+    uint8_t recoverAfterErrors = 3;  // consecutive bus errors before recovery
+    uint8_t busErrors = 0;
+    unsigned long recoveries = 0;
+    unsigned long overflows = 0;
+    unsigned int maxQueued = 0;
+    unsigned long lastTimeoutUs = 0;
+    uint8_t rbuf[maxRead];
+    bool bActive = false;
+
+    I2CBus(String name, I2CPort *pPort = nullptr, uint8_t queueSize = 16, uint8_t maxDevices = 8)
+        : name(name), pPort(pPort), maxDevices(maxDevices), transactions(queueSize) {
+        /*! Instantiate an I2C bus manager
+         *
+         * @param name Name of the bus, used for topics
+         * @param pPort I2C port, default is an I2CWirePort on Wire
+         * @param queueSize Max number of queued transactions
+         * @param maxDevices Max number of devices that can be registered
+         */
+        if (!this->pPort) {
+            this->pPort = new I2CWirePort();
+            ownPort = true;
+        }
+        devices = new T_I2C_DEVICE[maxDevices];
+    }
+
+    I2CBus(const I2CBus &) = delete;  // owns the device array and possibly the port
+    I2CBus &operator=(const I2CBus &) = delete;
+
+    ~I2CBus() {
+        if (ownPort)
+            delete pPort;
+        delete[] devices;
+    }
+
+    void begin(Scheduler *_pSched, unsigned long intervalUs = 5000, unsigned long _sliceUs = 2000) {
+        /*! Initialize the port and start the bus task
+         *
+         * @param _pSched Scheduler
+         * @param intervalUs Interval of the bus task in us
+         * @param _sliceUs Time budget per tick in us
+         */
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+        sliceUs = _sliceUs;
+        pPort->begin();
+
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, intervalUs);
+
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+            this->subsMsg(topic, msg, originator);
+        });
+        pSched->subscribe(tID, name + "/i2c/stats/get", fnall);
+        pSched->subscribe(tID, name + "/i2c/recover", fnall);
+        bActive = true;
+    }
+
+    int addDevice(String devName, uint8_t address, unsigned long timeoutUs = 25000) {
+        /*! Register a device
+         *
+         * A device that is already registered with the same address is
+         * shared.
+         *
+         * @param devName Name of the device, used for statistics
+         * @param address I2C address
+         * @param timeoutUs Max duration of a transaction of this device
+         * @return Device handle for transfer(), -1 if no more
+         * devices can be registered.
+         */
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            if (devices[i].address == address)
+                return i;
+        }
+        if (deviceCount >= maxDevices)
+            return -1;
+        T_I2C_DEVICE *pDev = &devices[deviceCount];
+        pDev->name = devName;
+        pDev->address = address;
+        pDev->timeoutUs = timeoutUs;
+        pDev->transactions = 0;
+        pDev->errors = 0;
+        pDev->timeouts = 0;
+        pDev->totalUs = 0;
+        pDev->maxUs = 0;
+        pDev->backoffStart = 0;
+        pDev->backoffMs = 0;
+        pDev->consecutiveErrors = 0;
+        pDev->pending = 0;
+        pDev->lastStatus = I2CPort::OK;
+        return deviceCount++;
+    }
+
+    bool transfer(int device, const uint8_t *wdata, uint8_t wlen, uint8_t rlen,
+                  T_I2C_DONE done = nullptr) {
+        /*! Queue a register transfer
+         *
+         * Writes wlen bytes (without STOP if data is read), then reads rlen
+         * bytes. The result is passed to done, the data pointer is only
+         * valid during the callback.
+         *
+         * @return false if the queue is full or the parameters are invalid
+         */
+        if (device < 0 || device >= deviceCount || wlen > maxWrite || rlen > maxRead)
+            return false;
+        T_I2C_TRANSACTION t;
+        t.device = device;
+        t.wlen = wlen;
+        t.rlen = rlen;
+        memcpy(t.wbuf, wdata, wlen);
+        t.done = done;
+        return enqueue(t);
+    }
+
+    bool writeRegister(int device, uint8_t reg, uint8_t value, T_I2C_DONE done = nullptr) {
+        uint8_t buf[2] = {reg, value};
+        return transfer(device, buf, 2, 0, done);
+    }
+
+    bool readRegisters(int device, uint8_t reg, uint8_t len, T_I2C_DONE done = nullptr) {
+        return transfer(device, &reg, 1, len, done);
+    }
+
+    bool isPending(int device) {
+        /*! Check for queued transactions of a device
+         *
+         * Periodic mupplets use this to avoid queueing a new measurement
+         * while the previous one has not been executed yet.
+         */
+        if (device < 0 || device >= deviceCount)
+            return false;
+        return devices[device].pending > 0;
+    }
+
+    bool isAvailable(int device) {
+        /*! Check that a device is not in error backoff */
+        if (device < 0 || device >= deviceCount)
+            return false;
+        return !inBackoff(&devices[device]);
+    }
+
+    void loop() {
+        unsigned long start = micros();
+        while (transactions.length()) {
+            T_I2C_TRANSACTION t = transactions.pop();
+            execute(t);
+            if (timeDiff(start, micros()) >= sliceUs)
+                break;
+        }
+    }
+
+    bool recover() {
+        busErrors = 0;
+        ++recoveries;
+        lastTimeoutUs = 0;
+        return pPort->recover();
+    }
+
+    void publishStats() {
+        char buf[192];
+        sprintf(buf,
+                "{\"queued\": %u, \"maxQueued\": %u, \"overflows\": %lu, \"recoveries\": %lu}",
+                transactions.length(), maxQueued, overflows, recoveries);
+        pSched->publish(name + "/i2c/stats", buf);
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            T_I2C_DEVICE *pDev = &devices[i];
+            unsigned long avgUs = pDev->transactions ? pDev->totalUs / pDev->transactions : 0;
+            sprintf(buf,
+                    "{\"address\": %u, \"transactions\": %lu, \"errors\": %lu, \"timeouts\": %lu, "
+                    "\"avgUs\": %lu, \"maxUs\": %lu, \"lastStatus\": %u, \"backoffMs\": %lu}",
+                    pDev->address, pDev->transactions, pDev->errors, pDev->timeouts, avgUs,
+                    pDev->maxUs, pDev->lastStatus, inBackoff(pDev) ? pDev->backoffMs : 0);
+            pSched->publish(name + "/i2c/stats/" + pDev->name, buf);
+        }
+    }
+
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == name + "/i2c/stats/get") {
+            publishStats();
+        }
+        if (topic == name + "/i2c/recover") {
+            recover();
+        }
+    }
+
+  private:
+    bool enqueue(T_I2C_TRANSACTION &t) {
+        if (!transactions.push(t)) {
+            ++overflows;
+            if (t.done)
+                t.done(QUEUE_FULL, nullptr, 0);
+            return false;
+        }
+        ++devices[t.device].pending;
+        if (transactions.length() > maxQueued)
+            maxQueued = transactions.length();
+        return true;
+    }
+
+    bool inBackoff(T_I2C_DEVICE *pDev) {
+        return pDev->backoffMs && timeDiff(pDev->backoffStart, millis()) < pDev->backoffMs;
+    }
+
+    void execute(T_I2C_TRANSACTION &t) {
+        T_I2C_DEVICE *pDev = &devices[t.device];
+        uint8_t status;
+        if (pDev->pending)
+            --pDev->pending;
+        if (inBackoff(pDev)) {
+            if (t.done)
+                t.done(BACKOFF, nullptr, 0);
+            return;
+        }
+        if (pDev->timeoutUs != lastTimeoutUs) {
+            pPort->setTimeout(pDev->timeoutUs);
+            lastTimeoutUs = pDev->timeoutUs;
+        }
+        unsigned long t0 = micros();
+        status = I2CPort::OK;
+        if (t.wlen)
+            status = pPort->write(pDev->address, t.wbuf, t.wlen, t.rlen == 0);
+        if (status == I2CPort::OK && t.rlen)
+            status = pPort->read(pDev->address, rbuf, t.rlen);
+        unsigned long dt = timeDiff(t0, micros());
+        ++pDev->transactions;
+        pDev->totalUs += dt;
+        if (dt > pDev->maxUs)
+            pDev->maxUs = dt;
+        if (dt > pDev->timeoutUs)
+            status = I2CPort::TIMEOUT;  // too late, even if the port didn't abort it
+        if (status == I2CPort::TIMEOUT)
+            ++pDev->timeouts;
+        pDev->lastStatus = status;
+        if (status == I2CPort::OK) {
+            pDev->consecutiveErrors = 0;
+            pDev->backoffMs = 0;
+            busErrors = 0;
+        } else {
+            ++pDev->errors;
+            if (pDev->consecutiveErrors < 255)
+                ++pDev->consecutiveErrors;
+            // exponential backoff: 100ms, 200ms, ... maxBackoffMs
+            uint8_t shift = pDev->consecutiveErrors - 1;
+            pDev->backoffMs = shift > 9 ? maxBackoffMs : (100UL << shift);
+            if (pDev->backoffMs > maxBackoffMs)
+                pDev->backoffMs = maxBackoffMs;
+            pDev->backoffStart = millis();
+            if (status == I2CPort::TIMEOUT || status == I2CPort::BUS_ERROR) {
+                if (++busErrors >= recoverAfterErrors)
+                    recover();
+            }
+        }
+        if (t.done)
+            t.done(status, t.rlen ? rbuf : nullptr, status == I2CPort::OK ? t.rlen : 0);
+    }
+};  // I2CBus
+
+class I2CClient {
+    /*! Register access of a mupplet to its I2C device
+     *
+     * With an I2CBus, transfers are queued on the bus and done is called from
+     * the bus task. Without a bus, the client uses its own I2CWirePort and
+     * executes each transfer immediately, done is called before the transfer
+     * function returns. Either way a transfer is one short transaction: the
+     * mupplet waits for conversions in its own task between transfers.
+     */
+  public:
+    I2CBus *pBus = nullptr;
+    I2CPort *pPort = nullptr;  // port of the bus, or own port without bus
+    bool ownPort = false;
+    int device = -1;
+    uint8_t address = 0;
+    uint8_t rbuf[I2CBus::maxRead];
+
+    I2CClient() {
+    }
+
+    I2CClient(const I2CClient &) = delete;
+    I2CClient &operator=(const I2CClient &) = delete;
+
+    ~I2CClient() {
+        if (ownPort)
+            delete pPort;
+    }
+
+    void begin(String devName, uint8_t _address, I2CBus *_pBus = nullptr,
+               unsigned long timeoutUs = 25000) {
+        /*! Register the device on the bus, or open an own port on Wire without bus
+         *
+         * @param devName Name of the device, used for the bus statistics
+         * @param _address I2C address
+         * @param _pBus Shared bus manager, nullptr: direct access
+         * @param timeoutUs Max duration of a transaction of this device
+         */
+        address = _address;
+        pBus = _pBus;
+        if (pBus) {
+            device = pBus->addDevice(devName, address, timeoutUs);
+            pPort = pBus->pPort;
+        } else if (!pPort) {
+            pPort = new I2CWirePort();
+            ownPort = true;
+            pPort->begin();
+            pPort->setTimeout(timeoutUs);
+        }
+    }
+
+    bool transfer(const uint8_t *wdata, uint8_t wlen, uint8_t rlen, T_I2C_DONE done = nullptr) {
+        /*! Write wlen bytes, then read rlen bytes, see I2CBus::transfer()
+         *
+         * @return false if the transfer was not queued (done is called with the reason)
+         */
+        if (pBus)
+            return pBus->transfer(device, wdata, wlen, rlen, done);
+        if (wlen > I2CBus::maxWrite || rlen > I2CBus::maxRead)
+            return false;
+        uint8_t status = I2CPort::OK;
+        if (wlen)
+            status = pPort->write(address, wdata, wlen, rlen == 0);
+        if (status == I2CPort::OK && rlen)
+            status = pPort->read(address, rbuf, rlen);
+        if (done)
+            done(status, rlen ? rbuf : nullptr, status == I2CPort::OK ? rlen : 0);
+        return true;
+    }
+
+    bool writeRegister(uint8_t reg, uint8_t value, T_I2C_DONE done = nullptr) {
+        uint8_t buf[2] = {reg, value};
+        return transfer(buf, 2, 0, done);
+    }
+
+    bool readRegisters(uint8_t reg, uint8_t len, T_I2C_DONE done = nullptr) {
+        return transfer(&reg, 1, len, done);
+    }
+
+    bool isPending() {
+        /*! Check for queued transfers, always false without bus */
+        return pBus && pBus->isPending(device);
+    }
+
+    uint8_t readNow(uint8_t reg, uint8_t *buf, uint8_t len) {
+        /*! Synchronous register read, bypassing the bus queue: for initialization in begin() */
+        uint8_t status = pPort->write(address, &reg, 1, false);
+        if (status != I2CPort::OK)
+            return status;
+        return pPort->read(address, buf, len);
+    }
+
+    uint8_t writeNow(const uint8_t *data, uint8_t len) {
+        /*! Synchronous write, bypassing the bus queue: for initialization in begin() */
+        return pPort->write(address, data, len);
+    }
+};  // I2CClient
+
+}  // namespace ustd
@@ -4,42 +4,175 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "mupplet_arena.h"
+#include "mup_util.h"
 #include "Wire.h"
 #include <Adafruit_PWMServoDriver.h>
 
+// Max bytes per I2C write transaction (register address + data)
+#ifndef USTD_I2CPWM_MAX_BURST
+#if defined(I2C_BUFFER_LENGTH)
+#define USTD_I2CPWM_MAX_BURST (I2C_BUFFER_LENGTH)
+#elif defined(BUFFER_LENGTH)
+#define USTD_I2CPWM_MAX_BURST (BUFFER_LENGTH)
+#else
+#define USTD_I2CPWM_MAX_BURST (32)
+#endif
+#endif
+
 namespace ustd {
-class I2CPWM {
+
+class I2CPWMModes {
+  public:
+    enum Mode : uint8_t { GPIO, PWM, SERVO };
+    enum Profile : uint8_t { TRAPEZOID, SCURVE };
+    static const uint8_t allModes = 0x07;
+};
+
+constexpr uint8_t i2cpwmModeMask() {
+    return 0;
+}
+template <typename... T> constexpr uint8_t i2cpwmModeMask(I2CPWMModes::Mode mode, T... more) {
+    /*! Bit mask of modes, template argument of I2CPWMT */
+    return (uint8_t)((1 << mode) | i2cpwmModeMask(more...));
+}
+
+template <uint8_t MODES = I2CPWMModes::allModes> class I2CPWMT : public I2CPWMModes {
+    /*! PCA9685 PWM boards with a compile-time set of modes
+     *
+     * Without SERVO, the motion profiles (servo speed and acceleration limits, synchronized
+     * moves) are not compiled in. `I2CPWM` supports all modes, `I2CPWMOnly<...>` only the given
+     * ones, e.g. `I2CPWMOnly<I2CPWM::PWM>`.
+     */
   public:
-    enum Mode { GPIO, PWM, SERVO };
+    typedef struct {
+        float pos;   // current position [0.0..1.0], <0: unknown
+        float from;  // start position of current move
+        float to;    // target position of current move
+        float vmax;  // max speed in units/s, 0: unlimited
+        float amax;  // max acceleration in units/s^2, 0: unlimited
+        float T;     // duration of current move in s
+        float ta;    // acceleration (and deceleration) time of trapezoidal move in s
+        float v0;    // speed in units/s at start of current move, !=0: started while moving
+        float a0;    // acceleration in units/s^2 at start of current move
+        unsigned long t0;
+        Profile profile;  // profile of current move
+        bool active;
+    } T_MOTION;
+    static const uint8_t channelsPerBoard = 16;
+    static const uint8_t regMode1 = 0x00;
+    static const uint8_t regLed0OnL = 0x06;
+    static const uint8_t mode1AutoIncrement = 0x20;
+    static const uint8_t mode1AllCall = 0x01;
+    static const uint8_t maxMoveChannels = 32;  // max channels of one /i2cpwm/move message
+
     Scheduler *pSched;
     int tID;
     String name;
     Mode mode;
     uint8_t i2c_address;
+    uint8_t boards;
+    uint16_t channelCount;
     int frequency;
     int servoMin = 150;  // out of 4096
     int servoMax = 600;
     int servoFrequency = 60;
     int ledFrequency = 1000;
+    Profile profile = Profile::TRAPEZOID;
+    T_MOTION *motion;           // per channel motion state, SERVO mode only
+    uint16_t activeMoves = 0;  // number of channels currently moving
 
-    Adafruit_PWMServoDriver *pPwm;
+    Adafruit_PWMServoDriver *pPwm;       // first board
+    Adafruit_PWMServoDriver **pBoards;   // all boards, consecutive i2c addresses
+    uint16_t *onVal;                     // shadow registers LEDn_ON, per channel
+    uint16_t *offVal;                    // shadow registers LEDn_OFF, per channel
+    uint16_t *dirty;                     // changed channels, bitmask per board
+    unsigned long transactions = 0;      // number of i2c write transactions for channel data
     bool bActive = false;
 
-    I2CPWM(String name, Mode mode = Mode::PWM, uint8_t i2c_address = 0x40)
-        : name(name), mode(mode), i2c_address(i2c_address) {
-        if (mode == Mode::SERVO) {
+    I2CPWMT(String name, Mode mode = defaultMode(), uint8_t i2c_address = 0x40,
+            uint8_t boards = 1)
+        : name(name), mode(hasMode(mode) ? mode : defaultMode()), i2c_address(i2c_address),
+          boards(boards) {
+        /*! Instantiate a PWM mupplet for one or more PCA9685 boards
+         *
+         * @param name Name of the mupplet, used for topics
+         * @param mode Mode::PWM, Mode::SERVO or Mode::GPIO, common to all channels, must be
+         * compiled in (MODES)
+         * @param i2c_address Address of the first board (default 0x40)
+         * @param boards Number of boards, located at consecutive addresses starting with
+         * i2c_address. Channels 0..15 are on the first board, 16..31 on the second, etc.
+         */
+        if (isMode(Mode::SERVO)) {
             frequency = servoFrequency;
         } else {
             frequency = ledFrequency;
         }
+        if (this->boards < 1)
+            this->boards = 1;
+        channelCount = (uint16_t)this->boards * channelsPerBoard;
+        pPwm = nullptr;
+        pBoards = nullptr;
+        motion = nullptr;
+        if (isMode(Mode::SERVO)) {
+            motion = (T_MOTION *)arenaAlloc(channelCount * sizeof(T_MOTION));
+            for (uint16_t i = 0; i < channelCount; i++) {
+                motion[i].pos = -1.0;
+                motion[i].vmax = 0.0;
+                motion[i].amax = 0.0;
+                motion[i].v0 = 0.0;
+                motion[i].a0 = 0.0;
+                motion[i].active = false;
+            }
+        }
+        onVal = (uint16_t *)arenaAlloc(channelCount * sizeof(uint16_t));
+        offVal = (uint16_t *)arenaAlloc(channelCount * sizeof(uint16_t));
+        dirty = (uint16_t *)arenaAlloc(this->boards * sizeof(uint16_t));
+        for (uint16_t i = 0; i < channelCount; i++) {
+            onVal[i] = 0;
+            offVal[i] = 4096;  // fully off
+        }
+        for (uint8_t b = 0; b < this->boards; b++) {
+            dirty[b] = 0;
+        }
     }
 
-    ~I2CPWM() {
+    ~I2CPWMT() {
+        if (pBoards) {
+            for (uint8_t b = 0; b < boards; b++) {
+                arenaDelete(pBoards[b]);
+            }
+            arenaFree(pBoards);
+        }
+        arenaFree(onVal);
+        arenaFree(offVal);
+        arenaFree(dirty);
+        if (motion)
+            arenaFree(motion);
+    }
+
+    static constexpr bool hasMode(Mode m) {
+        /*! True if mode m is compiled in */
+        return MODES & (1 << m);
+    }
+
+    static constexpr Mode defaultMode() {
+        /*! PWM, if compiled in, else the first compiled in mode */
+        return hasMode(Mode::PWM) ? Mode::PWM : (Mode)__builtin_ctz(MODES);
+    }
+
+    bool isMode(Mode m) const {
+        /*! Like mode == m, but constant false if m is not compiled in */
+        return hasMode(m) && mode == m;
     }
 
     void setFrequency(int freq) {
         frequency = freq;
-        pPwm->setPWMFreq(frequency);
+        for (uint8_t b = 0; b < boards; b++) {
+            pBoards[b]->setPWMFreq(frequency);
+            enableAutoIncrement(b);
+        }
     }
 
     void setServoMinMax(int minP = 150,
@@ -53,58 +186,442 @@ class I2CPWM {
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
-        pPwm = new Adafruit_PWMServoDriver(i2c_address, Wire);
+        pBoards =
+            (Adafruit_PWMServoDriver **)arenaAlloc(boards * sizeof(Adafruit_PWMServoDriver *));
+        for (uint8_t b = 0; b < boards; b++) {
+            pBoards[b] = new (arenaAlloc(sizeof(Adafruit_PWMServoDriver)))
+                Adafruit_PWMServoDriver(i2c_address + b, Wire);
+            pBoards[b]->begin();
+            pBoards[b]->setPWMFreq(frequency);
+            enableAutoIncrement(b);
+        }
+        pPwm = pBoards[0];
 
-        pPwm->begin();
-        pPwm->setPWMFreq(frequency);
-        auto ft = [=]() { this->loop(); };
-        tID = pSched->add(ft, name, 300000);
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, 20000);
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/i2cpwm/#", fnall);
         bActive = true;
     }
 
+    void setMotionLimits(uint16_t port, double maxSpeed, double maxAccel = 0.0) {
+        /*! Set motion limits of a servo channel
+         *
+         * Moves started with setUnitLevel() or moveSynchronized() follow a
+         * velocity profile (see setProfile()) that respects these limits.
+         * Without limits (the default), the servo jumps to the target
+         * position.
+         *
+         * @param port Channel 0..16*boards-1
+         * @param maxSpeed Max speed in units (full servo range) per second, 0: unlimited
+         * @param maxAccel Max acceleration in units per second^2, 0: unlimited
+         */
+        if (!hasMode(Mode::SERVO) || !motion || port >= channelCount)
+            return;
+        motion[port].vmax = maxSpeed > 0.0 ? maxSpeed : 0.0;
+        motion[port].amax = maxAccel > 0.0 ? maxAccel : 0.0;
+    }
+
+    void setProfile(Profile newProfile) {
+        /*! Select velocity profile for servo moves
+         *
+         * @param newProfile Profile::TRAPEZOID (constant acceleration) or
+         * Profile::SCURVE (minimum jerk, smooth start and stop)
+         */
+        profile = newProfile;
+    }
+
+    bool isMoving(uint16_t port) {
+        if (!hasMode(Mode::SERVO) || !motion || port >= channelCount)
+            return false;
+        return motion[port].active;
+    }
+
+    void moveSynchronized(const uint16_t *ports, const double *levels, uint8_t count) {
+        /*! Move several servos so that they all arrive at the same time
+         *
+         * The duration of the move is that of the slowest channel, all other
+         * channels are slowed down accordingly.
+         *
+         * @param ports Array of channels
+         * @param levels Array of target positions [0.0..1.0]
+         * @param count Number of entries in ports and levels
+         */
+        if (!hasMode(Mode::SERVO) || !motion)
+            return;
+        float T = 0.0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (ports[i] >= channelCount)
+                continue;
+            float d = distance(ports[i], levels[i]);
+            float Tmin = minDuration(motion[ports[i]], d, profile);
+            if (Tmin > T)
+                T = Tmin;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            if (ports[i] < channelCount)
+                startMove(ports[i], levels[i], T);
+        }
+    }
+
     void loop() {
+        if (hasMode(Mode::SERVO) && activeMoves) {
+            unsigned long now = millis();
+            for (uint16_t i = 0; i < channelCount; i++) {
+                if (motion[i].active)
+                    updateMove(i, now);
+            }
+        }
+        flush();
     }
 
-    void setState(uint8_t port, bool state) {
-        if (mode != Mode::SERVO) {
-            if (state) {                      // XXX: negative logic, save state?!
-                pPwm->setPWM(port, 4096, 0);  // turns pin fully on
+    void setPWM(uint16_t port, uint16_t on, uint16_t off) {
+        /*! Set raw on and off counts of a channel in the shadow registers
+         *
+         * The change is written at the end of the current scheduler tick
+         * together with all other changed channels of the same board, or by
+         * calling flush().
+         *
+         * @param port Channel 0..16*boards-1
+         * @param on Counter value [0..4095] at which the output turns on, 4096: fully on
+         * @param off Counter value [0..4095] at which the output turns off, 4096: fully off
+         */
+        if (port >= channelCount)
+            return;
+        if (onVal[port] == on && offVal[port] == off)
+            return;
+        onVal[port] = on;
+        offVal[port] = off;
+        dirty[port / channelsPerBoard] |= (uint16_t)(1 << (port % channelsPerBoard));
+    }
+
+    void setState(uint16_t port, bool state) {
+        if (!isMode(Mode::SERVO)) {
+            if (state) {                // XXX: negative logic, save state?!
+                setPWM(port, 4096, 0);  // turns pin fully on
             } else {
-                pPwm->setPWM(port, 0, 4096);  // turns pin fully off
+                setPWM(port, 0, 4096);  // turns pin fully off
             }
         }
     }
 
-    void setUnitLevel(uint8_t port, double level) {  // 0.0 ... 1.0
-        if (mode != Mode::SERVO) {
+    void setUnitLevel(uint16_t port, double level) {  // 0.0 ... 1.0
+        if (level < 0.0)
+            level = 0.0;
+        if (level > 1.0)
+            level = 1.0;
+        if (!isMode(Mode::SERVO)) {
             int l1 = (int)(4096.0 * level);
             int l2 = 4096 - l1;
-            pPwm->setPWM(port, l1, l2);
-        } else {  // Servo
-            int pulseLen = (int)((double)(servoMax - servoMin) * level) + servoMin;
-            pPwm->setPWM(port, 0, pulseLen);
+            setPWM(port, l1, l2);
+        } else if (hasMode(Mode::SERVO)) {
+            if (port >= channelCount)
+                return;
+            startMove(port, level, minDuration(motion[port], distance(port, level), profile));
+        }
+    }
+
+    void flush() {
+        /*! Write all changed channels to the boards
+         *
+         * The changed channels of each board are written with auto-increment
+         * bursts covering the range from the lowest to the highest changed
+         * channel. A burst is only split if it exceeds the size of the I2C
+         * transmit buffer.
+         */
+        if (!bActive)
+            return;
+        const uint8_t maxChannels = (USTD_I2CPWM_MAX_BURST - 1) / 4;
+        for (uint8_t b = 0; b < boards; b++) {
+            if (!dirty[b])
+                continue;
+            uint8_t first = 0;
+            uint8_t last = channelsPerBoard - 1;
+            while (!(dirty[b] & (1 << first)))
+                ++first;
+            while (!(dirty[b] & (1 << last)))
+                --last;
+            while (first <= last) {
+                uint8_t n = last - first + 1;
+                if (n > maxChannels)
+                    n = maxChannels;
+                writeChannels(b, first, n);
+                first += n;
+            }
+            dirty[b] = 0;
         }
     }
 
     void subsMsg(String topic, String msg, String originator) {
         String wct = name + "/i2cpwm/set/*";
+        String wctMotion = name + "/i2cpwm/motion/set/*";
         int port;
         if (pSched->mqttmatch(topic, wct)) {
             if (topic.length() >= wct.length()) {
                 const char *p = topic.c_str();
-                port = atoi(&p[name.length() + strlen("/i2cpwm/")]);
+                port = atoi(&p[name.length() + strlen("/i2cpwm/set/")]);
                 double level = parseUnitLevel(msg);
                 setUnitLevel(port, level);
             }
+        } else if (hasMode(Mode::SERVO) && pSched->mqttmatch(topic, wctMotion)) {
+            if (topic.length() >= wctMotion.length()) {
+                const char *p = topic.c_str();
+                port = atoi(&p[name.length() + strlen("/i2cpwm/motion/set/")]);
+                // <speed>[,<accel>]
+                const char *m = msg.c_str();
+                double maxAccel = 0.0;
+                const char *pc = strchr(m, ',');
+                if (pc)
+                    maxAccel = atof(pc + 1);
+                setMotionLimits(port, atof(m), maxAccel);
+            }
+        } else if (hasMode(Mode::SERVO) && topic == name + "/i2cpwm/profile/set") {
+            if (msg == "scurve") {
+                setProfile(Profile::SCURVE);
+            } else if (msg == "trapezoid") {
+                setProfile(Profile::TRAPEZOID);
+            }
+        } else if (hasMode(Mode::SERVO) && topic == name + "/i2cpwm/move") {
+            // <channel>:<level>[,<channel>:<level>...]
+            uint16_t ports[maxMoveChannels];
+            double levels[maxMoveChannels];
+            uint8_t count = 0;
+            const char *m = msg.c_str();
+            while (m && *m && count < maxMoveChannels) {
+                const char *pc = strchr(m, ':');
+                if (!pc)
+                    break;
+                ports[count] = atoi(m);
+                levels[count] = atof(pc + 1);
+                ++count;
+                m = strchr(pc, ',');
+                if (m)
+                    ++m;
+            }
+            moveSynchronized(ports, levels, count);
+        }
+    }
+
+  private:
+    float distance(uint16_t port, double level) {
+        if (motion[port].pos < 0.0)
+            return 0.0;  // position unknown: jump
+        float d = (float)level - motion[port].pos;
+        return d < 0.0 ? -d : d;
+    }
+
+    float minDuration(const T_MOTION &m, float d, Profile p) {
+        // shortest duration of a move over distance d within the channel's limits
+        if (d <= 0.0)
+            return 0.0;
+        if (p == Profile::SCURVE) {
+            // minimum jerk: peak speed 1.875*d/T, peak acceleration 5.774*d/T^2
+            float Tv = m.vmax > 0.0 ? 1.875 * d / m.vmax : 0.0;
+            float Ta = m.amax > 0.0 ? sqrt(5.774 * d / m.amax) : 0.0;
+            return Tv > Ta ? Tv : Ta;
+        }
+        if (m.vmax > 0.0 && m.amax > 0.0) {
+            if (d >= m.vmax * m.vmax / m.amax)
+                return d / m.vmax + m.vmax / m.amax;
+            return 2.0 * sqrt(d / m.amax);  // triangular, vmax not reached
+        }
+        if (m.vmax > 0.0)
+            return d / m.vmax;
+        if (m.amax > 0.0)
+            return 2.0 * sqrt(d / m.amax);
+        return 0.0;
+    }
+
+    void startMove(uint16_t port, double level, float T) {
+        T_MOTION &m = motion[port];
+        if (level < 0.0)
+            level = 0.0;
+        if (level > 1.0)
+            level = 1.0;
+        float v0 = 0.0, a0 = 0.0;
+        if (m.active) {
+            // retarget: continue from the current position, speed and acceleration
+            float pos = sample(m, (float)(millis() - m.t0) / 1000.0, &v0, &a0);
+            m.pos = pos < 0.0 ? 0.0 : (pos > 1.0 ? 1.0 : pos);
+            m.active = false;
+            --activeMoves;
+            if (profile == Profile::TRAPEZOID && m.amax <= 0.0)
+                v0 = a0 = 0.0;  // unlimited acceleration: speed may change at once
+        }
+        float d = distance(port, level);
+        Profile p = profile;
+        if (v0 != 0.0 || a0 != 0.0) {
+            // blend with a quintic from the current speed and acceleration, not shorter than a
+            // rest-to-rest S-curve
+            p = Profile::SCURVE;
+            float Ts = minDuration(m, d, p);
+            if (Ts > T)
+                T = Ts;
+            if (T <= 0.0)
+                T = 0.02;
+        } else if (d <= 0.0) {
+            T = 0.0;
+        }
+        if (T <= 0.0) {
+            m.pos = level;
+            writeServo(port, level);
+            return;
+        }
+        m.from = m.pos;
+        m.to = level;
+        m.T = T;
+        m.ta = 0.0;
+        m.v0 = v0;
+        m.a0 = a0;
+        m.profile = p;
+        if (p == Profile::SCURVE && m.amax > 0.0) {
+            // stretch a blended move until its peak acceleration is within the limit
+            for (uint8_t i = 0; i < 8; i++) {
+                float amax = peakAcceleration(m);
+                if (amax <= m.amax * 1.01)
+                    break;
+                m.T *= sqrt(amax / m.amax);
+            }
         }
+        if (p == Profile::TRAPEZOID && m.amax > 0.0) {
+            // stretch to duration T with the channel's acceleration: d = amax*ta*(T-ta)
+            float disc = T * T - 4.0 * d / m.amax;
+            m.ta = (T - sqrt(disc > 0.0 ? disc : 0.0)) / 2.0;
+        }
+        m.t0 = millis();
+        m.active = true;
+        ++activeMoves;
     }
-};  // I2CPWM
+
+    float sample(const T_MOTION &m, float t, float *pv, float *pa) {
+        // position, speed and acceleration of the current move t seconds after its start
+        float D = m.to - m.from;
+        if (t >= m.T) {
+            *pv = 0.0;
+            *pa = 0.0;
+            return m.to;
+        }
+        if (m.profile == Profile::SCURVE) {
+            // quintic from (from, v0, a0) to (to, 0, 0), minimum jerk for v0 = a0 = 0
+            float tau = t / m.T;
+            float V = m.v0 * m.T;
+            float A = m.a0 * m.T * m.T;
+            float c3 = 10.0 * D - 6.0 * V - 1.5 * A;
+            float c4 = -15.0 * D + 8.0 * V + 1.5 * A;
+            float c5 = 6.0 * D - 3.0 * V - 0.5 * A;
+            *pv = (V + tau * (A + tau * (3.0 * c3 + tau * (4.0 * c4 + tau * 5.0 * c5)))) / m.T;
+            *pa = (A + tau * (6.0 * c3 + tau * (12.0 * c4 + tau * 20.0 * c5))) / (m.T * m.T);
+            return m.from + tau * (V + tau * (0.5 * A + tau * (c3 + tau * (c4 + tau * c5))));
+        }
+        if (m.ta <= 0.0) {
+            *pv = D / m.T;
+            *pa = 0.0;
+            return m.from + D * t / m.T;
+        }
+        // normalized peak speed, distance 1 covered in T
+        float vp = 1.0 / (m.T - m.ta);
+        float s;  // fraction of distance covered [0..1]
+        if (t < m.ta) {
+            s = 0.5 * vp / m.ta * t * t;
+            *pv = vp / m.ta * t;
+            *pa = vp / m.ta;
+        } else if (t < m.T - m.ta) {
+            s = vp * (t - m.ta / 2.0);
+            *pv = vp;
+            *pa = 0.0;
+        } else {
+            float tr = m.T - t;
+            s = 1.0 - 0.5 * vp / m.ta * tr * tr;
+            *pv = vp / m.ta * tr;
+            *pa = -vp / m.ta;
+        }
+        *pv *= D;
+        *pa *= D;
+        return m.from + D * s;
+    }
+
+    float peakAcceleration(const T_MOTION &m) {
+        // largest |acceleration| of a quintic move: at its ends or where the jerk is zero
+        float tau[4] = {0.0, 1.0, -1.0, -1.0};
+        float D = m.to - m.from;
+        float V = m.v0 * m.T;
+        float A = m.a0 * m.T * m.T;
+        float c3 = 10.0 * D - 6.0 * V - 1.5 * A;
+        float c4 = -15.0 * D + 8.0 * V + 1.5 * A;
+        float c5 = 6.0 * D - 3.0 * V - 0.5 * A;
+        // jerk: 6*c3 + 24*c4*tau + 60*c5*tau^2
+        if (c5 != 0.0) {
+            float disc = 576.0 * c4 * c4 - 1440.0 * c5 * c3;
+            if (disc >= 0.0) {
+                tau[2] = (-24.0 * c4 + sqrt(disc)) / (120.0 * c5);
+                tau[3] = (-24.0 * c4 - sqrt(disc)) / (120.0 * c5);
+            }
+        } else if (c4 != 0.0) {
+            tau[2] = -c3 / (4.0 * c4);
+        }
+        float peak = 0.0;
+        for (uint8_t i = 0; i < 4; i++) {
+            if (tau[i] < 0.0 || tau[i] > 1.0)
+                continue;
+            float t = tau[i];
+            float a = A + t * (6.0 * c3 + t * (12.0 * c4 + t * 20.0 * c5));
+            if (a < 0.0)
+                a = -a;
+            if (a > peak)
+                peak = a;
+        }
+        return peak / (m.T * m.T);
+    }
+
+    void updateMove(uint16_t port, unsigned long now) {
+        T_MOTION &m = motion[port];
+        float t = (float)(now - m.t0) / 1000.0;
+        float v, a;
+        float pos = sample(m, t, &v, &a);
+        if (t >= m.T) {
+            m.active = false;
+            --activeMoves;
+        }
+        // a blended move may swing slightly past its target
+        m.pos = pos < 0.0 ? 0.0 : (pos > 1.0 ? 1.0 : pos);
+        writeServo(port, m.pos);
+    }
+
+    void writeServo(uint16_t port, double level) {
+        int pulseLen = (int)((double)(servoMax - servoMin) * level) + servoMin;
+        setPWM(port, 0, pulseLen);
+    }
+
+    void enableAutoIncrement(uint8_t board) {
+        // MODE1 after begin() and setPWMFreq(): awake, ALLCALL; no read-back needed
+        Wire.beginTransmission((uint8_t)(i2c_address + board));
+        Wire.write(regMode1);
+        Wire.write((uint8_t)(mode1AllCall | mode1AutoIncrement));
+        Wire.endTransmission();
+    }
+
+    void writeChannels(uint8_t board, uint8_t first, uint8_t n) {
+        Wire.beginTransmission((uint8_t)(i2c_address + board));
+        Wire.write((uint8_t)(regLed0OnL + 4 * first));
+        for (uint8_t i = 0; i < n; i++) {
+            uint16_t ch = (uint16_t)board * channelsPerBoard + first + i;
+            Wire.write((uint8_t)(onVal[ch] & 0xff));
+            Wire.write((uint8_t)(onVal[ch] >> 8));
+            Wire.write((uint8_t)(offVal[ch] & 0xff));
+            Wire.write((uint8_t)(offVal[ch] >> 8));
+        }
+        Wire.endTransmission();
+        ++transactions;
+    }
+};  // I2CPWMT
+
+typedef I2CPWMT<I2CPWMModes::allModes> I2CPWM;
+template <I2CPWMModes::Mode... M> using I2CPWMOnly = I2CPWMT<i2cpwmModeMask(M...)>;
 
 }  // namespace ustd
@@ -2,12 +2,16 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "sensors.h"
 #include "home_assistant.h"
+#include "filter_kernels.h"
+#include "adaptive_poll.h"
 
 namespace ustd {
 class Ldr {
   private:
-    String LDR_VERSION = "0.1.0";
+    static constexpr const char *LDR_VERSION = "0.2.0";
     Scheduler *pSched;
     int tID;
     String name;
@@ -24,11 +28,46 @@ class Ldr {
 
   public:
     ustd::sensorprocessor illuminanceSensor = ustd::sensorprocessor(4, 600, 0.005);
+    FilterKernel *pKernel;
+    AdaptivePoll *pAdaptive = nullptr;
 
     Ldr(String name, uint8_t port) : name(name), port(port) {
+        pKernel = new HampelFilter(7, 3.0);  // reject spikes of the analog input
     }
 
     ~Ldr() {
+        if (pKernel)
+            delete pKernel;
+        if (pAdaptive)
+            delete pAdaptive;
+    }
+
+    void setAdaptivePolling(unsigned long minIntervalMs = 200, unsigned long maxIntervalMs = 5000) {
+        /*! Sample fast while the illuminance changes and slow down while it is stable
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs);
+        pAdaptive->setEps(0, illuminanceSensor.eps);
+    }
+
+    void setFilterKernel(FilterKernel *pNewKernel) {
+        /*! Replace the filter applied to raw values before the sensorprocessor
+         *
+         * @param pNewKernel New kernel (ownership is transferred) or nullptr for no filter,
+         * default is a HampelFilter(7, 3.0).
+         */
+        if (pKernel)
+            delete pKernel;
+        pKernel = pNewKernel;
+        illuminanceSensor.reset();
+    }
+
+    void publishFilterKernel() {
+        pSched->publish(name + "/sensor/unitilluminance/filter", pKernel ? pKernel->spec() : "none");
     }
 
     void publishIlluminance() {
@@ -42,26 +81,28 @@ class Ldr {
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
         // give a c++11 lambda as callback scheduler task registration of
         // this.loop():
         /* std::function<void()> */
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 200000);
 
         /* std::function<void(String, String, String)> */
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/unitilluminance/#", fnall);
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, LDR_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, LDR_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("unitilluminance", "Unit-Illuminance", "[0..1]", "illuminance",
                        "mdi:brightness-6");
         pHA->begin(pSched);
@@ -71,6 +112,12 @@ class Ldr {
   private:
     void loop() {
         double val = analogRead(port) / (adRange - 1.0);
+        if (pKernel)
+            val = pKernel->update(val);
+        if (pAdaptive) {
+            pAdaptive->update(0, val);
+            pAdaptive->reschedule(pSched, tID);
+        }
         if (illuminanceSensor.filter(&val)) {
             ldrvalue = val;
             publishIlluminance();
@@ -81,6 +128,13 @@ class Ldr {
         if (topic == name + "/sensor/unitilluminance/get") {
             publishIlluminance();
         }
+        if (topic == name + "/sensor/unitilluminance/filter/set") {
+            setFilterKernel(createFilterKernel(msg));
+            publishFilterKernel();
+        }
+        if (topic == name + "/sensor/unitilluminance/filter/get") {
+            publishFilterKernel();
+        }
     };
 };  // Ldr
 
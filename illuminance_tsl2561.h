@@ -1,17 +1,19 @@
 // tsl2561.h
-// Substantial parts of the code are taken from Adafruit's example
-// sensorapi.h included with the TSL2561 library by Adafruit.
+// Register access and lux calculation according to the TAOS TSL2560/TSL2561 datasheet (TAOS059).
 #pragma once
 
 #include "scheduler.h"
-#include <Adafruit_Sensor.h>
-#include <Adafruit_TSL2561_U.h>
+#include "mupplet_stats.h"
+#include "sensors.h"
+#include "home_assistant.h"
+#include "i2c_bus.h"
+#include "adaptive_poll.h"
 
 namespace ustd {
 class IlluminanceTsl2561 {
     /*! Support for TSL256 light-to-digital converter that approximates human eye response */
   public:
-    String TSL_VERSION = "0.2.0";
+    static constexpr const char *TSL_VERSION = "0.3.0";
     enum SampleGainMode {
         FAST_GAINX1,
         FAST_GAINX16,
@@ -21,6 +23,14 @@ class IlluminanceTsl2561 {
         PRECISE_GAINX16
     };
     enum FilterMode { FAST, MEDIUM, LONGTERM };
+    enum MeasureState { IDLE, CONFIGURING, INTEGRATING, READING };
+    typedef struct {
+        uint8_t timing;   // TIMING register: gain 0x10 (16x), integration 0, 1, 2
+        uint16_t intMs;   // integration time, rounded up
+        double scale;     // factor to nominal 16x / 402ms
+        uint16_t maxCounts;  // saturation of channel 0
+    } T_RANGE;
+    static const uint8_t rangeCount = 6;
     Scheduler *pSched;
     int tID;
 
@@ -31,15 +41,37 @@ class IlluminanceTsl2561 {
 
     FilterMode filterMode;
     unsigned long usSampleThread = 250000;  // default poll time in us.
+    AdaptivePoll *pAdaptive = nullptr;  // adapts usSampleThread if set
     double luxvalue = 0.0;
     double unitIlluminanceValue = 0.0;
     double maxLux = 800.0;
     ustd::sensorprocessor illuminanceSensor = ustd::sensorprocessor(40, 600, 5.0);
 
-    Adafruit_TSL2561_Unified *pTsl;
+    I2CBus *pBus = nullptr;
+    int busDevice = -1;
+    I2CPort *pPort = nullptr;  // used without bus and for initialization
+    bool ownPort = false;
     bool bActive = false;
-    tsl2561Gain_t tsl2561Gain = TSL2561_GAIN_1X;
-    tsl2561IntegrationTime_t tsl2561Speed = TSL2561_INTEGRATIONTIME_101MS;
+
+    // auto-ranging: all gain and integration time combinations, ordered by sensitivity
+    const T_RANGE ranges[rangeCount] = {{0x00, 14, 16.0 * 402.0 / 13.7, 5047},     // 1x 13.7ms
+                                        {0x01, 101, 16.0 * 402.0 / 101.0, 37177},  // 1x 101ms
+                                        {0x10, 14, 402.0 / 13.7, 5047},            // 16x 13.7ms
+                                        {0x02, 402, 16.0, 65535},                  // 1x 402ms
+                                        {0x11, 101, 402.0 / 101.0, 37177},         // 16x 101ms
+                                        {0x12, 402, 1.0, 65535}};                  // 16x 402ms
+    bool bAutoRange = true;
+    uint8_t range = 5;
+    MeasureState state = MeasureState::IDLE;
+    unsigned long cycleStart = 0;
+    unsigned long integrationStart = 0;
+    bool rangePending = true;
+    bool discardPending = false;  // first conversion after a range change mixes both ranges
+    uint16_t ch0 = 0, ch1 = 0;
+    double lastLux = 0.0;  // last valid illuminance, before amp and filter
+    unsigned long samples = 0;
+    unsigned long rangeChanges = 0;
+    unsigned long errors = 0;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
@@ -49,38 +81,32 @@ class IlluminanceTsl2561 {
         : name(name), i2c_address(i2c_address), sampleGainMode(sampleGainMode), amp(amp) {
         switch (sampleGainMode) {
         case FAST_GAINX1:
-            tsl2561Speed = TSL2561_INTEGRATIONTIME_13MS;
-            tsl2561Gain = TSL2561_GAIN_1X;
+            range = 0;
             usSampleThread = 250000;
             setFilterMode(FAST, true);
             break;
         case FAST_GAINX16:
-            tsl2561Speed = TSL2561_INTEGRATIONTIME_13MS;
-            tsl2561Gain = TSL2561_GAIN_16X;
+            range = 2;
             usSampleThread = 250000;
             setFilterMode(FAST, true);
             break;
         case MEDIUM_GAINX1:
-            tsl2561Speed = TSL2561_INTEGRATIONTIME_101MS;
-            tsl2561Gain = TSL2561_GAIN_1X;
+            range = 1;
             usSampleThread = 500000;
             setFilterMode(MEDIUM, true);
             break;
         case MEDIUM_GAINX16:
-            tsl2561Speed = TSL2561_INTEGRATIONTIME_101MS;
-            tsl2561Gain = TSL2561_GAIN_16X;
+            range = 4;
             usSampleThread = 500000;
             setFilterMode(MEDIUM, true);
             break;
         case PRECISE_GAINX1:
-            tsl2561Speed = TSL2561_INTEGRATIONTIME_402MS;
-            tsl2561Gain = TSL2561_GAIN_1X;
+            range = 3;
             usSampleThread = 1000000;
             setFilterMode(LONGTERM, true);
             break;
         case PRECISE_GAINX16:
-            tsl2561Speed = TSL2561_INTEGRATIONTIME_402MS;
-            tsl2561Gain = TSL2561_GAIN_16X;
+            range = 5;
             usSampleThread = 1000000;
             setFilterMode(LONGTERM, true);
             break;
@@ -91,6 +117,10 @@ class IlluminanceTsl2561 {
     }
 
     ~IlluminanceTsl2561() {
+        if (ownPort)
+            delete pPort;
+        if (pAdaptive)
+            delete pAdaptive;
     }
 
     void setFilterMode(FilterMode mode, bool silent = false) {
@@ -118,26 +148,105 @@ class IlluminanceTsl2561 {
             illuminanceSensor.reset();
             break;
         }
+        if (pAdaptive)
+            pAdaptive->setEps(0, illuminanceSensor.eps);
         if (!silent)
             publishFilterMode();
     }
 
+    void setAdaptivePolling(unsigned long minIntervalMs = 250,
+                            unsigned long maxIntervalMs = 10000) {
+        /*! Sample fast while the illuminance changes and slow down while it is stable
+         *
+         * The significant change is the eps of the current filter mode.
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs);
+        pAdaptive->setEps(0, illuminanceSensor.eps);
+        usSampleThread = pAdaptive->intervalMs * 1000;
+    }
+
+    double calcLux(uint16_t broadband, uint16_t ir, const T_RANGE &r) {
+        /*! Calculate illuminance from raw channel counts
+         *
+         * Counts are scaled to 16x gain and 402ms integration time, formulas
+         * for the T, FN and CL packages.
+         *
+         * @return Illuminance in lux, -1.0 if channel 0 is saturated
+         */
+        if (broadband >= r.maxCounts)
+            return -1.0;
+        if (broadband == 0)
+            return 0.0;
+        double c0 = broadband * r.scale;
+        double c1 = ir * r.scale;
+        double ratio = c1 / c0;
+        double lux;
+        if (ratio <= 0.50)
+            lux = 0.0304 * c0 - 0.062 * c0 * pow(ratio, 1.4);
+        else if (ratio <= 0.61)
+            lux = 0.0224 * c0 - 0.031 * c1;
+        else if (ratio <= 0.80)
+            lux = 0.0128 * c0 - 0.0153 * c1;
+        else if (ratio <= 1.30)
+            lux = 0.00146 * c0 - 0.00112 * c1;
+        else
+            lux = 0.0;
+        return lux < 0.0 ? 0.0 : lux;
+    }
+
     double calcLux() {
-        double val = 0.0;
-        /* Get a new sensor event */
-        sensors_event_t event;
-        pTsl->getEvent(&event);
-
-        /* Display the results (light is measured in lux) */
-        if (event.light) {
-            val = event.light;
-        } else {
-            /* If event.light = 0 lux the sensor is probably saturated
-               and no reliable data could be generated!
-               Unfortunately this can't be discriminated from darkness! */
-            val = 0.0;
-        }
-        return val;
+        /*! Illuminance in lux of the last valid sample, before amp and filtering
+         *
+         * Kept for compatibility: the sensor is no longer read synchronously,
+         * the value is that of the measurement cycle run by loop().
+         */
+        return lastLux;
+    }
+
+    void configureSensor() {
+        /*! Write gain and integration time of the current range to the sensor
+         *
+         * Kept for compatibility, loop() configures the sensor; this only
+         * schedules a new configuration.
+         */
+        rangePending = true;
+    }
+
+    void displaySensorDetails() {
+        /*! Print address, range and counters to Serial (USE_SERIAL_DBG) */
+#ifdef USE_SERIAL_DBG
+        const T_RANGE &r = ranges[range];
+        Serial.println("------------------------------------");
+        Serial.print("Sensor:       TSL2561 at 0x");
+        Serial.println(String(i2c_address, 16));
+        Serial.print("Gain:         ");
+        Serial.println(r.timing & 0x10 ? "16x" : "1x");
+        Serial.print("Integration:  ");
+        Serial.print(r.intMs);
+        Serial.println(" ms");
+        Serial.print("Samples:      ");
+        Serial.println(samples);
+        Serial.print("Range changes: ");
+        Serial.println(rangeChanges);
+        Serial.print("Errors:       ");
+        Serial.println(errors);
+        Serial.println("------------------------------------");
+        Serial.println("");
+#endif
+    }
+
+    void setAutoRange(bool autoRange) {
+        /*! Enable or disable automatic selection of gain and integration time
+         *
+         * Without auto-ranging, gain and integration time are those of the
+         * SampleGainMode given in the constructor.
+         */
+        bAutoRange = autoRange;
     }
 
     double setMaxLux(double newMaxLux) {
@@ -163,73 +272,42 @@ class IlluminanceTsl2561 {
         return unitIlluminanceValue;
     }
 
-    // Taken from Adafruit's sensorapi.ino example
-    void displaySensorDetails(void) {
-#ifdef USE_SERIAL_DBG
-        sensor_t sensor;
-        pTsl->getSensor(&sensor);
-        Serial.println("------------------------------------");
-        Serial.print("Sensor:       ");
-        Serial.println(sensor.name);
-        Serial.print("Driver Ver:   ");
-        Serial.println(sensor.version);
-        Serial.print("Unique ID:    ");
-        Serial.println(sensor.sensor_id);
-        Serial.print("Max Value:    ");
-        Serial.print(sensor.max_value);
-        Serial.println(" lux");
-        Serial.print("Min Value:    ");
-        Serial.print(sensor.min_value);
-        Serial.println(" lux");
-        Serial.print("Resolution:   ");
-        Serial.print(sensor.resolution);
-        Serial.println(" lux");
-        Serial.println("------------------------------------");
-        Serial.println("");
-#endif
-    }
-
-    // Taken from Adafruit's sensorapi.ino example
-    void configureSensor(void) {
-        // if (bAutogain) {
-        //    /* Auto-gain ... switches automatically between 1x and 16x */
-        //    pTsl->enableAutoRange(true);
-        //} else {
-        /* You can also manually set the gain or enable auto-gain support */
-        // pTsl.setGain(TSL2561_GAIN_1X);      /* No gain ... use in bright
-        // light to avoid sensor saturation */
-        /* // 16x gain ... use in low light to boost sensitivity */
-        pTsl->setGain(tsl2561Gain);
-        //}
-
-        pTsl->setIntegrationTime(tsl2561Speed);
-        /* Changing the integration time gives you better sensor resolution
-         * (402ms = 16-bit data) */
-        // pTsl->setIntegrationTime(TSL2561_INTEGRATIONTIME_101MS);  /* medium
-        // resolution and speed   */
-        // pTsl->setIntegrationTime(TSL2561_INTEGRATIONTIME_402MS);  /* 16-bit
-        // data but slowest conversions */
-    }
-
-    void begin(Scheduler *_pSched) {
+    void begin(Scheduler *_pSched, I2CBus *_pBus = nullptr) {
+        /*! Initialize sensor and start measurements
+         *
+         * @param _pSched Scheduler
+         * @param _pBus Optional shared I2C bus manager, measurements are then
+         * queued on the bus instead of accessing the sensor from the loop.
+         */
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
+        pBus = _pBus;
+        if (pBus) {
+            busDevice = pBus->addDevice(name, i2c_address);
+            pPort = pBus->pPort;
+        } else {
+            pPort = new I2CWirePort();
+            ownPort = true;
+            pPort->begin();
+        }
 
-        pTsl = new Adafruit_TSL2561_Unified(i2c_address, 12345);
-
-        if (!pTsl->begin()) {
+        if (!initSensor()) {
             /* There was a problem detecting the TSL2561 ... check your
              * connections */
             DBG("No TSL2561 detected, check your wiring or i2c_address (usually 0x29, 0x39, or "
                 "0x49)");
         } else {
-            auto ft = [=]() { this->loop(); };
-            tID = pSched->add(ft, name, usSampleThread);
+            auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+            tID = pSched->add(ft, name, 10000);  // state machine, sample every usSampleThread
 
-            auto fnall = [=](String topic, String msg, String originator) {
+            auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
                 this->subsMsg(topic, msg, originator);
-            };
+            });
             pSched->subscribe(tID, name + "/sensor/illuminance/#", fnall);
             pSched->subscribe(tID, name + "/sensor/unitilluminance/#", fnall);
+            pSched->subscribe(tID, name + "/sensor/maxlux/#", fnall);
+            pSched->subscribe(tID, name + "/sensor/mode/#", fnall);
+            pSched->subscribe(tID, name + "/sensor/autorange/#", fnall);
             bActive = true;
         }
     }
@@ -237,8 +315,9 @@ class IlluminanceTsl2561 {
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, TSL_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, TSL_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("unitilluminance", "Unit-Illuminance", "[0..1]", "illuminance",
                        "mdi:brightness-6");
         pHA->addSensor("illuminance", "Illuminance", "lux", "illuminance", "mdi:brightness-6");
@@ -275,17 +354,35 @@ class IlluminanceTsl2561 {
     }
 
     void loop() {
-        if (bActive) {
-            double val = calcLux() * amp;
-            if (val != -1.0) {
-                if (illuminanceSensor.filter(&val)) {
-                    luxvalue = val;
-                    unitIlluminanceValue = val / maxLux;
-                    if (unitIlluminanceValue > 1.0)
-                        unitIlluminanceValue = 1.0;
-                    publishIlluminance();
-                }
+        /*! Auto-ranging measurement cycle
+         *
+         * The sensor integrates continuously. After a change of gain or
+         * integration time, the first conversion is discarded (it was started
+         * with the old range) and the channels are read once the following
+         * integration period has elapsed; otherwise they are read every
+         * usSampleThread.
+         * The counts select the range for the next sample: saturated or
+         * above 80% of full scale: less sensitive, expected to stay below
+         * 40% of full scale in the next range: more sensitive.
+         */
+        if (!bActive)
+            return;
+        switch (state) {
+        case MeasureState::IDLE:
+            if (rangePending) {
+                configure();
+            } else if (timeDiff(cycleStart, millis()) >= usSampleThread / 1000 &&
+                       timeDiff(integrationStart, millis()) >= ranges[range].intMs) {
+                readChannels();
+            }
+            break;
+        case MeasureState::INTEGRATING:
+            if (timeDiff(integrationStart, millis()) >= (unsigned long)ranges[range].intMs + 2) {
+                readChannels();
             }
+            break;
+        default:  // waiting for bus
+            break;
         }
     }
 
@@ -315,7 +412,137 @@ class IlluminanceTsl2561 {
         if (topic == name + "/sensor/mode/get") {
             publishFilterMode();
         }
+        if (topic == name + "/sensor/autorange/set") {
+            setAutoRange(msg == "on" || msg == "true" || msg == "1");
+        }
     };
+
+  private:
+    static const uint8_t cmd = 0x80;
+    static const uint8_t cmdWord = 0xA0;
+    static const uint8_t regControl = 0x00;
+    static const uint8_t regTiming = 0x01;
+    static const uint8_t regId = 0x0A;
+    static const uint8_t regData0 = 0x0C;
+    static const uint8_t regData1 = 0x0E;
+    uint8_t ch0Status = 0;
+
+    bool initSensor() {
+        uint8_t reg = cmd | regId;
+        uint8_t id = 0xff;
+        if (pPort->write(i2c_address, &reg, 1, false) != I2CPort::OK ||
+            pPort->read(i2c_address, &id, 1) != I2CPort::OK)
+            return false;
+        if ((id & 0xA0) != 0x00)  // part number: 0000 or 0001 (CS), 0100 or 0101 (T, FN, CL)
+            return false;
+        uint8_t powerOn[2] = {cmd | regControl, 0x03};
+        if (pPort->write(i2c_address, powerOn, 2) != I2CPort::OK)
+            return false;
+        rangePending = true;
+        return true;
+    }
+
+    void configure() {
+        uint8_t timing = ranges[range].timing;
+        if (pBus) {
+            state = MeasureState::CONFIGURING;
+            pBus->writeRegister(busDevice, cmd | regTiming, timing,
+                                [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                                    this->onConfigured(st);
+                                });
+        } else {
+            uint8_t buf[2] = {cmd | regTiming, timing};
+            onConfigured(pPort->write(i2c_address, buf, 2));
+        }
+    }
+
+    void onConfigured(uint8_t st) {
+        if (st != I2CPort::OK) {
+            ++errors;
+            state = MeasureState::IDLE;
+            return;
+        }
+        rangePending = false;
+        discardPending = true;
+        integrationStart = millis();
+        state = MeasureState::INTEGRATING;
+    }
+
+    void readChannels() {
+        if (pBus) {
+            state = MeasureState::READING;
+            pBus->readRegisters(busDevice, cmdWord | regData0, 2,
+                                [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                                    ch0Status = st;
+                                    if (st == I2CPort::OK)
+                                        ch0 = (uint16_t)(data[1] << 8 | data[0]);
+                                });
+            pBus->readRegisters(busDevice, cmdWord | regData1, 2,
+                                [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                                    if (st == I2CPort::OK)
+                                        ch1 = (uint16_t)(data[1] << 8 | data[0]);
+                                    this->onData(ch0Status != I2CPort::OK ? ch0Status : st);
+                                });
+        } else {
+            uint8_t d[2];
+            uint8_t reg = cmdWord | regData0;
+            uint8_t st = pPort->write(i2c_address, &reg, 1, false);
+            if (st == I2CPort::OK)
+                st = pPort->read(i2c_address, d, 2);
+            ch0 = (uint16_t)(d[1] << 8 | d[0]);
+            reg = cmdWord | regData1;
+            if (st == I2CPort::OK)
+                st = pPort->write(i2c_address, &reg, 1, false);
+            if (st == I2CPort::OK)
+                st = pPort->read(i2c_address, d, 2);
+            ch1 = (uint16_t)(d[1] << 8 | d[0]);
+            onData(st);
+        }
+    }
+
+    void onData(uint8_t st) {
+        state = MeasureState::IDLE;
+        cycleStart = millis();
+        integrationStart = millis();  // next result available after one integration period
+        if (st != I2CPort::OK) {
+            ++errors;
+            return;
+        }
+        if (discardPending) {
+            // the conversion in progress when the range was written, wait for the next one
+            discardPending = false;
+            state = MeasureState::INTEGRATING;
+            return;
+        }
+        const T_RANGE &r = ranges[range];
+        double val = calcLux(ch0, ch1, r);
+        if (bAutoRange) {
+            if ((ch0 >= r.maxCounts * 0.8 || ch1 >= r.maxCounts * 0.8) && range > 0) {
+                --range;
+                ++rangeChanges;
+                rangePending = true;
+            } else if (range < rangeCount - 1 &&
+                       ch0 * r.scale / ranges[range + 1].scale < ranges[range + 1].maxCounts * 0.4) {
+                ++range;
+                ++rangeChanges;
+                rangePending = true;
+            }
+        }
+        if (val < 0.0)
+            return;  // saturated, repeat with new range
+        ++samples;
+        lastLux = val;
+        val *= amp;
+        if (pAdaptive)
+            usSampleThread = pAdaptive->update(0, val) * 1000;
+        if (illuminanceSensor.filter(&val)) {
+            luxvalue = val;
+            unitIlluminanceValue = val / maxLux;
+            if (unitIlluminanceValue > 1.0)
+                unitIlluminanceValue = 1.0;
+            publishIlluminance();
+        }
+    }
 };  // Illuminance
 
 }  // namespace ustd
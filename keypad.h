@@ -0,0 +1,254 @@
+// keypad.h
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_stats.h"
+#include "switch.h"
+
+namespace ustd {
+
+#define USTD_MAX_KEYPAD_LINES (8)
+
+template <typename SW = Switch> class KeypadT {
+    /*! Matrix keypad with up to 8 rows and 8 columns
+     *
+     * Rows are driven low one at a time, the other rows are high impedance, columns are read with
+     * pull-ups: a pressed key pulls its column low. Each tick reads the columns of the row driven
+     * during the previous tick and drives the next row, so the lines have a full tick to settle
+     * and no tick waits. A complete matrix frame (one bit per key) is available every `rows`
+     * ticks. All keys are debounced in parallel with a 2-bit vertical counter over 4 frames.
+     *
+     * Keys that may be ghosts (two rows sharing two or more pressed columns, which a matrix
+     * without diodes can't distinguish from three pressed keys) are masked: in the rows and
+     * columns of the ambiguity, the debounced state is kept until it is gone; all other keys of
+     * the frame are processed normally.
+     *
+     * Keys are added as Switch instances (addKey()) and publish `<key-name>/switch/state` with
+     * the same modes and topics as a Switch on a GPIO. Keys without Switch publish
+     * `<keypad-name>/keypad/key` `<row>,<col> on|off`. The keys have the type SW: `Keypad` uses
+     * `Switch`, e.g. `KeypadT<SwitchOnly<Switch::Default>>` keys with only the Default mode.
+     */
+  public:
+    static constexpr const char *KEYPAD_VERSION = "0.1.0";
+    Scheduler *pSched;
+    int tID;
+    String name;
+    uint8_t rows;
+    uint8_t cols;
+    uint8_t rowPins[USTD_MAX_KEYPAD_LINES];
+    uint8_t colPins[USTD_MAX_KEYPAD_LINES];
+    SW *keys[USTD_MAX_KEYPAD_LINES * USTD_MAX_KEYPAD_LINES];  // row * 8 + col
+    uint8_t keyList[USTD_MAX_KEYPAD_LINES * USTD_MAX_KEYPAD_LINES];  // indices of added keys
+    uint8_t keyCount = 0;
+
+    uint8_t scanRow = 0;
+    uint64_t frame = 0;      // bit row * 8 + col: pressed
+    uint64_t debounced = 0;  // debounced key state
+    uint64_t count0 = 0xffffffffffffffffULL;  // vertical counter, bit 0
+    uint64_t count1 = 0xffffffffffffffffULL;  // vertical counter, bit 1
+    uint64_t ghostMask = 0;  // keys masked in the last frame
+    uint64_t ticking = 0;    // keys with a timer or gesture in progress
+    bool ghosting = false;
+    unsigned long frames = 0;
+    unsigned long ghostFrames = 0;
+
+    KeypadT(String name, const uint8_t *pRowPins, uint8_t rows, const uint8_t *pColPins,
+            uint8_t cols)
+        : name(name), rows(rows), cols(cols) {
+        /*! Instantiate a matrix keypad
+         *
+         * @param name Name of the keypad
+         * @param pRowPins GPIOs of the rows
+         * @param rows Number of rows (1..8)
+         * @param pColPins GPIOs of the columns
+         * @param cols Number of columns (1..8)
+         */
+        if (this->rows > USTD_MAX_KEYPAD_LINES)
+            this->rows = USTD_MAX_KEYPAD_LINES;
+        if (this->cols > USTD_MAX_KEYPAD_LINES)
+            this->cols = USTD_MAX_KEYPAD_LINES;
+        memcpy(rowPins, pRowPins, this->rows);
+        memcpy(colPins, pColPins, this->cols);
+        memset(keys, 0, sizeof(keys));
+    }
+
+    KeypadT(const KeypadT &) = delete;  // owns the key switches
+    KeypadT &operator=(const KeypadT &) = delete;
+
+    ~KeypadT() {
+        for (uint8_t i = 0; i < keyCount; i++) {
+            delete keys[keyList[i]];
+        }
+    }
+
+    SW *addKey(uint8_t row, uint8_t col, String keyName, SwitchModes::Mode mode = SW::firstMode(),
+               String customTopic = "") {
+        /*! Add a key as Switch, before begin()
+         *
+         * @param row Row of the key
+         * @param col Column of the key
+         * @param keyName Name of the Switch, topics are `<keyName>/switch/...`
+         * @param mode Switch mode (Default, Rising, Falling, Flipflop, Timer, Duration, Gesture),
+         * modes that are not compiled into SW are replaced by its first mode
+         * @param customTopic Optional additional topic for state changes
+         * @return The Switch (e.g. for setTimerDuration()), owned by the keypad, nullptr if the
+         * key is not part of the matrix or already added.
+         */
+        if (row >= rows || col >= cols || keys[row * 8 + col])
+            return nullptr;
+        // port is not used, the keypad sets the physical level
+        keys[row * 8 + col] = new SW(keyName, 255, mode, true, customTopic);
+        keyList[keyCount++] = row * 8 + col;
+        return keys[row * 8 + col];
+    }
+
+    void begin(Scheduler *_pSched, unsigned long rowIntervalUs = 1000) {
+        /*! Start scanning
+         *
+         * @param _pSched Scheduler
+         * @param rowIntervalUs Time per row, a frame takes rows * rowIntervalUs, debouncing
+         * 4 frames
+         */
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+        for (uint8_t c = 0; c < cols; c++)
+            pinMode(colPins[c], INPUT_PULLUP);
+        for (uint8_t r = 0; r < rows; r++)
+            pinMode(rowPins[r], INPUT);
+
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, rowIntervalUs);
+
+        for (uint8_t i = 0; i < keyCount; i++) {
+            keys[keyList[i]]->begin(pSched, tID);
+            keys[keyList[i]]->setTickMask(&ticking, keyList[i]);
+            keys[keyList[i]]->setPhysicalLevel(false);
+        }
+
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+            this->subsMsg(topic, msg, originator);
+        });
+        pSched->subscribe(tID, name + "/keypad/#", fnall);
+
+        driveRow(scanRow);
+    }
+
+    void publishState() {
+        char buf[160];
+        sprintf(buf,
+                "{\"frames\":%lu,\"ghostFrames\":%lu,\"ghosting\":%s,\"keys\":\"%08lx%08lx\","
+                "\"masked\":\"%08lx%08lx\"}",
+                frames, ghostFrames, ghosting ? "true" : "false",
+                (unsigned long)(debounced >> 32), (unsigned long)(debounced & 0xffffffff),
+                (unsigned long)(ghostMask >> 32), (unsigned long)(ghostMask & 0xffffffff));
+        pSched->publish(name + "/keypad/state", buf);
+    }
+
+    void loop() {
+        frame |= (uint64_t)readColumns() << (scanRow * 8);
+        pinMode(rowPins[scanRow], INPUT);
+        if (++scanRow == rows) {
+            scanRow = 0;
+            processFrame(frame);
+            frame = 0;
+        }
+        driveRow(scanRow);
+        uint64_t active = ticking;
+        while (active) {
+            uint8_t key = __builtin_ctzll(active);
+            active &= active - 1;
+            keys[key]->tick();
+        }
+    }
+
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == name + "/keypad/state/get") {
+            publishState();
+        }
+    }
+
+  private:
+    void driveRow(uint8_t row) {
+        digitalWrite(rowPins[row], LOW);
+        pinMode(rowPins[row], OUTPUT);
+    }
+
+    uint8_t readColumns() {
+        /*! Columns that are low, bit n: column n */
+        uint8_t pressed = 0;
+#if defined(__ESP32__)
+        uint32_t in[2] = {GPIO.in, GPIO.in1.val};
+        for (uint8_t c = 0; c < cols; c++) {
+            if (!(in[colPins[c] / 32] >> (colPins[c] % 32) & 1))
+                pressed |= 1 << c;
+        }
+#elif defined(__ESP__)
+        uint32_t in = (GPI & 0xffff) | ((uint32_t)(GP16I & 0x01) << 16);
+        for (uint8_t c = 0; c < cols; c++) {
+            if (!(in >> colPins[c] & 1))
+                pressed |= 1 << c;
+        }
+#else
+        for (uint8_t c = 0; c < cols; c++) {
+            if (digitalRead(colPins[c]) == LOW)
+                pressed |= 1 << c;
+        }
+#endif
+        return pressed;
+    }
+
+    uint64_t ghostKeys(uint64_t keyFrame) {
+        /*! Keys in the rows and columns where two rows share two or more pressed columns */
+        uint64_t mask = 0;
+        for (uint8_t r1 = 0; r1 < rows; r1++) {
+            uint8_t row1 = keyFrame >> (r1 * 8);
+            if (!(row1 & (row1 - 1)))
+                continue;  // less than two keys in this row
+            for (uint8_t r2 = r1 + 1; r2 < rows; r2++) {
+                uint8_t common = row1 & (uint8_t)(keyFrame >> (r2 * 8));
+                if (common & (common - 1))
+                    mask |= (uint64_t)common << (r1 * 8) | (uint64_t)common << (r2 * 8);
+            }
+        }
+        return mask;
+    }
+
+    void processFrame(uint64_t keyFrame) {
+        ++frames;
+        ghostMask = ghostKeys(keyFrame);
+        if (ghostMask) {
+            ++ghostFrames;
+            if (!ghosting) {
+                ghosting = true;
+                pSched->publish(name + "/keypad/ghosting", "on");
+            }
+            // ambiguous keys keep their debounced state
+            keyFrame = (keyFrame & ~ghostMask) | (debounced & ghostMask);
+        } else if (ghosting) {
+            ghosting = false;
+            pSched->publish(name + "/keypad/ghosting", "off");
+        }
+        uint64_t delta = keyFrame ^ debounced;
+        // vertical counter: reset on unchanged keys, count down on changed keys
+        count0 = ~(count0 & delta);
+        count1 = count0 ^ (count1 & delta);
+        uint64_t changed = delta & count0 & count1;
+        debounced ^= changed;
+        while (changed) {
+            uint8_t key = __builtin_ctzll(changed);
+            changed &= changed - 1;
+            bool pressed = debounced >> key & 1;
+            if (keys[key]) {
+                keys[key]->setPhysicalLevel(pressed);
+            } else {
+                char buf[16];
+                sprintf(buf, "%u,%u %s", key / 8, key % 8, pressed ? "on" : "off");
+                pSched->publish(name + "/keypad/key", buf);
+            }
+        }
+    }
+};  // KeypadT
+
+typedef KeypadT<Switch> Keypad;
+
+}  // namespace ustd
@@ -2,15 +2,35 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "mup_util.h"
 #include "home_assistant.h"
 
 namespace ustd {
 
-class Led {
+class LedModes {
   public:
-    String LED_VERSION = "0.1.0";
-    enum Mode { Passive, Blink, Wave, Pulse, Pattern };
+    enum Mode : uint8_t { Passive, Blink, Wave, Pulse, Pattern };
+    static const uint8_t allModes = 0x1f;
+};
+
+constexpr uint8_t ledModeMask() {
+    return 1 << LedModes::Passive;
+}
+template <typename... T> constexpr uint8_t ledModeMask(LedModes::Mode mode, T... more) {
+    /*! Bit mask of led modes, template argument of LedT, Passive is always included */
+    return (uint8_t)((1 << mode) | ledModeMask(more...));
+}
+
+template <uint8_t MODES = LedModes::allModes> class LedT : public LedModes {
+    /*! Led with a compile-time set of modes
+     *
+     * Code and constant strings of modes that are not in MODES are removed by the compiler,
+     * setMode() ignores them. `Led` supports all modes, `LedOnly<...>` only the given ones and
+     * Passive, e.g. `LedOnly<Led::Blink>`.
+     */
+  public:
+    static constexpr const char *LED_VERSION = "0.2.0";
 
     Scheduler *pSched;
     int tID;
@@ -18,10 +38,10 @@ class Led {
     uint8_t port;
     bool activeLogic = false;
     uint8_t channel;
-    double brightlevel;
     bool state;
-    uint16_t pwmrange;
     Mode mode;
+    uint16_t pwmrange;
+    double brightlevel;
     unsigned long interval;
     double phase = 0.0;
     unsigned long uPhase = 0;
@@ -34,14 +54,25 @@ class Led {
     HomeAssistant *pHA;
 #endif
 
-    Led(String name, uint8_t port, bool activeLogic = false, uint8_t channel = 0)
+    LedT(String name, uint8_t port, bool activeLogic = false, uint8_t channel = 0)
         : name(name), port(port), activeLogic(activeLogic), channel(channel) {
     }
 
-    ~Led() {
+    ~LedT() {
+    }
+
+    static constexpr bool hasMode(Mode m) {
+        /*! True if mode m is compiled in */
+        return MODES & (1 << m);
+    }
+
+    bool isMode(Mode m) const {
+        /*! Like mode == m, but constant false if m is not compiled in */
+        return hasMode(m) && mode == m;
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 #if defined(__ESP32__)
         pinMode(port, OUTPUT);
@@ -65,21 +96,22 @@ class Led {
         interval = 1000;  // ms
                           // give a c++11 lambda as callback scheduler task registration of
                           // this.loop():
-        /* std::function<void()> */ auto ft = [=]() { this->loop(); };
+        /* std::function<void()> */ auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 50000);
 
-        /* std::function<void(String, String, String)> */ auto fnall = [=](String topic, String msg,
-                                                                           String originator) {
-            this->subsMsg(topic, msg, originator);
-        };
+        /* std::function<void(String, String, String)> */ auto fnall =
+            MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+                this->subsMsg(topic, msg, originator);
+            });
         pSched->subscribe(tID, name + "/light/#", fnall);
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, LED_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, LED_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addLight();
         pHA->begin(pSched);
     }
@@ -142,6 +174,8 @@ class Led {
     }
 
     void setMode(Mode newmode, unsigned int interval_ms = 1000, double phase_unit = 0.0) {
+        if (!hasMode(newmode))
+            return;
         mode = newmode;
         if (mode == Mode::Passive)
             return;
@@ -213,7 +247,7 @@ class Led {
         if (mode == Mode::Passive)
             return;
         unsigned long period = (millis() + uPhase) % (2 * interval);
-        if (mode == Mode::Pulse) {
+        if (isMode(Mode::Pulse)) {
             if (millis() - startPulse < interval) {
                 set(true, true);
             } else {
@@ -221,7 +255,7 @@ class Led {
                 setMode(Mode::Passive);
             }
         }
-        if (mode == Mode::Blink) {
+        if (isMode(Mode::Blink)) {
             if (period < oPeriod) {
                 set(false, true);
             } else {
@@ -230,7 +264,7 @@ class Led {
                 }
             }
         }
-        if (mode == Mode::Wave) {
+        if (isMode(Mode::Wave)) {
             unsigned long period = (millis() + uPhase) % (2 * interval);
             double br = 0.0;
             if (period < interval) {
@@ -240,7 +274,7 @@ class Led {
             }
             brightness(br, true);
         }
-        if (mode == Mode::Pattern) {
+        if (isMode(Mode::Pattern)) {
             if (period < oPeriod) {
                 if (patternPointer < pattern.length()) {
                     char c = pattern[patternPointer];
@@ -300,23 +334,23 @@ class Led {
             double phs = 0.0;
             if (!strcmp(msgbuf, "passive")) {
                 setMode(Mode::Passive);
-            } else if (!strcmp(msgbuf, "pulse")) {
+            } else if (hasMode(Mode::Pulse) && !strcmp(msgbuf, "pulse")) {
                 if (p)
                     t = atoi(p);
                 setMode(Mode::Pulse, t);
-            } else if (!strcmp(msgbuf, "blink")) {
+            } else if (hasMode(Mode::Blink) && !strcmp(msgbuf, "blink")) {
                 if (p)
                     t = atoi(p);
                 if (p2)
                     phs = atof(p2);
                 setMode(Mode::Blink, t, phs);
-            } else if (!strcmp(msgbuf, "wave")) {
+            } else if (hasMode(Mode::Wave) && !strcmp(msgbuf, "wave")) {
                 if (p)
                     t = atoi(p);
                 if (p2)
                     phs = atof(p2);
                 setMode(Mode::Wave, t, phs);
-            } else if (!strcmp(msgbuf, "pattern")) {
+            } else if (hasMode(Mode::Pattern) && !strcmp(msgbuf, "pattern")) {
                 if (p && strlen(p) > 0) {
                     pattern = String(p);
                     patternPointer = 0;
@@ -332,6 +366,9 @@ class Led {
             publishState();
         }
     };
-};  // Led
+};  // LedT
+
+typedef LedT<LedModes::allModes> Led;
+template <LedModes::Mode... M> using LedOnly = LedT<ledModeMask(M...)>;
 
 }  // namespace ustd
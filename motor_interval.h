@@ -30,8 +30,19 @@ class MotorInterval {
      *
      * A security mechanism performs a hard emergency stop if the sensor switch
      * does not report any activity during a specified timeout.
+     *
+     * Sensor edges are passed directly from the sensor switch to the motor (edge
+     * hook), without message. If the sensor switch uses an interrupt, the motor is
+     * stopped from the interrupt service routine at the target edge, the state is
+     * published by the next loop.
+     *
+     * The duration of each full interval is learned (moving average and jitter).
+     * From it, the time of arrival is published at each interval, the sensor
+     * timeout is shortened to a multiple of the period, and a slowdown against
+     * the long-term period (mechanical drag) is reported. Optionally, the motor
+     * is ramped down by PWM during the final interval (soft stop).
      */
-    String MOTORINTERVAL_VERSION = "0.3.0";
+    static constexpr const char *MOTORINTERVAL_VERSION = "0.5.1";
     Scheduler *pSched;
     int tID;
     String name;
@@ -42,21 +53,42 @@ class MotorInterval {
     unsigned defaultIntervals = UINT_MAX;
     bool motorActiveLogic = false;
     bool sensorActiveLogic = false;
-    bool state;
+    volatile bool state;
     unsigned long startTime = millis();
-    unsigned long stopTime = 0;
-    unsigned long lastTime = 0;
-    unsigned target_interval = 0;
-    unsigned current_interval = 0;
+    volatile unsigned long stopTime = 0;
+    volatile unsigned long lastTime = 0;
+    volatile unsigned target_interval = 0;
+    volatile unsigned current_interval = 0;
+    volatile bool stopPending = false;  // stopped by sensor edge, state not yet published
+
+    // interval timing, periods are recorded by sensorEdge() and evaluated by loop()
+    volatile unsigned long periods[8];
+    volatile uint8_t periodHead = 0;
+    uint8_t periodTail = 0;
+    unsigned long periodSamples = 0;
+    double periodMs = 0.0;   // moving average of interval duration
+    double jitterMs = 0.0;   // moving average of deviation from periodMs
+    double nominalMs = 0.0;  // long-term interval duration, reference for drag detection
+    double dragThreshold = 0.25;
+    bool dragWarning = false;
+    unsigned etaInterval = 0;  // interval of last ETA publication
+
+    // soft stop
+    uint8_t softStopDutyPct = 0;  // 0: off
+    double rampFraction = 0.7;    // ramp time as fraction of periodMs
+    volatile bool ramping = false;
+    uint8_t pwmChannel = 0;
+    uint16_t pwmrange;
     String lastResult = "Not initialized";
-    Switch intervalSensor;
+    SwitchOnly<Switch::Falling> intervalSensor;  // only Falling mode is compiled in
 
     MotorInterval(String name, uint8_t motorPort, uint8_t sensorPort, unsigned long sensorTimeout,
-                  bool motorActiveLogic = false, bool sensorActiveLogic = false)
+                  bool motorActiveLogic = false, bool sensorActiveLogic = false,
+                  int8_t sensorInterruptIndex = -1)
         : name(name), motorPort(motorPort), sensorPort(sensorPort), sensorTimeout(sensorTimeout),
           motorActiveLogic(motorActiveLogic), sensorActiveLogic(sensorActiveLogic),
           intervalSensor(name + ".sensor", sensorPort, ustd::Switch::Mode::Falling,
-                         sensorActiveLogic) {
+                         sensorActiveLogic, "", sensorInterruptIndex) {
         /*! Instantiate an Interval Motor
          * @param name              The name of the entity
          * @param motorPort         The pin identifier for the digital output GPIO port that
@@ -69,6 +101,9 @@ class MotorInterval {
          * @param motorActiveLogic  If true, the motor logic is inverted (motor on on LOW).
          *                          Default is false
          * @param sensorActiveLogic If true, the sensor logic is inverted. Default is false
+         * @param sensorInterruptIndex Interrupt index (0..USTD_MAX_IRQS-1) for the sensor switch,
+         *                          the motor is then stopped from the interrupt at the target
+         *                          edge. Default is -1: sensor is polled every 50ms
          */
     }
 
@@ -107,6 +142,40 @@ class MotorInterval {
         }
     }
 
+    void setSoftStop(uint8_t minDutyPct = 40, double _rampFraction = 0.7, uint8_t channel = 0) {
+        /*! Ramp the motor down by PWM during the final interval
+         *
+         * Must be called before begin(). The ramp starts at the begin of the final interval, once
+         * the interval duration has been learned, and reduces the duty cycle linearly to
+         * minDutyPct within _rampFraction of the learned interval duration.
+         *
+         * @param minDutyPct    Final duty cycle in percent, 0 disables the soft stop
+         * @param _rampFraction Duration of the ramp as fraction of the interval duration
+         * @param channel       ESP32 only: LEDC channel used for the motor port
+         */
+        softStopDutyPct = minDutyPct > 100 ? 100 : minDutyPct;
+        rampFraction = _rampFraction;
+        pwmChannel = channel;
+    }
+
+    void setDragThreshold(double threshold) {
+        /*! Relative increase of the interval duration against the long-term duration that is
+         * reported as drag, default 0.25 (25% slower) */
+        dragThreshold = threshold;
+    }
+
+    unsigned long watchdogTimeout() {
+        /*! Current sensor timeout in ms: sensorTimeout until the interval duration is known and
+         * during the soft stop, otherwise three average intervals plus four times the jitter,
+         * but at least 100ms and at most sensorTimeout. */
+        if (periodSamples < 3 || ramping)
+            return sensorTimeout;
+        unsigned long t = (unsigned long)(3.0 * periodMs + 4.0 * jitterMs);
+        if (t < 100)
+            t = 100;
+        return t < sensorTimeout ? t : sensorTimeout;
+    }
+
     void begin(Scheduler *_pSched) {
         /*! Initialize the interval motor mupplet
          *
@@ -116,6 +185,17 @@ class MotorInterval {
         lastResult = "OK";
         pinMode(motorPort, OUTPUT);
         pinMode(sensorPort, INPUT);
+#ifdef __ESP32__
+        if (softStopDutyPct) {
+            ledcSetup(pwmChannel, 5000, 10);
+            ledcAttachPin(motorPort, pwmChannel);
+        }
+#endif
+#ifdef __ESP__
+        pwmrange = 1023;
+#else
+        pwmrange = 255;
+#endif
 
         stopMotor();
         tID = pSched->add([this]() { this->loop(); }, name, 50000);
@@ -125,11 +205,7 @@ class MotorInterval {
                               this->commandMsg(topic, msg, originator);
                           });
 
-        pSched->subscribe(tID, name + ".sensor/switch/#",
-                          [this](String topic, String msg, String originator) {
-                              this->sensorMsg(topic, msg, originator);
-                          });
-
+        intervalSensor.setEdgeHook(sensorEdgeHook, this);
         intervalSensor.begin(_pSched);
         pSched->publish(name + "/switch/result", lastResult.c_str());
     }
@@ -195,6 +271,15 @@ class MotorInterval {
         }
     }
 
+    void publishTiming() {
+        char buf[128];
+        sprintf(buf,
+                "{\"periodMs\":%.1f,\"jitterMs\":%.1f,\"nominalMs\":%.1f,\"timeoutMs\":%lu,"
+                "\"samples\":%lu}",
+                periodMs, jitterMs, nominalMs, watchdogTimeout(), periodSamples);
+        pSched->publish(name + "/switch/timing", buf);
+    }
+
     void publishState() {
         pSched->publish(name + "/switch/state", state ? "on" : "off");
         pSched->publish(name + "/switch/result", lastResult.c_str());
@@ -204,7 +289,26 @@ class MotorInterval {
     }
 
     virtual void loop() {
-        if (state && timeDiff(lastTime, millis()) > sensorTimeout) {
+        if (stopPending) {
+            stopPending = false;
+#ifdef __ESP32__
+            if (softStopDutyPct)
+                motorOff();  // LEDC can't be written from the interrupt
+#endif
+            endRamp();
+            publishState();
+        }
+        while (periodTail != periodHead) {
+            updateTiming(periods[periodTail % 8]);
+            ++periodTail;
+        }
+        if (state && etaInterval != current_interval) {
+            etaInterval = current_interval;
+            publishEta();
+        }
+        if (state)
+            softStop();
+        if (state && timeDiff(lastTime, millis()) > watchdogTimeout()) {
             // sensor broken or movement stuck
             lastResult = "No feedback from motor sensor. Please check device.";
             stop(true);
@@ -233,7 +337,69 @@ class MotorInterval {
         pSched->publish(topic, buffer);
     }
 
+    void updateTiming(unsigned long period) {
+        ++periodSamples;
+        if (periodSamples == 1) {
+            periodMs = period;
+            jitterMs = 0.0;
+        } else {
+            double dev = period - periodMs;
+            periodMs += 0.2 * dev;
+            jitterMs += 0.2 * (fabs(dev) - jitterMs);
+        }
+        if (periodSamples < 4)
+            return;
+        if (nominalMs == 0.0) {
+            nominalMs = periodMs;
+        } else if (periodMs > nominalMs * (1.0 + dragThreshold)) {
+            if (!dragWarning) {
+                dragWarning = true;
+                char buf[64];
+                sprintf(buf, "{\"periodMs\":%.1f,\"nominalMs\":%.1f}", periodMs, nominalMs);
+                pSched->publish(name + "/switch/drag", buf);
+            }
+        } else {
+            if (periodMs < nominalMs * (1.0 + dragThreshold / 2.0))
+                dragWarning = false;
+            nominalMs += 0.01 * (periodMs - nominalMs);  // follow slow changes, but not drag
+        }
+    }
+
+    void publishEta() {
+        if (periodSamples == 0 || target_interval == UINT_MAX ||
+            target_interval <= current_interval)
+            return;
+        double eta = (target_interval - current_interval) * periodMs;
+        eta -= timeDiff(lastTime, millis());
+        publishf(name + "/switch/eta", "%lu", eta > 0.0 ? (unsigned long)eta : 0UL);
+    }
+
+    void softStop() {
+        /*! Ramp the duty cycle down during the final interval */
+        bool finalInterval = current_interval + 1 >= target_interval;
+        if (!softStopDutyPct || periodSamples < 3 || !finalInterval) {
+            if (ramping) {
+                endRamp();  // target was changed
+                motorDuty(1.0);
+            }
+            return;
+        }
+        if (!ramping) {
+            ramping = true;
+            pSched->reschedule(tID, 10000);
+        }
+        double minDuty = softStopDutyPct / 100.0;
+        double progress = timeDiff(lastTime, millis()) / (rampFraction * periodMs);
+        if (progress > 1.0)
+            progress = 1.0;
+        motorDuty(1.0 - (1.0 - minDuty) * progress);
+    }
+
     void commandMsg(String topic, String msg, String originator) {
+        if (topic == name + "/switch/timing/get") {
+            publishTiming();
+            return;
+        }
         msg.toLowerCase();
         if (topic == name + "/switch/set") {
             if (msg == "on") {
@@ -254,38 +420,87 @@ class MotorInterval {
         }
     };
 
-    void sensorMsg(String topic, String msg, String originator) {
-        if (originator != "mqtt" && topic == name + ".sensor/switch/state") {
-            if (msg == "trigger") {
-                lastTime = millis();
-                ++current_interval;
-                if (current_interval >= target_interval) {
-                    stopMotor();
-                    publishState();
-                }
+    static void G_INT_ATTR sensorEdgeHook(void *pOwner) {
+        ((MotorInterval *)pOwner)->sensorEdge();
+    }
+
+    void G_INT_ATTR sensorEdge() {
+        /*! Count an interval, called by the sensor switch, possibly from interrupt */
+        if (!state)
+            return;  // coasting after stop
+        unsigned long now = millis();
+        if (current_interval && !ramping) {  // first interval starts at an arbitrary position
+            periods[periodHead % 8] = now - lastTime;
+            ++periodHead;
+        }
+        lastTime = now;
+        ++current_interval;
+        if (current_interval >= target_interval) {
+#ifdef __ESP32__
+            if (softStopDutyPct) {
+                state = false;  // motorOff() by loop, LEDC can't be written from the interrupt
+                stopTime = now;
+                stopPending = true;
+                return;
             }
+#endif
+            stopMotor();
+            stopPending = true;
+        }
+    }
+
+    void motorDuty(double duty) {
+        /*! Run the motor with duty cycle 0..1, 1: full speed without PWM */
+        if (duty >= 1.0) {
+#ifdef __ESP32__
+            if (softStopDutyPct) {
+                ledcWrite(pwmChannel, motorActiveLogic ? pwmrange : 0);
+                return;
+            }
+#endif
+            digitalWrite(motorPort, motorActiveLogic ? true : false);
+            return;
+        }
+        uint16_t value = (uint16_t)(duty * pwmrange);
+        if (!motorActiveLogic)
+            value = pwmrange - value;
+#ifdef __ESP32__
+        ledcWrite(pwmChannel, value);
+#else
+        analogWrite(motorPort, value);
+#endif
+    }
+
+    void G_INT_ATTR motorOff() {
+#ifdef __ESP32__
+        if (softStopDutyPct) {
+            ledcWrite(pwmChannel, motorActiveLogic ? 0 : pwmrange);
+            return;
+        }
+#endif
+        digitalWrite(motorPort, motorActiveLogic ? false : true);  // also ends analogWrite()
+    }
+
+    void endRamp() {
+        if (ramping) {
+            ramping = false;
+            pSched->reschedule(tID, 50000);
         }
     }
 
     void startMotor() {
+        endRamp();
+        etaInterval = (unsigned)-1;
         state = true;
         startTime = millis();
         stopTime = lastTime = startTime;
-        if (motorActiveLogic) {
-            digitalWrite(motorPort, true);
-        } else {
-            digitalWrite(motorPort, false);
-        }
+        motorDuty(1.0);
     }
 
-    void stopMotor() {
+    void G_INT_ATTR stopMotor() {
         state = false;
         stopTime = millis();
-        if (!motorActiveLogic) {
-            digitalWrite(motorPort, true);
-        } else {
-            digitalWrite(motorPort, false);
-        }
+        motorOff();
     }
 };
 
@@ -5,6 +5,8 @@
 
 #pragma once
 // #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "mupplet_arena.h"
 
 namespace ustd {
 
@@ -561,13 +563,16 @@ class Mp3Player {
         : name(name), pSerial(pSerial), mp3type(mp3type) {
         switch (mp3type) {
         case MP3_PLAYER_TYPE::DFROBOT:
-            mp3prot = (Mp3PlayerProtocol *)new Mp3PlayerDFRobot(pSerial);
+            mp3prot = (Mp3PlayerProtocol *)new (arenaAlloc(sizeof(Mp3PlayerDFRobot)))
+                Mp3PlayerDFRobot(pSerial);
             break;
         case MP3_PLAYER_TYPE::CATALEX:
-            mp3prot = (Mp3PlayerProtocol *)new Mp3PlayerCatalex(pSerial);
+            mp3prot = (Mp3PlayerProtocol *)new (arenaAlloc(sizeof(Mp3PlayerCatalex)))
+                Mp3PlayerCatalex(pSerial);
             break;
         case MP3_PLAYER_TYPE::OPENSMART:
-            mp3prot = (Mp3PlayerProtocol *)new Mp3PlayerOpenSmart(pSerial);
+            mp3prot = (Mp3PlayerProtocol *)new (arenaAlloc(sizeof(Mp3PlayerOpenSmart)))
+                Mp3PlayerOpenSmart(pSerial);
             break;
         default:
             mp3prot = nullptr;
@@ -579,19 +584,20 @@ class Mp3Player {
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
         Serial.begin(9600);
 
         // give a c++11 lambda as callback scheduler task registration of
         // this.loop():
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 50000);
 
         /* std::function<void(String, String, String)> */
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/mediaplayer/#", fnall);
 
         mp3prot->begin();
@@ -55,10 +55,31 @@ double parseUnitLevel(String msg) {
     return br;
 }
 
+class Uptime {
+    /*! Seconds since start, continuing across the wrap of millis() after 49.7 days
+     *
+     * seconds() accumulates the elapsed milliseconds since its previous call, so it must be
+     * called at least once per wrap period, e.g. from the task of the mupplet.
+     */
+  public:
+    unsigned long lastMs = 0;
+    uint32_t sec = 0;
+    uint16_t fracMs = 0;
+
+    uint32_t seconds() {
+        unsigned long now = millis();
+        uint64_t ms = (uint64_t)(uint32_t)(now - lastMs) + fracMs;
+        lastMs = now;
+        sec += (uint32_t)(ms / 1000);
+        fracMs = (uint16_t)(ms % 1000);
+        return sec;
+    }
+};
+
 #ifdef __ESP__
 bool fsBeginDone = false;
 
-bool writeJson(String filename, JSONVar jsonobj) {
+bool fsBegin() {
     if (!fsBeginDone) {
 #ifdef __USE_SPIFFS_FS__
         if (!SPIFFS.begin(false)) {
@@ -77,11 +98,29 @@ bool writeJson(String filename, JSONVar jsonobj) {
 #endif
         fsBeginDone = true;
     }
+    return true;
+}
+
+fs::File fsOpen(String filename, const char *mode) {
 #ifdef __USE_SPIFFS_FS__
-    fs::File f = SPIFFS.open(filename, "w");
+    return SPIFFS.open(filename, mode);
 #else
-    fs::File f = LittleFS.open(filename, "w");
+    return LittleFS.open(filename, mode);
 #endif
+}
+
+bool fsRemove(String filename) {
+#ifdef __USE_SPIFFS_FS__
+    return SPIFFS.remove(filename);
+#else
+    return LittleFS.remove(filename);
+#endif
+}
+
+bool writeJson(String filename, JSONVar jsonobj) {
+    if (!fsBegin())
+        return false;
+    fs::File f = fsOpen(filename, "w");
     if (!f) {
         return false;
     }
@@ -92,30 +131,10 @@ bool writeJson(String filename, JSONVar jsonobj) {
 }
 
 bool readJson(String filename, String &content) {
-    if (!fsBeginDone) {
-#ifdef __USE_SPIFFS_FS__
-        if (!SPIFFS.begin(false)) {
-#ifdef USE_SERIAL_DBG
-            Serial.println("SPIFFS.begin() failed.");
-#endif
-            return false;
-        }
-#else
-        if (!LittleFS.begin()) {
-#ifdef USE_SERIAL_DBG
-            Serial.println("LittleFS.begin() failed.");
-#endif
-            return false;
-        }
-#endif
-        fsBeginDone = true;
-    }
+    if (!fsBegin())
+        return false;
     content = "";
-#ifdef __USE_SPIFFS_FS__
-    fs::File f = SPIFFS.open(filename, "r");
-#else
-    fs::File f = LittleFS.open(filename, "r");
-#endif
+    fs::File f = fsOpen(filename, "r");
     if (!f) {
         return false;
     } else {
@@ -0,0 +1,125 @@
+// mupplet_arena.h
+#pragma once
+
+#include "scheduler.h"
+#include <new>
+
+// Arena for the long-lived objects mupplets create once at start (HomeAssistant, driver and
+// protocol objects), enabled by defining USTD_MUPPLET_ARENA_SIZE (bytes) before including
+// mupplets. Without it, arenaAlloc() and arenaFree() are plain operator new and delete.
+//
+// Usage in mupplets: `pObj = new (arenaAlloc(sizeof(T))) T(args);`, released (if ever) with
+// arenaDelete(pObj).
+
+namespace ustd {
+
+#ifdef USTD_MUPPLET_ARENA_SIZE
+
+#define USTD_MUPPLET_ARENA_ALIGN (8)
+
+class MuppletArena {
+    /*! Bump allocator over a static block
+     *
+     * The block is part of the static RAM (.bss), so it is reserved before the first heap
+     * allocation and objects drawn from it never interleave with the transient allocations
+     * (Strings, messages) of the running system. Allocations are only returned to the arena if
+     * they are the most recent one; long-lived objects are not expected to be freed at all. If the
+     * arena is full, allocations fall back to the heap and are counted, so USTD_MUPPLET_ARENA_SIZE
+     * can be adjusted to the high-water mark of an application.
+     */
+  public:
+    uint8_t *block;
+    uint32_t size;
+    uint32_t used = 0;
+    uint32_t highWater = 0;
+    uint32_t last = 0;  // offset of the most recent allocation
+    uint16_t allocs = 0;
+    uint16_t fallbacks = 0;
+    uint32_t fallbackBytes = 0;
+
+    constexpr MuppletArena(uint8_t *block, uint32_t size) : block(block), size(size) {
+        // constexpr: the global arena is initialized before any constructor of a global mupplet
+    }
+
+    void *alloc(size_t bytes) {
+        uint32_t start = (used + USTD_MUPPLET_ARENA_ALIGN - 1) & ~(USTD_MUPPLET_ARENA_ALIGN - 1);
+        if (start + bytes > size) {
+            ++fallbacks;
+            fallbackBytes += bytes;
+            return ::operator new(bytes);
+        }
+        ++allocs;
+        last = start;
+        used = start + bytes;
+        if (used > highWater)
+            highWater = used;
+        return block + start;
+    }
+
+    bool contains(const void *p) {
+        return p >= block && p < block + size;
+    }
+
+    void free(void *p) {
+        if (!contains(p)) {
+            ::operator delete(p);
+            return;
+        }
+        if (p == block + last)
+            used = last;  // older allocations stay until restart
+    }
+
+    String toJson() {
+        char buf[128];
+        sprintf(buf,
+                "{\"size\":%lu,\"used\":%lu,\"highWater\":%lu,\"allocs\":%u,\"fallbacks\":%u,"
+                "\"fallbackBytes\":%lu}",
+                (unsigned long)size, (unsigned long)used, (unsigned long)highWater, allocs,
+                fallbacks, (unsigned long)fallbackBytes);
+        return buf;
+    }
+};
+
+alignas(USTD_MUPPLET_ARENA_ALIGN) uint8_t ustd_mupplet_arena_block[USTD_MUPPLET_ARENA_SIZE];
+MuppletArena ustd_mupplet_arena(ustd_mupplet_arena_block, USTD_MUPPLET_ARENA_SIZE);
+
+void *arenaAlloc(size_t bytes) {
+    return ustd_mupplet_arena.alloc(bytes);
+}
+
+void arenaFree(void *p) {
+    if (p)
+        ustd_mupplet_arena.free(p);
+}
+
+void muppletArenaBegin(Scheduler *pSched) {
+    /*! Answer `arena/state/get` with `arena/state` (size, used bytes, high-water mark and heap
+     * fallbacks of the arena) */
+    auto fnarena = [=](String topic, String msg, String originator) {
+        pSched->publish("arena/state", ustd_mupplet_arena.toJson());
+    };
+    int tID = pSched->add([]() {}, "muppletarena", 0xffffffff);
+    pSched->subscribe(tID, "arena/state/get", fnarena);
+}
+
+#else
+
+inline void *arenaAlloc(size_t bytes) {
+    return ::operator new(bytes);
+}
+
+inline void arenaFree(void *p) {
+    ::operator delete(p);
+}
+
+#endif  // USTD_MUPPLET_ARENA_SIZE
+
+template <class T> void arenaDelete(T *p) {
+    /*! Destroy an object created with `new (arenaAlloc(sizeof(T))) T(...)` */
+    if (p) {
+        p->~T();
+        arenaFree(p);
+    }
+}
+
+}  // namespace ustd
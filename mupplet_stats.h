@@ -0,0 +1,253 @@
+// mupplet_stats.h
+#pragma once
+
+#include "scheduler.h"
+
+// Timing statistics for mupplet loops and message handlers and memory use of mupplet instances,
+// enabled by defining USTD_MUPPLET_STATS before including mupplets. Without it, MUP_STATS_TASK()
+// and MUP_STATS_SUBS() return the unchanged callback, MUP_STATS_BEGIN() is empty and nothing of
+// this file is compiled.
+
+#ifdef USTD_MUPPLET_STATS
+
+#ifndef USTD_MAX_MUPPLET_STATS
+#define USTD_MAX_MUPPLET_STATS (24)
+#endif
+#define USTD_MUPPLET_STATS_BUCKETS (20)
+
+// Used in member functions (begin()) of mupplets, the size of the instance is recorded.
+// MUP_STATS_BEGIN() is the first statement of begin(): the heap mark is taken before begin()
+// allocates anything.
+#define MUP_STATS_BEGIN(name) ustd::muppletStats(name, sizeof(*this))
+#define MUP_STATS_TASK(name, ...) ustd::muppletStatsTask(name, sizeof(*this), __VA_ARGS__)
+#define MUP_STATS_SUBS(name, ...) ustd::muppletStatsSubs(name, sizeof(*this), __VA_ARGS__)
+
+namespace ustd {
+
+class MuppletStats {
+    /*! Execution time statistics of one mupplet
+     *
+     * For the loop task and for the message handler: number of calls, minimum, mean and maximum
+     * duration, and a histogram with log2 buckets. Durations are measured in CPU cycles on ESP8266
+     * and ESP32 (micros() elsewhere) and kept in 1/16 us, bucket n counts durations of
+     * 2^(n-1)/16 <= duration < 2^n/16 us (bucket 0: below 1/16 us, the last bucket: from 16 ms).
+     *
+     * Memory: staticBytes is the size of the mupplet instance (sizeof), heapMark the free heap
+     * at the start of the mupplet's begin() (MUP_STATS_BEGIN). The heap used by a mupplet's start
+     * is the difference to the heapMark of the next mupplet, see muppletStatsHeapBytes().
+     */
+  public:
+    typedef struct {
+        unsigned long count;
+        uint32_t min;  // durations in 1/16 us
+        uint32_t max;
+        uint64_t sum;
+        uint16_t histogram[USTD_MUPPLET_STATS_BUCKETS];
+    } T_TIMING;
+    enum Kind { LOOP, MSG };
+
+    String name;
+    T_TIMING timing[2];
+    uint32_t staticBytes = 0;
+    uint32_t heapMark = 0;
+
+    MuppletStats() {
+        reset();
+    }
+
+    void reset() {
+        memset(timing, 0, sizeof(timing));
+        timing[0].min = 0xffffffff;
+        timing[1].min = 0xffffffff;
+    }
+
+    static uint32_t freeHeap() {
+#ifdef __ESP__
+        return ESP.getFreeHeap();
+#else
+        return 0;
+#endif
+    }
+
+    static inline uint32_t now() {
+#ifdef __ESP__
+        return ESP.getCycleCount();
+#else
+        return micros();
+#endif
+    }
+
+    void record(Kind kind, uint32_t start) {
+#ifdef __ESP__
+        uint32_t dt = (uint32_t)((uint64_t)(now() - start) * 16 / ESP.getCpuFreqMHz());
+#else
+        uint32_t dt = (now() - start) * 16;
+#endif
+        T_TIMING &t = timing[kind];
+        ++t.count;
+        t.sum += dt;
+        if (dt < t.min)
+            t.min = dt;
+        if (dt > t.max)
+            t.max = dt;
+        uint8_t bucket = dt ? 32 - __builtin_clz(dt) : 0;
+        if (bucket >= USTD_MUPPLET_STATS_BUCKETS)
+            bucket = USTD_MUPPLET_STATS_BUCKETS - 1;
+        if (t.histogram[bucket] < 0xffff)
+            ++t.histogram[bucket];
+    }
+
+    String toJson(uint32_t heapBytes) {
+        String json = "{\"name\":\"" + name + "\"";
+        const char *kinds[] = {"loop", "msg"};
+        char buf[128];
+        for (uint8_t k = 0; k < 2; k++) {
+            T_TIMING &t = timing[k];
+            sprintf(buf,
+                    ",\"%s\":{\"count\":%lu,\"minUs\":%.2f,\"avgUs\":%.2f,\"maxUs\":%.2f,"
+                    "\"hist\":[",
+                    kinds[k], t.count, t.count ? t.min / 16.0 : 0.0,
+                    t.count ? t.sum / 16.0 / t.count : 0.0, t.max / 16.0);
+            json += buf;
+            for (uint8_t i = 0; i < USTD_MUPPLET_STATS_BUCKETS; i++) {
+                json += (i ? "," : "") + String(t.histogram[i]);
+            }
+            json += "]}";
+        }
+        sprintf(buf, ",\"mem\":{\"staticBytes\":%lu,\"heapBytes\":%lu}}",
+                (unsigned long)staticBytes, (unsigned long)heapBytes);
+        return json + buf;
+    }
+};
+
+MuppletStats ustd_mupplet_stats[USTD_MAX_MUPPLET_STATS];
+uint8_t ustd_mupplet_stats_count = 0;
+uint32_t ustd_mupplet_stats_heap_end = 0;  // free heap at muppletStatsBegin()
+Scheduler *ustd_mupplet_stats_sched = nullptr;
+int ustd_mupplet_stats_tid = -1;
+
+void muppletStatsSubscribe(uint8_t index);
+
+MuppletStats *muppletStats(String name, uint32_t staticBytes) {
+    /*! Find or allocate the statistics of a mupplet, nullptr if the table is full */
+    for (uint8_t i = 0; i < ustd_mupplet_stats_count; i++) {
+        if (ustd_mupplet_stats[i].name == name)
+            return &ustd_mupplet_stats[i];
+    }
+    if (ustd_mupplet_stats_count == USTD_MAX_MUPPLET_STATS)
+        return nullptr;
+    MuppletStats *pStats = &ustd_mupplet_stats[ustd_mupplet_stats_count++];
+    pStats->name = name;
+    pStats->staticBytes = staticBytes;
+    pStats->heapMark = MuppletStats::freeHeap();
+    if (ustd_mupplet_stats_sched)
+        muppletStatsSubscribe(ustd_mupplet_stats_count - 1);  // started after muppletStatsBegin()
+    return pStats;
+}
+
+uint32_t muppletStatsHeapBytes(uint8_t index) {
+    /*! Heap used from the begin() of mupplet index to that of the next mupplet
+     *
+     * The last mupplet is measured up to muppletStatsBegin(), which should therefore be called
+     * after all mupplets are started. Includes the scheduler's task and subscription entries and
+     * all other allocations in between (e.g. of the application), 0 if not known.
+     */
+    uint32_t end = ustd_mupplet_stats_heap_end;
+    if (index + 1 < ustd_mupplet_stats_count)
+        end = ustd_mupplet_stats[index + 1].heapMark;
+    uint32_t start = ustd_mupplet_stats[index].heapMark;
+    return (end && start > end) ? start - end : 0;
+}
+
+std::function<void()> muppletStatsTask(String name, uint32_t staticBytes,
+                                       std::function<void()> fn) {
+    MuppletStats *pStats = muppletStats(name, staticBytes);
+    if (!pStats)
+        return fn;
+    return [=]() {
+        uint32_t start = MuppletStats::now();
+        fn();
+        pStats->record(MuppletStats::LOOP, start);
+    };
+}
+
+std::function<void(String, String, String)>
+muppletStatsSubs(String name, uint32_t staticBytes,
+                 std::function<void(String, String, String)> fn) {
+    MuppletStats *pStats = muppletStats(name, staticBytes);
+    if (!pStats)
+        return fn;
+    return [=](String topic, String msg, String originator) {
+        uint32_t start = MuppletStats::now();
+        fn(topic, msg, originator);
+        pStats->record(MuppletStats::MSG, start);
+    };
+}
+
+void muppletStatsPublishMemory(Scheduler *pSched) {
+    uint32_t staticBytes = 0, heapBytes = 0;
+    for (uint8_t i = 0; i < ustd_mupplet_stats_count; i++) {
+        staticBytes += ustd_mupplet_stats[i].staticBytes;
+        heapBytes += muppletStatsHeapBytes(i);
+    }
+    char buf[128];
+    sprintf(buf, "{\"mupplets\":%u,\"staticBytes\":%lu,\"heapBytes\":%lu,\"freeHeap\":%lu}",
+            ustd_mupplet_stats_count, (unsigned long)staticBytes, (unsigned long)heapBytes,
+            (unsigned long)MuppletStats::freeHeap());
+    pSched->publish("stats/memory", buf);
+}
+
+void muppletStatsSubscribe(uint8_t index) {
+    /*! Subscribe `<mupplet-name>/stats/get` and `<mupplet-name>/stats/reset` of one mupplet
+     *
+     * Exact topics instead of a wildcard: mupplet names may have several levels (e.g. the
+     * `<value-topic>/history` of a SensorHistory), and the `<mupplet-name>/stats` replies are not
+     * delivered back to the handler.
+     */
+    Scheduler *pSched = ustd_mupplet_stats_sched;
+    auto fnstats = [=](String topic, String msg, String originator) {
+        MuppletStats &s = ustd_mupplet_stats[index];
+        if (topic == s.name + "/stats/get")
+            pSched->publish(s.name + "/stats", s.toJson(muppletStatsHeapBytes(index)));
+        else
+            s.reset();
+    };
+    String name = ustd_mupplet_stats[index].name;
+    pSched->subscribe(ustd_mupplet_stats_tid, name + "/stats/get", fnstats);
+    pSched->subscribe(ustd_mupplet_stats_tid, name + "/stats/reset", fnstats);
+}
+
+void muppletStatsBegin(Scheduler *pSched) {
+    /*! Answer `<mupplet-name>/stats/get` with `<mupplet-name>/stats` and `stats/get` with the
+     * statistics of all mupplets, `<mupplet-name>/stats/reset` and `stats/reset` clear them,
+     * `stats/memory/get` is answered with the memory totals `stats/memory` */
+    ustd_mupplet_stats_heap_end = MuppletStats::freeHeap();
+    auto fnstats = [=](String topic, String msg, String originator) {
+        for (uint8_t i = 0; i < ustd_mupplet_stats_count; i++) {
+            MuppletStats &s = ustd_mupplet_stats[i];
+            if (topic == "stats/get")
+                pSched->publish(s.name + "/stats", s.toJson(muppletStatsHeapBytes(i)));
+            if (topic == "stats/reset")
+                s.reset();
+        }
+        if (topic == "stats/memory/get")
+            muppletStatsPublishMemory(pSched);
+    };
+    ustd_mupplet_stats_tid = pSched->add([]() {}, "muppletstats", 0xffffffff);
+    ustd_mupplet_stats_sched = pSched;
+    pSched->subscribe(ustd_mupplet_stats_tid, "stats/get", fnstats);
+    pSched->subscribe(ustd_mupplet_stats_tid, "stats/reset", fnstats);
+    pSched->subscribe(ustd_mupplet_stats_tid, "stats/memory/get", fnstats);
+    for (uint8_t i = 0; i < ustd_mupplet_stats_count; i++)
+        muppletStatsSubscribe(i);
+}
+
+}  // namespace ustd
+
+#else
+
+#define MUP_STATS_BEGIN(name) ((void)0)
+#define MUP_STATS_TASK(name, ...) (__VA_ARGS__)
+#define MUP_STATS_SUBS(name, ...) (__VA_ARGS__)
+
+#endif  // USTD_MUPPLET_STATS
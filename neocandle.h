@@ -3,6 +3,8 @@
 // Platformio lib finder collapses on space in 'Adafruit NeoPixel_ID28' name...
 #include "../.pio/libdeps/huzzah/Adafruit NeoPixel/Adafruit_NeoPixel.h"
 #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "mupplet_arena.h"
 #include "mup_util.h"
 
 //#include "Adafruit_NeoPixel.h"
@@ -18,7 +20,7 @@
 namespace ustd {
 class NeoCandle {
   public:
-    String NEOCANDLE_VERSION = "0.1.0";
+    static constexpr const char *NEOCANDLE_VERSION = "0.1.0";
     Scheduler *pSched;
     int tID;
     String name;
@@ -69,8 +71,9 @@ class NeoCandle {
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                NEOCANDLE_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, NEOCANDLE_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addLight();
         pHA->begin(pSched);
     }
@@ -218,6 +221,7 @@ class NeoCandle {
 
     void begin(Scheduler *_pSched, int _start_hour = -1, int _start_minute = -1, int _end_hour = -1,
                int _end_minute = -1) {
+        MUP_STATS_BEGIN(name);
         // Make sure _clientName is Unique! Otherwise MQTT server will
         // rapidly disconnect.
         // char buf[32];
@@ -233,18 +237,19 @@ class NeoCandle {
             end_minute = _end_minute;
         }
 
-        pPixels = new Adafruit_NeoPixel(numPixels, pin, options);
+        pPixels = new (arenaAlloc(sizeof(Adafruit_NeoPixel)))
+            Adafruit_NeoPixel(numPixels, pin, options);
         pPixels->begin();
         // give a c++11 lambda as callback scheduler task registration of
         // this.loop():
         /* std::function<void()> */
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 100000);
 
         /* std::function<void(String, String, String)> */
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/light/set", fnall);
         pSched->subscribe(tID, name + "/light/windlevel/set", fnall);
         if (bAutobrightness)
@@ -2,7 +2,10 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "sensors.h"
 #include "home_assistant.h"
+#include "filter_kernels.h"
 
 namespace ustd {
 
@@ -103,7 +106,7 @@ bool changeSELi(bool bsel, uint8_t pin_sel, uint8_t irqno) {
 
 class PowerBl0937 {
   public:
-    String POWER_BL0937_VERSION = "0.1.0";
+    static constexpr const char *POWER_BL0937_VERSION = "0.2.0";
     Scheduler *pSched;
     int tID;
 
@@ -116,6 +119,10 @@ class PowerBl0937 {
     ustd::sensorprocessor frequencyCF = ustd::sensorprocessor(8, 600, 0.1);
     ustd::sensorprocessor frequencyCF1_I = ustd::sensorprocessor(8, 600, 0.01);
     ustd::sensorprocessor frequencyCF1_V = ustd::sensorprocessor(8, 600, 0.1);
+    // outlier rejection before the sensorprocessors, see setFilterKernel()
+    FilterKernel *pKernelCF = new HampelFilter(5, 3.0);
+    FilterKernel *pKernelCF1_I = new HampelFilter(5, 3.0);
+    FilterKernel *pKernelCF1_V = new HampelFilter(5, 3.0);
     double CFfrequencyVal = 0.0;
     double CF1_IfrequencyVal = 0.0;
     double CF1_VfrequencyVal = 0.0;
@@ -162,9 +169,13 @@ class PowerBl0937 {
             detachInterrupt(irqno_CF);
             detachInterrupt(irqno_CF1);
         }
+        setFilterKernel("power", nullptr);
+        setFilterKernel("voltage", nullptr);
+        setFilterKernel("current", nullptr);
     }
 
     bool begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
         pinMode(pin_CF, INPUT_PULLUP);
@@ -189,21 +200,25 @@ class PowerBl0937 {
             return false;
         }
 
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 2000000);  // uS schedule
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
-        pSched->subscribe(tID, name + "/power_bl0937/#", fnall);
+        });
+        // not sensor/#: that would include the mupplet's own value messages
+        pSched->subscribe(tID, name + "/sensor/+/get", fnall);
+        pSched->subscribe(tID, name + "/sensor/+/filter/get", fnall);
+        pSched->subscribe(tID, name + "/sensor/+/filter/set", fnall);
         return true;
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                POWER_BL0937_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, POWER_BL0937_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("power", "Power", "W", "power", "mdi:gauge");
         pHA->addSensor("voltage", "Voltage", "V", "None", "mdi:gauge");
         pHA->addSensor("current", "Current", "A", "None", "mdi:gauge");
@@ -222,6 +237,36 @@ class PowerBl0937 {
         frequencyCF1_I.reset();
     }
 
+    bool setFilterKernel(String value, FilterKernel *pNewKernel) {
+        /*! Replace the filter applied to raw values before the sensorprocessor
+         *
+         * @param value `power`, `voltage` or `current`
+         * @param pNewKernel New kernel (ownership is transferred) or nullptr for no filter,
+         * default is a HampelFilter(5, 3.0) for each value.
+         * @return false if value is unknown
+         */
+        FilterKernel **ppKernel = kernelOf(value);
+        if (!ppKernel) {
+            if (pNewKernel)
+                delete pNewKernel;
+            return false;
+        }
+        if (*ppKernel)
+            delete *ppKernel;
+        *ppKernel = pNewKernel;
+        frequencyCF.reset();
+        frequencyCF1_V.reset();
+        frequencyCF1_I.reset();
+        return true;
+    }
+
+    void publishFilterKernel(String value) {
+        FilterKernel **ppKernel = kernelOf(value);
+        if (ppKernel)
+            pSched->publish(name + "/sensor/" + value + "/filter",
+                            *ppKernel ? (*ppKernel)->spec() : "none");
+    }
+
     void publish_CF() {
         char buf[32];
         sprintf(buf, "%6.1f", CFfrequencyVal);
@@ -258,8 +303,10 @@ class PowerBl0937 {
                        userCalibrationPowerFactor;
         if ((frequencyCF.lastVal == 0.0 && watts > 0.0) ||
             (frequencyCF.lastVal > 0.0 && watts == 0.0))
-            frequencyCF.reset();
+            resetFilter(frequencyCF, pKernelCF);
         if (watts >= 0.0 && watts < 3800) {
+            if (pKernelCF)
+                watts = pKernelCF->update(watts);
             if (frequencyCF.filter(&watts)) {
                 CFfrequencyVal = watts;
                 publish_CF();
@@ -271,7 +318,9 @@ class PowerBl0937 {
             if (volts < 5.0 || (volts >= 100.0 && volts < 260)) {
                 if ((frequencyCF1_V.lastVal == 0.0 && volts > 0.0) ||
                     (frequencyCF1_V.lastVal > 0.0 && volts == 0.0))
-                    frequencyCF1_V.reset();
+                    resetFilter(frequencyCF1_V, pKernelCF1_V);
+                if (pKernelCF1_V)
+                    volts = pKernelCF1_V->update(volts);
                 if (frequencyCF1_V.filter(&volts)) {
                     CF1_VfrequencyVal = volts;
                     publish_CF1_V();
@@ -282,7 +331,9 @@ class PowerBl0937 {
             if (currents >= 0.0 && currents < 16.0) {
                 if ((frequencyCF1_I.lastVal == 0.0 && currents > 0.0) ||
                     (frequencyCF1_I.lastVal > 0.0 && currents == 0.0))
-                    frequencyCF1_I.reset();
+                    resetFilter(frequencyCF1_I, pKernelCF1_I);
+                if (pKernelCF1_I)
+                    currents = pKernelCF1_I->update(currents);
                 if (frequencyCF1_I.filter(&currents)) {
                     CF1_IfrequencyVal = currents;
                     publish_CF1_I();
@@ -305,7 +356,35 @@ class PowerBl0937 {
         if (topic == name + "/sensor/current/get") {
             publish_CF1_I();
         }
+        const char *values[] = {"power", "voltage", "current"};
+        for (auto value : values) {
+            if (topic == name + "/sensor/" + value + "/filter/set") {
+                setFilterKernel(value, createFilterKernel(msg));
+                publishFilterKernel(value);
+            }
+            if (topic == name + "/sensor/" + value + "/filter/get") {
+                publishFilterKernel(value);
+            }
+        }
     };
+
+  private:
+    FilterKernel **kernelOf(String value) {
+        if (value == "power")
+            return &pKernelCF;
+        if (value == "voltage")
+            return &pKernelCF1_V;
+        if (value == "current")
+            return &pKernelCF1_I;
+        return nullptr;
+    }
+
+    void resetFilter(ustd::sensorprocessor &processor, FilterKernel *pKernel) {
+        // on/off transitions are steps, not outliers
+        processor.reset();
+        if (pKernel)
+            pKernel->reset();
+    }
 };  // PowerBl0937
 
 }  // namespace ustd
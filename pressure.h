@@ -1,19 +1,36 @@
 // pressure.h
-// adapted from:
-// https://github.com/adafruit/Adafruit_BMP085_Unified/blob/master/examples/sensorapi/sensorapi.pde
+// BMP085 / BMP180 barometric pressure sensor, register access and compensation as in the
+// Bosch BMP085 datasheet
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "sensors.h"
+#include "i2c_bus.h"
+#include "adaptive_poll.h"
 
-#include <Adafruit_Sensor.h>
-#include <Adafruit_BMP085_U.h>
 #include <home_assistant.h>
 
 namespace ustd {
 class Pressure {
+    /*! Temperature and pressure of a BMP085 or BMP180
+     *
+     * A measurement is a state machine of register transfers: start the temperature
+     * conversion, wait 5ms, read it and start the pressure conversion, wait for the conversion
+     * time of the oversampling, read and compensate (datasheet algorithm, integer arithmetic).
+     * The waits are done in the mupplet's task, no transfer waits for the sensor, so the loop
+     * (or the shared I2CBus) is never blocked for the conversion.
+     */
   public:
-    String PRESSURE_VERSION = "0.1.0";
+    static constexpr const char *PRESSURE_VERSION = "0.1.0";
+    enum MeasureState {
+        IDLE,
+        TRIGGERING,
+        TEMPERATURE_CONVERTING,
+        TEMPERATURE_READING,
+        PRESSURE_CONVERTING,
+        PRESSURE_READING
+    };
     Scheduler *pSched;
     int tID;
     String name;
@@ -22,13 +39,26 @@ class Pressure {
     bool bActive = false;
     ustd::sensorprocessor temperatureSensor = ustd::sensorprocessor(4, 600, 0.1);
     ustd::sensorprocessor pressureSensor = ustd::sensorprocessor(4, 600, 1.0);
-    Adafruit_BMP085_Unified *pPressure;
+    uint8_t i2cAddress;
+    uint8_t oversampling = 3;  // 0..3: 1, 2, 4, 8 samples
+    I2CClient i2c;
+    MeasureState state = MeasureState::IDLE;
+    unsigned long sampleIntervalMs = 5000;
+    unsigned long cycleStart = 0;
+    unsigned long convStart = 0;
+    unsigned long samples = 0;
+    unsigned long errors = 0;
+    AdaptivePoll *pAdaptive = nullptr;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
 
-    Pressure(String name) : name(name) {
-        pPressure = new Adafruit_BMP085_Unified(10085);
+    Pressure(String name, uint8_t i2cAddress = 0x77) : name(name), i2cAddress(i2cAddress) {
+        /*! Instantiate a BMP085 or BMP180 sensor
+         *
+         * @param name Name of the mupplet, used for topics
+         * @param i2cAddress I2C address, fixed 0x77 for these sensors
+         */
     }
 
     ~Pressure() {
@@ -42,23 +72,50 @@ class Pressure {
         return pressureSensorVal;
     }
 
-    void begin(Scheduler *_pSched) {
-        pSched = _pSched;
+    void setAdaptivePolling(unsigned long minIntervalMs = 1000,
+                            unsigned long maxIntervalMs = 60000) {
+        /*! Sample fast while temperature or pressure changes and slow down while it is stable
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs, 2);
+        pAdaptive->setEps(0, temperatureSensor.eps);
+        pAdaptive->setEps(1, pressureSensor.eps);
+        sampleIntervalMs = pAdaptive->intervalMs;
+    }
+
+    void setOversampling(uint8_t oss) {
+        /*! Pressure oversampling 0..3 (1, 2, 4, 8 samples; conversion 4.5 .. 25.5ms), default 3 */
+        oversampling = oss > 3 ? 3 : oss;
+    }
 
-        if (pPressure->begin()) {
+    void begin(Scheduler *_pSched, I2CBus *_pBus = nullptr) {
+        /*! Initialize sensor and start measurements
+         *
+         * @param _pSched Scheduler
+         * @param _pBus Optional shared I2C bus manager, measurements are then
+         * queued on the bus instead of accessing the sensor from the loop.
+         */
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+        i2c.begin(name, i2cAddress, _pBus);
+        if (initSensor()) {
             bActive = true;
         }
 
         // give a c++11 lambda as callback scheduler task registration of
         // this.loop():
         /* std::function<void()> */
-        auto ft = [=]() { this->loop(); };
-        tID = pSched->add(ft, name, 5000000);
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, 10000);  // state machine, measurement every sampleIntervalMs
 
         /* std::function<void(String, String, String)> */
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/temperature/get", fnall);
         pSched->subscribe(tID, name + "/sensor/pressure/get", fnall);
     }
@@ -66,8 +123,9 @@ class Pressure {
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, PRESSURE_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, PRESSURE_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Temperature", "\\u00B0C", "temperature", "mdi:thermometer");
         pHA->addSensor("pressure", "Pressure", "hPa", "pressure", "mdi:altimeter");
         pHA->begin(pSched);
@@ -89,28 +147,30 @@ class Pressure {
     }
 
     void loop() {
-        if (bActive) {
-            sensors_event_t event;
-            pPressure->getEvent(&event);
-            if (event.pressure) {
-                double p, t;
-                float tf;
-                /* Display atmospheric pressue in hPa */
-                p = event.pressure;  // hPa
-                pPressure->getTemperature(&tf);
-                t = (double)tf;
-
-                if (temperatureSensor.filter(&t)) {
-                    temperatureSensorVal = t;
-                    publishTemperature();
-                }
-                if (pressureSensor.filter(&p)) {
-                    pressureSensorVal = p;
-                    publishPressure();
-                }
+        if (!bActive) {
+            if (!resultPublished) {
+                pSched->publish(name + "/sensor/result", "hardware not initialized");
+                resultPublished = true;
+            }
+            return;
+        }
+        switch (state) {
+        case MeasureState::IDLE:
+            if (samples + errors == 0 || timeDiff(cycleStart, millis()) >= sampleIntervalMs) {
+                cycleStart = millis();
+                startTemperature();
             }
-        } else {
-            pSched->publish(name + "/sensor/result", "hardware not initialized");
+            break;
+        case MeasureState::TEMPERATURE_CONVERTING:
+            if (timeDiff(convStart, millis()) >= 5)
+                readTemperature();
+            break;
+        case MeasureState::PRESSURE_CONVERTING:
+            if (timeDiff(convStart, millis()) >= pressureConvMs())
+                readPressure();
+            break;
+        default:  // waiting for bus
+            break;
         }
     }
 
@@ -122,6 +182,135 @@ class Pressure {
             publishPressure();
         }
     };
+
+  private:
+    static const uint8_t regCalibration = 0xAA;
+    static const uint8_t regChipId = 0xD0;
+    static const uint8_t regControl = 0xF4;
+    static const uint8_t regData = 0xF6;
+    static const uint8_t cmdTemperature = 0x2E;
+    static const uint8_t cmdPressure = 0x34;
+    bool resultPublished = false;
+    int16_t ac1, ac2, ac3, b1, b2, mb, mc, md;
+    uint16_t ac4, ac5, ac6;
+    int32_t b5 = 0;  // temperature term of the pressure compensation
+
+    unsigned long pressureConvMs() {
+        // 4.5, 7.5, 13.5, 25.5ms
+        static const uint8_t ms[4] = {5, 8, 14, 26};
+        return ms[oversampling];
+    }
+
+    bool initSensor() {
+        uint8_t id = 0;
+        if (i2c.readNow(regChipId, &id, 1) != I2CPort::OK || id != 0x55)
+            return false;
+        uint8_t c[22];
+        if (i2c.readNow(regCalibration, c, 22) != I2CPort::OK)
+            return false;
+        ac1 = (int16_t)(c[0] << 8 | c[1]);
+        ac2 = (int16_t)(c[2] << 8 | c[3]);
+        ac3 = (int16_t)(c[4] << 8 | c[5]);
+        ac4 = (uint16_t)(c[6] << 8 | c[7]);
+        ac5 = (uint16_t)(c[8] << 8 | c[9]);
+        ac6 = (uint16_t)(c[10] << 8 | c[11]);
+        b1 = (int16_t)(c[12] << 8 | c[13]);
+        b2 = (int16_t)(c[14] << 8 | c[15]);
+        mb = (int16_t)(c[16] << 8 | c[17]);
+        mc = (int16_t)(c[18] << 8 | c[19]);
+        md = (int16_t)(c[20] << 8 | c[21]);
+        return true;
+    }
+
+    void startTemperature() {
+        state = MeasureState::TRIGGERING;
+        i2c.writeRegister(regControl, cmdTemperature,
+                          [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                              this->onTriggered(st, MeasureState::TEMPERATURE_CONVERTING);
+                          });
+    }
+
+    void onTriggered(uint8_t st, MeasureState next) {
+        if (st != I2CPort::OK) {
+            onError();
+            return;
+        }
+        convStart = millis();
+        state = next;
+    }
+
+    void readTemperature() {
+        state = MeasureState::TEMPERATURE_READING;
+        i2c.readRegisters(regData, 2, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK) {
+                this->onError();
+                return;
+            }
+            int32_t ut = (int32_t)data[0] << 8 | data[1];
+            int32_t x1 = ((ut - (int32_t)ac6) * (int32_t)ac5) >> 15;
+            int32_t x2 = ((int32_t)mc << 11) / (x1 + md);
+            b5 = x1 + x2;
+            state = MeasureState::TRIGGERING;
+            i2c.writeRegister(regControl, (uint8_t)(cmdPressure | oversampling << 6),
+                              [=](uint8_t st, const uint8_t *data, uint8_t len) {
+                                  this->onTriggered(st, MeasureState::PRESSURE_CONVERTING);
+                              });
+        });
+    }
+
+    void readPressure() {
+        state = MeasureState::PRESSURE_READING;
+        i2c.readRegisters(regData, 3, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK) {
+                this->onError();
+                return;
+            }
+            state = MeasureState::IDLE;
+            int32_t up = ((int32_t)data[0] << 16 | (int32_t)data[1] << 8 | data[2]) >>
+                         (8 - oversampling);
+            this->onData(b5 / 160.0, compensatePressure(up) / 100.0);
+        });
+    }
+
+    int32_t compensatePressure(int32_t up) {
+        // datasheet algorithm, result in Pa
+        int32_t b6 = b5 - 4000;
+        int32_t x1 = ((int32_t)b2 * ((b6 * b6) >> 12)) >> 11;
+        int32_t x2 = ((int32_t)ac2 * b6) >> 11;
+        int32_t x3 = x1 + x2;
+        int32_t b3 = ((((int32_t)ac1 * 4 + x3) << oversampling) + 2) / 4;
+        x1 = ((int32_t)ac3 * b6) >> 13;
+        x2 = ((int32_t)b1 * ((b6 * b6) >> 12)) >> 16;
+        x3 = ((x1 + x2) + 2) >> 2;
+        uint32_t b4 = ((uint32_t)ac4 * (uint32_t)(x3 + 32768)) >> 15;
+        uint32_t b7 = ((uint32_t)up - b3) * (uint32_t)(50000UL >> oversampling);
+        int32_t p = b7 < 0x80000000 ? (int32_t)((b7 * 2) / b4) : (int32_t)((b7 / b4) * 2);
+        x1 = (p >> 8) * (p >> 8);
+        x1 = (x1 * 3038) >> 16;
+        x2 = (-7357 * p) >> 16;
+        return p + ((x1 + x2 + 3791) >> 4);
+    }
+
+    void onError() {
+        ++errors;
+        state = MeasureState::IDLE;
+    }
+
+    void onData(double t, double p) {
+        ++samples;
+        if (pAdaptive) {
+            pAdaptive->update(0, t);
+            sampleIntervalMs = pAdaptive->update(1, p);
+        }
+        if (temperatureSensor.filter(&t)) {
+            temperatureSensorVal = t;
+            publishTemperature();
+        }
+        if (pressureSensor.filter(&p)) {
+            pressureSensorVal = p;
+            publishPressure();
+        }
+    }
 };  // Pressure
 
 }  // namespace ustd
@@ -4,7 +4,9 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "sensors.h"
+#include "adaptive_poll.h"
 
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BMP280.h>
@@ -13,7 +15,7 @@
 namespace ustd {
 class PressureBmp280 {
   public:
-    String PRESSURE_VERSION = "0.1.0";
+    static constexpr const char *PRESSURE_VERSION = "0.1.0";
     Scheduler *pSched;
     int tID;
     String name;
@@ -28,6 +30,7 @@ class PressureBmp280 {
     Adafruit_Sensor *bmp_temp;
     Adafruit_Sensor *bmp_pressure;
     String errmsg;
+    AdaptivePoll *pAdaptive = nullptr;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
@@ -49,7 +52,22 @@ class PressureBmp280 {
         return pressureSensorVal;
     }
 
+    void setAdaptivePolling(unsigned long minIntervalMs = 1000,
+                            unsigned long maxIntervalMs = 60000) {
+        /*! Sample fast while temperature or pressure changes and slow down while it is stable
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs, 2);
+        pAdaptive->setEps(0, temperatureSensor.eps);
+        pAdaptive->setEps(1, pressureSensor.eps);
+    }
+
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
         if (pPressure->begin(i2c_addr, chip_id)) {
@@ -69,12 +87,12 @@ class PressureBmp280 {
 #endif
         }
 
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, 5000000);
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/temperature/get", fnall);
         pSched->subscribe(tID, name + "/sensor/pressure/get", fnall);
     }
@@ -82,8 +100,9 @@ class PressureBmp280 {
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, PRESSURE_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, PRESSURE_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Temperature", "\\u00B0C", "temperature", "mdi:thermometer");
         pHA->addSensor("pressure", "Pressure", "hPa", "pressure", "mdi:altimeter");
         pHA->begin(pSched);
@@ -114,6 +133,11 @@ class PressureBmp280 {
             /* Display atmospheric pressue in hPa */
             p = pressure_event.pressure;  // hPa
             t = temp_event.temperature;   // C
+            if (pAdaptive) {
+                pAdaptive->update(0, t);
+                pAdaptive->update(1, p);
+                pAdaptive->reschedule(pSched, tID);
+            }
 
             if (temperatureSensor.filter(&t)) {
                 temperatureSensorVal = t;
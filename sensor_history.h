@@ -0,0 +1,377 @@
+// sensor_history.h
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_stats.h"
+#include "mup_util.h"
+
+namespace ustd {
+
+class SensorHistory {
+    /*! On-device history of a sensor value
+     *
+     * SensorHistory subscribes to a value topic of any sensor mupplet, e.g.
+     * `myLdr/sensor/unitilluminance`, and keeps the recent values in three ring buffers:
+     * raw values as published, and minimum/mean/maximum per minute and per hour. Values are
+     * stored as fixed-point integers (value * scale), raw values are delta-encoded. Memory
+     * is allocated once in the constructor, see memoryUsage().
+     *
+     * Values published while MQTT is disconnected are replayed after reconnect.
+     */
+  public:
+    static constexpr const char *HISTORY_VERSION = "0.1.0";
+    enum Resolution { RAW, MINUTE, HOUR };
+    typedef struct {
+        int16_t dv;   // difference to previous value (fixed-point), +-INT16_MAX: continued
+        uint16_t dt;  // seconds since previous value
+    } T_RAW;
+    typedef struct {
+        int32_t mean;        // fixed-point, INT32_MIN: no data
+        uint32_t belowMean;  // mean - min
+        uint32_t aboveMean;  // max - mean
+    } T_AGGREGATE;
+    typedef struct {
+        int32_t min;
+        int32_t max;
+        int64_t sum;
+        uint16_t n;
+    } T_ACCU;
+
+    Scheduler *pSched;
+    int tID;
+    String valueTopic;
+    double scale;
+    uint16_t rawSize, minuteSize, hourSize;
+    uint8_t chunkSize = 16;  // entries per published message
+
+    // raw values: oldest value absolute, each following as difference
+    T_RAW *raw;
+    uint16_t rawCount = 0;
+    uint16_t rawOldest = 0;
+    int32_t rawFirstValue = 0, rawLastValue = 0;
+    uint32_t rawFirstTime = 0, rawLastTime = 0;
+    unsigned long rawRestarts = 0;  // steps too large for the raw buffer
+
+    T_AGGREGATE *minutes;
+    T_AGGREGATE *hours;
+    uint16_t minuteCount = 0, minuteNext = 0;
+    uint16_t hourCount = 0, hourNext = 0;
+    T_ACCU minuteAccu, hourAccu;
+    uint32_t minuteStart = 0, hourStart = 0;
+    Uptime clock;
+    bool bHaveValue = false;
+    int32_t lastValue = 0;
+
+    bool bDisconnected = false;
+    uint32_t disconnectTime = 0;
+
+    SensorHistory(String valueTopic, double scale = 100.0, uint16_t rawSize = 64,
+                  uint16_t minuteSize = 60, uint16_t hourSize = 48)
+        : valueTopic(valueTopic), scale(scale), rawSize(rawSize), minuteSize(minuteSize),
+          hourSize(hourSize) {
+        /*! Instantiate a history for one sensor value
+         *
+         * @param valueTopic Topic under which the mupplet publishes the value
+         * @param scale Fixed-point factor, e.g. 100 for two decimals. A raw entry holds a step
+         * of less than 32767/scale, a larger step takes one additional entry (same time) per
+         * 32767/scale. A step that needs more entries than rawSize restarts the raw history.
+         * @param rawSize Number of raw values (4 bytes each)
+         * @param minuteSize Number of minute aggregates (12 bytes each)
+         * @param hourSize Number of hour aggregates (12 bytes each)
+         */
+        if (this->rawSize < 2)
+            this->rawSize = 2;
+        if (this->minuteSize < 1)
+            this->minuteSize = 1;
+        if (this->hourSize < 1)
+            this->hourSize = 1;
+        raw = new T_RAW[this->rawSize];
+        minutes = new T_AGGREGATE[this->minuteSize];
+        hours = new T_AGGREGATE[this->hourSize];
+        resetAccu(&minuteAccu);
+        resetAccu(&hourAccu);
+    }
+
+    SensorHistory(const SensorHistory &) = delete;  // owns the history buffers
+    SensorHistory &operator=(const SensorHistory &) = delete;
+
+    ~SensorHistory() {
+        delete[] raw;
+        delete[] minutes;
+        delete[] hours;
+    }
+
+    void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(valueTopic + "/history");
+        pSched = _pSched;
+        minuteStart = uptime();
+        hourStart = minuteStart;
+
+        auto ft = MUP_STATS_TASK(valueTopic + "/history", [=]() { this->loop(); });
+        tID = pSched->add(ft, valueTopic + "/history", 1000000);
+
+        auto fnall = MUP_STATS_SUBS(valueTopic + "/history",
+                                    [=](String topic, String msg, String originator) {
+                                        this->subsMsg(topic, msg, originator);
+                                    });
+        pSched->subscribe(tID, valueTopic, fnall);
+        pSched->subscribe(tID, valueTopic + "/history/get", fnall);
+        pSched->subscribe(tID, "mqtt/state", fnall);
+    }
+
+    unsigned long memoryUsage() {
+        /*! @return Bytes used by this history, including buffers */
+        return sizeof(*this) + rawSize * sizeof(T_RAW) +
+               (minuteSize + hourSize) * sizeof(T_AGGREGATE);
+    }
+
+    void add(double value) {
+        /*! Record a value, called for each message on the value topic */
+        int32_t v = toFixed(value);
+        uint32_t now = uptime();
+        rollOver(now);
+        addRaw(v, now);
+        accumulate(&minuteAccu, v);
+        lastValue = v;
+        bHaveValue = true;
+    }
+
+    void publish(Resolution res, uint32_t maxAgeSec = 0xffffffff, String suffix = "") {
+        /*! Publish the history as json messages of up to chunkSize entries
+         *
+         * Messages are sent to `<valueTopic>/history/<raw|minute|hour>` (or the given
+         * suffix), format: `{"chunk":<n>,"last":<bool>,"data":[[<age>,<value>],...]}` for raw
+         * values and `[[<age>,<min>,<mean>,<max>],...]` for aggregates. Age is in seconds (for
+         * aggregates: of the start of the interval), oldest entries first.
+         */
+        String topic = valueTopic + "/history/" +
+                       (suffix != "" ? suffix
+                                     : (res == RAW ? "raw" : (res == MINUTE ? "minute" : "hour")));
+        uint32_t now = uptime();
+        String data = "";
+        uint16_t entries = 0, chunk = 0;
+        char buf[64];
+        if (res == RAW) {
+            int32_t v = rawFirstValue;
+            uint32_t t = rawFirstTime;
+            for (uint16_t i = 0; i < rawCount; i++) {
+                const T_RAW &r = raw[(rawOldest + i) % rawSize];
+                if (i > 0) {
+                    v += r.dv;
+                    t += r.dt;
+                }
+                if (r.dv == INT16_MAX || r.dv == -INT16_MAX)
+                    continue;  // step continues in the next entry, not a measured value
+                if (now - t > maxAgeSec)
+                    continue;
+                sprintf(buf, "[%lu,%s]", (unsigned long)(now - t), fmt(v).c_str());
+                append(topic, data, buf, entries, chunk);
+            }
+        } else {
+            T_AGGREGATE *pAgg = res == MINUTE ? minutes : hours;
+            uint16_t size = res == MINUTE ? minuteSize : hourSize;
+            uint16_t count = res == MINUTE ? minuteCount : hourCount;
+            uint16_t next = res == MINUTE ? minuteNext : hourNext;
+            uint32_t period = res == MINUTE ? 60 : 3600;
+            uint32_t end = res == MINUTE ? minuteStart : hourStart;  // end of newest slot
+            for (uint16_t i = 0; i < count; i++) {
+                const T_AGGREGATE &a = pAgg[(next + size - count + i) % size];
+                uint32_t age = now - end + (count - i) * period;
+                if (a.mean == INT32_MIN || age > maxAgeSec)
+                    continue;
+                int32_t min = (int32_t)((int64_t)a.mean - a.belowMean);
+                int32_t max = (int32_t)((int64_t)a.mean + a.aboveMean);
+                sprintf(buf, "[%lu,%s,", (unsigned long)age, fmt(min).c_str());
+                String entry = String(buf) + fmt(a.mean) + "," + fmt(max) + "]";
+                append(topic, data, entry.c_str(), entries, chunk);
+            }
+        }
+        sprintf(buf, "{\"chunk\":%u,\"last\":true,\"data\":[", chunk);
+        pSched->publish(topic, String(buf) + data + "]}");
+    }
+
+    void loop() {
+        rollOver(uptime());
+    }
+
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == valueTopic) {
+            add(atof(msg.c_str()));
+        }
+        if (topic == valueTopic + "/history/get") {
+            // <raw|minute|hour>[,<maxAgeSec>]
+            Resolution res = RAW;
+            if (msg.startsWith("minute"))
+                res = MINUTE;
+            else if (msg.startsWith("hour"))
+                res = HOUR;
+            uint32_t maxAge = 0xffffffff;
+            int ind = msg.indexOf(',');
+            if (ind != -1)
+                maxAge = atol(msg.substring(ind + 1).c_str());
+            publish(res, maxAge);
+        }
+        if (topic == "mqtt/state") {
+            if (msg == "connected") {
+                if (bDisconnected) {
+                    bDisconnected = false;
+                    publish(RAW, uptime() - disconnectTime, "replay");
+                }
+            } else if (!bDisconnected) {
+                bDisconnected = true;
+                disconnectTime = uptime();
+            }
+        }
+    }
+
+  private:
+    uint32_t uptime() {
+        return clock.seconds();  // loop() calls it every second
+    }
+
+    int32_t toFixed(double value) {
+        double f = value * scale;
+        if (f > 2.0e9)
+            f = 2.0e9;
+        if (f < -2.0e9)
+            f = -2.0e9;
+        return (int32_t)(f < 0 ? f - 0.5 : f + 0.5);
+    }
+
+    String fmt(int32_t v) {
+        char buf[24];
+        sprintf(buf, "%.4g", v / scale);
+        return String(buf);
+    }
+
+    void append(String &topic, String &data, const char *entry, uint16_t &entries,
+                uint16_t &chunk) {
+        if (entries == chunkSize) {
+            char buf[48];
+            sprintf(buf, "{\"chunk\":%u,\"last\":false,\"data\":[", chunk);
+            pSched->publish(topic, String(buf) + data + "]}");
+            data = "";
+            entries = 0;
+            ++chunk;
+        }
+        if (entries)
+            data += ",";
+        data += entry;
+        ++entries;
+    }
+
+    void addRaw(int32_t v, uint32_t now) {
+        int32_t dv = v - rawLastValue;
+        // entries of +-INT16_MAX are continued by the next entry, the last one is < INT16_MAX
+        uint32_t entries = (uint32_t)((dv < 0 ? -(int64_t)dv : (int64_t)dv) / INT16_MAX) + 1;
+        if (rawCount && entries >= rawSize) {
+            ++rawRestarts;
+            rawCount = 0;
+        }
+        if (rawCount == 0) {
+            rawFirstValue = v;
+            rawFirstTime = now;
+            rawLastValue = v;
+            rawLastTime = now;
+            raw[rawOldest] = {0, 0};
+            rawCount = 1;
+            return;
+        }
+        uint32_t dt = now - rawLastTime;
+        if (dt > UINT16_MAX)
+            dt = UINT16_MAX;
+        while (entries--) {
+            int32_t step = entries ? (dv > 0 ? INT16_MAX : -INT16_MAX) : dv;
+            pushRaw((int16_t)step, (uint16_t)dt);
+            dv -= step;
+            dt = 0;
+        }
+    }
+
+    void pushRaw(int16_t dv, uint16_t dt) {
+        if (rawCount == rawSize) {
+            // drop oldest value, its successor becomes absolute
+            rawOldest = (rawOldest + 1) % rawSize;
+            rawFirstValue += raw[rawOldest].dv;
+            rawFirstTime += raw[rawOldest].dt;
+            --rawCount;
+        }
+        raw[(rawOldest + rawCount) % rawSize] = {dv, dt};
+        ++rawCount;
+        rawLastValue += dv;
+        rawLastTime += dt;
+    }
+
+    static void resetAccu(T_ACCU *pAccu) {
+        pAccu->min = INT32_MAX;
+        pAccu->max = INT32_MIN;
+        pAccu->sum = 0;
+        pAccu->n = 0;
+    }
+
+    static void accumulate(T_ACCU *pAccu, int32_t v) {
+        if (pAccu->n == UINT16_MAX)
+            return;
+        if (v < pAccu->min)
+            pAccu->min = v;
+        if (v > pAccu->max)
+            pAccu->max = v;
+        pAccu->sum += v;
+        ++pAccu->n;
+    }
+
+    static T_AGGREGATE aggregate(const T_ACCU &accu) {
+        T_AGGREGATE a;
+        if (!accu.n) {
+            a.mean = INT32_MIN;
+            a.belowMean = 0;
+            a.aboveMean = 0;
+            return a;
+        }
+        a.mean = (int32_t)(accu.sum / accu.n);
+        a.belowMean = (uint32_t)((int64_t)a.mean - accu.min);
+        a.aboveMean = (uint32_t)((int64_t)accu.max - a.mean);
+        return a;
+    }
+
+    void rollOver(uint32_t now) {
+        // after a long gap (task starved), only the last minutes that fill all minute and hour
+        // slots are rolled over, skipped in whole hours to keep minutes aligned to hours
+        uint32_t behind = (now - minuteStart) / 60;
+        uint32_t limit = 60UL * hourSize + minuteSize + 60;
+        if (behind > limit) {
+            uint32_t skip = (behind - limit) / 60 * 3600;
+            minuteStart += skip;
+            hourStart += skip;
+        }
+        while (now - minuteStart >= 60) {
+            // mupplets publish only changes, a minute without message keeps the last value
+            if (minuteAccu.n == 0 && bHaveValue)
+                accumulate(&minuteAccu, lastValue);
+            minutes[minuteNext] = aggregate(minuteAccu);
+            minuteNext = (minuteNext + 1) % minuteSize;
+            if (minuteCount < minuteSize)
+                ++minuteCount;
+            if (minuteAccu.n) {
+                if (minuteAccu.min < hourAccu.min)
+                    hourAccu.min = minuteAccu.min;
+                if (minuteAccu.max > hourAccu.max)
+                    hourAccu.max = minuteAccu.max;
+                hourAccu.sum += minuteAccu.sum / minuteAccu.n;  // mean of minute means
+                ++hourAccu.n;
+            }
+            resetAccu(&minuteAccu);
+            minuteStart += 60;
+            if (minuteStart - hourStart >= 3600) {
+                hours[hourNext] = aggregate(hourAccu);
+                hourNext = (hourNext + 1) % hourSize;
+                if (hourCount < hourSize)
+                    ++hourCount;
+                resetAccu(&hourAccu);
+                hourStart += 3600;
+            }
+        }
+    }
+};  // SensorHistory
+
+}  // namespace ustd
@@ -0,0 +1,153 @@
+// sensor_snapshot.h
+#pragma once
+
+#include "scheduler.h"
+#include "mup_util.h"
+
+namespace ustd {
+
+class SensorSnapshot {
+    /*! Persist calibration state of a sensor (e.g. a baseline or an algorithm state blob)
+     *
+     * The state is stored as hex string together with the time of saving in a json file.
+     * Saving is wear-aware: the interval starts with minIntervalSec and doubles with each
+     * save up to maxIntervalSec, and unchanged state is not written again. On platforms
+     * without file system, saving and restoring fail silently.
+     */
+  public:
+    String filename;
+    unsigned long minIntervalMs;
+    unsigned long maxIntervalMs;
+    unsigned long intervalMs;
+    unsigned long lastSave = 0;
+    time_t savedAt = 0;  // time of last save or of the restored snapshot
+    unsigned long saves = 0;
+    String lastData = "";
+
+    SensorSnapshot(String filename, unsigned long minIntervalSec = 3600,
+                   unsigned long maxIntervalSec = 86400)
+        : filename(filename) {
+        /*! Instantiate a snapshot
+         *
+         * @param filename Name of the json file, e.g. `/mysensor_state.json`
+         * @param minIntervalSec Interval after first save
+         * @param maxIntervalSec Maximum interval between saves
+         */
+        minIntervalMs = minIntervalSec * 1000;
+        maxIntervalMs = maxIntervalSec * 1000;
+        intervalMs = minIntervalMs;
+    }
+
+    bool due() {
+        /*! @return true if the schedule calls for a new snapshot */
+        return timeDiff(lastSave, millis()) >= intervalMs;
+    }
+
+    bool save(const uint8_t *data, uint16_t len, bool force = false) {
+        /*! Save a state blob and advance the schedule
+         *
+         * @param data State
+         * @param len Length of state in bytes
+         * @param force Write even if state is unchanged
+         * @return true if the snapshot was written
+         */
+        lastSave = millis();
+        intervalMs *= 2;
+        if (intervalMs > maxIntervalMs)
+            intervalMs = maxIntervalMs;
+        String hex = toHex(data, len);
+        if (hex == lastData && !force)
+            return false;
+#ifdef __ESP__
+        JSONVar snap;
+        if (time(NULL) > 100000)  // NTP time available
+            savedAt = time(NULL);
+        else
+            savedAt = 0;
+        snap["time"] = (long)savedAt;
+        snap["data"] = hex;
+        if (!writeJson(filename, snap))
+            return false;
+        lastData = hex;
+        ++saves;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool restore(uint8_t *data, uint16_t maxLen, uint16_t *pLen = nullptr) {
+        /*! Read a saved state blob
+         *
+         * @param data Buffer for the state
+         * @param maxLen Size of buffer
+         * @param pLen Optional, receives length of state in bytes
+         * @return true if a valid snapshot was read
+         */
+#ifdef __ESP__
+        String content;
+        if (!readJson(filename, content))
+            return false;
+        JSONVar snap = JSON.parse(content);
+        if (JSON.typeof(snap) == "undefined" || !snap.hasOwnProperty("data"))
+            return false;
+        String hex = (const char *)snap["data"];
+        uint16_t len = hex.length() / 2;
+        if (len == 0 || len > maxLen)
+            return false;
+        for (uint16_t i = 0; i < len; i++) {
+            int hi = hexVal(hex[2 * i]);
+            int lo = hexVal(hex[2 * i + 1]);
+            if (hi < 0 || lo < 0)
+                return false;
+            data[i] = (uint8_t)(hi << 4 | lo);
+        }
+        if (pLen)
+            *pLen = len;
+        savedAt = (time_t)(long)snap["time"];
+        lastData = hex;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    long age() {
+        /*! @return Age of the last snapshot in seconds, -1 if unknown */
+        if (savedAt == 0 || time(NULL) < savedAt)
+            return -1;
+        return (long)(time(NULL) - savedAt);
+    }
+
+    String toJson() {
+        /*! @return Age, number of saves and time to next save in seconds as json */
+        char buf[96];
+        unsigned long dt = timeDiff(lastSave, millis());
+        unsigned long next = dt < intervalMs ? (intervalMs - dt) / 1000 : 0;
+        sprintf(buf, "{\"age\":%ld,\"saves\":%lu,\"nextSaveSec\":%lu}", age(), saves, next);
+        return String(buf);
+    }
+
+  private:
+    static String toHex(const uint8_t *data, uint16_t len) {
+        String hex = "";
+        char buf[3];
+        for (uint16_t i = 0; i < len; i++) {
+            sprintf(buf, "%02x", data[i]);
+            hex += buf;
+        }
+        return hex;
+    }
+
+    static int hexVal(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+};  // SensorSnapshot
+
+}  // namespace ustd
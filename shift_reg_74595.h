@@ -18,37 +18,459 @@
 
 #pragma once
 
+#include <SPI.h>
+
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "mup_util.h"
 
 namespace ustd {
 
+#ifdef __ESP32__
+#define G_INT_ATTR IRAM_ATTR
+#else
+#ifdef __ESP__
+#define G_INT_ATTR ICACHE_RAM_ATTR
+#else
+#define G_INT_ATTR
+#endif
+#endif
+
+#define USTD_SHIFTREG_MAX_PWM_BITS (8)
+#ifndef USTD_SHIFTREG_MIN_PLANE_US
+#define USTD_SHIFTREG_MIN_PLANE_US (40)  // shortest plane without burst, see minPlaneUs()
+#endif
+
+void G_INT_ATTR ustd_shiftreg_fast_write(uint8_t pin, bool val) {
+#if defined(__ESP32__)
+    if (pin < 32) {
+        if (val)
+            GPIO.out_w1ts = ((uint32_t)1 << pin);
+        else
+            GPIO.out_w1tc = ((uint32_t)1 << pin);
+    } else {
+        if (val)
+            GPIO.out1_w1ts.val = ((uint32_t)1 << (pin - 32));
+        else
+            GPIO.out1_w1tc.val = ((uint32_t)1 << (pin - 32));
+    }
+#elif defined(__ESP__)
+    if (pin < 16) {
+        if (val)
+            GPOS = (1 << pin);
+        else
+            GPOC = (1 << pin);
+    } else {
+        digitalWrite(pin, val);
+    }
+#else
+    digitalWrite(pin, val);
+#endif
+}
+
+class ShiftRegRefresh;
+ShiftRegRefresh *pShiftRegRefresh = nullptr;
+void G_INT_ATTR ustd_shiftreg_refresh_irq();
+
+class ShiftRegRefresh {
+    /*! Timer driven refresh engine for a chain of 74HC595 shift registers.
+     *
+     * The engine is driven by a hardware timer and implements multi-bit
+     * software PWM for all outputs of the chain using bit-angle modulation
+     * (BAM): for pwmBits bits of resolution, each frame consists of pwmBits
+     * planes, plane k contains bit k of all output levels and is displayed
+     * for 2^k time units. Therefore only pwmBits latched bursts per frame
+     * are required, independent of the number of outputs and the level
+     * values.
+     *
+     * Long planes are split into slices of at most maxSliceUs, this gives
+     * the timer interrupt a resolution that is used for precise pulses:
+     * a pulsed output is forced on until the pulse time has expired.
+     *
+     * The outputs are bit-banged from the interrupt using direct GPIO
+     * register access, hardware SPI is not used by the engine. The shortest
+     * plane must leave time for a burst and the interrupt overhead, the
+     * frame rate is reduced if frameHz * (2^pwmBits-1) would result in
+     * shorter planes than minPlaneUs(). The longest interrupt is recorded
+     * in isrMaxUs (ESP8266 and ESP32).
+     */
+  public:
+    uint8_t port_data;
+    uint8_t port_clock;
+    uint8_t port_latch;
+    uint8_t chainLength;
+    uint16_t bitCount;
+    uint8_t pwmBits;
+    uint16_t maxLevel;
+    unsigned int frameHz;
+    unsigned long maxSliceUs;
+
+    uint8_t *planes[2] = {nullptr, nullptr};  // [pwmBits][chainLength] each
+    volatile uint8_t frontPlanes = 0;
+    volatile bool planesPending = false;
+    unsigned long planeUs[USTD_SHIFTREG_MAX_PWM_BITS];
+    uint8_t planeSlices[USTD_SHIFTREG_MAX_PWM_BITS];
+
+    uint8_t *shown;               // currently latched data
+    volatile uint8_t *pulseMask;  // outputs forced on by a pulse
+    unsigned long *pulseEnd;      // micros() at end of pulse
+    volatile uint16_t pulsesActive = 0;
+
+    uint8_t curPlane = 0;
+    uint8_t curSlice = 0;
+    volatile unsigned long bursts = 0;
+    volatile unsigned long frames = 0;
+    volatile uint32_t isrMaxCycles = 0;
+
+#ifdef __ESP32__
+    hw_timer_t *pTimer = nullptr;
+    portMUX_TYPE refreshMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+    ShiftRegRefresh(uint8_t port_data, uint8_t port_clock, uint8_t port_latch,
+                    uint8_t chainLength, unsigned int frameHz = 200, uint8_t pwmBits = 8,
+                    unsigned long maxSliceUs = 1000)
+        : port_data(port_data), port_clock(port_clock), port_latch(port_latch),
+          chainLength(chainLength), frameHz(frameHz), maxSliceUs(maxSliceUs) {
+        /*! Create refresh engine
+         *
+         * @param port_data GPIO connected to DS of the first 74HC595
+         * @param port_clock GPIO connected to SH_CP
+         * @param port_latch GPIO connected to ST_CP
+         * @param chainLength Number of cascaded 74HC595
+         * @param frameHz PWM frame rate in Hz, default 200. Reduced, if the
+         * shortest plane would be shorter than minPlaneUs().
+         * @param pwmBits PWM resolution in bits [1..8], default 8.
+         * @param maxSliceUs Maximum time between two timer interrupts, this
+         * is the resolution of pulses, default 1000us.
+         */
+        if (pwmBits < 1)
+            pwmBits = 1;
+        if (pwmBits > USTD_SHIFTREG_MAX_PWM_BITS)
+            pwmBits = USTD_SHIFTREG_MAX_PWM_BITS;
+        this->pwmBits = pwmBits;
+        maxLevel = (1 << pwmBits) - 1;
+        if (this->frameHz < 1)
+            this->frameHz = 1;
+        if (this->maxSliceUs < 100)
+            this->maxSliceUs = 100;
+        bitCount = (uint16_t)chainLength * 8;
+        for (uint8_t i = 0; i < 2; i++) {
+            planes[i] = new uint8_t[pwmBits * chainLength];
+            memset(planes[i], 0, pwmBits * chainLength);
+        }
+        shown = new uint8_t[chainLength];
+        memset(shown, 0, chainLength);
+        pulseMask = new uint8_t[chainLength];
+        memset((uint8_t *)pulseMask, 0, chainLength);
+        pulseEnd = new unsigned long[bitCount];
+        memset(pulseEnd, 0, bitCount * sizeof(unsigned long));
+        calcTiming();
+    }
+
+    ShiftRegRefresh(const ShiftRegRefresh &) = delete;  // owns the plane buffers
+    ShiftRegRefresh &operator=(const ShiftRegRefresh &) = delete;
+
+    ~ShiftRegRefresh() {
+        end();
+        delete[] planes[0];
+        delete[] planes[1];
+        delete[] shown;
+        delete[] pulseMask;
+        delete[] pulseEnd;
+    }
+
+    unsigned long minPlaneUs() {
+        /*! Shortest plane duration in microseconds
+         *
+         * A burst shifts 8 * chainLength bits with three GPIO register
+         * writes each, estimated with 0.5us per bit (ESP8266 at 80MHz),
+         * plus USTD_SHIFTREG_MIN_PLANE_US for interrupt entry and exit and
+         * for the code outside of the interrupt. Check with isrMaxUs().
+         */
+        return USTD_SHIFTREG_MIN_PLANE_US + bitCount / 2;
+    }
+
+    void calcTiming() {
+        // duration of plane k is 2^k units, a frame has 2^pwmBits-1 units
+        if ((unsigned long)frameHz * maxLevel * minPlaneUs() > 1000000UL)
+            frameHz = 1000000UL / ((unsigned long)maxLevel * minPlaneUs());
+        if (frameHz < 1)
+            frameHz = 1;
+        double unitUs = 1000000.0 / ((double)frameHz * (double)maxLevel);
+        for (uint8_t k = 0; k < pwmBits; k++) {
+            planeUs[k] = (unsigned long)(unitUs * (double)(1 << k) + 0.5);
+            if (planeUs[k] < 1)
+                planeUs[k] = 1;
+            planeSlices[k] = (planeUs[k] + maxSliceUs - 1) / maxSliceUs;
+        }
+    }
+
+    unsigned long frameUs() {
+        /*! Duration of one PWM frame in microseconds */
+        unsigned long us = 0;
+        for (uint8_t k = 0; k < pwmBits; k++)
+            us += planeUs[k];
+        return us;
+    }
+
+    unsigned long isrMaxUs() {
+        /*! Longest execution time of the timer interrupt in microseconds */
+#ifdef __ESP__
+        return isrMaxCycles / ESP.getCpuFreqMHz();
+#else
+        return isrMaxCycles;
+#endif
+    }
+
+    void setLevels(const uint8_t *levels) {
+        /*! Set new output levels
+         *
+         * Levels are transferred to the bit planes, the new planes are
+         * displayed starting with the next frame.
+         *
+         * @param levels Array of bitCount levels [0..2^pwmBits-1].
+         */
+        // the interrupt (on ESP32 possibly on the other core) won't swap while the back planes
+        // are built, the critical sections order the handover
+        lock();
+        planesPending = false;
+        uint8_t *back = planes[frontPlanes ^ 1];
+        unlock();
+        memset(back, 0, pwmBits * chainLength);
+        for (uint16_t bit = 0; bit < bitCount; bit++) {
+            uint8_t level = levels[bit];
+            if (!level)
+                continue;
+            uint8_t cw = 1 << (bit % 8);
+            uint8_t chip = bit / 8;
+            for (uint8_t k = 0; k < pwmBits; k++) {
+                if (level & (1 << k))
+                    back[k * chainLength + chip] |= cw;
+            }
+        }
+        lock();
+        planesPending = true;
+        unlock();
+    }
+
+    void pulse(uint16_t bit, unsigned long ms) {
+        /*! Force an output on for ms milliseconds
+         *
+         * @param bit Output to pulse
+         * @param ms Duration in milliseconds, resolution is maxSliceUs.
+         */
+        if (bit >= bitCount || !ms)
+            return;
+        lock();
+        if (!(pulseMask[bit / 8] & (1 << (bit % 8)))) {
+            pulseMask[bit / 8] |= (1 << (bit % 8));
+            ++pulsesActive;
+        }
+        pulseEnd[bit] = micros() + ms * 1000;
+        unlock();
+    }
+
+    bool begin(uint8_t timerNo = 0) {
+        /*! Start the refresh timer
+         *
+         * @param timerNo Hardware timer to use (ESP32 only, 0..3). ESP8266
+         * always uses timer1.
+         * @return true on success, false if no hardware timer is available.
+         */
+        digitalWrite(port_latch, HIGH);
+        digitalWrite(port_clock, LOW);
+        pinMode(port_data, OUTPUT);
+        pinMode(port_clock, OUTPUT);
+        pinMode(port_latch, OUTPUT);
+        curPlane = 0;
+        curSlice = 0;
+        pShiftRegRefresh = this;
+#if defined(__ESP32__)
+        pTimer = timerBegin(timerNo, 80, true);  // 1us ticks
+        timerAttachInterrupt(pTimer, ustd_shiftreg_refresh_irq, true);
+        timerAlarmWrite(pTimer, planeUs[0], true);
+        timerAlarmEnable(pTimer);
+        return true;
+#elif defined(__ESP__)
+        timer1_attachInterrupt(ustd_shiftreg_refresh_irq);
+        timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);  // 5 ticks per us
+        timer1_write(planeUs[0] * 5);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void end() {
+        if (pShiftRegRefresh != this)
+            return;
+#if defined(__ESP32__)
+        if (pTimer) {
+            timerEnd(pTimer);
+            pTimer = nullptr;
+        }
+#elif defined(__ESP__)
+        timer1_disable();
+        timer1_detachInterrupt();
+#endif
+        pShiftRegRefresh = nullptr;
+    }
+
+    unsigned long G_INT_ATTR refreshStep(unsigned long now) {
+        /*! Display the next slice of the current frame
+         *
+         * Called by the timer interrupt at the beginning of each slice.
+         *
+         * @param now Current time in microseconds
+         * @return Duration of this slice in microseconds
+         */
+        if (curPlane == 0 && curSlice == 0) {
+            if (planesPending) {
+                frontPlanes ^= 1;
+                planesPending = false;
+            }
+            ++frames;
+        }
+        if (pulsesActive)
+            expirePulses(now);
+        const uint8_t *plane = &planes[frontPlanes][curPlane * chainLength];
+        bool changed = false;
+        for (uint8_t chip = 0; chip < chainLength; chip++) {
+            uint8_t data = plane[chip] | pulseMask[chip];
+            if (data != shown[chip]) {
+                shown[chip] = data;
+                changed = true;
+            }
+        }
+        if (changed)
+            shiftOutShown();
+        unsigned long us;
+        if (planeSlices[curPlane] <= 1) {
+            us = planeUs[curPlane];
+        } else if (curSlice < planeSlices[curPlane] - 1) {
+            us = maxSliceUs;
+        } else {
+            us = planeUs[curPlane] - maxSliceUs * (planeSlices[curPlane] - 1);
+        }
+        ++curSlice;
+        if (curSlice >= planeSlices[curPlane]) {
+            curSlice = 0;
+            ++curPlane;
+            if (curPlane >= pwmBits)
+                curPlane = 0;
+        }
+        return us;
+    }
+
+    void G_INT_ATTR onTimer() {
+#ifdef __ESP32__
+        uint32_t start = ESP.getCycleCount();
+        portENTER_CRITICAL_ISR(&refreshMux);
+        unsigned long us = refreshStep(micros());
+        portEXIT_CRITICAL_ISR(&refreshMux);
+        timerAlarmWrite(pTimer, us, true);
+#elif defined(__ESP__)
+        uint32_t start = ESP.getCycleCount();
+        unsigned long us = refreshStep(micros());
+        timer1_write(us * 5);
+#endif
+#ifdef __ESP__
+        uint32_t cycles = ESP.getCycleCount() - start;
+        if (cycles > isrMaxCycles)
+            isrMaxCycles = cycles;
+#endif
+    }
+
+  private:
+    void lock() {
+#ifdef __ESP32__
+        portENTER_CRITICAL(&refreshMux);
+#else
+        noInterrupts();
+#endif
+    }
+
+    void unlock() {
+#ifdef __ESP32__
+        portEXIT_CRITICAL(&refreshMux);
+#else
+        interrupts();
+#endif
+    }
+
+    void G_INT_ATTR expirePulses(unsigned long now) {
+        for (uint16_t bit = 0; bit < bitCount; bit++) {
+            uint8_t cw = 1 << (bit % 8);
+            if ((pulseMask[bit / 8] & cw) && (long)(now - pulseEnd[bit]) >= 0) {
+                pulseMask[bit / 8] &= ~cw;
+                --pulsesActive;
+            }
+        }
+    }
+
+    void G_INT_ATTR shiftOutShown() {
+        ustd_shiftreg_fast_write(port_latch, LOW);
+        for (int chip = chainLength - 1; chip >= 0; chip--) {
+            uint8_t data = shown[chip];
+            for (int8_t b = 7; b >= 0; b--) {
+                ustd_shiftreg_fast_write(port_data, (data >> b) & 1);
+                ustd_shiftreg_fast_write(port_clock, HIGH);
+                ustd_shiftreg_fast_write(port_clock, LOW);
+            }
+        }
+        ustd_shiftreg_fast_write(port_latch, HIGH);
+        ++bursts;
+    }
+
+};  // ShiftRegRefresh
+
+void G_INT_ATTR ustd_shiftreg_refresh_irq() {
+    if (pShiftRegRefresh)
+        pShiftRegRefresh->onTimer();
+}
+
 class ShiftReg {
     /*! Instantiate a 74HC595 shift register mupplet.
      *
-     * This mupplet uses three IOs to fill a 74HC595 shift register of 8 output
-     * bits with data. It can either use the hardware SPI or 3 arbitrary IOs.
-     * Through cascading shift registers, a large number of outputs can be
-     * driven.
+     * This mupplet uses three IOs to fill a chain of 74HC595 shift registers
+     * with data. It can either use the hardware SPI or 3 arbitrary IOs.
+     * Through cascading shift registers (Q7' of one chip connected to DS of
+     * the next), a large number of outputs can be driven. Bits 0..7 are the
+     * outputs of the first chip (the one connected to the MCU), bits 8..15
+     * the outputs of the second chip, and so on.
+     *
+     * All bit changes done during one scheduler tick are collected and
+     * written with a single latched burst at the end of the tick, followed
+     * by a single state message.
+     *
+     * Optionally, a hardware timer driven refresh engine (see
+     * beginRefresh()) provides software PWM levels for all outputs and
+     * pulses with a resolution of about one millisecond.
      */
 
   public:
-    String SHIFTREG74595_VERSION = "0.1.0";
+    static constexpr const char *SHIFTREG74595_VERSION = "0.3.0";
     Scheduler *pSched;
     int tID;
     String name;
     uint8_t port_data_mosi;
     uint8_t port_clock_sck;
     uint8_t port_latch;
-    uint8_t cur_data;
     bool useSPI;
-    unsigned long bitPulseTimer[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-    unsigned long bitPulseDelta[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t chainLength;
+    uint16_t bitCount;
+    uint8_t *cur_data;
+    bool dirty = false;
+    unsigned long *bitPulseTimer;
+    unsigned long *bitPulseDelta;
+    ShiftRegRefresh *pRefresh = nullptr;
+    uint8_t *levels = nullptr;
 
     ShiftReg(String name, uint8_t port_data_mosi, uint8_t port_clock_sck, uint8_t port_latch,
-             bool useSPI = true)
+             bool useSPI = true, uint8_t chainLength = 1)
         : name(name), port_data_mosi(port_data_mosi), port_clock_sck(port_clock_sck),
-          port_latch(port_latch), useSPI(useSPI) {
+          port_latch(port_latch), useSPI(useSPI), chainLength(chainLength) {
         /*! Create 74HC595 mupplet
          *
          * This either use hardware SPI or 3 GPIOs. Functionality is equivalent.
@@ -61,19 +483,40 @@ class ShiftReg {
          * @param port_latch A GPIO used to latch the outputs during
          * programming.
          * @param useSPI true: hardware SPI mode, false: GPIO bitbang mode.
+         * @param chainLength Number of cascaded 74HC595 chips, default 1.
          */
+        if (this->chainLength < 1)
+            this->chainLength = 1;
+        bitCount = (uint16_t)this->chainLength * 8;
+        cur_data = new uint8_t[this->chainLength];
+        memset(cur_data, 0, this->chainLength);
+        bitPulseTimer = new unsigned long[bitCount];
+        bitPulseDelta = new unsigned long[bitCount];
+        memset(bitPulseTimer, 0, bitCount * sizeof(unsigned long));
+        memset(bitPulseDelta, 0, bitCount * sizeof(unsigned long));
     }
 
+    ShiftReg(const ShiftReg &) = delete;  // owns the data and timer arrays
+    ShiftReg &operator=(const ShiftReg &) = delete;
+
     ~ShiftReg() {
+        if (pRefresh)
+            delete pRefresh;
+        if (levels)
+            delete[] levels;
+        delete[] cur_data;
+        delete[] bitPulseTimer;
+        delete[] bitPulseDelta;
     }
 
     void begin(Scheduler *_pSched, unsigned long scheduleIntervalUsec = 50000) {
         /*! Start mupplet
          *
          * @param pSched Pointer to scheduler object
-         * @param scheduleIntervalUsec Period for pulse-timer scheduling,
-         * default 50ms
+         * @param scheduleIntervalUsec Period for pulse-timer scheduling and
+         * for writing coalesced changes to the shift registers, default 50ms
          */
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
         digitalWrite(port_latch, HIGH);
         pinMode(port_latch, OUTPUT);
@@ -87,69 +530,246 @@ class ShiftReg {
             pinMode(port_data_mosi, OUTPUT);
             pinMode(port_clock_sck, OUTPUT);
         }
-        writeShiftReg(0);
-        auto ft = [=]() { this->loop(); };
+        writeShiftReg();
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         tID = pSched->add(ft, name, scheduleIntervalUsec);
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/shiftreg/#", fnall);
     }
 
-  private:
-    void writeShiftReg(uint8_t data, uint8_t mask = 0xff) {
-        uint8_t abs_data = data;
-        if (mask != 0xff) {
-            abs_data = (cur_data & (!mask)) | (data & mask);
+    bool beginRefresh(unsigned int frameHz = 200, uint8_t pwmBits = 8, uint8_t timerNo = 0,
+                      unsigned long maxSliceUs = 1000) {
+        /*! Start hardware timer driven refresh of the outputs
+         *
+         * Must be called after begin(). Once started, outputs are refreshed
+         * by a ShiftRegRefresh engine from a timer interrupt, which allows
+         * PWM levels with setLevel() and pulses with a resolution of
+         * maxSliceUs. The engine bit-bangs the three GPIOs, hardware SPI is
+         * released (SPI.end()) and no longer used by this mupplet.
+         *
+         * @param frameHz PWM frame rate in Hz, default 200. Reduced for long
+         * chains and high pwmBits, see ShiftRegRefresh::minPlaneUs().
+         * @param pwmBits PWM resolution in bits [1..8], default 8.
+         * @param timerNo Hardware timer to use (ESP32 only, 0..3).
+         * @param maxSliceUs Pulse resolution in microseconds, default 1000.
+         * @return true on success, false if no hardware timer is available
+         * or the engine is already used by another ShiftReg instance.
+         */
+        if (pRefresh || pShiftRegRefresh)
+            return false;
+        pRefresh = new ShiftRegRefresh(port_data_mosi, port_clock_sck, port_latch, chainLength,
+                                       frameHz, pwmBits, maxSliceUs);
+        levels = new uint8_t[bitCount];
+        for (uint16_t bit = 0; bit < bitCount; bit++) {
+            levels[bit] = getBit(bit) ? pRefresh->maxLevel : 0;
         }
-        cur_data = abs_data;
+        pRefresh->setLevels(levels);
+        if (useSPI)
+            SPI.end();  // give the pins back to GPIO
+        if (!pRefresh->begin(timerNo)) {
+            if (useSPI)
+                SPI.begin();
+            delete pRefresh;
+            pRefresh = nullptr;
+            delete[] levels;
+            levels = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    void writeShiftReg() {
         digitalWrite(port_latch,
                      LOW);  // Pulse latch to put data on output ports
         delayMicroseconds(2);
-        if (useSPI)
-            SPI.transfer(abs_data);
-        else
-            shiftOut(port_data_mosi, port_clock_sck, MSBFIRST, abs_data);
+        // The first byte shifted out ends up in the last chip of the chain
+        for (int chip = chainLength - 1; chip >= 0; chip--) {
+            if (useSPI)
+                SPI.transfer(cur_data[chip]);
+            else
+                shiftOut(port_data_mosi, port_clock_sck, MSBFIRST, cur_data[chip]);
+        }
         delayMicroseconds(2);
         digitalWrite(port_latch, HIGH);
+        dirty = false;
+    }
+
+    static int parseIndex(const char *p, unsigned int limit) {
+        /*! Decimal number at p, -1 if p is not a number or not below limit */
+        if (*p < '0' || *p > '9')
+            return -1;
+        char *end;
+        long index = strtol(p, &end, 10);
+        if (*end || index >= (long)limit)
+            return -1;
+        return (int)index;
+    }
+
+    void writeLevels() {
+        pRefresh->setLevels(levels);
+        dirty = false;
     }
 
   public:
-    void set(uint8_t data, uint8_t mask = 0xff) {
+    void set(uint8_t data, uint8_t mask = 0xff, uint8_t chip = 0) {
         /*! Output to 74HC595
          *
-         * Write complete byte or masked part to 74HC595 outputs and send MQTT
-         * update message.
+         * Change complete byte or masked part of one 74HC595 of the chain.
+         * The change is written to the outputs (and an MQTT update message
+         * is sent) at the end of the current scheduler tick, or by calling
+         * flush().
          *
          * @param data data byte for output.
          * @param mask masks that shows which bits should be changed to content
          * of data. If a bit in mask is zero, then the old content of the shift
          * register is maintained.
+         * @param chip index of the chip in the chain, default 0.
          */
-        writeShiftReg(data, mask);
-        char buf[32];
-        sprintf(buf, "%d", cur_data);
-        pSched->publish(name + "/shiftreg", buf);
+        if (chip >= chainLength)
+            return;
+        uint8_t abs_data = (cur_data[chip] & (~mask)) | (data & mask);
+        if (levels) {
+            for (uint8_t b = 0; b < 8; b++) {
+                if (mask & (1 << b)) {
+                    uint8_t level = (abs_data & (1 << b)) ? pRefresh->maxLevel : 0;
+                    if (levels[chip * 8 + b] != level) {
+                        levels[chip * 8 + b] = level;
+                        dirty = true;
+                    }
+                }
+            }
+        }
+        if (abs_data != cur_data[chip]) {
+            cur_data[chip] = abs_data;
+            dirty = true;
+        }
     }
 
-    void setBit(uint8_t bit, bool val) {
-        /*! Change a single bit of 74HC595
+    void setLevel(uint16_t bit, double unitLevel) {
+        /*! Set PWM level of a single output
          *
-         * Set or reset a bit in 74HC595 shift register.
+         * Requires a running refresh engine (see beginRefresh()), otherwise
+         * the output is simply switched on for levels > 0. The change is
+         * written at the end of the current scheduler tick, or by calling
+         * flush().
          *
-         * @param bit bit to change.
+         * @param bit output to change, 0..8*chainLength-1.
+         * @param unitLevel Level [0.0..1.0]
+         */
+        if (bit >= bitCount)
+            return;
+        if (unitLevel < 0.0)
+            unitLevel = 0.0;
+        if (unitLevel > 1.0)
+            unitLevel = 1.0;
+        if (!levels) {
+            setBit(bit, unitLevel > 0.0);
+            return;
+        }
+        uint8_t level = (uint8_t)(unitLevel * (double)pRefresh->maxLevel + 0.5);
+        uint8_t cw = 1 << (bit % 8);
+        if (level)
+            cur_data[bit / 8] |= cw;
+        else
+            cur_data[bit / 8] &= ~cw;
+        if (levels[bit] != level) {
+            levels[bit] = level;
+            dirty = true;
+        }
+    }
+
+    void setBit(uint16_t bit, bool val) {
+        /*! Change a single bit of the 74HC595 chain
+         *
+         * Set or reset a bit in 74HC595 shift register chain. The change is
+         * written at the end of the current scheduler tick, or by calling
+         * flush().
+         *
+         * @param bit bit to change, 0..8*chainLength-1.
          * @param val true: set bit to 1, false: set bit to zero.
          */
-        uint8_t cw = 1 << bit;
+        if (bit >= bitCount)
+            return;
+        uint8_t cw = 1 << (bit % 8);
         if (val) {
-            set(cw, cw);
+            set(cw, cw, bit / 8);
         } else {
-            set(0, cw);
+            set(0, cw, bit / 8);
         }
     }
 
-    void pulseBit(uint8_t bit, unsigned long ms = 1000) {
+    bool getBit(uint16_t bit) {
+        /*! Get current state of a single bit of the 74HC595 chain
+         *
+         * @param bit bit to query, 0..8*chainLength-1.
+         * @return true, if bit is set (or set pending to be written).
+         */
+        if (bit >= bitCount)
+            return false;
+        return (cur_data[bit / 8] & (1 << (bit % 8))) != 0;
+    }
+
+    void flush() {
+        /*! Write pending changes to the 74HC595 chain
+         *
+         * Writes all changes done since the last write with a single latched
+         * burst and sends one MQTT update message. Does nothing, if no bits
+         * have changed. This is called automatically at the end of each
+         * scheduler tick of this mupplet.
+         */
+        if (dirty) {
+            if (pRefresh)
+                writeLevels();
+            else
+                writeShiftReg();
+            publishState();
+        }
+    }
+
+    void publishState() {
+        /*! Publish current content of the 74HC595 chain
+         *
+         * Message is a comma separated list of decimal byte values, starting
+         * with the first chip, outputs with a PWM level > 0 are 1. With
+         * running refresh engine, the levels of all outputs are published
+         * as `<name>/shiftreg/levels`, too.
+         */
+        char buf[8];
+        String state = "";
+        for (uint8_t chip = 0; chip < chainLength; chip++) {
+            sprintf(buf, chip ? ",%d" : "%d", cur_data[chip]);
+            state += buf;
+        }
+        pSched->publish(name + "/shiftreg", state);
+        if (levels) {
+            state = "";
+            for (uint16_t bit = 0; bit < bitCount; bit++) {
+                sprintf(buf, bit ? ",%d" : "%d", levels[bit]);
+                state += buf;
+            }
+            pSched->publish(name + "/shiftreg/levels", state);
+        }
+    }
+
+    void publishRefresh() {
+        /*! Publish timing of the refresh engine */
+        if (!pRefresh)
+            return;
+        char buf[160];
+        sprintf(buf,
+                "{\"frameHz\":%u,\"pwmBits\":%u,\"minPlaneUs\":%lu,\"frames\":%lu,"
+                "\"bursts\":%lu,\"isrMaxUs\":%lu}",
+                pRefresh->frameHz, pRefresh->pwmBits, pRefresh->minPlaneUs(),
+                (unsigned long)pRefresh->frames, (unsigned long)pRefresh->bursts,
+                pRefresh->isrMaxUs());
+        pSched->publish(name + "/shiftreg/refresh", buf);
+    }
+
+    void pulseBit(uint16_t bit, unsigned long ms = 1000) {
         /*! Pulse a single bit of 74HC595 shift register for duration of ms
          * milliseconds.
          *
@@ -161,9 +781,16 @@ class ShiftReg {
          * for this mupplet is 50ms, which therefore is the minimum resolution
          * for a pulse. Change parameter scheduleIntervalUsec of the begin()
          * method to increase the resolution. (Shorter schedule intervals allow
-         * for shorter pulses.)
+         * for shorter pulses.) If the refresh engine is running (see
+         * beginRefresh()), the pulse is timed by the engine with a resolution
+         * of about one millisecond, and the state of the output is not
+         * changed.
          */
-        if (bit >= 0 and bit < 8) {
+        if (pRefresh) {
+            pRefresh->pulse(bit, ms);
+            return;
+        }
+        if (bit < bitCount) {
             setBit(bit, true);
             bitPulseTimer[bit] = millis();
             bitPulseDelta[bit] = ms;
@@ -172,7 +799,7 @@ class ShiftReg {
 
   private:
     void loop() {
-        for (uint8_t bit = 0; bit < 8; bit++) {
+        for (uint16_t bit = 0; bit < bitCount; bit++) {
             if (bitPulseTimer[bit]) {
                 if (timeDiff(bitPulseTimer[bit], millis()) > bitPulseDelta[bit]) {
                     bitPulseTimer[bit] = 0;
@@ -181,6 +808,7 @@ class ShiftReg {
                 }
             }
         }
+        flush();
     }
 
     void subsMsg(String topic, String msg, String originator) {
@@ -188,55 +816,65 @@ class ShiftReg {
         memset(msgbuf, 0, 128);
         strncpy(msgbuf, msg.c_str(), 127);
         // TODO: allow other data-formats than decimal
-        if (topic == name + "/shiftreg/set/all") {
+        String setPrefix = name + "/shiftreg/set/";
+        String pulsePrefix = name + "/shiftreg/pulse/";
+        String levelPrefix = name + "/shiftreg/level/";
+        const char *p = topic.c_str();
+        if (topic == name + "/shiftreg/get") {
+            publishState();
+        } else if (topic == name + "/shiftreg/refresh/get") {
+            publishRefresh();
+        } else if (topic == setPrefix + "all" || !strncmp(p, (setPrefix + "chip/").c_str(),
+                                                          setPrefix.length() + 5)) {
+            // /shiftreg/set/all: first chip, /shiftreg/set/chip/<n>: chip n
+            int chip = 0;
+            if (topic != setPrefix + "all")
+                chip = parseIndex(&p[setPrefix.length() + 5], chainLength);
+            if (chip == -1)
+                return;
             uint8_t mask = 0xff;
-            char *p = strchr(msgbuf, ',');
-            if (p != nullptr) {
-                *p = 0;
-                ++p;
-                mask = atoi(p);
+            char *pm = strchr(msgbuf, ',');
+            if (pm != nullptr) {
+                *pm = 0;
+                ++pm;
+                mask = atoi(pm);
             }
             uint8_t data = atoi(msgbuf);
-            set(data, mask);
-        } else {
-            String wct = name + "/shiftreg/set/*";  // 8Bits:  /shiftreg/set/[0..7]
-            int bit;
-            if (pSched->mqttmatch(topic, wct)) {
-                if (topic.length() >= wct.length()) {
-                    const char *p = topic.c_str();
-                    bit = atoi(&p[name.length() + strlen("/i2cpwm/")]);
-                    if (bit >= 0 and bit <= 7) {
-                        double level = parseUnitLevel(msg);
-                        if (level == 0.0)
-                            setBit(bit, false);
-                        else
-                            setBit(bit, true);
-                    }
-                }
+            set(data, mask, chip);
+        } else if (!strncmp(p, setPrefix.c_str(), setPrefix.length())) {
+            // /shiftreg/set/<bit>
+            int bit = parseIndex(&p[setPrefix.length()], bitCount);
+            if (bit != -1) {
+                double level = parseUnitLevel(msg);
+                if (level == 0.0)
+                    setBit(bit, false);
+                else
+                    setBit(bit, true);
             }
-        }
-        String wct = name + "/shiftreg/pulse/*";  // 8Bits: /shiftreg/set/[0..7]
-        int bit;
-        if (pSched->mqttmatch(topic, wct)) {
-            if (topic.length() >= wct.length()) {
-                const char *p = topic.c_str();
-                bit = atoi(&p[name.length() + strlen("/i2cpwm/")]);
-                if (bit >= 0 and bit <= 7) {
-                    unsigned long ms = 1000;
-                    char *p = strchr(msgbuf, ',');
-                    if (p != nullptr) {
-                        *p = 0;
-                        ++p;
-                        ms = atol(p);
-                    }
-                    double level = parseUnitLevel(msgbuf);
-                    if (level == 0.0)
-                        setBit(bit, false);
-                    else {
-                        pulseBit(bit, ms);
-                    }
+        } else if (!strncmp(p, pulsePrefix.c_str(), pulsePrefix.length())) {
+            // /shiftreg/pulse/<bit>
+            int bit = parseIndex(&p[pulsePrefix.length()], bitCount);
+            if (bit != -1) {
+                unsigned long ms = 1000;
+                char *pm = strchr(msgbuf, ',');
+                if (pm != nullptr) {
+                    *pm = 0;
+                    ++pm;
+                    ms = atol(pm);
+                }
+                double level = parseUnitLevel(msgbuf);
+                if (level == 0.0)
+                    setBit(bit, false);
+                else {
+                    pulseBit(bit, ms);
                 }
             }
+        } else if (!strncmp(p, levelPrefix.c_str(), levelPrefix.length())) {
+            // /shiftreg/level/<bit>
+            int bit = parseIndex(&p[levelPrefix.length()], bitCount);
+            if (bit != -1) {
+                setLevel(bit, parseUnitLevel(msg));
+            }
         }
     };
 };  // ShiftReg
@@ -0,0 +1,216 @@
+// store_forward.h
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_stats.h"
+#include "queue.h"
+#include "mup_util.h"
+
+namespace ustd {
+
+class StoreForward {
+    /*! Store-and-forward buffer for sensor messages published while MQTT is disconnected
+     *
+     * Messages on the captured topics (e.g. `myPowerMeter/sensor/#`) are recorded with their
+     * time while `mqtt/state` is not `connected`. After reconnect, they are published again at a
+     * limited rate as `<topic>/stored` with message `{"time":<epoch>,"age":<sec>,"msg":"<msg>"}`,
+     * oldest first. If the RAM queue is full, further messages are appended to a file (ESP8266,
+     * ESP32) up to a configured number, after that new messages are dropped.
+     */
+  public:
+    static constexpr const char *STORE_FORWARD_VERSION = "0.1.0";
+    typedef struct {
+        String topic;
+        String msg;
+        uint32_t time;  // uptime in seconds
+    } T_STORED;
+
+    Scheduler *pSched;
+    int tID;
+    String name;
+    uint16_t queueSize;
+    uint16_t maxSpill;
+    uint8_t maxMsgLen = 128;
+    ustd::queue<T_STORED> stored;
+    String spillFile;
+    uint16_t spillCount = 0;
+    unsigned long spillReadPos = 0;
+    bool bConnected = false;
+    uint8_t drainPerTick;
+    unsigned long captured = 0, forwarded = 0, dropped = 0;
+    uint32_t epochOffset = 0;  // time(NULL) - uptime, 0 if unknown
+    Uptime clock;
+
+    StoreForward(String name, uint16_t queueSize = 64, uint16_t maxSpill = 0)
+        : name(name), queueSize(queueSize), maxSpill(maxSpill), stored(queueSize) {
+        /*! Instantiate a store-and-forward buffer
+         *
+         * @param name Name, used for topics and for the spill file `/<name>_spill.txt`
+         * @param queueSize Number of messages kept in RAM
+         * @param maxSpill Number of additional messages that are appended to a file if the RAM
+         * queue is full, 0: no file.
+         */
+        spillFile = "/" + name + "_spill.txt";
+    }
+
+    ~StoreForward() {
+    }
+
+    void begin(Scheduler *_pSched, unsigned long drainIntervalMs = 100, uint8_t _drainPerTick = 4) {
+        /*! Start capturing
+         *
+         * @param _pSched Scheduler
+         * @param drainIntervalMs Interval of the drain task
+         * @param _drainPerTick Maximum number of stored messages published per interval
+         */
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+        drainPerTick = _drainPerTick;
+#ifdef __ESP__
+        if (maxSpill && fsBegin())
+            fsRemove(spillFile);  // messages of previous run have no valid time
+#endif
+
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, drainIntervalMs * 1000);
+
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+            this->subsMsg(topic, msg, originator);
+        });
+        pSched->subscribe(tID, "mqtt/state", fnall);
+        pSched->subscribe(tID, name + "/storeforward/#", fnall);
+        pSched->publish("mqtt/state/get");
+    }
+
+    void capture(String topicPattern) {
+        /*! Capture messages on topics matching topicPattern (MQTT wildcards + and #) */
+        auto fncap = [=](String topic, String msg, String originator) {
+            this->store(topic, msg);
+        };
+        pSched->subscribe(tID, topicPattern, fncap);
+    }
+
+    uint16_t pending() {
+        return stored.length() + spillCount;
+    }
+
+    void publishState() {
+        char buf[128];
+        sprintf(buf,
+                "{\"pending\":%u,\"spilled\":%u,\"captured\":%lu,\"forwarded\":%lu,"
+                "\"dropped\":%lu}",
+                pending(), spillCount, captured, forwarded, dropped);
+        pSched->publish(name + "/storeforward/state", buf);
+    }
+
+    void loop() {
+        uint32_t now = uptime();  // also while disconnected, keeps the clock across millis() wraps
+        if (!bConnected)
+            return;
+        if (time(NULL) > 100000)  // NTP time available
+            epochOffset = time(NULL) - now;
+        for (uint8_t i = 0; i < drainPerTick; i++) {
+            if (!stored.isEmpty()) {
+                forward(stored.pop());
+            } else if (spillCount) {
+                T_STORED entry;
+                if (!unspill(&entry))
+                    break;
+                forward(entry);
+            } else {
+                break;
+            }
+        }
+    }
+
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == "mqtt/state") {
+            bConnected = (msg == "connected");
+        }
+        if (topic == name + "/storeforward/state/get") {
+            publishState();
+        }
+    }
+
+  private:
+    uint32_t uptime() {
+        return clock.seconds();
+    }
+
+    void store(String &topic, String &msg) {
+        if (bConnected || topic.endsWith("/stored"))
+            return;
+        if (msg.length() > maxMsgLen) {
+            ++dropped;
+            return;
+        }
+        T_STORED entry = {topic, msg, uptime()};
+        // once spilling started, newer messages go to the file too, to keep the order
+        if (spillCount == 0 && stored.push(entry)) {
+            ++captured;
+            return;
+        }
+        if (spill(entry))
+            ++captured;
+        else
+            ++dropped;
+    }
+
+    void forward(const T_STORED &entry) {
+        char buf[48];
+        uint32_t age = uptime() - entry.time;
+        String msg = entry.msg;
+        msg.replace("\"", "\\\"");
+        sprintf(buf, "{\"time\":%lu,\"age\":%lu,\"msg\":\"",
+                epochOffset ? (unsigned long)(epochOffset + entry.time) : 0UL,
+                (unsigned long)age);
+        pSched->publish(entry.topic + "/stored", String(buf) + msg + "\"}");
+        ++forwarded;
+    }
+
+    bool spill(const T_STORED &entry) {
+#ifdef __ESP__
+        if (spillCount >= maxSpill)
+            return false;
+        fs::File f = fsOpen(spillFile, "a");
+        if (!f)
+            return false;
+        // one line per message: time, topic and message separated by tabs
+        f.print(String(entry.time) + "\t" + entry.topic + "\t" + entry.msg + "\n");
+        f.close();
+        ++spillCount;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool unspill(T_STORED *pEntry) {
+#ifdef __ESP__
+        fs::File f = fsOpen(spillFile, "r");
+        if (!f || !f.seek(spillReadPos)) {
+            spillCount = 0;
+            return false;
+        }
+        String line = f.readStringUntil('\n');
+        spillReadPos = f.position();
+        f.close();
+        if (--spillCount == 0) {
+            fsRemove(spillFile);
+            spillReadPos = 0;
+        }
+        int t1 = line.indexOf('\t');
+        int t2 = line.indexOf('\t', t1 + 1);
+        if (t1 == -1 || t2 == -1)
+            return false;
+        pEntry->time = atol(line.substring(0, t1).c_str());
+        pEntry->topic = line.substring(t1 + 1, t2);
+        pEntry->msg = line.substring(t2 + 1);
+        return true;
+#else
+        return false;
+#endif
+    }
+};  // StoreForward
+
+}  // namespace ustd
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "home_assistant.h"
 
 namespace ustd {
@@ -22,6 +23,13 @@ volatile unsigned long irqcounter[USTD_MAX_IRQS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 volatile unsigned long lastIrq[USTD_MAX_IRQS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 volatile unsigned long debounceMs[USTD_MAX_IRQS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
+// Edge hooks are called from the interrupt for each accepted edge, see Switch::setEdgeHook()
+typedef void (*T_SWITCH_EDGE_HOOK)(void *pOwner);
+T_SWITCH_EDGE_HOOK volatile irqEdgeHook[USTD_MAX_IRQS] = {
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+void *volatile irqEdgeHookOwner[USTD_MAX_IRQS] = {
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+
 void G_INT_ATTR ustd_irq_master(uint8_t irqno) {
     unsigned long curr = millis();
     noInterrupts();
@@ -34,6 +42,8 @@ void G_INT_ATTR ustd_irq_master(uint8_t irqno) {
     ++irqcounter[irqno];
     lastIrq[irqno] = curr;
     interrupts();
+    if (irqEdgeHook[irqno])
+        irqEdgeHook[irqno](irqEdgeHookOwner[irqno]);
 }
 
 void G_INT_ATTR ustd_irq0() {
@@ -81,48 +91,148 @@ unsigned long getResetIrqCount(uint8_t irqno) {
     return count;
 }
 
-class Switch {
+class SwitchModes {
   public:
-    String SWITCH_VERSION = "0.1.0";
-    enum Mode { Default, Rising, Falling, Flipflop, Timer, Duration };
+    enum Mode : uint8_t { Default, Rising, Falling, Flipflop, Timer, Duration, Gesture };
+    enum GestureState : uint8_t { G_IDLE, G_DOWN, G_UP, G_HOLD };
+    enum GestureEvent { G_PRESS, G_RELEASE, G_CLICK_TIMEOUT, G_HOLD_TIMEOUT, G_REPEAT_TIMEOUT };
+    enum GestureAction { G_NONE, G_COUNT, G_CLICKS, G_HOLD_START, G_HOLD_REPEAT, G_HOLD_END };
+    typedef struct {
+        uint8_t state;   // GestureState
+        uint8_t event;   // GestureEvent
+        uint8_t next;    // GestureState
+        uint8_t action;  // GestureAction
+    } T_GESTURE_RULE;
+    static const uint8_t allModes = 0x7f;
+
+    static const T_GESTURE_RULE *defaultGestureTable(uint8_t *pSize) {
+        /*! Single, double and triple click, hold start, hold repeat and hold release */
+        static const T_GESTURE_RULE table[] = {
+            {G_IDLE, G_PRESS, G_DOWN, G_NONE},
+            {G_DOWN, G_RELEASE, G_UP, G_COUNT},
+            {G_DOWN, G_HOLD_TIMEOUT, G_HOLD, G_HOLD_START},
+            {G_UP, G_PRESS, G_DOWN, G_NONE},
+            {G_UP, G_CLICK_TIMEOUT, G_IDLE, G_CLICKS},
+            {G_HOLD, G_REPEAT_TIMEOUT, G_HOLD, G_HOLD_REPEAT},
+            {G_HOLD, G_RELEASE, G_IDLE, G_HOLD_END},
+        };
+        *pSize = sizeof(table) / sizeof(table[0]);
+        return table;
+    }
+};
+
+constexpr uint8_t switchModeMask() {
+    return 0;
+}
+template <typename... T> constexpr uint8_t switchModeMask(SwitchModes::Mode mode, T... more) {
+    /*! Bit mask of switch modes, template argument of SwitchT */
+    return (uint8_t)((1 << mode) | switchModeMask(more...));
+}
+
+template <uint8_t MODES = SwitchModes::allModes> class SwitchT : public SwitchModes {
+    /*! Switch with a compile-time set of modes
+     *
+     * Code and constant strings of modes that are not in MODES are removed by the compiler,
+     * setMode() ignores them. `Switch` supports all modes, `SwitchOnly<...>` only the given
+     * ones, e.g. `SwitchOnly<Switch::Flipflop>`.
+     */
+  public:
+    static constexpr const char *SWITCH_VERSION = "0.3.0";
     Scheduler *pSched;
     int tID;
 
     String name;
+    String customTopic;
+    unsigned long debounceTimeMs;
     uint8_t port;
     Mode mode;
     bool activeLogic;
-    String customTopic;
     int8_t interruptIndex;
-    unsigned long debounceTimeMs;
 
+    T_SWITCH_EDGE_HOOK pEdgeHook = nullptr;
+    void *pEdgeHookOwner = nullptr;
+    unsigned long lastChangeMs = 0;
     bool useInterrupt = false;
+    bool banked = false;  // read and debounced by a SwitchBank, no own task
+    uint64_t *pTickMask = nullptr;  // bit tickBit is set while needsTick(), see setTickMask()
+    uint8_t tickBit = 0;
     uint8_t ipin = 255;
-    unsigned long lastChangeMs = 0;
-    int physicalState = -1;
-    int logicalState = -1;
+    int8_t physicalState = -1;
+    int8_t logicalState = -1;
     bool overriddenPhysicalState = false;
     bool overridePhysicalActive = false;
-
     bool flipflop = true;  // This starts with 'off', since state is initially changed once.
+
     unsigned long activeTimer = 0;
     unsigned long timerDuration = 1000;  // ms
     unsigned long startEvent = 0;        // ms
     unsigned long durations[2] = {3000, 30000};
+
+    // gesture recognizer
+    const T_GESTURE_RULE *pGestureTable;
+    unsigned long gestureStateStart = 0;  // ms, entry into current state or last repeat
+    unsigned long clickGapMs = 300;       // max. release time between clicks of a multi-click
+    unsigned long holdMs = 600;           // min. press time for hold
+    uint8_t gestureTableSize;
+    GestureState gestureState = G_IDLE;
+    uint8_t gestureClicks = 0;
+    uint8_t repeatHz = 5;   // hold repeat rate, 0: no repeat
+    uint8_t maxClicks = 3;  // reached count is reported without waiting for the gap
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
 
-    Switch(String name, uint8_t port, Mode mode = Mode::Default, bool activeLogic = false,
-           String customTopic = "", int8_t interruptIndex = -1, unsigned long debounceTimeMs = 0)
-        : name(name), port(port), mode(mode), activeLogic(activeLogic), customTopic(customTopic),
-          interruptIndex(interruptIndex), debounceTimeMs(debounceTimeMs) {
-        setMode(mode);
+    SwitchT(String name, uint8_t port, Mode mode = firstMode(), bool activeLogic = false,
+            String customTopic = "", int8_t interruptIndex = -1, unsigned long debounceTimeMs = 0)
+        : name(name), customTopic(customTopic), debounceTimeMs(debounceTimeMs), port(port),
+          mode(mode), activeLogic(activeLogic), interruptIndex(interruptIndex) {
+        pGestureTable = nullptr;
+        gestureTableSize = 0;
+        if (hasMode(Mode::Gesture))
+            pGestureTable = defaultGestureTable(&gestureTableSize);
+        setMode(hasMode(mode) ? mode : firstMode());
     }
 
-    ~Switch() {
-        if (useInterrupt)
+    ~SwitchT() {
+        if (useInterrupt) {
             detachInterrupt(ipin);
+            irqEdgeHook[interruptIndex] = nullptr;
+        }
+    }
+
+    static constexpr bool hasMode(Mode m) {
+        /*! True if mode m is compiled in */
+        return MODES & (1 << m);
+    }
+
+    static constexpr Mode firstMode() {
+        return (Mode)__builtin_ctz(MODES);
+    }
+
+    bool isMode(Mode m) const {
+        /*! Like mode == m, but constant false if m is not compiled in */
+        return hasMode(m) && mode == m;
+    }
+
+    void setEdgeHook(T_SWITCH_EDGE_HOOK pHook, void *pOwner) {
+        /*! Call a function directly on each trigger edge, without message
+         *
+         * The hook is called in modes Rising and Falling for each trigger, in addition to the
+         * `switch/state` `trigger` message. In interrupt mode it is called from the interrupt
+         * service routine for each edge accepted by the debounce logic, so it must be short,
+         * in IRAM on ESP (G_INT_ATTR) and must not publish or allocate memory.
+         *
+         * @param pHook Function, nullptr to remove the hook
+         * @param pOwner Argument passed to the function, usually the owner object
+         */
+        pEdgeHook = pHook;
+        pEdgeHookOwner = pOwner;
+        if (useInterrupt) {
+            noInterrupts();
+            irqEdgeHookOwner[interruptIndex] = pOwner;
+            irqEdgeHook[interruptIndex] = pHook;
+            interrupts();
+        }
     }
 
     void setDebounce(long ms) {
@@ -137,7 +247,40 @@ class Switch {
         timerDuration = ms;
     }
 
+    void setGestureTiming(unsigned long _clickGapMs = 300, unsigned long _holdMs = 600,
+                          uint8_t _repeatHz = 5, uint8_t _maxClicks = 3) {
+        /*! Set the timing thresholds of Gesture mode
+         *
+         * @param _clickGapMs A click is part of a multi-click, if the button is pressed again
+         * within this time after the release
+         * @param _holdMs Presses longer than this are a hold
+         * @param _repeatHz Rate of `holdrepeat` gestures while holding, 0: no repeat
+         * @param _maxClicks Number of clicks that is reported immediately, without waiting
+         * for the click gap
+         */
+        clickGapMs = _clickGapMs;
+        holdMs = _holdMs;
+        repeatHz = _repeatHz;
+        maxClicks = _maxClicks ? _maxClicks : 1;
+    }
+
+    void setGestureTable(const T_GESTURE_RULE *pTable, uint8_t size) {
+        /*! Replace the state table of the gesture recognizer
+         *
+         * Each rule moves the recognizer from `state` to `next` on `event` and executes
+         * `action`. Events without rule for the current state are ignored. The table must
+         * remain valid while the switch exists.
+         */
+        pGestureTable = pTable;
+        gestureTableSize = size;
+        gestureState = G_IDLE;
+        gestureClicks = 0;
+        updateTickMask();
+    }
+
     void setMode(Mode newmode, unsigned long duration = 0) {
+        if (!hasMode(newmode))
+            return;
         if (useInterrupt)
             flipflop = false;  // This starts with 'off', since state is
                                // initially changed once.
@@ -153,14 +296,27 @@ class Switch {
         lastChangeMs = 0;
         mode = newmode;
         startEvent = (unsigned long)-1;
+        gestureState = G_IDLE;
+        gestureClicks = 0;
+        updateTickMask();
     }
 
-    void begin(Scheduler *_pSched) {
+    void begin(Scheduler *_pSched, int bankTID = -1) {
+        /*! Start the switch
+         *
+         * @param _pSched Scheduler
+         * @param bankTID Task of a SwitchBank or Keypad that configures, reads and debounces
+         * the input and calls setPhysicalLevel() and tick(), the switch then has no task of its
+         * own and does not use interrupts.
+         */
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
+        banked = (bankTID >= 0);
 
-        pinMode(port, INPUT_PULLUP);
+        if (!banked)
+            pinMode(port, INPUT_PULLUP);
 
-        if (interruptIndex >= 0 && interruptIndex < USTD_MAX_IRQS) {
+        if (interruptIndex >= 0 && interruptIndex < USTD_MAX_IRQS && !banked) {
 #ifdef __ESP32__
             ipin = digitalPinToInterrupt(port);
 #else
@@ -178,20 +334,27 @@ class Switch {
                 break;
             }
             debounceMs[interruptIndex] = debounceTimeMs;
+            irqEdgeHookOwner[interruptIndex] = pEdgeHookOwner;
+            irqEdgeHook[interruptIndex] = pEdgeHook;
             useInterrupt = true;
         }
 
-        readState();
+        if (!banked)
+            readState();
 
-        // give a c++11 lambda as callback scheduler task registration of
-        // this.loop():
-        /* std::function<void()> */ auto ft = [=]() { this->loop(); };
-        tID = pSched->add(ft, name, 50000);
+        if (banked) {
+            tID = bankTID;
+        } else {
+            // give a c++11 lambda as callback scheduler task registration of
+            // this.loop():
+            /* std::function<void()> */ auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+            tID = pSched->add(ft, name, isMode(Mode::Gesture) ? 10000 : 50000);
+        }
 
         /* std::function<void(String, String, String)> */
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/switch/#", fnall);
         pSched->subscribe(tID, "mqtt/state", fnall);
     }
@@ -200,8 +363,9 @@ class Switch {
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String customIcon = "mdi:light-switch",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, SWITCH_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, SWITCH_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSwitch(customIcon);
         pHA->begin(pSched);
     }
@@ -222,20 +386,26 @@ class Switch {
                 pSched->publish(customTopic, textState);
             break;
         case Mode::Rising:
-            if (lState == true) {
+            if (hasMode(Mode::Rising) && lState == true) {
+                if (pEdgeHook && !useInterrupt)
+                    pEdgeHook(pEdgeHookOwner);
                 pSched->publish(name + "/switch/state", "trigger");
                 if (customTopic != "")
                     pSched->publish(customTopic, "trigger");
             }
             break;
         case Mode::Falling:
-            if (lState == false) {
+            if (hasMode(Mode::Falling) && lState == false) {
+                if (pEdgeHook && !useInterrupt)
+                    pEdgeHook(pEdgeHookOwner);
                 pSched->publish(name + "/switch/state", "trigger");
                 if (customTopic != "")
                     pSched->publish(customTopic, "trigger");
             }
             break;
         case Mode::Duration:
+            if (!hasMode(Mode::Duration))
+                break;
             if (lState == true) {
                 startEvent = millis();
             } else {
@@ -254,6 +424,82 @@ class Switch {
                 }
             }
             break;
+        case Mode::Gesture:
+            if (hasMode(Mode::Gesture))
+                gestureEvent(lState ? G_PRESS : G_RELEASE);
+            break;
+        }
+    }
+
+    void publishGesture(const char *gesture) {
+        pSched->publish(name + "/switch/gesture", gesture);
+        if (customTopic != "")
+            pSched->publish(customTopic, gesture);
+    }
+
+    void gestureEvent(GestureEvent event) {
+        /*! Feed an event into the gesture state table */
+        for (uint8_t i = 0; i < gestureTableSize; i++) {
+            const T_GESTURE_RULE &rule = pGestureTable[i];
+            if (rule.state != gestureState || rule.event != event)
+                continue;
+            gestureState = (GestureState)rule.next;
+            gestureStateStart = millis();
+            switch (rule.action) {
+            case G_COUNT:
+                ++gestureClicks;
+                if (gestureClicks >= maxClicks)
+                    gestureEvent(G_CLICK_TIMEOUT);
+                break;
+            case G_CLICKS:
+                if (gestureClicks == 1) {
+                    publishGesture("single");
+                } else if (gestureClicks == 2) {
+                    publishGesture("double");
+                } else if (gestureClicks == 3) {
+                    publishGesture("triple");
+                } else if (gestureClicks) {
+                    char buf[16];
+                    sprintf(buf, "%uclick", gestureClicks);
+                    publishGesture(buf);
+                }
+                gestureClicks = 0;
+                break;
+            case G_HOLD_START:
+                gestureClicks = 0;
+                publishGesture("holdstart");
+                break;
+            case G_HOLD_REPEAT:
+                publishGesture("holdrepeat");
+                break;
+            case G_HOLD_END:
+                publishGesture("holdrelease");
+                break;
+            default:
+                break;
+            }
+            return;
+        }
+    }
+
+    void gestureTick() {
+        /*! Generate the timeout events of the current gesture state */
+        unsigned long dt = timeDiff(gestureStateStart, millis());
+        switch (gestureState) {
+        case G_DOWN:
+            if (dt >= holdMs)
+                gestureEvent(G_HOLD_TIMEOUT);
+            break;
+        case G_UP:
+            if (dt >= clickGapMs)
+                gestureEvent(G_CLICK_TIMEOUT);
+            break;
+        case G_HOLD:
+            if (repeatHz && dt >= 1000UL / repeatHz)
+                gestureEvent(G_REPEAT_TIMEOUT);
+            break;
+        default:
+            break;
         }
     }
 
@@ -270,15 +516,18 @@ class Switch {
         case Mode::Rising:
         case Mode::Falling:
         case Mode::Duration:
+        case Mode::Gesture:
             setLogicalState(physicalState);
             break;
         case Mode::Flipflop:
-            if (physicalState == false) {
+            if (hasMode(Mode::Flipflop) && physicalState == false) {
                 flipflop = !flipflop;
                 setLogicalState(flipflop);
             }
             break;
         case Mode::Timer:
+            if (!hasMode(Mode::Timer))
+                break;
             if (physicalState == false) {
                 activeTimer = millis();
             } else {
@@ -289,7 +538,7 @@ class Switch {
     }
 
     void setPhysicalState(bool newState, bool override) {
-        if (mode != Mode::Timer) {
+        if (!isMode(Mode::Timer)) {
             activeTimer = 0;
         }
         if (override) {
@@ -305,7 +554,7 @@ class Switch {
             }
             if (overridePhysicalActive)
                 return;
-            if (newState != physicalState || mode == Mode::Falling || mode == Mode::Rising) {
+            if (newState != physicalState || isMode(Mode::Falling) || isMode(Mode::Rising)) {
                 if (timeDiff(lastChangeMs, millis()) > debounceTimeMs || useInterrupt) {
                     lastChangeMs = millis();
                     physicalState = newState;
@@ -313,6 +562,7 @@ class Switch {
                 }
             }
         }
+        updateTickMask();
     }
 
     void readState() {
@@ -366,25 +616,60 @@ class Switch {
                 }
             }
         } else {
-            int newstate = digitalRead(port);
-            if (newstate == HIGH)
-                newstate = true;
-            else
-                newstate = false;
-            if (!activeLogic)
-                newstate = !newstate;
-            setPhysicalState(newstate, false);
+            setPhysicalLevel(digitalRead(port) == HIGH);
         }
     }
 
+    void setPhysicalLevel(bool high) {
+        /*! Process the level of the port, HIGH: true */
+        if (activeLogic)
+            setPhysicalState(high, false);
+        else
+            setPhysicalState(!high, false);
+    }
+
+    bool needsTick() {
+        /*! True if a timer or gesture is in progress and tick() must be called */
+        return (isMode(Mode::Timer) && activeTimer) ||
+               (isMode(Mode::Gesture) && gestureState != G_IDLE);
+    }
+
+    void setTickMask(uint64_t *pMask, uint8_t bit) {
+        /*! Keep bit in *pMask set while needsTick() is true
+         *
+         * Used by SwitchBank and Keypad to call tick() only for switches with a timer or
+         * gesture in progress. The bit is updated by every change of the physical state (input
+         * level or `switch/set` message), by tick() and by setMode().
+         */
+        pTickMask = pMask;
+        tickBit = bit;
+        updateTickMask();
+    }
+
+    void updateTickMask() {
+        if (!pTickMask)
+            return;
+        if (needsTick())
+            *pTickMask |= (uint64_t)1 << tickBit;
+        else
+            *pTickMask &= ~((uint64_t)1 << tickBit);
+    }
+
     void loop() {
         readState();
-        if (mode == Mode::Timer && activeTimer) {
+        tick();
+    }
+
+    void tick() {
+        if (isMode(Mode::Timer) && activeTimer) {
             if (timeDiff(activeTimer, millis()) > timerDuration) {
                 activeTimer = 0;
                 setLogicalState(false);
             }
         }
+        if (isMode(Mode::Gesture))
+            gestureTick();
+        updateTickMask();
     }
 
     void subsMsg(String topic, String msg, String originator) {
@@ -419,20 +704,20 @@ class Switch {
                     ++p2;
                 }
             }
-            if (!strcmp(buf, "default")) {
+            if (hasMode(Mode::Default) && !strcmp(buf, "default")) {
                 setMode(Mode::Default);
-            } else if (!strcmp(buf, "rising")) {
+            } else if (hasMode(Mode::Rising) && !strcmp(buf, "rising")) {
                 setMode(Mode::Rising);
-            } else if (!strcmp(buf, "falling")) {
+            } else if (hasMode(Mode::Falling) && !strcmp(buf, "falling")) {
                 setMode(Mode::Falling);
-            } else if (!strcmp(buf, "flipflop")) {
+            } else if (hasMode(Mode::Flipflop) && !strcmp(buf, "flipflop")) {
                 setMode(Mode::Flipflop);
-            } else if (!strcmp(buf, "timer")) {
+            } else if (hasMode(Mode::Timer) && !strcmp(buf, "timer")) {
                 unsigned long dur = 1000;
                 if (p)
                     dur = atol(p);
                 setMode(Mode::Timer, dur);
-            } else if (!strcmp(buf, "duration")) {
+            } else if (hasMode(Mode::Duration) && !strcmp(buf, "duration")) {
                 durations[0] = 3000;
                 durations[1] = 30000;
                 if (p) {
@@ -444,7 +729,25 @@ class Switch {
                     durations[1] = (unsigned long)-1;
                 }
                 setMode(Mode::Duration);
+            } else if (hasMode(Mode::Gesture) && !strcmp(buf, "gesture")) {
+                unsigned long gap = 300, hold = 600, hz = 5;
+                if (p) {
+                    gap = atol(p);
+                    if (p2) {
+                        char *p3 = strchr(p2, ',');
+                        if (p3) {
+                            *p3 = 0;
+                            hz = atol(p3 + 1);
+                        }
+                        hold = atol(p2);
+                    }
+                }
+                setGestureTiming(gap, hold, hz, maxClicks);
+                setMode(Mode::Gesture);
             }
+            // gesture timing needs a faster loop
+            if (!banked)
+                pSched->reschedule(tID, isMode(Mode::Gesture) ? 10000 : 50000);
         }
         if (topic == name + "/switch/set") {
             char buf[32];
@@ -476,13 +779,16 @@ class Switch {
             setDebounce(dbt);
         }
         if (topic == "mqtt/state") {
-            if (mode == Mode::Default || mode == Mode::Flipflop) {
+            if (isMode(Mode::Default) || isMode(Mode::Flipflop)) {
                 if (msg == "connected") {
                     publishLogicalState(logicalState);
                 }
             }
         }
     };
-};  // Switch
+};  // SwitchT
+
+typedef SwitchT<SwitchModes::allModes> Switch;
+template <SwitchModes::Mode... M> using SwitchOnly = SwitchT<switchModeMask(M...)>;
 
 }  // namespace ustd
@@ -0,0 +1,163 @@
+// switch_bank.h
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_stats.h"
+#include "switch.h"
+
+namespace ustd {
+
+#define USTD_MAX_BANK_SWITCHES (32)
+#define USTD_BANK_WORDS (2)  // 32 bit input words, GPIO 0..63
+
+template <typename SW = Switch> class SwitchBankT {
+    /*! Read and debounce many switches with one task
+     *
+     * Each tick, the GPIO input register is read once (ESP32: GPIO 0..39, ESP8266: GPIO 0..16,
+     * other platforms: digitalRead() of the bank's ports), and all lines are debounced in
+     * parallel with a 2-bit vertical counter: a line changes its state after 4 consecutive
+     * samples with the new level. Only switches whose debounced level changed are called, plus
+     * switches with a running timer or gesture. The per-tick cost is therefore nearly
+     * independent of the number of switches.
+     *
+     * Switches are added before begin() and must not be started with their own begin(). They
+     * keep their topics and modes, but do not use interrupts. All switches of a bank have the
+     * type SW: `SwitchBank` holds `Switch`, e.g. `SwitchBankT<SwitchOnly<Switch::Flipflop>>`
+     * holds switches with only the Flipflop mode.
+     */
+  public:
+    static constexpr const char *SWITCH_BANK_VERSION = "0.1.0";
+    Scheduler *pSched;
+    int tID;
+    String name;
+    SW *switches[USTD_MAX_BANK_SWITCHES];
+    uint8_t switchCount = 0;
+    uint8_t lineSwitch[USTD_BANK_WORDS * 32];  // GPIO -> index in switches, 255: unused
+    uint32_t usedMask[USTD_BANK_WORDS] = {0, 0};
+    uint32_t debounced[USTD_BANK_WORDS] = {0, 0};
+    uint32_t count0[USTD_BANK_WORDS] = {0xffffffff, 0xffffffff};  // vertical counter, bit 0
+    uint32_t count1[USTD_BANK_WORDS] = {0xffffffff, 0xffffffff};  // vertical counter, bit 1
+    uint64_t ticking = 0;  // bit i: switches[i] has a timer or gesture in progress
+    unsigned long ticks = 0;
+    unsigned long changes = 0;
+
+    SwitchBankT(String name) : name(name) {
+        /*! Instantiate a switch bank
+         *
+         * @param name Name of the bank's task
+         */
+        memset(lineSwitch, 255, sizeof(lineSwitch));
+    }
+
+    ~SwitchBankT() {
+    }
+
+    bool add(SW *pSwitch) {
+        /*! Add a switch, before begin()
+         *
+         * @param pSwitch Switch, its port must be < 64 and not used by another switch of the bank
+         * @return false if the bank is full or the port is not usable
+         */
+        uint8_t port = pSwitch->port;
+        if (switchCount == USTD_MAX_BANK_SWITCHES || port >= USTD_BANK_WORDS * 32 ||
+            lineSwitch[port] != 255)
+            return false;
+        lineSwitch[port] = switchCount;
+        switches[switchCount++] = pSwitch;
+        usedMask[port / 32] |= (uint32_t)1 << (port % 32);
+        return true;
+    }
+
+    void begin(Scheduler *_pSched, unsigned long tickUs = 5000) {
+        /*! Start all switches of the bank
+         *
+         * @param _pSched Scheduler
+         * @param tickUs Sample interval, the debounce time is 4 * tickUs
+         */
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, tickUs);
+
+        for (uint8_t i = 0; i < switchCount; i++) {
+            pinMode(switches[i]->port, INPUT_PULLUP);
+            switches[i]->begin(pSched, tID);
+            switches[i]->setTickMask(&ticking, i);
+        }
+        for (uint8_t w = 0; w < USTD_BANK_WORDS; w++) {
+            debounced[w] = readInputs(w) & usedMask[w];
+        }
+        for (uint8_t i = 0; i < switchCount; i++) {
+            uint8_t port = switches[i]->port;
+            switches[i]->setPhysicalLevel(debounced[port / 32] >> (port % 32) & 1);
+        }
+
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
+            this->subsMsg(topic, msg, originator);
+        });
+        pSched->subscribe(tID, name + "/switchbank/#", fnall);
+    }
+
+    uint32_t readInputs(uint8_t word) {
+        /*! Read 32 GPIO input levels, bit n: GPIO (32 * word + n) */
+#if defined(__ESP32__)
+        return word ? GPIO.in1.val : GPIO.in;
+#elif defined(__ESP__)
+        return word ? 0 : (GPI & 0xffff) | ((uint32_t)(GP16I & 0x01) << 16);
+#else
+        uint32_t levels = 0;
+        uint32_t mask = usedMask[word];
+        while (mask) {
+            uint8_t bit = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (digitalRead(word * 32 + bit) == HIGH)
+                levels |= (uint32_t)1 << bit;
+        }
+        return levels;
+#endif
+    }
+
+    void loop() {
+        ++ticks;
+        for (uint8_t w = 0; w < USTD_BANK_WORDS; w++) {
+            if (!usedMask[w])
+                continue;
+            uint32_t delta = (readInputs(w) & usedMask[w]) ^ debounced[w];
+            // vertical counter: reset on unchanged lines, count down on changed lines
+            count0[w] = ~(count0[w] & delta);
+            count1[w] = count0[w] ^ (count1[w] & delta);
+            uint32_t changed = delta & count0[w] & count1[w];
+            debounced[w] ^= changed;
+            while (changed) {
+                uint8_t bit = __builtin_ctz(changed);
+                changed &= changed - 1;
+                ++changes;
+                switches[lineSwitch[w * 32 + bit]]->setPhysicalLevel(debounced[w] >> bit & 1);
+            }
+        }
+        uint64_t active = ticking;
+        while (active) {
+            uint8_t i = __builtin_ctzll(active);
+            active &= active - 1;
+            switches[i]->tick();
+        }
+    }
+
+    void publishState() {
+        char buf[96];
+        sprintf(buf, "{\"switches\":%u,\"ticks\":%lu,\"changes\":%lu}", switchCount, ticks,
+                changes);
+        pSched->publish(name + "/switchbank/state", buf);
+    }
+
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == name + "/switchbank/state/get") {
+            publishState();
+        }
+    }
+};  // SwitchBankT
+
+typedef SwitchBankT<Switch> SwitchBank;
+
+}  // namespace ustd
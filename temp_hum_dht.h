@@ -4,29 +4,101 @@
 #include "DHT.h"  // from "DHT sensor library", https://github.com/adafruit/DHT-sensor-library
 // and "Adafruit Unified Sensor", https://github.com/adafruit/Adafruit_Sensor
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "sensors.h"
+#include "adaptive_poll.h"
 #include "home_assistant.h"
 
 namespace ustd {
+
+#ifdef __ESP32__
+#define G_INT_ATTR IRAM_ATTR
+#else
+#ifdef __ESP__
+#define G_INT_ATTR ICACHE_RAM_ATTR
+#else
+#define G_INT_ATTR
+#endif
+#endif
+
+#define USTD_MAX_DHT_IRQS (4)
+#define USTD_DHT_MAX_EDGES (44)
+
+// falling edge timestamps (lower 16 bits of micros()), a frame takes less than 6ms
+volatile uint16_t ustd_dht_edges[USTD_MAX_DHT_IRQS][USTD_DHT_MAX_EDGES];
+volatile uint8_t ustd_dht_edge_count[USTD_MAX_DHT_IRQS] = {0, 0, 0, 0};
+
+void G_INT_ATTR ustd_dht_irq_master(uint8_t irqno) {
+    uint8_t n = ustd_dht_edge_count[irqno];
+    if (n < USTD_DHT_MAX_EDGES) {
+        ustd_dht_edges[irqno][n] = (uint16_t)micros();
+        ustd_dht_edge_count[irqno] = n + 1;
+    }
+}
+
+void G_INT_ATTR ustd_dht_irq0() {
+    ustd_dht_irq_master(0);
+}
+void G_INT_ATTR ustd_dht_irq1() {
+    ustd_dht_irq_master(1);
+}
+void G_INT_ATTR ustd_dht_irq2() {
+    ustd_dht_irq_master(2);
+}
+void G_INT_ATTR ustd_dht_irq3() {
+    ustd_dht_irq_master(3);
+}
+
+void (*ustd_dht_irq_table[USTD_MAX_DHT_IRQS])() = {ustd_dht_irq0, ustd_dht_irq1, ustd_dht_irq2,
+                                                   ustd_dht_irq3};
+
 class Dht {
   public:
-    String DHT_VERSION = "0.1.0";
+    enum FrameState { IDLE, START, CAPTURE };
+    static constexpr const char *DHT_VERSION = "0.2.0";
     Scheduler *pSched;
     int tID;
     String name;
     uint8_t port;
     uint8_t type;
+    int8_t interruptIndex;
     double temperatureSensorVal;
     double humiditySensorVal;
     ustd::sensorprocessor temperatureSensor = ustd::sensorprocessor(12, 600, 0.025);
     ustd::sensorprocessor humiditySensor = ustd::sensorprocessor(4, 600, 1.0);
+    unsigned long sampleIntervalMs = 5000;
+    AdaptivePoll *pAdaptive = nullptr;
     DHT *pDht;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
 
-    Dht(String name, uint8_t port, uint8_t type = DHT22) : name(name), port(port), type(type) {
-        pDht = new DHT(port, type);
+    // interrupt decoder
+    FrameState frameState = FrameState::IDLE;
+    unsigned long lastSample = 0;
+    unsigned long stateStart = 0;
+    unsigned long frames = 0;
+    unsigned long checksumErrors = 0;
+    unsigned long timeouts = 0;
+
+    Dht(String name, uint8_t port, uint8_t type = DHT22, int8_t interruptIndex = -1)
+        : name(name), port(port), type(type), interruptIndex(interruptIndex) {
+        /*! Instantiate a DHT temperature and humidity sensor
+         *
+         * @param name Name of the mupplet, used for topics
+         * @param port GPIO of the data line
+         * @param type DHT11, DHT21 or DHT22
+         * @param interruptIndex 0..USTD_MAX_DHT_IRQS-1: decode the frame from
+         * interrupt timestamps, interrupts stay enabled while the sensor is read.
+         * Each sensor needs a different index. -1 (default): use the blocking
+         * DHT library.
+         */
+        if (interruptIndex < 0 || interruptIndex >= USTD_MAX_DHT_IRQS) {
+            this->interruptIndex = -1;
+            pDht = new DHT(port, type);
+        } else {
+            pDht = nullptr;
+        }
 
         pinMode(port, INPUT_PULLUP);
     }
@@ -42,21 +114,39 @@ class Dht {
         return humiditySensorVal;
     }
 
+    void setAdaptivePolling(unsigned long minIntervalMs = 2000,
+                            unsigned long maxIntervalMs = 60000) {
+        /*! Sample fast while temperature or humidity changes and slow down while both are stable
+         *
+         * @param minIntervalMs Shortest sample interval, DHT sensors need at least 2 sec (DHT11:
+         * 1 sec)
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs, 2);
+        // the eps of the temperature is below the sensor resolution of 0.1
+        pAdaptive->setEps(0, temperatureSensor.eps < 0.1 ? 0.1 : temperatureSensor.eps);
+        pAdaptive->setEps(1, humiditySensor.eps);
+    }
+
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
 
-        pDht->begin();
+        if (pDht)
+            pDht->begin();
 
         // give a c++11 lambda as callback scheduler task registration of
         // this.loop():
         //* std::function<void()> */
-        auto ft = [=]() { this->loop(); };
-        tID = pSched->add(ft, name, 5000000);
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, pDht ? 5000000 : 10000);
 
         /* std::function<void(String, String, String)> */
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/temperature/get", fnall);
         pSched->subscribe(tID, name + "/sensor/humidity/get", fnall);
     }
@@ -64,8 +154,9 @@ class Dht {
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, DHT_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, DHT_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Temperature", "\\u00B0C", "temperature", "mdi:thermometer");
         pHA->addSensor("humidity", "Humidity", "%", "humidity", "mdi:water-percent");
         pHA->begin(pSched);
@@ -84,10 +175,121 @@ class Dht {
         pSched->publish(name + "/sensor/humidity", buf);
     }
 
+    static bool decodeFrame(const volatile uint16_t *edges, uint8_t count, uint8_t data[5]) {
+        /*! Decode a DHT frame from falling edge timestamps
+         *
+         * Each bit starts with a 50us low phase followed by a high phase of
+         * 26-28us for 0 or 70us for 1, so the interval between two falling
+         * edges is ~78us for 0 and ~120us for 1. The last 41 edges delimit
+         * the 40 data bits, preceding edges (host start, sensor response)
+         * are ignored.
+         *
+         * @param edges Falling edge timestamps in us (16 bit, wrapping)
+         * @param count Number of timestamps
+         * @param data Decoded bytes: humidity (2), temperature (2), checksum
+         * @return true if a complete frame with valid checksum was decoded
+         */
+        if (count < 41)
+            return false;
+        const volatile uint16_t *e = &edges[count - 41];
+        for (uint8_t i = 0; i < 5; i++)
+            data[i] = 0;
+        for (uint8_t i = 0; i < 40; i++) {
+            uint16_t dt = (uint16_t)(e[i + 1] - e[i]);
+            if (dt < 50 || dt > 200)
+                return false;  // not a bit
+            data[i / 8] <<= 1;
+            if (dt > 100)
+                data[i / 8] |= 1;
+        }
+        return (uint8_t)(data[0] + data[1] + data[2] + data[3]) == data[4];
+    }
+
+    static void convertFrame(uint8_t type, const uint8_t data[5], double *pTemp, double *pHumid) {
+        /*! Convert a decoded frame to temperature in Celsius and humidity in percent */
+        if (type == DHT11) {
+            *pHumid = data[0] + data[1] * 0.1;
+            *pTemp = data[2] + (data[3] & 0x0f) * 0.1;
+            if (data[3] & 0x80)
+                *pTemp = -*pTemp;
+        } else {  // DHT21, DHT22
+            *pHumid = ((uint16_t)data[0] << 8 | data[1]) * 0.1;
+            *pTemp = ((uint16_t)(data[2] & 0x7f) << 8 | data[3]) * 0.1;
+            if (data[2] & 0x80)
+                *pTemp = -*pTemp;
+        }
+    }
+
     void loop() {
-        double t = pDht->readTemperature();
-        double h = pDht->readHumidity();
+        if (pDht) {
+            double t = pDht->readTemperature();
+            double h = pDht->readHumidity();
+            processValues(t, h);
+            return;
+        }
+        switch (frameState) {
+        case FrameState::IDLE:
+            if (frames + checksumErrors + timeouts == 0 ||
+                timeDiff(lastSample, millis()) >= sampleIntervalMs) {
+                // start signal: host pulls data line low
+                lastSample = millis();
+                pinMode(port, OUTPUT);
+                digitalWrite(port, LOW);
+                stateStart = millis();
+                frameState = FrameState::START;
+            }
+            break;
+        case FrameState::START:
+            // DHT11 needs >= 18ms, DHT21/22 >= 1ms
+            if (timeDiff(stateStart, millis()) >= (type == DHT11 ? 20UL : 2UL)) {
+                ustd_dht_edge_count[interruptIndex] = 0;
+                attachInterrupt(digitalPinToInterrupt(port), ustd_dht_irq_table[interruptIndex],
+                                FALLING);
+                pinMode(port, INPUT_PULLUP);  // release line, sensor answers
+                stateStart = millis();
+                frameState = FrameState::CAPTURE;
+            }
+            break;
+        case FrameState::CAPTURE:
+            // response (160us) + 40 bits (<= 5ms)
+            if (ustd_dht_edge_count[interruptIndex] >= 42 ||
+                timeDiff(stateStart, millis()) >= 10) {
+                detachInterrupt(digitalPinToInterrupt(port));
+                frameState = FrameState::IDLE;
+                uint8_t count = ustd_dht_edge_count[interruptIndex];
+                uint8_t data[5];
+                if (count < 41) {
+                    ++timeouts;
+                } else if (!decodeFrame(ustd_dht_edges[interruptIndex], count, data)) {
+                    ++checksumErrors;
+                } else {
+                    ++frames;
+                    double t, h;
+                    convertFrame(type, data, &t, &h);
+                    processValues(t, h);
+                }
+            }
+            break;
+        }
+    }
 
+    void subsMsg(String topic, String msg, String originator) {
+        if (topic == name + "/sensor/temperature/get" || topic == name + "/temperature/get") {
+            publishTemperature();
+        }
+        if (topic == name + "/sensor/humidity/get" || topic == name + "/humidity/get") {
+            publishHumidity();
+        }
+    };
+
+  private:
+    void processValues(double t, double h) {
+        if (pAdaptive) {
+            pAdaptive->update(0, t);
+            sampleIntervalMs = pAdaptive->update(1, h);
+            if (pDht)
+                pAdaptive->reschedule(pSched, tID);
+        }
         if (!isnan(t)) {
             if (temperatureSensor.filter(&t)) {
                 temperatureSensorVal = t;
@@ -101,15 +303,6 @@ class Dht {
             }
         }
     }
-
-    void subsMsg(String topic, String msg, String originator) {
-        if (topic == name + "/temperature/get") {
-            publishTemperature();
-        }
-        if (topic == name + "/humidity/get") {
-            publishHumidity();
-        }
-    };
 };  // Dht
 
 }  // namespace ustd
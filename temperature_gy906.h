@@ -1,19 +1,25 @@
 // temperature_gy906.h
-// adapted from:
-// https://github.com/adafruit/Adafruit-MLX90614-Library/blob/master/examples/mlxtest/mlxtest.ino
+// MLX90614 (GY-906) infrared thermometer, SMBus register access as in the Melexis datasheet
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "sensors.h"
+#include "i2c_bus.h"
+#include "adaptive_poll.h"
 
-//#include <Adafruit_Sensor.h>
-#include <Adafruit_MLX90614.h>
 #include <home_assistant.h>
 
 namespace ustd {
 class Gy906 {
+    /*! Ambient and object temperature of a MLX90614
+     *
+     * The sensor converts continuously, a measurement is two short register reads (ambient,
+     * then object temperature) with PEC check, each queued as its own transfer.
+     */
   public:
-    String GY906_TEMP_VERSION = "0.1.0";
+    static constexpr const char *GY906_TEMP_VERSION = "0.1.0";
+    enum MeasureState { IDLE, READING_AMBIENT, READING_OBJECT };
     Scheduler *pSched;
     int tID;
     String name;
@@ -23,13 +29,24 @@ class Gy906 {
     bool fastIR = false;
     ustd::sensorprocessor temperatureAmbientSensor = ustd::sensorprocessor(4, 600, 0.1);
     ustd::sensorprocessor temperatureIRSensor = ustd::sensorprocessor(4, 600, 0.1);
-    Adafruit_MLX90614 *pGy;
+    uint8_t i2cAddress;
+    I2CClient i2c;
+    MeasureState state = MeasureState::IDLE;
+    unsigned long sampleIntervalMs = 500;
+    unsigned long cycleStart = 0;
+    unsigned long samples = 0;
+    unsigned long errors = 0;
+    AdaptivePoll *pAdaptive = nullptr;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
 
-    Gy906(String name) : name(name) {
-        pGy = new Adafruit_MLX90614();
+    Gy906(String name, uint8_t i2cAddress = 0x5A) : name(name), i2cAddress(i2cAddress) {
+        /*! Instantiate a MLX90614 sensor
+         *
+         * @param name Name of the mupplet, used for topics
+         * @param i2cAddress SMBus address, default 0x5A
+         */
     }
 
     ~Gy906() {
@@ -47,21 +64,44 @@ class Gy906 {
         return temperatureIRSensorVal;
     }
 
-    void begin(Scheduler *_pSched, int _fastIR = false) {
+    void setAdaptivePolling(unsigned long minIntervalMs = 500,
+                            unsigned long maxIntervalMs = 10000) {
+        /*! Sample fast while ambient or object temperature changes and slow down while it is stable
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs, 2);
+        pAdaptive->setEps(0, temperatureAmbientSensor.eps);
+        pAdaptive->setEps(1, temperatureIRSensor.eps);
+        sampleIntervalMs = pAdaptive->intervalMs;
+    }
+
+    void begin(Scheduler *_pSched, int _fastIR = false, I2CBus *_pBus = nullptr) {
+        /*! Initialize sensor and start measurements
+         *
+         * @param _pSched Scheduler
+         * @param _fastIR Publish every change of IR temperature without filtering
+         * @param _pBus Optional shared I2C bus manager, measurements are then
+         * queued on the bus instead of accessing the sensor from the loop.
+         */
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
         fastIR = _fastIR;
-
-        Wire.begin();
-        if (pGy->begin()) {
+        i2c.begin(name, i2cAddress, _pBus);
+        uint8_t buf[3];
+        if (i2c.readNow(regAmbient, buf, 3) == I2CPort::OK && checkPec(regAmbient, buf)) {
             bActive = true;
         }
 
-        auto ft = [=]() { this->loop(); };
-        /* tID = */ pSched->add(ft, name, 500000);
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, 10000);  // state machine, measurement every sampleIntervalMs
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/ambient_temperature/get", fnall);
         pSched->subscribe(tID, name + "/sensor/ir_temperature/get", fnall);
     }
@@ -69,8 +109,9 @@ class Gy906 {
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                GY906_TEMP_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, GY906_TEMP_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Ambient temperature", "\\u00B0C", "temperature",
                        "mdi:thermometer");
         pHA->addSensor("temperature", "IR Temperature", "\\u00B0C", "pressure", "mdi:thermometer");
@@ -93,27 +134,19 @@ class Gy906 {
     }
 
     void loop() {
-        if (bActive) {
-            double t = pGy->readAmbientTempC();
-            if (temperatureAmbientSensor.filter(&t)) {
-                temperatureAmbientSensorVal = t;
-                publishAmbientTemperature();
-            }
-            t = pGy->readObjectTempC();
-            if (fastIR) {
-                if (t != temperatureIRSensorVal) {
-                    temperatureIRSensorVal = t;
-                    publishIRTemperature();
-                }
-            } else {
-                if (temperatureIRSensor.filter(&t)) {
-                    temperatureIRSensorVal = t;
-                    publishIRTemperature();
-                }
+        if (!bActive) {
+            if (!resultPublished) {
+                pSched->publish(name + "/sensor/result", "hardware not initialized");
+                resultPublished = true;
             }
-        } else {
-            pSched->publish(name + "/sensor/result", "hardware not initialized");
+            return;
+        }
+        if (state == MeasureState::IDLE &&
+            (samples + errors == 0 || timeDiff(cycleStart, millis()) >= sampleIntervalMs)) {
+            cycleStart = millis();
+            readAmbient();
         }
+        // other states: waiting for bus
     }
 
     void subsMsg(String topic, String msg, String originator) {
@@ -124,6 +157,89 @@ class Gy906 {
             publishAmbientTemperature();
         }
     };
+
+  private:
+    static const uint8_t regAmbient = 0x06;
+    static const uint8_t regObject = 0x07;
+    bool resultPublished = false;
+
+    bool checkPec(uint8_t reg, const uint8_t *data) {
+        // SMBus PEC: CRC-8 (x^8 + x^2 + x + 1) over address+W, command, address+R, data
+        uint8_t msg[5] = {(uint8_t)(i2cAddress << 1), reg, (uint8_t)(i2cAddress << 1 | 1),
+                          data[0], data[1]};
+        uint8_t crc = 0;
+        for (uint8_t i = 0; i < 5; i++) {
+            crc ^= msg[i];
+            for (uint8_t b = 0; b < 8; b++)
+                crc = crc & 0x80 ? (uint8_t)(crc << 1 ^ 0x07) : (uint8_t)(crc << 1);
+        }
+        return crc == data[2];
+    }
+
+    bool decode(uint8_t reg, uint8_t st, const uint8_t *data, double *pT) {
+        // LSB first, bit 15 of the word is the error flag of the sensor
+        if (st != I2CPort::OK || !checkPec(reg, data) || (data[1] & 0x80))
+            return false;
+        *pT = (uint16_t)(data[1] << 8 | data[0]) * 0.02 - 273.15;
+        return true;
+    }
+
+    void readAmbient() {
+        state = MeasureState::READING_AMBIENT;
+        i2c.readRegisters(regAmbient, 3, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            double t;
+            if (!this->decode(regAmbient, st, data, &t)) {
+                this->onError();
+                return;
+            }
+            this->onAmbient(t);
+            this->readObject();
+        });
+    }
+
+    void readObject() {
+        state = MeasureState::READING_OBJECT;
+        i2c.readRegisters(regObject, 3, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            double t;
+            if (!this->decode(regObject, st, data, &t)) {
+                this->onError();
+                return;
+            }
+            state = MeasureState::IDLE;
+            ++samples;
+            this->onObject(t);
+        });
+    }
+
+    void onError() {
+        ++errors;
+        state = MeasureState::IDLE;
+    }
+
+    void onAmbient(double t) {
+        if (pAdaptive)
+            pAdaptive->update(0, t);
+        if (temperatureAmbientSensor.filter(&t)) {
+            temperatureAmbientSensorVal = t;
+            publishAmbientTemperature();
+        }
+    }
+
+    void onObject(double t) {
+        if (pAdaptive)
+            sampleIntervalMs = pAdaptive->update(1, t);
+        if (fastIR) {
+            if (t != temperatureIRSensorVal) {
+                temperatureIRSensorVal = t;
+                publishIRTemperature();
+            }
+        } else {
+            if (temperatureIRSensor.filter(&t)) {
+                temperatureIRSensorVal = t;
+                publishIRTemperature();
+            }
+        }
+    }
 };  // Gy906
 
 }  // namespace ustd
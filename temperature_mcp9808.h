@@ -4,18 +4,26 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
 #include "sensors.h"
+#include "i2c_bus.h"
+#include "adaptive_poll.h"
 
-//#include <Adafruit_Sensor.h>
-#include <Adafruit_MCP9808.h>
 #include <home_assistant.h>
 
 namespace ustd {
 class TemperatureMCP9808 {
   public:
     /*! High precision temperature measurement with MCP9808
+     *
+     * The sensor is kept in shutdown between measurements. A measurement is a state machine
+     * of register transfers: wake up (and write the resolution, if changed), wait for the
+     * conversion time of the resolution in the mupplet's task, read the temperature and shut
+     * down again. No transfer waits for the sensor, so the loop (or the shared I2CBus) is never
+     * blocked for the conversion.
      */
-    String MCP9808_TEMP_VERSION = "0.1.0";
+    static constexpr const char *MCP9808_TEMP_VERSION = "0.1.0";
+    enum MeasureState { IDLE, WAKING, CONVERTING, READING };
     Scheduler *pSched;
     int tID;
     String name;
@@ -25,7 +33,15 @@ class TemperatureMCP9808 {
     bool bActive = false;
     String errmsg;
     ustd::sensorprocessor temperatureSensor = ustd::sensorprocessor(6, 300, 0.01);
-    Adafruit_MCP9808 *pTemp;
+    I2CClient i2c;
+    MeasureState state = MeasureState::IDLE;
+    bool resolutionPending = true;
+    unsigned long sampleIntervalMs = 2000;
+    unsigned long cycleStart = 0;
+    unsigned long convStart = 0;
+    unsigned long samples = 0;
+    unsigned long errors = 0;
+    AdaptivePoll *pAdaptive = nullptr;
 #ifdef __ESP__
     HomeAssistant *pHA;
 #endif
@@ -54,7 +70,7 @@ class TemperatureMCP9808 {
          *  2  | 0.125°C   | 130 ms
          *  3  | 0.0625°C  | 250 ms [default]
          */
-        pTemp = new Adafruit_MCP9808();
+        this->resolution = resolution & 0x03;
     }
 
     ~TemperatureMCP9808() {
@@ -65,34 +81,57 @@ class TemperatureMCP9808 {
     }
 
     void setResulution(int _resolution) {
-        resolution = _resolution;
+        /*! Set the resolution (0..3, see constructor), written before the next measurement */
+        resolution = _resolution & 0x03;
+        resolutionPending = true;
     }
 
-    void begin(Scheduler *_pSched) {
-        pSched = _pSched;
+    void setAdaptivePolling(unsigned long minIntervalMs = 500,
+                            unsigned long maxIntervalMs = 30000) {
+        /*! Sample fast while the temperature changes and slow down while it is stable
+         *
+         * @param minIntervalMs Shortest sample interval
+         * @param maxIntervalMs Longest sample interval
+         */
+        if (pAdaptive)
+            delete pAdaptive;
+        pAdaptive = new AdaptivePoll(minIntervalMs, maxIntervalMs);
+        pAdaptive->setEps(0, temperatureSensor.eps);
+        sampleIntervalMs = pAdaptive->intervalMs;
+    }
 
-        Wire.begin();
-        if (pTemp->begin(i2cAddress)) {
+    void begin(Scheduler *_pSched, I2CBus *_pBus = nullptr) {
+        /*! Initialize sensor and start measurements
+         *
+         * @param _pSched Scheduler
+         * @param _pBus Optional shared I2C bus manager, measurements are then
+         * queued on the bus instead of accessing the sensor from the loop.
+         */
+        MUP_STATS_BEGIN(name);
+        pSched = _pSched;
+        i2c.begin(name, i2cAddress, _pBus);
+        if (initSensor()) {
             bActive = true;
             errmsg = "OK";
         } else {
             errmsg = "Can't find or initialize MCP9808 sensor";
         }
 
-        auto ft = [=]() { this->loop(); };
-        /* tID = */ pSched->add(ft, name, 2000000);
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
+        tID = pSched->add(ft, name, 10000);  // state machine, measurement every sampleIntervalMs
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/sensor/temperature/get", fnall);
     }
 
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName,
-                                MCP9808_TEMP_VERSION, homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, MCP9808_TEMP_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSensor("temperature", "Temperature", "\\u00B0C", "temperature", "mdi:thermometer");
         pHA->begin(pSched);
     }
@@ -106,16 +145,26 @@ class TemperatureMCP9808 {
     }
 
     void loop() {
-        if (bActive) {
-            pTemp->wake();
-            double t = pTemp->readTempC();
-            if (temperatureSensor.filter(&t)) {
-                temperatureSensorVal = t;
-                publishTemperature();
+        if (!bActive) {
+            if (errmsg != "") {
+                pSched->publish(name + "/sensor/result", errmsg);
+                errmsg = "";
             }
-            pTemp->shutdown_wake(1);
-        } else {
-            pSched->publish(name + "/sensor/result", errmsg);
+            return;
+        }
+        switch (state) {
+        case MeasureState::IDLE:
+            if (samples + errors == 0 || timeDiff(cycleStart, millis()) >= sampleIntervalMs) {
+                cycleStart = millis();
+                wake();
+            }
+            break;
+        case MeasureState::CONVERTING:
+            if (timeDiff(convStart, millis()) >= convMs())
+                readTemperature();
+            break;
+        default:  // waiting for bus
+            break;
         }
     }
 
@@ -124,6 +173,81 @@ class TemperatureMCP9808 {
             publishTemperature();
         }
     };
+
+  private:
+    static const uint8_t regConfig = 0x01;
+    static const uint8_t regTemperature = 0x05;
+    static const uint8_t regManufacturerId = 0x06;
+    static const uint8_t regDeviceId = 0x07;
+    static const uint8_t regResolution = 0x08;
+    static const uint16_t configShutdown = 0x0100;
+
+    unsigned long convMs() {
+        // t_conv: 30, 65, 130, 250ms (typ.) for resolution 0..3, plus margin
+        static const uint16_t ms[4] = {35, 70, 140, 260};
+        return ms[resolution];
+    }
+
+    bool initSensor() {
+        uint8_t id[2];
+        if (i2c.readNow(regManufacturerId, id, 2) != I2CPort::OK || id[0] != 0x00 || id[1] != 0x54)
+            return false;
+        if (i2c.readNow(regDeviceId, id, 2) != I2CPort::OK || id[0] != 0x04)
+            return false;
+        uint8_t shutdown[3] = {regConfig, configShutdown >> 8, configShutdown & 0xff};
+        return i2c.writeNow(shutdown, 3) == I2CPort::OK;
+    }
+
+    void wake() {
+        state = MeasureState::WAKING;
+        if (resolutionPending) {
+            i2c.writeRegister(regResolution, resolution);
+            resolutionPending = false;
+        }
+        uint8_t cmd[3] = {regConfig, 0x00, 0x00};  // continuous conversion
+        i2c.transfer(cmd, 3, 0, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK) {
+                this->onError();
+                return;
+            }
+            convStart = millis();
+            state = MeasureState::CONVERTING;
+        });
+    }
+
+    void readTemperature() {
+        state = MeasureState::READING;
+        i2c.readRegisters(regTemperature, 2, [=](uint8_t st, const uint8_t *data, uint8_t len) {
+            if (st != I2CPort::OK) {
+                this->onError();
+                return;
+            }
+            // T_A: 13 bit two's complement in 1/16 °C, bits 15..13 are alert flags
+            int16_t raw = (int16_t)((data[0] & 0x1f) << 8 | data[1]);
+            if (raw & 0x1000)
+                raw -= 0x2000;
+            uint8_t cmd[3] = {regConfig, configShutdown >> 8, configShutdown & 0xff};
+            i2c.transfer(cmd, 3, 0);
+            state = MeasureState::IDLE;
+            this->onTemperature(raw / 16.0);
+        });
+    }
+
+    void onError() {
+        ++errors;
+        resolutionPending = true;
+        state = MeasureState::IDLE;
+    }
+
+    void onTemperature(double t) {
+        ++samples;
+        if (pAdaptive)
+            sampleIntervalMs = pAdaptive->update(0, t);
+        if (temperatureSensor.filter(&t)) {
+            temperatureSensorVal = t;
+            publishTemperature();
+        }
+    }
 };  // MCP9808
 
 }  // namespace ustd
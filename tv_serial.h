@@ -3,6 +3,8 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_stats.h"
+#include "mupplet_arena.h"
 #include "home_assistant.h"
 
 namespace ustd {
@@ -371,7 +373,7 @@ class TvSerial {
     int tID;
 
   public:
-    String TVSERIAL_VERSION = "0.1.0";
+    static constexpr const char *TVSERIAL_VERSION = "0.1.0";
     TvSerialProtocol *tvProt;
     enum TV_SERIAL_TYPE { LG_TV };  // currently support serial TV types
     String name;
@@ -388,7 +390,8 @@ class TvSerial {
         // Instantiate the appropriate TvSerialProtocol:
         switch (tvSerialType) {
         case TV_SERIAL_TYPE::LG_TV:
-            tvProt = (TvSerialProtocol *)new TVSerialLG(pSerial);
+            tvProt = (TvSerialProtocol *)new (arenaAlloc(sizeof(TVSerialLG)))
+                TVSerialLG(pSerial);
             break;
         default:
             tvProt = nullptr;
@@ -400,17 +403,18 @@ class TvSerial {
     }
 
     void begin(Scheduler *_pSched) {
+        MUP_STATS_BEGIN(name);
         pSched = _pSched;
         tvProt->begin();
 
-        auto ft = [=]() { this->loop(); };
+        auto ft = MUP_STATS_TASK(name, [=]() { this->loop(); });
         // Loop 50ms: check async send/receive every 50ms,
         // (and request TV status every 1sec):
         tID = pSched->add(ft, name, 50000);  // call loop() every 50ms
 
-        auto fnall = [=](String topic, String msg, String originator) {
+        auto fnall = MUP_STATS_SUBS(name, [=](String topic, String msg, String originator) {
             this->subsMsg(topic, msg, originator);
-        };
+        });
         pSched->subscribe(tID, name + "/#", fnall);
     }
 
@@ -419,8 +423,9 @@ class TvSerial {
 #ifdef __ESP__
     void registerHomeAssistant(String homeAssistantFriendlyName, String projectName = "",
                                String homeAssistantDiscoveryPrefix = "homeassistant") {
-        pHA = new HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, TVSERIAL_VERSION,
-                                homeAssistantDiscoveryPrefix);
+        pHA = new (arenaAlloc(sizeof(HomeAssistant)))
+            HomeAssistant(name, tID, homeAssistantFriendlyName, projectName, TVSERIAL_VERSION,
+                          homeAssistantDiscoveryPrefix);
         pHA->addSwitch("mdi:television-classic");
         pHA->begin(pSched);
     }